@@ -0,0 +1,1036 @@
+/*
+ *  Embroidermodder 2.
+ *
+ *  ------------------------------------------------------------
+ *
+ *  Copyright 2013-2023 The Embroidermodder Team
+ *  Embroidermodder 2 is Open Source Software.
+ *  See LICENSE for licensing terms.
+ *
+ *  ------------------------------------------------------------
+ *
+ *  Use Python's PEP7 style guide.
+ *      https://peps.python.org/pep-0007/
+ *
+ *  Polygon clipping: the union, intersection and difference of two sets
+ *  of closed rings, and growing or shrinking a set by a distance.
+ *
+ *  The rings are snapped to a grid of CLIP_SCALE steps per mm so that
+ *  every test for which side of an edge a point is on is exact. Then:
+ *
+ *  1. A sweep up the page finds where edges cross or touch and splits
+ *     them there, repeating while rounding the crossings makes new ones.
+ *  2. Edges that coincide are merged, adding up the winding each one
+ *     gives to the subject and to the clip.
+ *  3. A second sweep walks each band between neighbouring y values from
+ *     left to right, keeping count of the windings, to find which edges
+ *     have the result inside on one side and outside on the other.
+ *  4. Those edges are chained into rings with the inside on their left.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+#include "core.h"
+
+/* The most passes of splitting allowed. Each pass splits the edges at
+ * the crossings the last one made, and if the last pass still finds new
+ * ones the shapes are given up on rather than clipped wrongly.
+ */
+#define CLIP_PASSES                              8
+
+/* A point on the grid. */
+typedef struct ClipPoint_ {
+    int64_t x;
+    int64_t y;
+} ClipPoint;
+
+/* An edge with a as its lower end (the lower y, then the lower x) and the
+ * winding it adds to the subject and to the clip for the places further
+ * along x: 1 for each time a ring runs down it, -1 for each time a ring
+ * runs up it. So a counter-clockwise ring has a winding of 1 inside.
+ */
+typedef struct ClipEdge_ {
+    ClipPoint a;
+    ClipPoint b;
+    int ws;
+    int wc;
+} ClipEdge;
+
+/* Where the first sweep found an edge has to be split. */
+typedef struct ClipSplit_ {
+    int edge;
+    EmbReal along;
+    ClipPoint p;
+} ClipSplit;
+
+/* An edge crossing the band the second sweep is in, by x at its middle. */
+typedef struct ClipActive_ {
+    EmbReal x;
+    int edge;
+} ClipActive;
+
+/* A growable array. */
+typedef struct ClipArray_ {
+    void *data;
+    int count;
+    int capacity;
+} ClipArray;
+
+/* Make room for one more entry of size bytes, returning where it goes. */
+static void *
+array_push(ClipArray *array, size_t size)
+{
+    if (array->count == array->capacity) {
+        int capacity = array->capacity ? 2*array->capacity : 64;
+        void *data = realloc(array->data, capacity * size);
+        if (!data) {
+            return NULL;
+        }
+        array->data = data;
+        array->capacity = capacity;
+    }
+    return (char*)array->data + size * (array->count++);
+}
+
+static int
+point_equal(ClipPoint p, ClipPoint q)
+{
+    return (p.x == q.x) && (p.y == q.y);
+}
+
+static int
+point_less(ClipPoint p, ClipPoint q)
+{
+    return (p.y < q.y) || ((p.y == q.y) && (p.x < q.x));
+}
+
+/* Twice the signed area of a, b, p: positive when p is left of a to b.
+ * Grid points within CLIP_LIMIT of the origin keep this inside 63 bits.
+ */
+static int64_t
+orient(ClipPoint a, ClipPoint b, ClipPoint p)
+{
+    return (b.x - a.x)*(p.y - a.y) - (b.y - a.y)*(p.x - a.x);
+}
+
+static ClipPoint
+to_grid(EmbVector v)
+{
+    ClipPoint p;
+    EmbReal x = fmin(fmax(v.x, -CLIP_LIMIT), CLIP_LIMIT);
+    EmbReal y = fmin(fmax(v.y, -CLIP_LIMIT), CLIP_LIMIT);
+    p.x = (int64_t)llround(x * CLIP_SCALE);
+    p.y = (int64_t)llround(y * CLIP_SCALE);
+    return p;
+}
+
+/* Add the edge of a ring running from p to q, which counts ws times for
+ * the subject and wc times for the clip.
+ */
+static int
+add_edge(ClipArray *edges, ClipPoint p, ClipPoint q, int ws, int wc)
+{
+    if (point_equal(p, q)) {
+        return 1;
+    }
+    ClipEdge *e = (ClipEdge*)array_push(edges, sizeof(ClipEdge));
+    if (!e) {
+        return 0;
+    }
+    if (point_less(p, q)) {
+        e->a = p;
+        e->b = q;
+        e->ws = -ws;
+        e->wc = -wc;
+    }
+    else {
+        e->a = q;
+        e->b = p;
+        e->ws = ws;
+        e->wc = wc;
+    }
+    return 1;
+}
+
+/* Add the rings of set as edges of one operand. */
+static int
+add_rings(ClipArray *edges, const PolygonSet *set, int ws, int wc)
+{
+    int start = 0;
+    for (int r=0; r<set->rings; r++) {
+        int end = set->ring_ends[r];
+        for (int i=start; i<end; i++) {
+            int j = (i+1 < end) ? i+1 : start;
+            if (!add_edge(edges, to_grid(set->points[i]),
+                to_grid(set->points[j]), ws, wc)) {
+                return 0;
+            }
+        }
+        start = end;
+    }
+    return 1;
+}
+
+/* Note that edge has to be split at p, unless p is one of its ends. */
+static int
+add_split(ClipArray *splits, const ClipEdge *edges, int edge, ClipPoint p)
+{
+    const ClipEdge *e = &edges[edge];
+    if (point_equal(p, e->a) || point_equal(p, e->b)) {
+        return 1;
+    }
+    ClipSplit *s = (ClipSplit*)array_push(splits, sizeof(ClipSplit));
+    if (!s) {
+        return 0;
+    }
+    s->edge = edge;
+    s->p = p;
+    s->along = (EmbReal)(p.x - e->a.x) * (EmbReal)(e->b.x - e->a.x)
+        + (EmbReal)(p.y - e->a.y) * (EmbReal)(e->b.y - e->a.y);
+    return 1;
+}
+
+/* Whether p, known to be in line with e, lies strictly inside it. */
+static int
+inside_edge(const ClipEdge *e, ClipPoint p)
+{
+    if (point_equal(p, e->a) || point_equal(p, e->b)) {
+        return 0;
+    }
+    int64_t left = (e->a.x < e->b.x) ? e->a.x : e->b.x;
+    int64_t right = (e->a.x < e->b.x) ? e->b.x : e->a.x;
+    return (p.x >= left) && (p.x <= right) && (p.y >= e->a.y)
+        && (p.y <= e->b.y);
+}
+
+/* Note where edges i and j cross, or where an end of one touches the
+ * other, which includes the ends of an overlap between edges in line.
+ */
+static int
+intersect(ClipArray *splits, const ClipEdge *edges, int i, int j)
+{
+    const ClipEdge *e = &edges[i];
+    const ClipEdge *f = &edges[j];
+    int64_t d1 = orient(f->a, f->b, e->a);
+    int64_t d2 = orient(f->a, f->b, e->b);
+    int64_t d3 = orient(e->a, e->b, f->a);
+    int64_t d4 = orient(e->a, e->b, f->b);
+    if ((((d1 > 0) && (d2 < 0)) || ((d1 < 0) && (d2 > 0)))
+        && (((d3 > 0) && (d4 < 0)) || ((d3 < 0) && (d4 > 0)))) {
+        EmbReal t = (EmbReal)d1 / ((EmbReal)d1 - (EmbReal)d2);
+        ClipPoint p;
+        p.x = e->a.x + (int64_t)llround(t * (EmbReal)(e->b.x - e->a.x));
+        p.y = e->a.y + (int64_t)llround(t * (EmbReal)(e->b.y - e->a.y));
+        return add_split(splits, edges, i, p) && add_split(splits, edges, j, p);
+    }
+    if ((d1 == 0) && inside_edge(f, e->a) && !add_split(splits, edges, j, e->a)) {
+        return 0;
+    }
+    if ((d2 == 0) && inside_edge(f, e->b) && !add_split(splits, edges, j, e->b)) {
+        return 0;
+    }
+    if ((d3 == 0) && inside_edge(e, f->a) && !add_split(splits, edges, i, f->a)) {
+        return 0;
+    }
+    if ((d4 == 0) && inside_edge(e, f->b) && !add_split(splits, edges, i, f->b)) {
+        return 0;
+    }
+    return 1;
+}
+
+static int
+compare_edge(const void *p, const void *q)
+{
+    const ClipEdge *a = (const ClipEdge*)p;
+    const ClipEdge *b = (const ClipEdge*)q;
+    if (a->a.y != b->a.y) {
+        return (a->a.y > b->a.y) - (a->a.y < b->a.y);
+    }
+    if (a->a.x != b->a.x) {
+        return (a->a.x > b->a.x) - (a->a.x < b->a.x);
+    }
+    if (a->b.y != b->b.y) {
+        return (a->b.y > b->b.y) - (a->b.y < b->b.y);
+    }
+    return (a->b.x > b->b.x) - (a->b.x < b->b.x);
+}
+
+static int
+compare_split(const void *p, const void *q)
+{
+    const ClipSplit *a = (const ClipSplit*)p;
+    const ClipSplit *b = (const ClipSplit*)q;
+    if (a->edge != b->edge) {
+        return a->edge - b->edge;
+    }
+    return (a->along > b->along) - (a->along < b->along);
+}
+
+/* Sweep up the edges, each checked against those still open when it
+ * starts whose x range overlaps its own, and split them where they meet.
+ * Returns -1 if memory ran out, otherwise the number of splits made.
+ */
+static int
+split_pass(ClipArray *edges)
+{
+    ClipEdge *list = (ClipEdge*)edges->data;
+    int count = edges->count;
+    qsort(list, count, sizeof(ClipEdge), compare_edge);
+    int *open = (int*)malloc(count * sizeof(int) + 1);
+    if (!open) {
+        return -1;
+    }
+
+    ClipArray splits = {NULL, 0, 0};
+    int open_count = 0;
+    int ok = 1;
+    for (int k=0; ok && (k<count); k++) {
+        const ClipEdge *e = &list[k];
+        int64_t left = (e->a.x < e->b.x) ? e->a.x : e->b.x;
+        int64_t right = (e->a.x < e->b.x) ? e->b.x : e->a.x;
+        int kept = 0;
+        for (int i=0; ok && (i<open_count); i++) {
+            const ClipEdge *f = &list[open[i]];
+            if (f->b.y < e->a.y) {
+                continue;
+            }
+            open[kept++] = open[i];
+            if ((f->a.x < left) && (f->b.x < left)) {
+                continue;
+            }
+            if ((f->a.x > right) && (f->b.x > right)) {
+                continue;
+            }
+            ok = intersect(&splits, list, k, open[i]);
+        }
+        open_count = kept;
+        open[open_count++] = k;
+    }
+    free(open);
+    if (!ok) {
+        free(splits.data);
+        return -1;
+    }
+    if (!splits.count) {
+        return 0;
+    }
+
+    /* Rebuild the edge list with each split edge in pieces, keeping the
+     * direction the ring ran so the windings stay right even when
+     * rounding tips a piece the other way up.
+     */
+    ClipSplit *s = (ClipSplit*)splits.data;
+    qsort(s, splits.count, sizeof(ClipSplit), compare_split);
+    ClipArray pieces = {NULL, 0, 0};
+    int next = 0;
+    for (int i=0; ok && (i<count); i++) {
+        const ClipEdge *e = &list[i];
+        ClipPoint from = e->a;
+        for (; ok && (next < splits.count) && (s[next].edge == i); next++) {
+            ok = add_edge(&pieces, s[next].p, from, e->ws, e->wc);
+            from = s[next].p;
+        }
+        if (ok) {
+            ok = add_edge(&pieces, e->b, from, e->ws, e->wc);
+        }
+    }
+    int made = splits.count;
+    free(splits.data);
+    if (!ok) {
+        free(pieces.data);
+        return -1;
+    }
+    free(edges->data);
+    *edges = pieces;
+    return made;
+}
+
+/* Merge the edges that coincide, dropping those whose windings cancel
+ * out, and leave the rest sorted from the bottom up.
+ */
+static void
+merge_edges(ClipArray *edges)
+{
+    ClipEdge *list = (ClipEdge*)edges->data;
+    qsort(list, edges->count, sizeof(ClipEdge), compare_edge);
+    int kept = 0;
+    for (int i=0; i<edges->count; i++) {
+        if (kept && point_equal(list[kept-1].a, list[i].a)
+            && point_equal(list[kept-1].b, list[i].b)) {
+            list[kept-1].ws += list[i].ws;
+            list[kept-1].wc += list[i].wc;
+            continue;
+        }
+        if (kept && !list[kept-1].ws && !list[kept-1].wc) {
+            kept--;
+        }
+        list[kept++] = list[i];
+    }
+    if (kept && !list[kept-1].ws && !list[kept-1].wc) {
+        kept--;
+    }
+    edges->count = kept;
+}
+
+static int
+rule_inside(int winding, int rule)
+{
+    switch (rule) {
+    case CLIP_NONZERO:
+        return winding != 0;
+    case CLIP_POSITIVE:
+        return winding > 0;
+    default:
+        break;
+    }
+    return winding & 1;
+}
+
+/* Whether a place with these windings is in the result. */
+static int
+result_inside(int ws, int wc, int subject_rule, int clip_rule, int op)
+{
+    int s = rule_inside(ws, subject_rule);
+    int c = rule_inside(wc, clip_rule);
+    switch (op) {
+    case CLIP_INTERSECTION:
+        return s && c;
+    case CLIP_DIFFERENCE:
+        return s && !c;
+    default:
+        break;
+    }
+    return s || c;
+}
+
+/* Where the edge e, which isn't level, is at height y. */
+static EmbReal
+edge_x(const ClipEdge *e, EmbReal y)
+{
+    return e->a.x + (EmbReal)(e->b.x - e->a.x) * (y - e->a.y)
+        / (EmbReal)(e->b.y - e->a.y);
+}
+
+static int
+compare_active(const void *p, const void *q)
+{
+    EmbReal a = ((const ClipActive*)p)->x;
+    EmbReal b = ((const ClipActive*)q)->x;
+    return (a > b) - (a < b);
+}
+
+static int
+compare_int64(const void *p, const void *q)
+{
+    int64_t a = *(const int64_t*)p;
+    int64_t b = *(const int64_t*)q;
+    return (a > b) - (a < b);
+}
+
+/* Add the windings of the open edges left of each level edge at y to
+ * ws and wc, which are indexed like levels.
+ */
+static void
+level_windings(const ClipEdge *list, const ClipActive *open, int open_count,
+    const int *levels, int level_count, int64_t y, int *ws, int *wc)
+{
+    int s = 0;
+    int c = 0;
+    int j = 0;
+    for (int h=0; h<level_count; h++) {
+        const ClipEdge *e = &list[levels[h]];
+        EmbReal middle = 0.5 * ((EmbReal)e->a.x + (EmbReal)e->b.x);
+        while ((j < open_count) && (edge_x(&list[open[j].edge], (EmbReal)y) < middle)) {
+            s += list[open[j].edge].ws;
+            c += list[open[j].edge].wc;
+            j++;
+        }
+        ws[h] = s;
+        wc[h] = c;
+    }
+}
+
+/* The edges that bound the result, each turned so the result is on its
+ * left, found band by band between the heights where edges end.
+ */
+static int
+classify(const ClipArray *edges, int subject_rule, int clip_rule, int op,
+    ClipArray *out)
+{
+    const ClipEdge *list = (const ClipEdge*)edges->data;
+    int count = edges->count;
+    if (!count) {
+        return 1;
+    }
+    int64_t *ys = (int64_t*)malloc(2 * count * sizeof(int64_t));
+    ClipActive *open = (ClipActive*)malloc(count * sizeof(ClipActive));
+    int *levels = (int*)malloc(3 * count * sizeof(int));
+    if (!(ys && open && levels)) {
+        free(ys);
+        free(open);
+        free(levels);
+        return 0;
+    }
+    int *below_s = levels + count;
+    int *below_c = below_s + count;
+
+    int heights = 0;
+    for (int i=0; i<count; i++) {
+        ys[heights++] = list[i].a.y;
+        ys[heights++] = list[i].b.y;
+    }
+    qsort(ys, heights, sizeof(int64_t), compare_int64);
+    int unique = 0;
+    for (int i=0; i<heights; i++) {
+        if (!unique || (ys[unique-1] != ys[i])) {
+            ys[unique++] = ys[i];
+        }
+    }
+    heights = unique;
+
+    /* The edges are in order of their lower ends, so each height's new
+     * edges follow on from the last height's.
+     */
+    int ok = 1;
+    int open_count = 0;
+    int next = 0;
+    for (int k=0; ok && (k<heights); k++) {
+        int64_t y = ys[k];
+        int level_count = 0;
+        int first = next;
+        for (; (next < count) && (list[next].a.y == y); next++) {
+            if (list[next].b.y == y) {
+                levels[level_count++] = next;
+            }
+        }
+
+        /* Level edges bound the result where it changes from the band
+         * below to the band above.
+         */
+        level_windings(list, open, open_count, levels, level_count, y,
+            below_s, below_c);
+
+        int kept = 0;
+        for (int i=0; i<open_count; i++) {
+            if (list[open[i].edge].b.y > y) {
+                open[kept++] = open[i];
+            }
+        }
+        open_count = kept;
+        int added = 0;
+        for (int i=first; i<next; i++) {
+            if (list[i].b.y != y) {
+                open[open_count].edge = i;
+                open_count++;
+                added++;
+            }
+        }
+        if (k+1 < heights) {
+            EmbReal middle = 0.5 * ((EmbReal)y + (EmbReal)ys[k+1]);
+            for (int i=0; i<open_count; i++) {
+                open[i].x = edge_x(&list[open[i].edge], middle);
+            }
+            if (added > 16) {
+                qsort(open, open_count, sizeof(ClipActive), compare_active);
+            }
+            else {
+                for (int i=1; i<open_count; i++) {
+                    ClipActive a = open[i];
+                    int j = i;
+                    for (; (j > 0) && (open[j-1].x > a.x); j--) {
+                        open[j] = open[j-1];
+                    }
+                    open[j] = a;
+                }
+            }
+        }
+
+        if (level_count) {
+            int *above_s = (int*)malloc(2 * level_count * sizeof(int));
+            if (!above_s) {
+                ok = 0;
+                break;
+            }
+            int *above_c = above_s + level_count;
+            level_windings(list, open, open_count, levels, level_count, y,
+                above_s, above_c);
+            for (int h=0; ok && (h<level_count); h++) {
+                const ClipEdge *e = &list[levels[h]];
+                int in_below = result_inside(below_s[h], below_c[h],
+                    subject_rule, clip_rule, op);
+                int in_above = result_inside(above_s[h], above_c[h],
+                    subject_rule, clip_rule, op);
+                if (in_below == in_above) {
+                    continue;
+                }
+                ClipEdge *o = (ClipEdge*)array_push(out, sizeof(ClipEdge));
+                if (!o) {
+                    ok = 0;
+                    break;
+                }
+                *o = *e;
+                if (in_below) {
+                    o->a = e->b;
+                    o->b = e->a;
+                }
+            }
+            free(above_s);
+        }
+
+        /* Each edge keeps its place from one band to the next, so it is
+         * only looked at in the band where it starts.
+         */
+        if (!added) {
+            continue;
+        }
+        int ws = 0;
+        int wc = 0;
+        for (int i=0; ok && (i<open_count); i++) {
+            const ClipEdge *e = &list[open[i].edge];
+            if (e->a.y == y) {
+                int in_left = result_inside(ws, wc, subject_rule, clip_rule, op);
+                int in_right = result_inside(ws + e->ws, wc + e->wc,
+                    subject_rule, clip_rule, op);
+                if (in_left != in_right) {
+                    ClipEdge *o = (ClipEdge*)array_push(out, sizeof(ClipEdge));
+                    if (!o) {
+                        ok = 0;
+                        break;
+                    }
+                    *o = *e;
+                    if (in_right) {
+                        o->a = e->b;
+                        o->b = e->a;
+                    }
+                }
+            }
+            ws += e->ws;
+            wc += e->wc;
+        }
+    }
+    free(ys);
+    free(open);
+    free(levels);
+    return ok;
+}
+
+static int
+compare_start(const void *p, const void *q)
+{
+    const ClipEdge *a = (const ClipEdge*)p;
+    const ClipEdge *b = (const ClipEdge*)q;
+    if (a->a.y != b->a.y) {
+        return (a->a.y > b->a.y) - (a->a.y < b->a.y);
+    }
+    return (a->a.x > b->a.x) - (a->a.x < b->a.x);
+}
+
+/* The first edge starting at p, or count if there is none. */
+static int
+find_start(const ClipEdge *list, int count, ClipPoint p)
+{
+    int low = 0;
+    int high = count;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (point_less(list[middle].a, p)) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/* Add a ring of grid points to result, leaving out points in line with
+ * their neighbours.
+ */
+static int
+add_ring(PolygonSet *result, ClipPoint *ring, int n)
+{
+    int kept = 0;
+    for (int i=0; i<n; i++) {
+        while ((kept >= 2) && !orient(ring[kept-2], ring[kept-1], ring[i])) {
+            kept--;
+        }
+        ring[kept++] = ring[i];
+    }
+    int first = 0;
+    while ((kept - first >= 3)
+        && !orient(ring[kept-2], ring[kept-1], ring[first])) {
+        kept--;
+    }
+    while ((kept - first >= 3)
+        && !orient(ring[kept-1], ring[first], ring[first+1])) {
+        first++;
+    }
+    if (kept - first < 3) {
+        return 1;
+    }
+    for (int i=first; i<kept; i++) {
+        EmbVector v;
+        v.x = ring[i].x / CLIP_SCALE;
+        v.y = ring[i].y / CLIP_SCALE;
+        if (!polygon_add_point(result, v)) {
+            return 0;
+        }
+    }
+    return polygon_close_ring(result);
+}
+
+/* Chain the result's edges into rings. Where rings meet at a point the
+ * sharpest left turn is taken, which keeps them apart.
+ */
+static int
+chain_rings(ClipArray *out, PolygonSet *result)
+{
+    ClipEdge *list = (ClipEdge*)out->data;
+    int count = out->count;
+    if (!count) {
+        return 1;
+    }
+    qsort(list, count, sizeof(ClipEdge), compare_start);
+    char *used = (char*)calloc(count, 1);
+    ClipPoint *ring = (ClipPoint*)malloc(count * sizeof(ClipPoint));
+    if (!(used && ring)) {
+        free(used);
+        free(ring);
+        return 0;
+    }
+    int ok = 1;
+    for (int i=0; ok && (i<count); i++) {
+        if (used[i]) {
+            continue;
+        }
+        int n = 0;
+        int edge = i;
+        while (edge < count) {
+            used[edge] = 1;
+            ring[n++] = list[edge].a;
+            ClipPoint at = list[edge].b;
+            if (point_equal(at, list[i].a)) {
+                break;
+            }
+            EmbReal back = atan2((EmbReal)(list[edge].a.y - at.y),
+                (EmbReal)(list[edge].a.x - at.x));
+            int best = count;
+            EmbReal best_turn = 0.0;
+            for (int j=find_start(list, count, at);
+                (j < count) && point_equal(list[j].a, at); j++) {
+                if (used[j]) {
+                    continue;
+                }
+                EmbReal turn = atan2((EmbReal)(list[j].b.y - at.y),
+                    (EmbReal)(list[j].b.x - at.x)) - back;
+                if (turn <= 0.0) {
+                    turn += 2.0*CONSTANT_PI;
+                }
+                if ((best == count) || (turn > best_turn)) {
+                    best = j;
+                    best_turn = turn;
+                }
+            }
+            edge = best;
+        }
+        ok = add_ring(result, ring, n);
+    }
+    free(used);
+    free(ring);
+    return ok;
+}
+
+/* Add a point to the ring being built. */
+int
+polygon_add_point(PolygonSet *set, EmbVector p)
+{
+    if (set->count == set->capacity) {
+        int capacity = set->capacity ? 2*set->capacity : 64;
+        EmbVector *points = (EmbVector*)realloc(set->points,
+            capacity * sizeof(EmbVector));
+        if (!points) {
+            return 0;
+        }
+        set->points = points;
+        set->capacity = capacity;
+    }
+    set->points[set->count++] = p;
+    return 1;
+}
+
+/* Finish the ring being built. Rings of fewer than 3 points are left out. */
+int
+polygon_close_ring(PolygonSet *set)
+{
+    int start = set->rings ? set->ring_ends[set->rings-1] : 0;
+    if (set->count - start < 3) {
+        set->count = start;
+        return 1;
+    }
+    if (set->rings == set->ring_capacity) {
+        int capacity = set->ring_capacity ? 2*set->ring_capacity : 16;
+        int *ends = (int*)realloc(set->ring_ends, capacity * sizeof(int));
+        if (!ends) {
+            return 0;
+        }
+        set->ring_ends = ends;
+        set->ring_capacity = capacity;
+    }
+    set->ring_ends[set->rings++] = set->count;
+    return 1;
+}
+
+void
+polygon_free(PolygonSet *set)
+{
+    free(set->points);
+    free(set->ring_ends);
+    memset(set, 0, sizeof(PolygonSet));
+}
+
+/* Combine subject and clip, each inside where its fill rule says, by op:
+ * CLIP_UNION, CLIP_INTERSECTION or CLIP_DIFFERENCE (subject less clip).
+ * The rings of result are added with the inside on their left, so outer
+ * rings run counter-clockwise with y up and holes run clockwise. clip
+ * may be NULL, which with CLIP_UNION tidies subject into that form.
+ * Returns 0 if memory ran out or the crossings were still turning up new
+ * ones after CLIP_PASSES passes.
+ */
+int
+polygon_boolean(const PolygonSet *subject, int subject_rule,
+    const PolygonSet *clip, int clip_rule, int op, PolygonSet *result)
+{
+    ClipArray edges = {NULL, 0, 0};
+    int ok = add_rings(&edges, subject, 1, 0);
+    if (ok && clip) {
+        ok = add_rings(&edges, clip, 0, 1);
+    }
+    int made = 0;
+    for (int pass=0; ok && (pass<CLIP_PASSES); pass++) {
+        made = split_pass(&edges);
+        if (made <= 0) {
+            break;
+        }
+    }
+    if (made != 0) {
+        ok = 0;
+    }
+    ClipArray out = {NULL, 0, 0};
+    if (ok) {
+        merge_edges(&edges);
+        ok = classify(&edges, subject_rule, clip_rule, op, &out);
+    }
+    free(edges.data);
+    if (ok) {
+        ok = chain_rings(&out, result);
+    }
+    free(out.data);
+    return ok;
+}
+
+/* Add the corner at q, where the ring turns from direction d1 to d2, to
+ * the outline offset by distance to the right. Where the outline opens
+ * up it is closed with an arc, and where it folds over it is taken in
+ * to q itself, so that the fold is left out of the positive winding.
+ */
+static int
+offset_corner(PolygonSet *raw, EmbVector q, EmbVector d1, EmbVector d2,
+    EmbReal distance)
+{
+    EmbVector n1 = {d1.y * distance, -d1.x * distance};
+    EmbVector n2 = {d2.y * distance, -d2.x * distance};
+    EmbReal cross = d1.x*d2.y - d1.y*d2.x;
+    EmbReal dot = d1.x*d2.x + d1.y*d2.y;
+    EmbVector p;
+    EmbReal gap = sqrt((n2.x - n1.x)*(n2.x - n1.x) + (n2.y - n1.y)*(n2.y - n1.y));
+    if (gap * CLIP_SCALE < 2.0) {
+        /* Too small a turn to show on the grid: one point between the
+         * two, rather than points that could be rounded out of order.
+         */
+        EmbReal length = sqrt((n1.x + n2.x)*(n1.x + n2.x)
+            + (n1.y + n2.y)*(n1.y + n2.y));
+        p.x = q.x + (n1.x + n2.x) * fabs(distance) / length;
+        p.y = q.y + (n1.y + n2.y) * fabs(distance) / length;
+        return polygon_add_point(raw, p);
+    }
+    if (cross * distance > 0.0) {
+        EmbReal turn = atan2(cross, dot);
+        int steps = (int)ceil(fabs(turn) * OFFSET_ARC_STEPS / (2.0*CONSTANT_PI));
+        if (steps < 1) {
+            steps = 1;
+        }
+        for (int i=0; i<=steps; i++) {
+            EmbReal a = turn * i / steps;
+            p.x = q.x + n1.x*cos(a) - n1.y*sin(a);
+            p.y = q.y + n1.x*sin(a) + n1.y*cos(a);
+            if (!polygon_add_point(raw, p)) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    p.x = q.x + n1.x;
+    p.y = q.y + n1.y;
+    if (!polygon_add_point(raw, p) || !polygon_add_point(raw, q)) {
+        return 0;
+    }
+    p.x = q.x + n2.x;
+    p.y = q.y + n2.y;
+    return polygon_add_point(raw, p);
+}
+
+/* The distance from p to the line through a and b. */
+static EmbReal
+line_distance(EmbVector p, EmbVector a, EmbVector b)
+{
+    EmbReal dx = b.x - a.x;
+    EmbReal dy = b.y - a.y;
+    EmbReal length = sqrt(dx*dx + dy*dy);
+    if (length == 0.0) {
+        return sqrt((p.x - a.x)*(p.x - a.x) + (p.y - a.y)*(p.y - a.y));
+    }
+    return fabs(dx*(p.y - a.y) - dy*(p.x - a.x)) / length;
+}
+
+/* Thin out the n points of a ring in place, keeping its shape to within
+ * OFFSET_TOLERANCE, by splitting it at the points furthest from the
+ * chords that leave them out. Rounding to the grid bends short edges by
+ * a few degrees, which the corners of an offset would make too much of.
+ * Returns how many points are kept.
+ */
+static int
+simplify_ring(EmbVector *ring, int n, char *keep, int *stack)
+{
+    int far = 0;
+    EmbReal furthest = -1.0;
+    for (int i=1; i<n; i++) {
+        EmbReal d = (ring[i].x - ring[0].x)*(ring[i].x - ring[0].x)
+            + (ring[i].y - ring[0].y)*(ring[i].y - ring[0].y);
+        if (d > furthest) {
+            furthest = d;
+            far = i;
+        }
+    }
+    memset(keep, 0, n);
+    keep[0] = 1;
+    keep[far] = 1;
+    int top = 0;
+    stack[top++] = 0;
+    stack[top++] = far;
+    stack[top++] = far;
+    stack[top++] = n;
+    while (top) {
+        int end = stack[--top];
+        int start = stack[--top];
+        EmbVector b = ring[end % n];
+        int split = -1;
+        EmbReal worst = OFFSET_TOLERANCE;
+        for (int i=start+1; i<end; i++) {
+            EmbReal d = line_distance(ring[i], ring[start], b);
+            if (d > worst) {
+                worst = d;
+                split = i;
+            }
+        }
+        if (split >= 0) {
+            keep[split] = 1;
+            stack[top++] = start;
+            stack[top++] = split;
+            stack[top++] = split;
+            stack[top++] = end;
+        }
+    }
+    int kept = 0;
+    for (int i=0; i<n; i++) {
+        if (keep[i] && !(kept && (ring[i].x == ring[kept-1].x)
+            && (ring[i].y == ring[kept-1].y))) {
+            ring[kept++] = ring[i];
+        }
+    }
+    if ((kept > 1) && (ring[kept-1].x == ring[0].x)
+        && (ring[kept-1].y == ring[0].y)) {
+        kept--;
+    }
+    return kept;
+}
+
+static EmbVector
+unit_direction(EmbVector from, EmbVector to)
+{
+    EmbVector d = {to.x - from.x, to.y - from.y};
+    EmbReal length = sqrt(d.x*d.x + d.y*d.y);
+    d.x /= length;
+    d.y /= length;
+    return d;
+}
+
+/* Grow subject, inside by its fill rule, by distance all round, or
+ * shrink it for a negative distance, with the corners that grow rounded.
+ * Each ring is tidied and thinned out, then traced at the distance with
+ * the inside on its left, and the places these outlines wind round a
+ * positive number of times are the result. Returns 0 if memory ran out
+ * or the clipping failed, see polygon_boolean().
+ */
+int
+polygon_offset(const PolygonSet *subject, int rule, EmbReal distance,
+    PolygonSet *result)
+{
+    if (distance == 0.0) {
+        return polygon_boolean(subject, rule, NULL, CLIP_NONZERO, CLIP_UNION,
+            result);
+    }
+    PolygonSet tidy;
+    memset(&tidy, 0, sizeof(PolygonSet));
+    if (!polygon_boolean(subject, rule, NULL, CLIP_NONZERO, CLIP_UNION, &tidy)) {
+        polygon_free(&tidy);
+        return 0;
+    }
+
+    char *keep = (char*)malloc(tidy.count + 1);
+    int *stack = (int*)malloc((2*tidy.count + 4) * sizeof(int));
+    if (!(keep && stack)) {
+        free(keep);
+        free(stack);
+        polygon_free(&tidy);
+        return 0;
+    }
+
+    /* The inside is on the left, so the outside is a positive distance
+     * to the right.
+     */
+    PolygonSet raw;
+    memset(&raw, 0, sizeof(PolygonSet));
+    int ok = 1;
+    int start = 0;
+    for (int r=0; ok && (r<tidy.rings); r++) {
+        int end = tidy.ring_ends[r];
+        EmbVector *ring = tidy.points + start;
+        int n = simplify_ring(ring, end - start, keep, stack);
+        start = end;
+        if (n < 3) {
+            continue;
+        }
+        for (int i=0; ok && (i<n); i++) {
+            EmbVector prev = ring[(i+n-1) % n];
+            EmbVector q = ring[i];
+            EmbVector next = ring[(i+1) % n];
+            ok = offset_corner(&raw, q, unit_direction(prev, q),
+                unit_direction(q, next), distance);
+        }
+        if (ok) {
+            ok = polygon_close_ring(&raw);
+        }
+    }
+    free(keep);
+    free(stack);
+    if (ok) {
+        ok = polygon_boolean(&raw, CLIP_POSITIVE, NULL, CLIP_NONZERO,
+            CLIP_UNION, result);
+    }
+    polygon_free(&raw);
+    polygon_free(&tidy);
+    return ok;
+}
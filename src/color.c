@@ -0,0 +1,254 @@
+/*
+ *  Embroidermodder 2.
+ *
+ *  ------------------------------------------------------------
+ *
+ *  Copyright 2013-2023 The Embroidermodder Team
+ *  Embroidermodder 2 is Open Source Software.
+ *  See LICENSE for licensing terms.
+ *
+ *  ------------------------------------------------------------
+ *
+ *  Use Python's PEP7 style guide.
+ *      https://peps.python.org/pep-0007/
+ *
+ *  Thread colour matching: finding the thread in a catalog that looks
+ *  closest to a given colour.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "core.h"
+
+/* An sRGB channel as linear light. */
+static EmbReal
+srgb_linear(unsigned char c)
+{
+    EmbReal v = c / 255.0;
+    if (v <= 0.04045) {
+        return v / 12.92;
+    }
+    return pow((v + 0.055) / 1.055, 2.4);
+}
+
+/* The CIELAB companding of a tristimulus value relative to white. */
+static EmbReal
+lab_f(EmbReal t)
+{
+    if (t > 216.0 / 24389.0) {
+        return cbrt(t);
+    }
+    return (24389.0 / 27.0 * t + 16.0) / 116.0;
+}
+
+/* The sRGB colour r, g, b in CIELAB under the D65 white point. */
+LabColor
+rgb_to_lab(unsigned char r, unsigned char g, unsigned char b)
+{
+    EmbReal lr = srgb_linear(r);
+    EmbReal lg = srgb_linear(g);
+    EmbReal lb = srgb_linear(b);
+    EmbReal x = (0.4124564*lr + 0.3575761*lg + 0.1804375*lb) / 0.95047;
+    EmbReal y = 0.2126729*lr + 0.7151522*lg + 0.0721750*lb;
+    EmbReal z = (0.0193339*lr + 0.1191920*lg + 0.9503041*lb) / 1.08883;
+    EmbReal fx = lab_f(x);
+    EmbReal fy = lab_f(y);
+    EmbReal fz = lab_f(z);
+    LabColor lab;
+    lab.l = 116.0*fy - 16.0;
+    lab.a = 500.0*(fx - fy);
+    lab.b = 200.0*(fy - fz);
+    return lab;
+}
+
+/* The CIE76 colour difference: a distance of about 2.3 is just
+ * noticeable side by side.
+ */
+EmbReal
+delta_e(LabColor x, LabColor y)
+{
+    EmbReal dl = x.l - y.l;
+    EmbReal da = x.a - y.a;
+    EmbReal db = x.b - y.b;
+    return sqrt(dl*dl + da*da + db*db);
+}
+
+/* The square of delta_e(), which is all the search needs. */
+static EmbReal
+delta_e2(LabColor x, LabColor y)
+{
+    EmbReal dl = x.l - y.l;
+    EmbReal da = x.a - y.a;
+    EmbReal db = x.b - y.b;
+    return dl*dl + da*da + db*db;
+}
+
+/* The L, a or b coordinate of c. */
+static EmbReal
+lab_axis(LabColor c, int axis)
+{
+    if (axis == 0) {
+        return c.l;
+    }
+    if (axis == 1) {
+        return c.a;
+    }
+    return c.b;
+}
+
+/* Swap entries i and j of the index. */
+static void
+index_swap(ColorIndex *index, int i, int j)
+{
+    LabColor c = index->colors[i];
+    int e = index->entries[i];
+    index->colors[i] = index->colors[j];
+    index->entries[i] = index->entries[j];
+    index->colors[j] = c;
+    index->entries[j] = e;
+}
+
+/* Reorder entries lo to hi (exclusive) so entry k holds the value it
+ * would if they were sorted on axis, with smaller values before it and
+ * larger after.
+ */
+static void
+index_select(ColorIndex *index, int lo, int hi, int k, int axis)
+{
+    hi--;
+    while (lo < hi) {
+        EmbReal pivot = lab_axis(index->colors[(lo + hi) / 2], axis);
+        int i = lo;
+        int j = hi;
+        while (i <= j) {
+            while (lab_axis(index->colors[i], axis) < pivot) {
+                i++;
+            }
+            while (lab_axis(index->colors[j], axis) > pivot) {
+                j--;
+            }
+            if (i <= j) {
+                index_swap(index, i, j);
+                i++;
+                j--;
+            }
+        }
+        if (k <= j) {
+            hi = j;
+        }
+        else if (k >= i) {
+            lo = i;
+        }
+        else {
+            return;
+        }
+    }
+}
+
+/* Arrange entries lo to hi (exclusive) as a subtree: the middle entry
+ * splits the rest on the axis of its depth.
+ */
+static void
+index_build(ColorIndex *index, int lo, int hi, int depth)
+{
+    if (hi - lo <= 1) {
+        return;
+    }
+    int mid = (lo + hi) / 2;
+    index_select(index, lo, hi, mid, depth % 3);
+    index_build(index, lo, mid, depth + 1);
+    index_build(index, mid + 1, hi, depth + 1);
+}
+
+/* Index the count colours of a catalog, given as r, g, b byte triplets.
+ * Returns 0 if out of memory.
+ */
+int
+color_index_build(ColorIndex *index, const unsigned char *rgb, int count)
+{
+    index->count = 0;
+    index->colors = (LabColor*)malloc((count > 0 ? count : 1) * sizeof(LabColor));
+    index->entries = (int*)malloc((count > 0 ? count : 1) * sizeof(int));
+    if (!index->colors || !index->entries) {
+        color_index_free(index);
+        return 0;
+    }
+    for (int i=0; i<count; i++) {
+        index->colors[i] = rgb_to_lab(rgb[3*i], rgb[3*i+1], rgb[3*i+2]);
+        index->entries[i] = i;
+    }
+    index->count = count;
+    index_build(index, 0, count, 0);
+    return 1;
+}
+
+/* The best match so far in a search. */
+typedef struct ColorMatch_ {
+    int entry;
+    EmbReal d2;
+} ColorMatch;
+
+/* Search the subtree of entries lo to hi (exclusive) for c, skipping the
+ * far side of a split whenever the split is further than the best match.
+ */
+static void
+index_search(const ColorIndex *index, int lo, int hi, int depth, LabColor c,
+    ColorMatch *best)
+{
+    if (lo >= hi) {
+        return;
+    }
+    int mid = (lo + hi) / 2;
+    EmbReal d2 = delta_e2(c, index->colors[mid]);
+    int entry = index->entries[mid];
+    /* Ties go to the earlier catalog entry so results don't depend on
+     * the layout of the tree.
+     */
+    if ((d2 < best->d2) || ((d2 == best->d2) && (entry < best->entry))) {
+        best->d2 = d2;
+        best->entry = entry;
+    }
+    int axis = depth % 3;
+    EmbReal diff = lab_axis(c, axis) - lab_axis(index->colors[mid], axis);
+    if (diff < 0.0) {
+        index_search(index, lo, mid, depth + 1, c, best);
+        if (diff*diff <= best->d2) {
+            index_search(index, mid + 1, hi, depth + 1, c, best);
+        }
+    }
+    else {
+        index_search(index, mid + 1, hi, depth + 1, c, best);
+        if (diff*diff <= best->d2) {
+            index_search(index, lo, mid, depth + 1, c, best);
+        }
+    }
+}
+
+/* The catalog entry nearest to c by delta_e(), or -1 if the catalog is
+ * empty. The distance is stored in distance if it is not NULL.
+ */
+int
+color_index_nearest(const ColorIndex *index, LabColor c, EmbReal *distance)
+{
+    ColorMatch best;
+    best.entry = -1;
+    best.d2 = HUGE_VAL;
+    index_search(index, 0, index->count, 0, c, &best);
+    if (distance) {
+        *distance = (best.entry < 0) ? 0.0 : sqrt(best.d2);
+    }
+    return best.entry;
+}
+
+/* Free the memory held by index. */
+void
+color_index_free(ColorIndex *index)
+{
+    free(index->colors);
+    free(index->entries);
+    index->colors = NULL;
+    index->entries = NULL;
+    index->count = 0;
+}
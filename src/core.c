@@ -26,10 +26,12 @@
 /* We assume here that all free systems and MacOS are POSIX compliant. */
 #if defined(WIN32)
 #include <windows.h>
+#include <psapi.h>
 #else
 #include <unistd.h>
 #include <sys/syscall.h>
 #include <sys/utsname.h>
+#include <sys/resource.h>
 #endif
 
 #include "core.h"
@@ -117,6 +119,21 @@ const char *usage_msg = ""
     "  -d, --debug      Print lots of debugging information.\n"
     "  -h, --help       Print this message and exit.\n"
     "  -v, --version    Print the version number of embroidermodder and exit.\n"
+    "  --bench-memory   Print the memory used by each object type and exit.\n"
+    "  --bench-stitches Print how long the stitch generators take and exit.\n"
+    "  --trace-startup  Print how long each phase of startup takes.\n"
+    "  --profile-scripts  Print how long each script command takes.\n"
+    "  --record FILE    Log the commands and mouse input of the session to FILE.\n"
+    "  --replay FILE    Play back a session log headless and report its timings.\n"
+    "  --estimate PATH  Print the run time and thread a design, or every design\n"
+    "                   in a folder, will take, its peak stitches per mm^2 and\n"
+    "                   how many areas are over the density limit, and exit.\n"
+    "                   May be repeated.\n"
+    "  --match-threads CATALOG  Change each thread of the files given to the\n"
+    "                   nearest in CATALOG, write them as NAME-CATALOG.EXT and\n"
+    "                   exit.\n"
+    "  --split-hoop WxH Split each of the files given between hoops of W by H mm,\n"
+    "                   write each hoop as NAME-hoopN.EXT and exit.\n"
     "\n";
 
 /*  . */
@@ -614,6 +631,7 @@ int display_props[] = {
     ST_SELECTBOX_ALPHA,
     ST_ZOOMSCALE_IN,
     ST_ZOOMSCALE_OUT,
+    ST_ZOOM_ANIMATION_FRAMES,
     -1
 };
 
@@ -678,6 +696,30 @@ platformString(void)
 #endif
 }
 
+/* The most memory the process has held at once, in kilobytes. */
+int64_t
+peak_memory_kb(void)
+{
+#if defined(WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage)) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    /* MacOS reports bytes rather than kilobytes. */
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
 /* Tokenize our command using a 1 character deliminator. */
 int
 tokenize(char **argv, char *str, const char delim)
@@ -777,9 +819,164 @@ string_array_length(const char *list[])
     return i;
 }
 
-/* Fourier series for parametric plotting. */
+/* Returns the position of entry in the "END" terminated list, or -1 if
+ * it isn't present.
+ */
+int
+string_array_index(const char *list[], const char *entry)
+{
+    int i;
+    for (i=0; strcmp(list[i], "END"); i++) {
+        if (!strcmp(list[i], entry)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* 32-bit FNV-1a hash of a NUL terminated string. */
+uint32_t
+fnv1a_hash(const char *str)
+{
+    return fnv1a_extend(FNV1A_OFFSET, str);
+}
+
+/* Continue the FNV-1a hash h over str, so that text held in several
+ * pieces can be hashed without joining it first.
+ */
+uint32_t
+fnv1a_extend(uint32_t h, const char *str)
+{
+    for (; *str; str++) {
+        h ^= (unsigned char)*str;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Index into settings_data of the setting with the given key, -1 if there
+ * isn't one.
+ *
+ * The keys are put into an open addressing table on first use, so looking
+ * a key up while parsing the settings file costs one hash rather than a
+ * strcmp against every entry.
+ */
+int
+setting_index(const char *key)
+{
+    static int table[SETTINGS_HASH_SIZE];
+    static int built = 0;
+    int i;
+    if (!built) {
+        for (i=0; i<SETTINGS_HASH_SIZE; i++) {
+            table[i] = -1;
+        }
+        for (i=0; i<SETTINGS_TOTAL; i++) {
+            uint32_t h = fnv1a_hash(settings_data[i].key) % SETTINGS_HASH_SIZE;
+            while (table[h] >= 0) {
+                h = (h + 1) % SETTINGS_HASH_SIZE;
+            }
+            table[h] = i;
+        }
+        built = 1;
+    }
+
+    uint32_t h = fnv1a_hash(key) % SETTINGS_HASH_SIZE;
+    while (table[h] >= 0) {
+        if (!strcmp(settings_data[table[h]].key, key)) {
+            return table[h];
+        }
+        h = (h + 1) % SETTINGS_HASH_SIZE;
+    }
+    return -1;
+}
+
+/* Index into command_table of the command whose name is the first length
+ * characters of name, -1 if there isn't one. Like setting_index() the
+ * names are hashed into a table on first use.
+ */
+int
+command_index(const char *name, int length)
+{
+    static int table[COMMAND_HASH_SIZE];
+    static int built = 0;
+    char key[MAX_STRING_LENGTH];
+    int i;
+    if (!built) {
+        for (i=0; i<COMMAND_HASH_SIZE; i++) {
+            table[i] = -1;
+        }
+        for (i=0; i<MAX_COMMANDS && command_table[i].command[0]; i++) {
+            uint32_t h = fnv1a_hash(command_table[i].command) % COMMAND_HASH_SIZE;
+            while (table[h] >= 0) {
+                h = (h + 1) % COMMAND_HASH_SIZE;
+            }
+            table[h] = i;
+        }
+        built = 1;
+    }
+
+    if (length >= MAX_STRING_LENGTH) {
+        return -1;
+    }
+    memcpy(key, name, length);
+    key[length] = 0;
+    uint32_t h = fnv1a_hash(key) % COMMAND_HASH_SIZE;
+    while (table[h] >= 0) {
+        if (!strcmp(command_table[table[h]].command, key)) {
+            return table[h];
+        }
+        h = (h + 1) % COMMAND_HASH_SIZE;
+    }
+    return -1;
+}
+
+/* Set n from the text of a value of the given type ('i', 'r' or 's'). */
+void
+set_node(Node *n, int type, const char *value)
+{
+    switch (type) {
+    case 'i':
+        n->i = atoi(value);
+        break;
+    case 'r':
+        n->r = atof(value);
+        break;
+    case 's':
+        strncpy(n->s, value, MAX_STRING_LENGTH-1);
+        n->s[MAX_STRING_LENGTH-1] = 0;
+        break;
+    default:
+        break;
+    }
+}
+
+/* Whether a and b hold the same value, comparing only the field that
+ * the type uses.
+ */
+int
+node_equal(Node *a, Node *b, int type)
+{
+    switch (type) {
+    case 'i':
+        return a->i == b->i;
+    case 'r':
+        return a->r == b->r;
+    case 's':
+        return !strcmp(a->s, b->s);
+    default:
+        break;
+    }
+    return 1;
+}
+
+/* Fourier series for parametric plotting.
+ *
+ * The terms are triples of amplitude, phase and frequency, so each one
+ * contributes terms[0] * sin(terms[1] + terms[2] * arg).
+ */
 EmbReal
-fourier_series(EmbReal arg, EmbReal *terms, int n_terms)
+fourier_series(EmbReal arg, const EmbReal *terms, int n_terms)
 {
     EmbReal x = 0.0f;
     for (int i=0; i<(n_terms/3); i++) {
@@ -788,6 +985,68 @@ fourier_series(EmbReal arg, EmbReal *terms, int n_terms)
     return x;
 }
 
+/* Sum the same series at the n arguments t0, t0 + h, t0 + 2h, ...
+ *
+ * Rather than calling sin() for every term of every sample, each term is
+ * stepped with the recurrence
+ *
+ *     sin(a + (k+1)b) = 2 cos(b) sin(a + kb) - sin(a + (k-1)b)
+ *
+ * which costs a multiply and a subtract. Up to FOURIER_LANES terms are
+ * advanced side by side in flat arrays so the inner loop has no
+ * dependencies between iterations and the compiler can vectorise it.
+ * The recurrence slowly loses precision, so it is seeded again with
+ * sin() every FOURIER_BLOCK samples.
+ */
+void
+fourier_series_batch(const EmbReal *terms, int n_terms, EmbReal t0,
+    EmbReal h, int n, EmbReal *out)
+{
+    EmbReal amp[FOURIER_LANES];
+    EmbReal step[FOURIER_LANES];
+    EmbReal s0[FOURIER_LANES];
+    EmbReal s1[FOURIER_LANES];
+    int total = n_terms/3;
+
+    for (int i=0; i<n; i++) {
+        out[i] = 0.0;
+    }
+
+    for (int first=0; first<total; first+=FOURIER_LANES) {
+        int lanes = total - first;
+        if (lanes > FOURIER_LANES) {
+            lanes = FOURIER_LANES;
+        }
+        const EmbReal *chunk = terms + 3*first;
+
+        for (int start=0; start<n; start+=FOURIER_BLOCK) {
+            int end = start + FOURIER_BLOCK;
+            if (end > n) {
+                end = n;
+            }
+            EmbReal t = t0 + h*start;
+            for (int j=0; j<lanes; j++) {
+                EmbReal phase = chunk[3*j+1];
+                EmbReal freq = chunk[3*j+2];
+                amp[j] = chunk[3*j+0];
+                step[j] = 2.0 * cos(freq * h);
+                s0[j] = sin(phase + freq * (t - h));
+                s1[j] = sin(phase + freq * t);
+            }
+            for (int i=start; i<end; i++) {
+                EmbReal sum = 0.0;
+                for (int j=0; j<lanes; j++) {
+                    EmbReal next = step[j]*s1[j] - s0[j];
+                    sum += amp[j] * s1[j];
+                    s0[j] = s1[j];
+                    s1[j] = next;
+                }
+                out[i] += sum;
+            }
+        }
+    }
+}
+
 /* . */
 bool
 willUnderflowInt32(int64_t a, int64_t b)
@@ -2514,6 +2773,102 @@ Setting settings_data[SETTINGS_TOTAL] = {
         .key = "stitch_time",
         .value = "0.01",
         .type = 'r'
+    },
+    {
+        .id = ST_UNDO_MEMORY_BUDGET,
+        .key = "undo_memory_budget",
+        .value = "65536",
+        .type = 'i'
+    },
+    {
+        .id = ST_ZOOM_ANIMATION_FRAMES,
+        .key = "display_zoom_animation_frames",
+        .value = "6",
+        .type = 'i'
+    },
+    {
+        .id = ST_FILL_SPACING,
+        .key = "fill_spacing",
+        .value = "0.4",
+        .type = 'r'
+    },
+    {
+        .id = ST_FILL_ANGLE,
+        .key = "fill_angle",
+        .value = "0.0",
+        .type = 'r'
+    },
+    {
+        .id = ST_FILL_STITCH_LENGTH,
+        .key = "fill_stitch_length",
+        .value = "3.0",
+        .type = 'r'
+    },
+    {
+        .id = ST_FILL_STAGGER,
+        .key = "fill_stagger",
+        .value = "4",
+        .type = 'i'
+    },
+    {
+        .id = ST_COLUMN_WIDTH,
+        .key = "column_width",
+        .value = "2.0",
+        .type = 'r'
+    },
+    {
+        .id = ST_COLUMN_SPACING,
+        .key = "column_spacing",
+        .value = "0.4",
+        .type = 'r'
+    },
+    {
+        .id = ST_PULL_COMPENSATION,
+        .key = "pull_compensation",
+        .value = "0.2",
+        .type = 'r'
+    },
+    {
+        .id = ST_MAX_STITCH_LENGTH,
+        .key = "opensave_max_stitch_length",
+        .value = "12.1",
+        .type = 'r'
+    },
+    {
+        .id = ST_MIN_STITCH_LENGTH,
+        .key = "opensave_min_stitch_length",
+        .value = "0.3",
+        .type = 'r'
+    },
+    {
+        .id = ST_DENSITY_CELL,
+        .key = "display_density_cell",
+        .value = "1.0",
+        .type = 'r'
+    },
+    {
+        .id = ST_DENSITY_LIMIT,
+        .key = "display_density_limit",
+        .value = "4.0",
+        .type = 'r'
+    },
+    {
+        .id = ST_HOOP_WIDTH,
+        .key = "opensave_hoop_width",
+        .value = "100.0",
+        .type = 'r'
+    },
+    {
+        .id = ST_HOOP_HEIGHT,
+        .key = "opensave_hoop_height",
+        .value = "100.0",
+        .type = 'r'
+    },
+    {
+        .id = ST_HOOP_OVERLAP,
+        .key = "opensave_hoop_overlap",
+        .value = "10.0",
+        .type = 'r'
     }
 };
 
@@ -2535,6 +2890,110 @@ CommandData command_table[MAX_COMMANDS] = {
         .gscene = 1,
         .undo = 1
     },
+    {
+        .id = COMMAND_RUN,
+        .command = "run",
+        .min_args = 1,
+        .gview = 0,
+        .gscene = 0,
+        .undo = 0
+    },
+    {
+        .id = COMMAND_SIMULATE,
+        .command = "simulate",
+        .min_args = 0,
+        .gview = 1,
+        .gscene = 1,
+        .undo = 0
+    },
+    {
+        .id = COMMAND_MATCH_THREADS,
+        .command = "matchthreads",
+        .min_args = 1,
+        .gview = 1,
+        .gscene = 1,
+        .undo = 1
+    },
+    {
+        .id = COMMAND_DENSITY,
+        .command = "density",
+        .min_args = 0,
+        .gview = 1,
+        .gscene = 1,
+        .undo = 0
+    },
+    {
+        .id = COMMAND_SPLIT_HOOP,
+        .command = "splithoop",
+        .min_args = 0,
+        .gview = 1,
+        .gscene = 1,
+        .undo = 0
+    },
+    {
+        .id = COMMAND_UNION,
+        .command = "union",
+        .min_args = 0,
+        .gview = 1,
+        .gscene = 1,
+        .undo = 1
+    },
+    {
+        .id = COMMAND_DIFFERENCE,
+        .command = "difference",
+        .min_args = 0,
+        .gview = 1,
+        .gscene = 1,
+        .undo = 1
+    },
+    {
+        .id = COMMAND_INTERSECTION,
+        .command = "intersection",
+        .min_args = 0,
+        .gview = 1,
+        .gscene = 1,
+        .undo = 1
+    },
+    {
+        .id = COMMAND_OFFSET,
+        .command = "offset",
+        .min_args = 1,
+        .gview = 1,
+        .gscene = 1,
+        .undo = 1
+    },
+    {
+        .id = COMMAND_ADD_HEART,
+        .command = "heart",
+        .min_args = 0,
+        .gview = 1,
+        .gscene = 1,
+        .undo = 1
+    },
+    {
+        .id = COMMAND_ADD_DOLPHIN,
+        .command = "dolphin",
+        .min_args = 0,
+        .gview = 1,
+        .gscene = 1,
+        .undo = 1
+    },
+    {
+        .id = COMMAND_ADD_SNOWFLAKE,
+        .command = "snowflake",
+        .min_args = 0,
+        .gview = 1,
+        .gscene = 1,
+        .undo = 1
+    },
+    {
+        .id = COMMAND_ADD_STAR,
+        .command = "star",
+        .min_args = 0,
+        .gview = 1,
+        .gscene = 1,
+        .undo = 1
+    },
     {
         .id = COMMAND_DO_NOTHING,
         .command = "donothing",
@@ -41,6 +41,34 @@
 #define MAX_ARGS                                20
 #define MAX_COMBOBOXES                         200
 
+/* Bumped whenever the layout of a tombstone record changes. */
+#define TOMBSTONE_VERSION                        2
+
+/* How far the tombstone queue and spill file may outgrow the records they
+ * hold before they are compacted, see TombstoneStore::compact().
+ */
+#define TOMBSTONE_SLACK                         64
+#define TOMBSTONE_SPILL_SLACK              1048576
+
+/* Frame interval for animated zooming, about 60 frames a second. */
+#define ZOOM_FRAME_MSEC                         16
+
+/* The narrowest and widest stretch of scene a view may show, zooms are
+ * clamped so the visible area stays between them.
+ */
+#define ZOOM_IN_LIMIT                       1.0e-10
+#define ZOOM_OUT_LIMIT                      1.0e13
+
+/* Frame interval for stitch simulation playback. */
+#define SIMULATE_FRAME_MSEC                     16
+
+/* The density overlay is counted in tiles of DENSITY_TILE by DENSITY_TILE
+ * cells, and recounted DENSITY_REFRESH_MSEC after the last edit so a drag
+ * doesn't recount on every step.
+ */
+#define DENSITY_TILE                            64
+#define DENSITY_REFRESH_MSEC                   100
+
 #define WIDGET_GROUPBOX                          0
 #define WIDGET_LINEEDIT                          1
 #define WIDGET_CHECKBOX                          2
@@ -198,7 +226,16 @@
 #define COMMAND_SET_RUBBER_MODE                 134
 #define COMMAND_SET_RUBBER_POINT                135
 #define COMMAND_SET_RUBBER_TEXT                 136
-#define N_COMMANDS                              137
+#define COMMAND_RUN                             137
+#define COMMAND_SIMULATE                        138
+#define COMMAND_MATCH_THREADS                   139
+#define COMMAND_DENSITY                         140
+#define COMMAND_SPLIT_HOOP                      141
+#define COMMAND_UNION                           142
+#define COMMAND_DIFFERENCE                      143
+#define COMMAND_INTERSECTION                    144
+#define COMMAND_OFFSET                          145
+#define N_COMMANDS                              146
 
 /* Actions.
  * These identifiers are subject to change since they are in alphabetical order
@@ -494,7 +531,7 @@
  *     TODO: Use color chart in formats/format-dxf.h for this.
  * LTYPE value type - int: See OBJ_LTYPE_VALUES
  * LWT value type - int: 0-27
- * RUBBER value type - int: See OBJ_RUBBER_VALUES
+ * RUBBER value type - int: See the RUBBER_* modes
  */
 #define OBJ_TYPE                                 0
 #define OBJ_NAME                                 1
@@ -505,15 +542,17 @@
 #define OBJ_RUBBER                               6
 
 /* Rubber modes */
-#define RUBBER_CIRCLE_1P_RAD                     0
-#define RUBBER_CIRCLE_1P_DIA                     1
-#define RUBBER_CIRCLE_2P                         2
-#define RUBBER_CIRCLE_3P                         3
+/* NOTE: Allow this enum to evaluate false, indices match rubber_modes. */
+#define RUBBER_OFF                               0
+#define RUBBER_CIRCLE_1P_RAD                     1
+#define RUBBER_CIRCLE_1P_DIA                     2
+#define RUBBER_CIRCLE_2P                         3
+#define RUBBER_CIRCLE_3P                         4
 #define RUBBER_CIRCLE_TTR                        5
 #define RUBBER_CIRCLE_TTT                        6
 #define RUBBER_DIMLEADER_LINE                    7
 #define RUBBER_ELLIPSE_LINE                      8
-#define RUBBER_ELLIPSE_MAJORDIAMETER_MINORDIAMETER 9
+#define RUBBER_ELLIPSE_MAJORDIAMETER_MINORRADIUS 9
 #define RUBBER_ELLIPSE_MAJORRADIUS_MINORRADIUS  10
 #define RUBBER_ELLIPSE_ROTATION                 11
 #define RUBBER_LINE                             12
@@ -523,8 +562,57 @@
 #define RUBBER_POLYLINE                         16
 #define RUBBER_RECTANGLE                        17
 #define RUBBER_TEXTSINGLE                       18
+#define RUBBER_GRIP                             19
+#define RUBBER_IMAGE                            20
 #define N_RUBBER_MODES                          40
 
+/* Rubber point slots, indices match rubber_point_keys.
+ * RUBBER_POINT_QSNAP is never stored: reading it, or any slot that
+ * hasn't been set, gives the scene's current snap point.
+ */
+#define RUBBER_POINT_QSNAP                       0
+#define RUBBER_POINT_GRIP                        1
+#define RUBBER_POINT_LINE_START                  2
+#define RUBBER_POINT_LINE_END                    3
+#define RUBBER_POINT_DIMLEADER_LINE_START        4
+#define RUBBER_POINT_DIMLEADER_LINE_END          5
+#define RUBBER_POINT_ELLIPSE_LINE_POINT1         6
+#define RUBBER_POINT_ELLIPSE_LINE_POINT2         7
+#define RUBBER_POINT_ELLIPSE_AXIS1_POINT1        8
+#define RUBBER_POINT_ELLIPSE_AXIS1_POINT2        9
+#define RUBBER_POINT_ELLIPSE_AXIS2_POINT2       10
+#define RUBBER_POINT_ELLIPSE_CENTER             11
+#define RUBBER_POINT_ELLIPSE_WIDTH              12
+#define RUBBER_POINT_ELLIPSE_ROT                13
+#define RUBBER_POINT_IMAGE_START                14
+#define RUBBER_POINT_IMAGE_END                  15
+#define RUBBER_POINT_CIRCLE_CENTER              16
+#define RUBBER_POINT_CIRCLE_RADIUS              17
+#define RUBBER_POINT_CIRCLE_DIAMETER            18
+#define RUBBER_POINT_CIRCLE_TAN1                19
+#define RUBBER_POINT_CIRCLE_TAN2                20
+#define RUBBER_POINT_CIRCLE_TAN3                21
+#define RUBBER_POINT_POLYGON_CENTER             22
+#define RUBBER_POINT_POLYGON_NUM_SIDES          23
+#define RUBBER_POINT_POLYGON_INSCRIBE_POINT     24
+#define RUBBER_POINT_POLYGON_CIRCUMSCRIBE_POINT 25
+#define RUBBER_POINT_RECTANGLE_START            26
+#define RUBBER_POINT_RECTANGLE_END              27
+#define RUBBER_POINT_TEXT_POINT                 28
+#define RUBBER_POINT_TEXT_HEIGHT_ROTATION       29
+#define N_RUBBER_POINTS                         30
+
+/* Rubber text slots, indices match rubber_text_keys. */
+#define RUBBER_TEXT_FONT                         0
+#define RUBBER_TEXT_JUSTIFY                      1
+#define RUBBER_TEXT_RAPID                        2
+#define N_RUBBER_TEXTS                           3
+
+/* Spare rubber: negative ids that spare every rubber object of a type. */
+#define SPARE_RUBBER_PATH                       -1
+#define SPARE_RUBBER_POLYGON                    -2
+#define SPARE_RUBBER_POLYLINE                   -3
+
 /* Justify */
 #define JUSTIFY_LEFT                             0
 #define JUSTIFY_CENTER                           1
@@ -771,7 +859,148 @@
 #define ST_GRID_SPACING_X                      112
 #define ST_GRID_SPACING_Y                      113
 
-#define SETTINGS_TOTAL                         114
+#define ST_UNDO_MEMORY_BUDGET                  114
+#define ST_ZOOM_ANIMATION_FRAMES               115
+
+/* Fill stitch settings. */
+#define ST_FILL_SPACING                        116
+#define ST_FILL_ANGLE                          117
+#define ST_FILL_STITCH_LENGTH                  118
+#define ST_FILL_STAGGER                        119
+
+/* Column stitch settings. */
+#define ST_COLUMN_WIDTH                        120
+#define ST_COLUMN_SPACING                      121
+#define ST_PULL_COMPENSATION                   122
+#define ST_MAX_STITCH_LENGTH                   123
+#define ST_MIN_STITCH_LENGTH                   124
+#define ST_DENSITY_CELL                        125
+#define ST_DENSITY_LIMIT                       126
+#define ST_HOOP_WIDTH                          127
+#define ST_HOOP_HEIGHT                         128
+#define ST_HOOP_OVERLAP                        129
+
+#define SETTINGS_TOTAL                         130
+#define SETTINGS_HASH_SIZE                     512
+#define COMMAND_HASH_SIZE                      512
+#define FNV1A_OFFSET                   2166136261u
+
+/* Compiled scripts kept by cached_script(), and how deeply actuator()
+ * calls may nest.
+ */
+#define SCRIPT_CACHE_SIZE                       64
+#define ACTUATOR_MAX_DEPTH                      32
+
+/* The parts of the interface to refresh when a setting changes,
+ * see setting_refresh().
+ */
+#define REFRESH_MDI_BACKGROUND              0x0001
+#define REFRESH_ICON_SIZE                   0x0002
+#define REFRESH_SCROLLBARS                  0x0004
+#define REFRESH_CROSSHAIR                   0x0008
+#define REFRESH_BACKGROUND                  0x0010
+#define REFRESH_SELECTBOX                   0x0020
+#define REFRESH_PROMPT                      0x0040
+#define REFRESH_GRID                        0x0080
+#define REFRESH_RULER                       0x0100
+#define REFRESH_LINEWEIGHT                  0x0200
+#define REFRESH_PICK_ADD                    0x0400
+#define REFRESH_LANGUAGE                    0x0800
+
+/* Parametric designs, see curve_points(). */
+#define DESIGN_HEART4                            0
+#define DESIGN_HEART5                            1
+#define DESIGN_DOLPHIN                           2
+#define DESIGN_SNOWFLAKE                         3
+
+/* Terms advanced together by fourier_series_batch() and the number of
+ * samples between fresh seeds of its recurrence.
+ */
+#define FOURIER_LANES                           64
+#define FOURIER_BLOCK                          256
+
+/* Deepest bisection curve_points() will do on one sample interval. */
+#define CURVE_MAX_DEPTH                          8
+
+/* Stitch sequencing, see src/stitch.c. Lengths are in millimetres. */
+#define SEQUENCE_JOIN_TOLERANCE               0.05
+#define SEQUENCE_TRIM_LENGTH                   3.0
+#define SEQUENCE_ENTRY_SAMPLES                  16
+#define SEQUENCE_TIME_BUDGET_MSEC             2000
+
+/* Fill stitching, see fill_region(). A row joins on to the row before it
+ * only if the step between their ends is under FILL_JOIN_ROWS rows long,
+ * otherwise it starts a new run.
+ */
+#define FILL_JOIN_ROWS                         4.0
+
+/* Fishbone columns, see column_stitches(). Each stitch reaches
+ * FISHBONE_OVERLAP of the way from the middle to the far side, landing
+ * FISHBONE_SLANT rows further along.
+ */
+#define FISHBONE_OVERLAP                      0.25
+#define FISHBONE_SLANT                         2.0
+
+/* Two open subpaths are only a pair of satin rails, see column_rails(),
+ * if at each of COLUMN_RAIL_SAMPLES points along them they are no more
+ * than COLUMN_MAX_WIDTH mm apart and stay on the same side of each other.
+ */
+#define COLUMN_RAIL_SAMPLES                     16
+#define COLUMN_MAX_WIDTH                      12.0
+
+/* The machine, see estimate_stitch(). The frame accelerates at
+ * MACHINE_ACCELERATION mm/s^2, and after a trim or stop the needle takes
+ * MACHINE_RAMP_STITCHES stitches to get back up to speed. Each stitch
+ * takes THREAD_PER_PENETRATION mm of top thread into the fabric besides
+ * its length, each trim leaves THREAD_TRIM_TAIL mm behind, and the
+ * bobbin gives BOBBIN_RATIO of the top thread's length.
+ */
+#define MACHINE_TRIM_SECONDS                   2.0
+#define MACHINE_STOP_SECONDS                  10.0
+#define MACHINE_ACCELERATION                2000.0
+#define MACHINE_RAMP_STITCHES                   10
+#define THREAD_PER_PENETRATION                 1.2
+#define THREAD_TRIM_TAIL                       5.0
+#define BOBBIN_RATIO                          0.33
+
+/* Splitting a design between hoops, see hoop_plan(). A design may take
+ * up to HOOP_MAX_SIDE hoops each way, and the registration crosses have
+ * arms of up to HOOP_MARK_SIZE mm.
+ */
+#define HOOP_MAX_SIDE                           32
+#define HOOP_MARK_SIZE                         5.0
+
+/* What hoop_plan() returns, see hoop_message(). */
+#define HOOP_OK                                  0
+#define HOOP_NO_OVERLAP                          1
+#define HOOP_TOO_MANY                            2
+#define HOOP_NO_MEMORY                           3
+
+/* Polygon clipping, see polygon_boolean(). Shapes are snapped to a grid
+ * of CLIP_SCALE steps per mm, which keeps the arithmetic exact as long as
+ * they stay within CLIP_LIMIT mm of the origin. An offset keeps a shape
+ * to within OFFSET_TOLERANCE mm and rounds the corners it grows with
+ * OFFSET_ARC_STEPS steps to the full turn.
+ */
+#define CLIP_SCALE                          1000.0
+#define CLIP_LIMIT                       1000000.0
+#define OFFSET_TOLERANCE                     0.005
+#define OFFSET_ARC_STEPS                        64
+
+/* Qt flattens curves into pieces to within half a unit, so outlines are
+ * flattened at CLIP_CURVE_SCALE times their size in mm before clipping.
+ */
+#define CLIP_CURVE_SCALE                     100.0
+
+/* Polygon boolean operations. */
+#define CLIP_UNION                               0
+#define CLIP_INTERSECTION                        1
+#define CLIP_DIFFERENCE                          2
+
+/* Fill rules: which places a set of rings counts as inside. */
+#define CLIP_EVEN_ODD                            0
+#define CLIP_NONZERO                             1
+#define CLIP_POSITIVE                            2
 
 /* Editor keys */
 #define ED_GENERAL_LAYER                         0
@@ -915,6 +1144,7 @@
 #define VIEW_STATE_SIMULATE                  0x200
 #define VIEW_STATE_SNAP                      0x400
 #define VIEW_STATE_RULER                     0x800
+#define VIEW_STATE_DENSITY                  0x1000
 
 /* Preview mode */
 #define PREVIEW_MODE_NULL                        0
@@ -1060,13 +1290,6 @@ typedef struct ViewData_ {
     uint8_t qSnapActive;
 } ViewData;
 
-/* . */
-typedef struct RubberPoint_ {
-    char key[MAX_STRING_LENGTH];
-    char text[MAX_STRING_LENGTH];
-    EmbVector position;
-} RubberPoint;
-
 /* . */
 typedef struct UndoData_ {
     EmbVector pivot;
@@ -1100,6 +1323,13 @@ const char *actuator(char string[MAX_STRING_LENGTH]);
 int string_equal(const char *a, const char *b);
 void emb_sleep(int seconds);
 int string_array_length(const char *list[]);
+int string_array_index(const char *list[], const char *entry);
+uint32_t fnv1a_hash(const char *str);
+uint32_t fnv1a_extend(uint32_t h, const char *str);
+int setting_index(const char *key);
+int command_index(const char *name, int length);
+void set_node(Node *n, int type, const char *value);
+int node_equal(Node *a, Node *b, int type);
 bool save_current_file(const char *fileName);
 
 const char *run_script_file(char *fname);
@@ -1109,17 +1339,257 @@ const char *translate(char *str);
 /* Utility Functions. */
 unsigned char validRGB(int r, int g, int b);
 int str_contains(char *s, char c);
-EmbReal fourier_series(EmbReal arg, EmbReal *terms, int n_terms);
+EmbReal fourier_series(EmbReal arg, const EmbReal *terms, int n_terms);
+void fourier_series_batch(const EmbReal *terms, int n_terms, EmbReal t0,
+    EmbReal h, int n, EmbReal *out);
+int curve_points(int design, int numPoints, EmbVector scale,
+    EmbReal tolerance, EmbVector *out, int max_out);
+int star_points(EmbVector center, EmbVector outer, EmbReal inner_radius,
+    int numPoints, EmbVector *out);
 bool willUnderflowInt32(int64_t a, int64_t b);
 bool willOverflowInt32(int64_t a, int64_t b);
 int roundToMultiple(bool roundUp, int numToRound, int multiple);
 int tokenize(char **argv, char *str, const char delim);
 void emb_sleep(int seconds);
 char *platformString(void);
+int64_t peak_memory_kb(void);
 void get_n_reals(float result[], char *argv[], int n, int offset);
 void clear_selection(void);
 void prompt_output(char *s);
 
+/* A run of stitches sewn in one piece in one colour. A closed run may be
+ * entered at any of its points and is sewn round back to that point.
+ */
+typedef struct StitchRun_ {
+    EmbVector *points;
+    int count;
+    int color;
+    int closed;
+} StitchRun;
+
+/* One run in a stitching order: which way an open run is sewn, or where
+ * a closed run is entered.
+ */
+typedef struct StitchStep_ {
+    int run;
+    int reversed;
+    int entry;
+} StitchStep;
+
+/* How the sequencer asks whether it has run out of time: expired(data)
+ * returns non-zero once it has. A NULL deadline never passes.
+ */
+typedef struct SequenceDeadline_ {
+    int (*expired)(void *data);
+    void *data;
+} SequenceDeadline;
+
+EmbVector step_entry(const StitchRun *runs, StitchStep s);
+EmbVector step_exit(const StitchRun *runs, StitchStep s);
+EmbReal sequence_travel(const StitchRun *runs, const StitchStep *steps, int n,
+    EmbVector start);
+void sequence_count(const StitchRun *runs, const StitchStep *steps, int n,
+    EmbReal trim_length, int *jumps, int *trims);
+void sequence_nearest(const StitchRun *runs, const int *members, int n,
+    int first, StitchStep *steps, const SequenceDeadline *deadline);
+int sequence_2opt_pass(const StitchRun *runs, StitchStep *steps, int n,
+    const SequenceDeadline *deadline);
+int sequence_oropt_pass(const StitchRun *runs, StitchStep *steps, int n,
+    const SequenceDeadline *deadline);
+void sequence_entries(const StitchRun *runs, StitchStep *steps, int n,
+    EmbVector start);
+void sequence_reverse(StitchStep *steps, int n);
+
+/* The stitches of a fill as open runs, run i being the points from
+ * run_ends[i-1] (or 0) up to run_ends[i].
+ */
+typedef struct FillStitches_ {
+    EmbVector *points;
+    int count;
+    int capacity;
+    int *run_ends;
+    int runs;
+    int run_capacity;
+} FillStitches;
+
+int fill_region(const EmbVector *points, const int *ring_ends, int rings,
+    EmbReal spacing, EmbReal angle, EmbReal stitch_length, int stagger,
+    FillStitches *fill);
+void fill_free(FillStitches *fill);
+
+/* Takes each stitch of a generator as it is made. */
+typedef void (*StitchEmit)(void *data, EmbVector v);
+
+int column_rails(const EmbVector *left, int n_left,
+    const EmbVector *right, int n_right, int *reversed);
+void column_stitches(const EmbVector *left, int n_left,
+    const EmbVector *right, int n_right, EmbReal width, EmbReal spacing,
+    EmbReal pull, int style, StitchEmit emit, void *data);
+
+/* Takes each stitch a StitchFilter lets through. */
+typedef void (*StitchWrite)(void *data, EmbReal x, EmbReal y, int flags);
+
+/* The last pass over the stitches on their way into a pattern, see
+ * filter_stitch(). It holds at most one stitch back at a time.
+ */
+typedef struct StitchFilter_ {
+    EmbReal max_length;
+    EmbReal min_length;
+    int trim_jumps;
+    EmbReal trim_length;
+    StitchWrite write;
+    void *data;
+
+    EmbVector at;
+    int started;
+    int jumps;
+    EmbReal jump_length;
+    int trimmed;
+    int held;
+    EmbVector held_at;
+
+    int stitches_in;
+    int stitches_out;
+    int split;
+    int dropped;
+    int trims;
+} StitchFilter;
+
+void filter_init(StitchFilter *f, EmbReal max_length, EmbReal min_length,
+    int trim_jumps, EmbReal trim_length, StitchWrite write, void *data);
+void filter_stitch(StitchFilter *f, EmbReal x, EmbReal y, int flags);
+
+/* Running totals of the time and thread a machine takes over a design,
+ * see estimate_stitch().
+ */
+typedef struct StitchEstimate_ {
+    EmbReal stitch_time;
+    EmbReal needle_speed;
+
+    EmbVector at;
+    int started;
+    int ramp;
+
+    EmbReal seconds;
+    int stitches;
+    int jumps;
+    int trims;
+    int stops;
+    EmbReal *top;
+    int colors;
+    int color_capacity;
+    EmbReal bobbin;
+} StitchEstimate;
+
+void estimate_init(StitchEstimate *e, EmbReal stitch_time,
+    EmbReal needle_speed);
+EmbReal estimate_stitch(StitchEstimate *e, EmbReal x, EmbReal y, int flags);
+void estimate_pattern(StitchEstimate *e, EmbPattern *pattern);
+void estimate_free(StitchEstimate *e);
+
+/* Stitches per square millimetre counted in square cells of side cell
+ * mm, row by row from the corner at origin.
+ */
+typedef struct DensityGrid_ {
+    float *cells;
+    int columns;
+    int rows;
+    EmbVector origin;
+    EmbReal cell;
+} DensityGrid;
+
+/* What density_pattern() found: the densest cell and the groups of
+ * touching cells over the limit.
+ */
+typedef struct DensityReport_ {
+    EmbReal peak;
+    EmbVector peak_at;
+    int regions;
+    EmbReal area;
+} DensityReport;
+
+void density_add_run(DensityGrid *g, const EmbVector *points, int count);
+void density_report(const DensityGrid *g, EmbReal limit,
+    DensityReport *report);
+int density_pattern(EmbPattern *pattern, EmbReal cell, EmbReal limit,
+    DensityReport *report);
+
+/* One hooping of a split design: where the hoop's field sits on the
+ * design and the part of the design it sews.
+ */
+typedef struct HoopTile_ {
+    EmbRect field;
+    EmbRect cut;
+    int column;
+    int row;
+    int stitches;
+} HoopTile;
+
+/* The hoops a design is split between, in rows of columns, with the
+ * empty ones left out. width and height are the hoop turned the way it
+ * is used.
+ */
+typedef struct HoopPlan_ {
+    HoopTile *tiles;
+    int count;
+    int columns;
+    int rows;
+    EmbReal width;
+    EmbReal height;
+    EmbReal overlap;
+} HoopPlan;
+
+int hoop_plan(HoopPlan *plan, EmbPattern *pattern, EmbReal width,
+    EmbReal height, EmbReal overlap);
+int hoop_pattern(const HoopPlan *plan, int index, EmbPattern *from,
+    EmbPattern *to);
+void hoop_free(HoopPlan *plan);
+const char *hoop_message(int status);
+
+/* A colour in CIELAB. */
+typedef struct LabColor_ {
+    EmbReal l;
+    EmbReal a;
+    EmbReal b;
+} LabColor;
+
+/* Nearest colour lookups over a thread catalog: a k-d tree on L, a, b
+ * kept in the arrays themselves, each range split by its middle entry.
+ * entries holds the catalog position of each colour.
+ */
+typedef struct ColorIndex_ {
+    LabColor *colors;
+    int *entries;
+    int count;
+} ColorIndex;
+
+LabColor rgb_to_lab(unsigned char r, unsigned char g, unsigned char b);
+EmbReal delta_e(LabColor x, LabColor y);
+int color_index_build(ColorIndex *index, const unsigned char *rgb, int count);
+int color_index_nearest(const ColorIndex *index, LabColor c,
+    EmbReal *distance);
+void color_index_free(ColorIndex *index);
+
+/* Closed rings of points, one after another; ring_ends holds the index
+ * one past the last point of each ring.
+ */
+typedef struct PolygonSet_ {
+    EmbVector *points;
+    int count;
+    int capacity;
+    int *ring_ends;
+    int rings;
+    int ring_capacity;
+} PolygonSet;
+
+int polygon_add_point(PolygonSet *set, EmbVector p);
+int polygon_close_ring(PolygonSet *set);
+void polygon_free(PolygonSet *set);
+int polygon_boolean(const PolygonSet *subject, int subject_rule,
+    const PolygonSet *clip, int clip_rule, int op, PolygonSet *result);
+int polygon_offset(const PolygonSet *subject, int rule, EmbReal distance,
+    PolygonSet *result);
+
 /* The Settings System
  *
  * Rather than pollute the global namespace, we collect together all the global
@@ -1189,6 +1659,9 @@ extern const int32_t group_box_ids[];
 
 extern char *coverage_test_script[];
 extern const char *geometry_subcommands[];
+extern const char *rubber_modes[];
+extern const char *rubber_point_keys[];
+extern const char *rubber_text_keys[];
 
 /* Widget data */
 extern WidgetData grid_geometry_widgets[];
@@ -20,6 +20,9 @@
 
 #include <vector>
 #include <string>
+#include <set>
+#include <functional>
+#include <mutex>
 
 /* From this source code directory. */
 #include "core.h"
@@ -42,6 +45,8 @@ class PropertyEditor;
 class UndoEditor;
 class MainWindow;
 class Geometry;
+class TranslationCatalog;
+class SessionLog;
 
 /* Global variables. */
 extern MdiArea* mdiArea;
@@ -51,9 +56,23 @@ extern PropertyEditor* dockPropEdit;
 extern UndoEditor* dockUndoEdit;
 extern StatusBar* statusbar;
 extern QAction* actionHash[MAX_ACTIONS];
+extern TranslationCatalog translations;
+extern SessionLog session_log;
+extern std::mutex pattern_io;
+extern bool background_busy;
+
+/* One hooping of a design written by split_hoops(). */
+typedef struct HoopFile_ {
+    std::string file;
+    int column;
+    int row;
+    int stitches;
+    int ok;
+} HoopFile;
 
 /* Functions in the global namespace */
 QString translate_str(const char *str);
+void startup_phase(const char *fmt, ...);
 bool contains(std::vector<std::string>, std::string);
 bool validFileFormat(std::string fileName);
 QString fileExtension(std::string fileName);
@@ -64,10 +83,25 @@ std::string convert_args_to_type(
     const char *args_template,
     std::vector<Node> a);
 
-void add_polyline(QPainterPath p, std::string rubberMode);
+void add_polyline(QPainterPath p, int32_t rubberMode);
+void add_design(int design, EmbVector position);
+void add_star(EmbVector center, EmbReal radius, int numPoints);
+QStringList build_stitches(View* view, EmbPattern* pattern);
+void object_stitch_runs(View* view, Geometry* obj,
+    std::vector<std::vector<EmbVector>>& runs);
+int split_hoops(EmbPattern* pattern, QString fileName, EmbReal width,
+    EmbReal height, EmbReal overlap, std::vector<HoopFile>& files);
+bool object_polygons(Geometry* obj, PolygonSet* set);
+QPainterPath polygon_path(const PolygonSet* set);
+QString format_run_time(EmbReal seconds);
+void parallel_for(int count, const std::function<void(int)>& fn);
+void run_in_background(const std::function<void()>& fn);
+void benchmark_object_memory(int count);
+void benchmark_stitches(void);
 
 View *activeView(void);
 QGraphicsScene* activeScene();
+View *scene_view(QGraphicsScene *scene);
 
 void set_enabled(QObject *parent, const char *key, bool enabled);
 void set_visibility(QObject *parent, const char *name, bool visibility);
@@ -79,6 +113,18 @@ EmbVector to_EmbVector(QPointF a);
 QIcon swatch(int32_t c);
 QWidget *make_widget(QWidget *parent, Node *d, WidgetData data);
 
+/* Interactive state for an object while it is being drawn or gripped.
+ * Allocated on first use and freed by vulcanize, so placed objects don't
+ * pay for it.
+ */
+typedef struct RubberData_ {
+    uint64_t pointsSet;
+    QPointF points[N_RUBBER_POINTS];
+    QString texts[N_RUBBER_TEXTS];
+    std::vector<QPointF> vertices;
+    bool verticesChanged;
+} RubberData;
+
 /* The Geometry class
  *
  * Combine all geometry objects into one class that uses the Type
@@ -88,15 +134,13 @@ QWidget *make_widget(QWidget *parent, Node *d, WidgetData data);
 class Geometry : public QGraphicsPathItem
 {
 public:
-    GeometryData gdata;
+    ShapeData gdata;
 
     QPen objPen;
     QPen lwtPen;
     QLineF objLine;
-    std::string objRubberMode = "OBJ_RUBBER_OFF";
-    std::vector<RubberPoint> rubber_points;
-    QHash<QString, QPointF> objRubberPoints;
-    QHash<QString, QString> objRubberTexts;
+    int32_t objRubberMode = RUBBER_OFF;
+    RubberData* rubber = 0;
     int64_t objID;
     int64_t mode;
 
@@ -122,8 +166,6 @@ public:
     QString objTextJustify;
     QPainterPath objTextPath;
 
-    EmbVector positions[MAX_POSITIONS];
-
     int gripIndex;
 
     int Type = OBJ_TYPE_BASE;
@@ -140,13 +182,18 @@ public:
 
     /* Alter state */
     void setFlag_(uint64_t new_flag) { flags |= new_flag; }
+    void setRubberPoint(int32_t slot, const QPointF& point);
+    bool setRubberVertex(int32_t index, const QPointF& point);
+    void setRubberText(int32_t slot, const QString& txt);
+    void clearRubberPoints(void);
     void unsetFlag_(uint64_t new_flag) { flags ^= new_flag; }
 
     /* Getters */
     Qt::PenStyle objectLineType() { return objPen.style(); }
     EmbReal objectLineWeight() { return lwtPen.widthF(); }
-    QPointF objectRubberPoint(QString key);
-    QString objectRubberText(QString key);
+    QPointF objectRubberPoint(int32_t slot);
+    QString objectRubberText(int32_t slot) { return rubber ? rubber->texts[slot] : QString(); }
+    const char* typeName() { return object_type_name(Type); }
 
     QPointF objectTopLeft();
     QPointF objectTopRight();
@@ -199,6 +246,8 @@ public:
 
     void updatePath();
     void updatePath(const QPainterPath& p);
+    void setShape(const QPainterPath& p);
+    void boundsChanged(bool shape);
     void updateLeader(void);
 
     virtual QRectF boundingRect();
@@ -213,6 +262,7 @@ public:
 
     void realRender(QPainter* painter, const QPainterPath& renderPath);
     void paint(QPainter*, const QStyleOptionGraphicsItem*, QWidget*);
+    QVariant itemChange(GraphicsItemChange change, const QVariant& value);
 
     /* Updaters, todo: combine */
     void calculateArcData(EmbArc arc);
@@ -227,6 +277,7 @@ public:
     void init_point(EmbVector pos);
 
     void setObjectPos(const QPointF& point) { setPos(point.x(), point.y()); }
+    void setObjectColor(QRgb rgb);
     void setObjectCenter(EmbVector center);
     void setObjectSize(EmbReal width, EmbReal height);
     void setObjectRect(EmbReal x, EmbReal y, EmbReal w, EmbReal h);
@@ -260,6 +311,10 @@ public:
     void setObjectDiameterMajor(EmbReal diameter);
     void setObjectDiameterMinor(EmbReal diameter);
 
+    /* Tombstone records */
+    QByteArray serialize(void);
+    static Geometry *deserialize(QByteArray record);
+
     /* Scripted commands, uses the script string in */
     void script_main(void);
     void script_click(EmbVector v);
@@ -420,6 +475,12 @@ public:
     uint32_t colorTotal;
     uint32_t colorChanges;
 
+    EmbReal runSeconds = 0.0;
+    EmbReal bobbinLength = 0.0;
+    std::vector<EmbReal> threadLengths;
+    std::vector<QRgb> threadColors;
+    DensityReport density = {};
+
     QRectF boundingRect;
 };
 
@@ -458,6 +519,63 @@ public:
         QString lineWeight, const bool print);
 };
 
+/* Every icon of one theme, packed into a sheet per icon size.
+ *
+ * Asking for an icon only hands out a slot number; nothing is read from
+ * disk until an icon is first drawn. The first draw at a given size loads
+ * that size's sheet from the cache directory in one read, or builds it
+ * from the theme's PNGs and saves it there for the next start. Slots are
+ * kept in the order of the cached index, so the sheets stay valid between
+ * runs while new icons are appended. A cached sheet is named after the
+ * modification time and size of every icon in it, so editing or replacing
+ * any one icon rebuilds it. Sizes are in device pixels.
+ */
+class IconAtlas
+{
+public:
+    IconAtlas(QString theme);
+
+    int32_t slot(const QString& stub);
+    QPixmap pixmap(int32_t slot, int size, qreal dpr);
+
+    QString theme;
+    int32_t filesRead = 0;
+    int32_t sheetsBuilt = 0;
+
+private:
+    const QPixmap& sheet(int size);
+    QString cachePath(int size);
+    QString fingerprint();
+    void saveIndex();
+
+    QString themeDir;
+    QString cacheDir;
+    QStringList stubs;
+    QHash<QString, int32_t> slots;
+    QHash<int, QPixmap> sheets;
+    QHash<int, int32_t> sheetCounts;
+    QHash<int64_t, QPixmap> cells;
+    QString stamp;
+    int32_t stampCount = -1;
+};
+
+/* Draws one slot of an IconAtlas, so an icon costs nothing until shown. */
+class AtlasIconEngine : public QIconEngine
+{
+public:
+    AtlasIconEngine(IconAtlas* atlas, int32_t slot) : atlas(atlas), iconSlot(slot) {}
+
+    void paint(QPainter* painter, const QRect& rect, QIcon::Mode mode, QIcon::State state) override;
+    QPixmap pixmap(const QSize& size, QIcon::Mode mode, QIcon::State state) override;
+    QPixmap scaledPixmap(const QSize& size, QIcon::Mode mode, QIcon::State state, qreal scale) override;
+    QIconEngine* clone() const override { return new AtlasIconEngine(atlas, iconSlot); }
+    QString key() const override { return "AtlasIconEngine"; }
+
+private:
+    IconAtlas* atlas;
+    int32_t iconSlot;
+};
+
 /* The MainWindow class. */
 class MainWindow: public QMainWindow
 {
@@ -489,6 +607,9 @@ public:
     QIcon create_icon(QString stub);
     QIcon create_icon(int32_t stub);
 
+    IconAtlas* icons = NULL;
+    int32_t actionIcons[MAX_ACTIONS];
+
 public slots:
 
     void onCloseWindow();
@@ -515,6 +636,8 @@ public slots:
 protected:
     virtual void resizeEvent(QResizeEvent*);
     void closeEvent(QCloseEvent *event);
+    void changeEvent(QEvent* event);
+    void retranslate();
     void loadFormats();
 
     bool shiftKeyPressedState;
@@ -658,9 +781,17 @@ public:
     QPixmap bgLogo;
     QPixmap bgTexture;
     QColor bgColor;
+    QString bgLogoFile;
+    QString bgTextureFile;
+
+    /* The color, texture and logo composited at the viewport size. */
+    QPixmap bgCache;
+    bool bgCacheValid;
 
     void zoomExtentsAllSubWindows();
-    void forceRepaint();
+    void applyBackgroundSettings(Node *d);
+    void invalidateBackground();
+    void rebuildBackground();
 
     MdiArea(QWidget* parent = 0)
     {
@@ -669,6 +800,7 @@ public:
         useLogo = false;
         useTexture = false;
         useColor = false;
+        bgCacheValid = false;
     }
 
     ~MdiArea() {}
@@ -756,6 +888,7 @@ public:
     QGroupBox *createGroupBox(int group_box_key, const char *title);
 
     QGroupBox *groupBoxes[GB_TOTAL];
+    QVBoxLayout *groupBoxLayout;
 
 protected:
     bool eventFilter(QObject *obj, QEvent *event);
@@ -769,6 +902,7 @@ public slots:
 
 private slots:
     void fieldEdited(QObject* fieldObj);
+    void buildGroups(int objType);
     void showGroups(int objType);
     void showOneType(int index);
     void hideAllGroups();
@@ -924,8 +1058,11 @@ public:
     void redo();
     void mirror();
     void rotate(EmbVector pivot, EmbReal rot);
+    Geometry* target();
 
     Geometry* object;
+    int64_t objID;
+    int64_t restoreCount;
     View* gview;
     std::string command;
     EmbVector delta;
@@ -940,9 +1077,341 @@ public:
     QPointF fromCenter;
     QPointF toCenter;
     QLineF mirrorLine;
+    QRgb fromColor;
+    QRgb toColor;
     bool done;
 };
 
+/* Compact storage for objects that have been removed from the scene.
+ *
+ * Rather than keeping every deleted Geometry alive until the View is
+ * destroyed, each one is packed into a compressed record and the object
+ * itself is freed. Once the records held in memory exceed the budget
+ * the oldest are spilled to a temporary file.
+ */
+class TombstoneStore
+{
+public:
+    TombstoneStore();
+    ~TombstoneStore();
+
+    void bury(Geometry* obj);
+    Geometry* exhume(int64_t id);
+    bool contains(int64_t id) { return records.contains(id); }
+    void setBudget(int64_t bytes);
+    void clear();
+
+    int64_t budget;
+    int64_t memoryUsed;
+    int64_t diskUsed;
+    int64_t restoreCount;
+
+private:
+    typedef struct Tombstone_ {
+        QByteArray blob;
+        int64_t offset;
+        int32_t size;
+    } Tombstone;
+
+    void enforceBudget();
+    void compact();
+
+    QHash<int64_t, Tombstone> records;
+    QQueue<int64_t> order;
+    QTemporaryFile* spill;
+};
+
+/* The bounding box of a set of rectangles, kept up to date as members are
+ * added, moved and removed.
+ *
+ * Each edge is a sorted multiset so removing the outermost member costs
+ * O(log n) rather than a pass over every member, and reading the box is O(1).
+ */
+class ExtentsIndex
+{
+public:
+    void insert(const void* key, const QRectF& rect);
+    void remove(const void* key);
+    void clear();
+    int count() { return rects.size(); }
+    QRectF extents();
+
+private:
+    QHash<const void*, QRectF> rects;
+    std::multiset<qreal> left;
+    std::multiset<qreal> top;
+    std::multiset<qreal> right;
+    std::multiset<qreal> bottom;
+};
+
+/* The translated strings for the current language.
+ *
+ * The translations themselves are the .qm catalogs compiled from the .ts
+ * sources at build time, which QTranslator maps into memory and searches
+ * by hash. Every string is looked up there once and kept here, keyed by
+ * its source text, so after the first use a lookup is one hash probe and
+ * hands back a shared QString or a stable UTF-8 pointer without
+ * allocating. Changing language swaps the catalogs and empties the cache,
+ * nothing has to be rebuilt.
+ */
+class TranslationCatalog
+{
+public:
+    ~TranslationCatalog();
+
+    void setLanguage(QString lang);
+    const QString& text(const char *source);
+    const char *utf8(const char *source);
+
+    QString language;
+
+private:
+    typedef struct Entry_ {
+        QString text;
+        QByteArray utf8;
+    } Entry;
+
+    Entry& lookup(const char *source);
+    void unload();
+
+    QHash<QByteArray, Entry> entries;
+    std::vector<QTranslator*> translators;
+};
+
+/* One line of a compiled script. The offsets point into the script's
+ * text and the argument arrays, argument 0 being the command name.
+ */
+typedef struct ScriptOp_ {
+    int32_t id;
+    int32_t line;
+    int32_t args;
+    int32_t argv;
+    int32_t argc;
+} ScriptOp;
+
+/* A script parsed once into a flat list of operations.
+ *
+ * Compiling looks each command up in command_table, splits the arguments
+ * and converts them to numbers, so running the script again only has to
+ * dispatch on the ids. Compiled scripts are cached by the hash of their
+ * text in run_script() and run_script_file(), see cached_script().
+ */
+class CompiledScript
+{
+public:
+    void compile(const char *const *lines, int n);
+    bool matches(const char *const *lines, int n);
+    const char *step(int i);
+    const char *run(void);
+
+    uint32_t hash = 0;
+    uint64_t lastUsed = 0;
+    bool running = false;
+    std::vector<ScriptOp> ops;
+    std::vector<char> text;
+    std::vector<int32_t> argv;
+    std::vector<EmbReal> reals;
+    std::string source;
+    std::string output;
+
+private:
+    void add_line(const char *line);
+};
+
+/* A timestamped log of the commands and mouse input of a session.
+ *
+ * With --record every top level command given to actuator() and every
+ * mouse event on a view is written out, one per line, as the milliseconds
+ * since recording started, the event and its arguments. --replay runs a
+ * log back as fast as it will go, against whichever design files are
+ * also given, then reports the latency of each command as percentiles,
+ * how often the views were repainted and the peak memory used.
+ * While replaying the tip of the day isn't shown at startup.
+ */
+class SessionLog
+{
+public:
+    bool record(const char *fname);
+    void command(const char *line);
+    void mouse(const char *type, QPointF pos, int button, int buttons,
+        int modifiers);
+    int replay(const char *fname);
+
+    int64_t repaints = 0;
+    bool replaying = false;
+
+private:
+    FILE *file = NULL;
+    QElapsedTimer clock;
+};
+
+/* The ids of the objects in one document and the objects they belong to.
+ *
+ * Ids come from a counter that only goes up, so no two objects in a
+ * document ever share one, even when thousands are made in the same
+ * millisecond, and a deleted object's id is never handed to a new one.
+ * An object keeps its id while it sits in the tombstone store and gets it
+ * back when it is restored. Lookups by id are a single hash probe.
+ */
+class ObjectTable
+{
+public:
+    int64_t insert(Geometry* obj);
+    void remove(Geometry* obj);
+    Geometry* find(int64_t id) { return objects.value(id, NULL); }
+    void clear();
+    int count() { return objects.size(); }
+
+private:
+    int64_t next = 1;
+    QHash<int64_t, Geometry*> objects;
+};
+
+/* Zooming and scene rect growth for a View.
+ *
+ * The transform for a zoom about a point is worked out directly, so a step
+ * costs one setTransform and one centerOn. The scene rect grows
+ * geometrically, so a long zoom out or pan only resizes it a handful of
+ * times. With ST_ZOOM_ANIMATION_FRAMES above 1 the zoom is spread over that
+ * many frames of a fixed duration; late frames are dropped, not stretched.
+ */
+class ViewNavigator
+{
+public:
+    void attach(View* v);
+    void zoomAbout(const QPointF& scenePoint, const QPoint& viewPoint, EmbReal factor);
+    void growSceneRect(const QRectF& visible);
+    void finish();
+    bool animating() { return timer.isActive(); }
+    EmbReal scale();
+    EmbReal minScale();
+    EmbReal maxScale();
+
+    int32_t frames = 0;
+
+private:
+    void applyScale(EmbReal s);
+    void step();
+    void end();
+
+    View* view = 0;
+    QGraphicsView::ViewportAnchor savedAnchor = QGraphicsView::AnchorViewCenter;
+    QTimer timer;
+    QElapsedTimer clock;
+    QPointF anchorScene;
+    QPoint anchorView;
+    EmbReal startScale = 1.0;
+    EmbReal targetScale = 1.0;
+};
+
+/* Stitch by stitch playback of what a View's design sews, shown while
+ * the view is in VIEW_STATE_SIMULATE.
+ *
+ * The time each stitch finishes is kept as a running total, so finding
+ * the stitch for any moment, to play or to seek, is a binary search.
+ * The stitches sewn so far are kept drawn in a frame at the view's
+ * scale, and each tick draws only those sewn since the last one; the
+ * frame is only redrawn whole after a zoom, pan, resize or seek back.
+ */
+class StitchSimulation
+{
+public:
+    void attach(View* v);
+    bool start(EmbReal speed);
+    void stop();
+    void seek(EmbReal seconds);
+    void draw(QPainter* painter);
+    bool playing() { return timer.isActive(); }
+    EmbReal duration() { return times.empty() ? 0.0 : times.back(); }
+    EmbReal position();
+
+private:
+    void step();
+    void render(int upto);
+
+    View* view = 0;
+    QTimer timer;
+    QElapsedTimer clock;
+    std::vector<QPointF> points;
+    std::vector<int> flags;
+    std::vector<QRgb> colors;
+    std::vector<EmbReal> times;
+    EmbReal speed = 1.0;
+    EmbReal offset = 0.0;
+    int shown = 0;
+    QImage frame;
+    QTransform frameTransform;
+};
+
+/* A map of stitches per square millimetre over a View's design, shown
+ * over it while the view is in VIEW_STATE_DENSITY.
+ *
+ * Each object's stitches are planned on their own and kept, and the map
+ * is counted in tiles of DENSITY_TILE cells a side, each on its own core.
+ * When objects change only they are planned again, and only the tiles
+ * under where they were and where they are now are counted again.
+ */
+class StitchDensity
+{
+public:
+    void attach(View* v);
+    void start();
+    void stop();
+    void changed(Geometry* obj);
+    void forget(Geometry* obj);
+    void draw(QPainter* painter);
+
+private:
+    typedef struct ObjectRuns_ {
+        std::vector<std::vector<EmbVector>> runs;
+        QRectF bounds;
+    } ObjectRuns;
+
+    typedef struct Tile_ {
+        std::vector<float> cells;
+        QImage image;
+    } Tile;
+
+    void refresh();
+    void recount(const QRectF& area);
+    QRectF tileRect(int x, int y);
+
+    View* view = 0;
+    bool running = false;
+    EmbReal cell = 1.0;
+    EmbReal limit = 1.0;
+    QHash<Geometry*, ObjectRuns> objects;
+    QSet<Geometry*> dirty;
+    QRectF dirtyArea;
+    QHash<QPoint, Tile> tiles;
+    QTimer timer;
+};
+
+/* A brand's threads read from a catalog file, one thread a line as
+ *     code,name,#rrggbb    or    code,name,r,g,b
+ * with lines that don't end in a colour, such as headers, skipped.
+ * The colours are indexed so each lookup of the nearest thread is a
+ * k-d tree search rather than a scan of the whole catalog.
+ */
+class ThreadCatalog
+{
+public:
+    ThreadCatalog() {}
+    ThreadCatalog(const ThreadCatalog&) = delete;
+    ~ThreadCatalog() { color_index_free(&index); }
+    bool load(QString fileName);
+    int nearest(QRgb rgb, EmbReal* distance = 0) const;
+    int size() const { return (int)colors.size(); }
+
+    QString name;
+    std::vector<QRgb> colors;
+    std::vector<QString> codes;
+    std::vector<QString> names;
+
+private:
+    ColorIndex index = {};
+};
+
 /* . */
 class View : public QGraphicsView
 {
@@ -1003,8 +1472,15 @@ public:
     QRgb crosshairColor;
     uint32_t crosshairSize;
 
-    QHash<int64_t, QGraphicsItem*> hashDeletedObjects;
-    std::vector<std::string> spareRubberList;
+    TombstoneStore tombstones;
+    ObjectTable objects;
+    ExtentsIndex sceneExtents;
+    ExtentsIndex selectionExtents;
+    ViewNavigator navigator;
+    StitchSimulation simulation;
+    StitchDensity density;
+    uint32_t spareRubberTypes = 0;
+    std::vector<int64_t> spareRubberIds;
     std::vector<QGraphicsItem*> rubberRoomList;
     std::vector<QGraphicsItem*> previewObjectList;
     QPointF previewPoint;
@@ -1024,12 +1500,21 @@ public:
 
     void recalculateLimits();
     void zoomToPoint(const QPoint& mousePoint, int zoomDir);
+    void zoomStepped(const QPoint& viewPoint);
     void centerAt(const QPointF& centerPoint);
     QPointF center() { return mapToScene(rect().center()); }
     void updateMouseCoords(int x, int y);
 
     void addObject(Geometry* obj);
     void deleteObject(Geometry* obj);
+    Geometry* restoreObject(int64_t id);
+    Geometry* objectFromId(int64_t id);
+    void trackExtents(Geometry* obj);
+    void forgetExtents(Geometry* obj);
+    bool fitsHoop(EmbReal width, EmbReal height);
+    int matchThreads(const ThreadCatalog& catalog);
+    int combineSelected(int op);
+    int offsetSelected(EmbReal distance);
     void vulcanizeObject(Geometry* obj);
 
     std::vector<QGraphicsItem*> selected_items();
@@ -1117,9 +1602,10 @@ public slots:
     void vulcanizeRubberRoom();
     void clearRubberRoom();
     void spareRubber(int64_t id);
-    void setRubberMode(std::string mode);
-    void setRubberPoint(QString key, const QPointF& point);
-    void setRubberText(QString key, QString txt);
+    void setRubberMode(int32_t mode);
+    void setRubberPoint(int32_t slot, const QPointF& point);
+    bool setRubberVertex(int32_t index, const QPointF& point);
+    void setRubberText(int32_t slot, QString txt);
 
 protected:
     void mouseDoubleClickEvent(QMouseEvent* event);
@@ -83,6 +83,18 @@ extern "C" {
 
 #include "../extern/libembroidery/src/embroidery.h"
 
+/* The shape held by a Geometry object. Only the member matching the
+ * object's type is ever in use, so they share storage.
+ */
+typedef union ShapeData_ {
+    EmbArc arc;
+    EmbCircle circle;
+    EmbEllipse ellipse;
+    EmbLine line;
+    EmbPoint point;
+    EmbRect rect;
+} ShapeData;
+
 /* . */
 typedef struct GeometryData_ {
     int32_t mode;
@@ -141,6 +153,7 @@ void set_int(GeometryData *g, int64_t id, int32_t i);
 void set_str(GeometryData *g, int64_t id, char *str);
 
 const char *add_geometry(char argv[MAX_ARGS][MAX_STRING_LENGTH], int argc);
+const char *object_type_name(int type);
 
 #ifdef __cplusplus
 }
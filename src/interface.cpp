@@ -32,8 +32,14 @@
 #include "embroidermodder.h"
 
 #include <time.h>
+#include <stdarg.h>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <atomic>
 
 bool test_program = false;
+bool profile_scripts = false;
 
 // Used when checking if fields vary
 QString fieldOldText;
@@ -50,18 +56,181 @@ QSpinBox *spinBoxes[TOTAL_EDITORS];
 QDoubleSpinBox *doubleSpinBoxes[TOTAL_EDITORS];
 QComboBox *comboBoxes[TOTAL_EDITORS];
 
+TranslationCatalog translations;
+
+/* libembroidery's readers and writers keep state of their own, so files
+ * are only ever read or written one at a time; see parallel_for().
+ */
+std::mutex pattern_io;
+
+/* Call fn(0) to fn(count-1), shared out between the cores as they come
+ * free, with the calling thread taking its turn. Returns once every call
+ * has finished. Anything that reads or writes a pattern file from fn
+ * holds pattern_io while it does.
+ */
+void
+parallel_for(int count, const std::function<void(int)>& fn)
+{
+    if (count <= 0) {
+        return;
+    }
+    int threads = std::max(1, (int)std::thread::hardware_concurrency());
+    threads = std::min(threads, count);
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+        for (int i = next++; i < count; i = next++) {
+            fn(i);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int i=1; i<threads; i++) {
+        pool.push_back(std::thread(worker));
+    }
+    worker();
+    for (std::thread& t : pool) {
+        t.join();
+    }
+}
+
+/* Set while run_in_background() waits, so actuator() can turn away
+ * commands that timers and queued events would otherwise start.
+ */
+bool background_busy = false;
+
+/* Run fn on a thread of its own and wait for it to finish. Meanwhile
+ * the window is kept painted, but takes no input, so a long job doesn't
+ * freeze it.
+ */
+void
+run_in_background(const std::function<void()>& fn)
+{
+    QEventLoop loop;
+    std::thread worker([&]() {
+        fn();
+        QMetaObject::invokeMethod(&loop, "quit", Qt::QueuedConnection);
+    });
+    bool busy = background_busy;
+    background_busy = true;
+    loop.exec(QEventLoop::ExcludeUserInputEvents);
+    background_busy = busy;
+    worker.join();
+}
+
 /* Make the translation function global in scope. */
 QString
 translate_str(const char *str)
 {
-    return _mainWin->tr(str);
+    return translations.text(str);
 }
 
-/* . */
+/* Translate str for the C core.
+ *
+ * The pointer stays valid until the language changes.
+ */
 const char *
 translate(char *str)
 {
-    return _mainWin->tr(str).toStdString().c_str();
+    return translations.utf8(str);
+}
+
+/* . */
+TranslationCatalog::~TranslationCatalog()
+{
+    unload();
+}
+
+/* Remove and free the installed catalogs. */
+void
+TranslationCatalog::unload()
+{
+    for (QTranslator* translator : translators) {
+        /* The catalog is global so it can outlive the application. */
+        if (qApp) {
+            qApp->removeTranslator(translator);
+        }
+        delete translator;
+    }
+    translators.clear();
+    entries.clear();
+}
+
+/* Load the compiled catalogs for lang, "system" meaning the system locale's
+ * language. A language with no catalogs falls back to the source strings.
+ */
+void
+TranslationCatalog::setLanguage(QString lang)
+{
+    if (lang == "system") {
+        lang = QLocale::system().languageToString(QLocale::system().language()).toLower();
+    }
+    if ((lang == language) && !translators.empty()) {
+        return;
+    }
+    unload();
+    language = lang;
+
+    QString dir = qApp->applicationDirPath() + "/translations/" + lang;
+    QStringList catalogs = {
+        dir + "/embroidermodder2_" + lang,
+        dir + "/commands_" + lang
+    };
+    for (const QString& catalog : catalogs) {
+        QTranslator* translator = new QTranslator();
+        if (translator->load(catalog)) {
+            qApp->installTranslator(translator);
+            translators.push_back(translator);
+        }
+        else {
+            delete translator;
+        }
+    }
+
+    //Load translations provided by Qt - this covers dialog buttons and other common things.
+    QTranslator* translatorQt = new QTranslator();
+    //TODO: ensure this always loads, ship a copy of this with the app
+    if (translatorQt->load("qt_" + QLocale::system().name(),
+        QLibraryInfo::path(QLibraryInfo::TranslationsPath))) {
+        qApp->installTranslator(translatorQt);
+        translators.push_back(translatorQt);
+    }
+    else {
+        delete translatorQt;
+    }
+
+    debug_message("language: %s, %d catalogs loaded.",
+        qPrintable(lang), (int)translators.size());
+}
+
+/* The cache entry for source, translating it on first use. The key is
+ * wrapped rather than copied for the lookup, so a hit doesn't allocate.
+ */
+TranslationCatalog::Entry&
+TranslationCatalog::lookup(const char *source)
+{
+    QByteArray key = QByteArray::fromRawData(source, strlen(source));
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        return it.value();
+    }
+
+    Entry entry;
+    entry.text = QCoreApplication::translate("MainWindow", source);
+    entry.utf8 = entry.text.toUtf8();
+    return entries.insert(QByteArray(source), entry).value();
+}
+
+/* The translation of source. */
+const QString&
+TranslationCatalog::text(const char *source)
+{
+    return lookup(source).text;
+}
+
+/* The translation of source as UTF-8 for the C core. */
+const char *
+TranslationCatalog::utf8(const char *source)
+{
+    return lookup(source).utf8.constData();
 }
 
 /* Convert an EmbVector to a QPointF. */
@@ -1433,6 +1602,34 @@ EmbDetailsDialog::createMainWidget()
     gridLayoutMisc->setColumnStretch(1,1);
     groupBoxMisc->setLayout(gridLayoutMisc);
 
+    QGroupBox* groupBoxEstimate = new QGroupBox(tr("Machine Estimate"), widget);
+    QGridLayout* gridLayoutEstimate = new QGridLayout(groupBoxEstimate);
+    gridLayoutEstimate->addWidget(new QLabel(tr("Run Time:"), widget), 0, 0, Qt::AlignLeft);
+    gridLayoutEstimate->addWidget(new QLabel(format_run_time(runSeconds), widget), 0, 1, Qt::AlignLeft);
+    gridLayoutEstimate->addWidget(new QLabel(tr("Bobbin Thread:"), widget), 1, 0, Qt::AlignLeft);
+    gridLayoutEstimate->addWidget(new QLabel(QString("%1 m").arg(bobbinLength / 1000.0, 0, 'f', 2), widget), 1, 1, Qt::AlignLeft);
+    for (int i=0; i<(int)threadLengths.size(); i++) {
+        QLabel* swatch = new QLabel(widget);
+        QPixmap pix(16, 16);
+        pix.fill(QColor(threadColors[i]));
+        swatch->setPixmap(pix);
+        gridLayoutEstimate->addWidget(swatch, i+2, 0, Qt::AlignLeft);
+        gridLayoutEstimate->addWidget(new QLabel(QString("%1 m").arg(threadLengths[i] / 1000.0, 0, 'f', 2), widget), i+2, 1, Qt::AlignLeft);
+    }
+    gridLayoutEstimate->setColumnStretch(1,1);
+    groupBoxEstimate->setLayout(gridLayoutEstimate);
+
+    QGroupBox* groupBoxDensity = new QGroupBox(tr("Stitch Density"), widget);
+    QGridLayout* gridLayoutDensity = new QGridLayout(groupBoxDensity);
+    gridLayoutDensity->addWidget(new QLabel(tr("Densest:"), widget), 0, 0, Qt::AlignLeft);
+    gridLayoutDensity->addWidget(new QLabel(QString("%1 per mm² at %2, %3")
+        .arg(density.peak, 0, 'f', 2).arg(density.peak_at.x, 0, 'f', 1)
+        .arg(density.peak_at.y, 0, 'f', 1), widget), 0, 1, Qt::AlignLeft);
+    gridLayoutDensity->addWidget(new QLabel(tr("Over %1 per mm²:").arg(settings[ST_DENSITY_LIMIT].r), widget), 1, 0, Qt::AlignLeft);
+    gridLayoutDensity->addWidget(new QLabel(tr("%1 areas, %2 mm²").arg(density.regions).arg(density.area, 0, 'f', 1), widget), 1, 1, Qt::AlignLeft);
+    gridLayoutDensity->setColumnStretch(1,1);
+    groupBoxDensity->setLayout(gridLayoutDensity);
+
     //TODO: Color Histogram
 
     //Stitch Distribution
@@ -1482,6 +1679,8 @@ EmbDetailsDialog::createMainWidget()
     //Widget Layout
     QVBoxLayout *vboxLayoutMain = new QVBoxLayout(widget);
     vboxLayoutMain->addWidget(groupBoxMisc);
+    vboxLayoutMain->addWidget(groupBoxEstimate);
+    vboxLayoutMain->addWidget(groupBoxDensity);
     //vboxLayoutMain->addWidget(groupBoxDist);
     //vboxLayoutMain->addWidget(buttonbox);
     vboxLayoutMain->addStretch(1);
@@ -1494,11 +1693,13 @@ EmbDetailsDialog::createMainWidget()
     return scrollArea;
 }
 
-/* Get information from the embroidery.
+/* Get information from the embroidery, using the stitches
+ * build_stitches() makes of the active view, estimate the time and
+ * thread the machine will take over them and find where they are
+ * too dense. The reports build_stitches() gives back are only for
+ * saves, so they are left out of the prompt history.
  *
  * TODO: Move majority of this code into libembroidery.
- * TODO: generate a temporary pattern from the scene data.
- * TODO: grab this information from the pattern
  *
  * TODO: embStitchList_count(pattern->stitchList, TOTAL);
  */
@@ -1517,7 +1718,11 @@ EmbDetailsDialog::getInfo(void)
         return;
     }
 
-    /* TODO: This is temporary. Generate actual pattern data from the scene. */
+    View* gview = activeView();
+    if (gview) {
+        build_stitches(gview, pattern);
+    }
+
     /* TODO: This convenience function is messed up. */
 
     //boundingRect = embPattern_calcBoundingBox(pattern);
@@ -1636,6 +1841,108 @@ EmbDetailsDialog::getInfo(void)
         }
         last_pos = st;
     }
+
+    StitchEstimate estimate;
+    estimate_init(&estimate, settings[ST_STITCH_TIME].r,
+        settings[ST_NEEDLE_SPEED].r);
+    estimate_pattern(&estimate, pattern);
+    runSeconds = estimate.seconds;
+    bobbinLength = estimate.bobbin;
+    for (int i=0; i<estimate.colors; i++) {
+        QRgb color = qRgb(0, 0, 0);
+        if (i < pattern->thread_list->count) {
+            EmbColor c = pattern->thread_list->thread[i].color;
+            color = qRgb(c.r, c.g, c.b);
+        }
+        threadLengths.push_back(estimate.top[i]);
+        threadColors.push_back(color);
+    }
+    estimate_free(&estimate);
+
+    if (!density_pattern(pattern, settings[ST_DENSITY_CELL].r,
+        settings[ST_DENSITY_LIMIT].r, &density)) {
+        debug_message("Could not allocate memory for the density grid");
+    }
+    embPattern_free(pattern);
+}
+
+/* Seconds as hours, minutes and seconds. */
+QString
+format_run_time(EmbReal seconds)
+{
+    int s = (int)ceil(seconds);
+    return QString("%1:%2:%3")
+        .arg(s / 3600)
+        .arg((s / 60) % 60, 2, 10, QChar('0'))
+        .arg(s % 60, 2, 10, QChar('0'));
+}
+
+/* Read a thread catalog and index its colours, replacing any catalog
+ * already loaded. Returns false if the file can't be read or holds no
+ * threads.
+ */
+bool
+ThreadCatalog::load(QString fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+    name = QFileInfo(fileName).completeBaseName();
+    colors.clear();
+    codes.clear();
+    names.clear();
+    QTextStream input(&file);
+    while (!input.atEnd()) {
+        QStringList fields = input.readLine().split(',');
+        for (QString& field : fields) {
+            field = field.trimmed();
+        }
+        int n = fields.size();
+        QRgb rgb = 0;
+        int used = 0;
+        bool ok = false;
+        if (fields.last().startsWith('#') && (fields.last().size() == 7)) {
+            rgb = fields.last().mid(1).toUInt(&ok, 16);
+            used = 1;
+        }
+        else if (n >= 4) {
+            int c[3];
+            ok = true;
+            for (int i=0; i<3; i++) {
+                bool isInt;
+                c[i] = fields[n-3+i].toInt(&isInt);
+                ok = ok && isInt && (c[i] >= 0) && (c[i] <= 255);
+            }
+            rgb = qRgb(c[0], c[1], c[2]);
+            used = 3;
+        }
+        if (!ok || (n - used < 1)) {
+            continue;
+        }
+        colors.push_back(rgb | 0xFF000000);
+        codes.push_back(fields[0]);
+        names.push_back(fields.mid(1, n - used - 1).join(", "));
+    }
+
+    std::vector<unsigned char> triplets(3*colors.size());
+    for (int i=0; i<size(); i++) {
+        triplets[3*i] = qRed(colors[i]);
+        triplets[3*i+1] = qGreen(colors[i]);
+        triplets[3*i+2] = qBlue(colors[i]);
+    }
+    color_index_free(&index);
+    return color_index_build(&index, triplets.data(), size()) && (size() > 0);
+}
+
+/* The position in the catalog of the thread nearest to rgb, or -1 if
+ * the catalog is empty. Safe to call from several threads at once.
+ */
+int
+ThreadCatalog::nearest(QRgb rgb, EmbReal* distance) const
+{
+    LabColor lab = rgb_to_lab(qRed(rgb), qGreen(rgb), qBlue(rgb));
+    return color_index_nearest(&index, lab, distance);
 }
 
 /* . */
@@ -1645,14 +1952,36 @@ MdiArea::mouseDoubleClickEvent(QMouseEvent* /*e*/)
     _mainWin->openFile();
 }
 
-/* . */
+/* Draw the cached background, rebuilding it first if it is stale.
+ *
+ * Resizes are caught by comparing the cache against the viewport, which
+ * also covers moving the window to a screen with a different pixel ratio.
+ */
 void
 MdiArea::paintEvent(QPaintEvent* /*e*/)
 {
     QWidget* vport = viewport();
-    QRect rect = vport->rect();
+    QSize size = vport->size() * vport->devicePixelRatioF();
+    if (!bgCacheValid || (bgCache.size() != size)) {
+        rebuildBackground();
+    }
 
     QPainter painter(vport);
+    painter.drawPixmap(0, 0, bgCache);
+}
+
+/* Composite the color, texture and logo into bgCache. */
+void
+MdiArea::rebuildBackground()
+{
+    QWidget* vport = viewport();
+    QRect rect = vport->rect();
+    qreal ratio = vport->devicePixelRatioF();
+
+    bgCache = QPixmap(rect.size() * ratio);
+    bgCache.setDevicePixelRatio(ratio);
+
+    QPainter painter(&bgCache);
     painter.setRenderHint(QPainter::SmoothPixmapTransform);
 
     //Always fill with a solid color first
@@ -1676,6 +2005,37 @@ MdiArea::paintEvent(QPaintEvent* /*e*/)
         int dy = (rect.height()-bgLogo.height())/2;
         painter.drawPixmap(dx, dy, bgLogo.width(), bgLogo.height(), bgLogo);
     }
+
+    bgCacheValid = true;
+}
+
+/* Mark the cached background as stale and schedule a repaint. */
+void
+MdiArea::invalidateBackground()
+{
+    bgCacheValid = false;
+    viewport()->update();
+}
+
+/* Take the background options from the settings table d.
+ * The images are only read from disk when their file has changed.
+ */
+void
+MdiArea::applyBackgroundSettings(Node *d)
+{
+    useLogo = d[ST_MDI_USE_LOGO].i;
+    useTexture = d[ST_MDI_USE_TEXTURE].i;
+    useColor = d[ST_MDI_USE_COLOR].i;
+    bgColor = QColor(d[ST_MDI_COLOR].i);
+    if (bgLogoFile != d[ST_MDI_LOGO].s) {
+        bgLogoFile = d[ST_MDI_LOGO].s;
+        bgLogo.load(bgLogoFile);
+    }
+    if (bgTextureFile != d[ST_MDI_TEXTURE].s) {
+        bgTextureFile = d[ST_MDI_TEXTURE].s;
+        bgTexture.load(bgTextureFile);
+    }
+    invalidateBackground();
 }
 
 /* Zoom extents all subwindows. */
@@ -1692,15 +2052,6 @@ void MdiArea::zoomExtentsAllSubWindows()
     }
 }
 
-/* Force repaint. */
-void MdiArea::forceRepaint()
-{
-    //HACK: Take that QMdiArea!
-    QSize hack = size();
-    resize(hack + QSize(1,1));
-    resize(hack);
-}
-
 /* Construct a new MdiWindow object.
  *
  * theIndex, parent, wflags
@@ -1842,7 +2193,7 @@ MdiWindow::loadFile(std::string fileName)
                 }
             }
 
-            add_polyline(stitchPath, "OBJ_RUBBER_OFF");
+            add_polyline(stitchPath, RUBBER_OFF);
         }
 
         for (int i=0; i<p->geometry->count; i++) {
@@ -1852,14 +2203,14 @@ MdiWindow::loadFile(std::string fileName)
             if (g.type == EMB_CIRCLE) {
                 EmbCircle c = g.object.circle;
                 sprintf(command_str, "add circle %f %f %f %i %s",
-                    c.center.x, c.center.y, c.radius, false, "OBJ_RUBBER_OFF");
+                    c.center.x, c.center.y, c.radius, false, "OFF");
                 // NOTE: With natives, the Y+ is up and libembroidery Y+ is up, so inverting the Y is NOT needed.
                 actuator(command_str); //TODO: fill
             }
             if (g.type == EMB_ELLIPSE) {
                 EmbEllipse e = g.object.ellipse;
                 sprintf(command_str, "add ellipse %f %f %f %f %i %i %s",    e.center.x, e.center.y, embEllipse_width(e),
-                    embEllipse_height(e), 0, false, "OBJ_RUBBER_OFF");
+                    embEllipse_height(e), 0, false, "OFF");
                 //NOTE: With natives, the Y+ is up and libembroidery Y+ is up, so inverting the Y is NOT needed.
                 actuator(command_str); //TODO: rotation and fill
             }
@@ -1872,7 +2223,7 @@ MdiWindow::loadFile(std::string fileName)
                     li.end.x,
                     li.end.y,
                     0,
-                    "OBJ_RUBBER_OFF");
+                    "OFF");
                 //NOTE: With natives, the Y+ is up and libembroidery Y+ is up, so inverting the Y is NOT needed.
                 actuator(command_str); //TODO: rotation
             }
@@ -1896,7 +2247,7 @@ MdiWindow::loadFile(std::string fileName)
                 /*
                 EmbVector v = {0.0, 0.0};
                 Geometry* obj = new Geometry(v, pathPath, loadPen.color().rgb(), Qt::SolidLine);
-                obj->objRubberMode = "OBJ_RUBBER_OFF";
+                obj->objRubberMode = RUBBER_OFF;
                 gscene->addItem(obj);
                 */
             }
@@ -1934,7 +2285,7 @@ MdiWindow::loadFile(std::string fileName)
                 }
 
                 polygonPath.translate(-startX, -startY);
-                //AddPolygon(startX, startY, polygonPath, "OBJ_RUBBER_OFF");
+                //AddPolygon(startX, startY, polygonPath, RUBBER_OFF);
             }
             /* NOTE: Polylines should only contain NORMAL stitches. */
             if (p->geometry->geometry[i].type == EMB_POLYLINE) {
@@ -1961,7 +2312,7 @@ MdiWindow::loadFile(std::string fileName)
                 }
 
                 polylinePath.translate(-start.x, -start.y);
-                //AddPolyline(start.x, start.y, polylinePath, "OBJ_RUBBER_OFF");
+                //AddPolyline(start.x, start.y, polylinePath, RUBBER_OFF);
             }
             if (g.type == EMB_RECT) {
                 EmbRect r = g.object.rect;
@@ -1974,13 +2325,20 @@ MdiWindow::loadFile(std::string fileName)
                     r.bottom - r.top,
                     0,
                     false,
-                    "OBJ_RUBBER_OFF");
+                    "OFF");
                 actuator(command_str);
             }
         }
 
         setCurrentFile(QString::fromStdString(fileName));
         statusbar->showMessage("File loaded.");
+        EmbReal hoopWidth = settings[ST_HOOP_WIDTH].r;
+        EmbReal hoopHeight = settings[ST_HOOP_HEIGHT].r;
+        if (!gview->fitsHoop(hoopWidth, hoopHeight)
+            && !gview->fitsHoop(hoopHeight, hoopWidth)) {
+            statusbar->showMessage(translate_str("File loaded. The design is "
+                "larger than the hoop, splithoop can split it between hoops."));
+        }
         QString stitches;
         stitches.setNum(stitchCount);
 
@@ -2044,7 +2402,7 @@ void MdiWindow::saveBMC()
     //TODO: figure out how to center the image, right now it just plops it to the left side.
     QImage img(150, 150, QImage::Format_ARGB32_Premultiplied);
     img.fill(qRgb(255,255,255));
-    QRectF extents = gscene->itemsBoundingRect();
+    QRectF extents = gview->sceneExtents.extents();
 
     QPainter painter(&img);
     QRectF targetRect(0,0,150,150);
@@ -2184,9 +2542,14 @@ PropertyEditor::PropertyEditor(QString  iconDirectory, bool pickAddMode, QWidget
     fieldOnText = "On";
     fieldOffText = "Off";
 
+    /* Only the General group is built now, the rest are built by
+     * buildGroups the first time an object of their type is selected.
+     */
     for (int i=0; i<GB_TOTAL; i++) {
-        groupBoxes[i] = createGroupBox(i, group_box_data[2*i+1]);
+        groupBoxes[i] = NULL;
     }
+    comboBoxTextSingleFont = NULL;
+    groupBoxes[GB_GENERAL] = createGroupBox(GB_GENERAL, group_box_data[2*GB_GENERAL+1]);
 
     QWidget* widgetMain = new QWidget(this);
 
@@ -2200,10 +2563,9 @@ PropertyEditor::PropertyEditor(QString  iconDirectory, bool pickAddMode, QWidget
     QScrollArea* scrollProperties = new QScrollArea(this);
     QWidget* widgetProperties = new QWidget(this);
     QVBoxLayout* vboxLayoutProperties = new QVBoxLayout(this);
-    for (int i=0; i<GB_TOTAL; i++) {
-        vboxLayoutProperties->addWidget(groupBoxes[i]);
-    }
+    vboxLayoutProperties->addWidget(groupBoxes[GB_GENERAL]);
     vboxLayoutProperties->addStretch(1);
+    groupBoxLayout = vboxLayoutProperties;
     widgetProperties->setLayout(vboxLayoutProperties);
     scrollProperties->setWidget(widgetProperties);
     scrollProperties->setWidgetResizable(true);
@@ -2380,6 +2742,10 @@ PropertyEditor::setSelectedItems(std::vector<QGraphicsItem*> itemList)
         comboBoxSelected->addItem(comboBoxStr, objType);
     }
 
+    foreach(int objType, typeSet) {
+        buildGroups(objType);
+    }
+
     /* Load Data into the fields. */
 
     //Clear fields first so if the selected data varies, the comparison is simple
@@ -2701,10 +3067,33 @@ void PropertyEditor::updateComboBoxBoolIfVaries(QComboBox* comboBox, bool val, b
     }
 }
 
+/* Build any group boxes for objType that don't exist yet, hidden and in
+ * their place in the list.
+ */
+void
+PropertyEditor::buildGroups(int objType)
+{
+    for (int i=0; i<GB_TOTAL; i++) {
+        if ((group_box_ids[i] != objType) || groupBoxes[i]) {
+            continue;
+        }
+        int position = 0;
+        for (int j=0; j<i; j++) {
+            if (groupBoxes[j]) {
+                position++;
+            }
+        }
+        groupBoxes[i] = createGroupBox(i, group_box_data[2*i+1]);
+        groupBoxes[i]->hide();
+        groupBoxLayout->insertWidget(position, groupBoxes[i]);
+    }
+}
+
 /* . */
 void
 PropertyEditor::showGroups(int objType)
 {
+    buildGroups(objType);
     for (int i=0; i<GB_TOTAL; i++) {
         if (group_box_ids[i]== objType) {
             groupBoxes[i]->show();
@@ -2725,7 +3114,7 @@ void
 PropertyEditor::hideAllGroups(void)
 {
     for (int i=0; i<GB_TOTAL; i++) {
-        if (i != GB_GENERAL) {
+        if ((i != GB_GENERAL) && groupBoxes[i]) {
             groupBoxes[i]->hide();
         }
     }
@@ -2739,6 +3128,10 @@ void PropertyEditor::clearAllFields()
 {
     for (int i=0; all_line_editors[i].key >= 0; i++) {
         int key = all_line_editors[i].key;
+        /* Editors in groups that haven't been built yet. */
+        if (!groupBoxes[all_line_editors[i].groupbox]) {
+            continue;
+        }
         switch (all_line_editors[i].type) {
         case EDITOR_DOUBLE: {
             lineEdits[key]->clear();
@@ -3096,10 +3489,503 @@ protected:
 #endif /* MacOS */
 
 static bool exitApp = false;
+static bool bench_memory = false;
+static bool bench_stitches = false;
+static bool trace_startup = false;
+static QElapsedTimer startup_clock;
+
+/* Print the time taken by a phase of startup when --trace-startup is given.
+ * Each line shows the time since main() was entered and the time since the
+ * previous phase.
+ */
+void
+startup_phase(const char *fmt, ...)
+{
+    static qint64 last = 0;
+    if (!trace_startup) {
+        return;
+    }
+    char phase[MAX_STRING_LENGTH];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(phase, MAX_STRING_LENGTH, fmt, args);
+    va_end(args);
+
+    qint64 now = startup_clock.nsecsElapsed();
+    fprintf(stderr, "startup: %9.2f ms  %+9.2f ms  %s\n",
+        now / 1e6, (now - last) / 1e6, phase);
+    last = now;
+}
+
+SessionLog session_log;
+
+/* Start writing the session to fname. */
+bool
+SessionLog::record(const char *fname)
+{
+    file = fopen(fname, "w");
+    if (!file) {
+        fprintf(stderr, "record: could not open %s\n", fname);
+        return false;
+    }
+    fprintf(file, "# embroidermodder session log\n");
+    fprintf(file, "# window %d %d\n", _mainWin->width(), _mainWin->height());
+    clock.start();
+    return true;
+}
+
+/* Log a command given to actuator(). */
+void
+SessionLog::command(const char *line)
+{
+    if (file) {
+        fprintf(file, "%.3f cmd %s\n", clock.nsecsElapsed() / 1e6, line);
+        fflush(file);
+    }
+}
+
+/* Log a mouse event at pos in the coordinates of the view's viewport.
+ * For the wheel, button is the vertical angle delta.
+ */
+void
+SessionLog::mouse(const char *type, QPointF pos, int button, int buttons,
+    int modifiers)
+{
+    if (file) {
+        fprintf(file, "%.3f %s %.2f %.2f %d %d %d\n",
+            clock.nsecsElapsed() / 1e6, type, pos.x(), pos.y(), button,
+            buttons, modifiers);
+    }
+}
+
+/* Send a recorded mouse event to the active view. */
+static bool
+replay_mouse(const char *type, QPointF pos, int button, int buttons,
+    int modifiers)
+{
+    View* view = activeView();
+    if (!view) {
+        return false;
+    }
+    QWidget* viewport = view->viewport();
+    QPointF global = viewport->mapToGlobal(pos);
+    Qt::KeyboardModifiers keys = Qt::KeyboardModifiers(modifiers);
+
+    if (!strcmp(type, "wheel")) {
+        QWheelEvent event(pos, global, QPoint(), QPoint(0, button),
+            Qt::MouseButtons(buttons), keys, Qt::NoScrollPhase, false);
+        QCoreApplication::sendEvent(viewport, &event);
+        return true;
+    }
+
+    QEvent::Type eventType;
+    if (!strcmp(type, "press")) {
+        eventType = QEvent::MouseButtonPress;
+    }
+    else if (!strcmp(type, "release")) {
+        eventType = QEvent::MouseButtonRelease;
+    }
+    else if (!strcmp(type, "double")) {
+        eventType = QEvent::MouseButtonDblClick;
+    }
+    else if (!strcmp(type, "move")) {
+        eventType = QEvent::MouseMove;
+    }
+    else {
+        return false;
+    }
+    QMouseEvent event(eventType, pos, global, Qt::MouseButton(button),
+        Qt::MouseButtons(buttons), keys);
+    QCoreApplication::sendEvent(viewport, &event);
+    return true;
+}
+
+/* The value below which fraction p of the sorted samples fall. */
+static double
+percentile(const std::vector<double>& sorted, double p)
+{
+    size_t i = (size_t)ceil(p * sorted.size());
+    if (i > 0) {
+        i--;
+    }
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+/* Run the log in fname against the open documents and print a report.
+ * Each event is timed until the event queue has drained, so the times
+ * include the repaints it causes. Quitting is left out so the report
+ * can be printed. A dialog an event opens would wait for a click that
+ * never comes, so it is cancelled as soon as it is up and the event's
+ * time includes it.
+ */
+int
+SessionLog::replay(const char *fname)
+{
+    FILE *log = fopen(fname, "r");
+    if (!log) {
+        fprintf(stderr, "replay: could not open %s\n", fname);
+        return 1;
+    }
+
+    std::map<std::string, std::vector<double>> latency;
+    char line[2*MAX_STRING_LENGTH];
+    int events = 0;
+    int64_t repaintsBefore = repaints;
+    std::string key;
+    QTimer dismiss;
+    QObject::connect(&dismiss, &QTimer::timeout, [&key]() {
+        QWidget* modal = QApplication::activeModalWidget();
+        if (!modal) {
+            return;
+        }
+        fprintf(stderr, "replay: cancelled the dialog opened by %s\n",
+            key.c_str());
+        QDialog* dialog = qobject_cast<QDialog*>(modal);
+        if (dialog) {
+            dialog->reject();
+        }
+        else {
+            modal->close();
+        }
+    });
+    QElapsedTimer timer;
+    timer.start();
+    while (fgets(line, sizeof(line), log)) {
+        line[strcspn(line, "\r\n")] = 0;
+        int width, height;
+        if (sscanf(line, "# window %d %d", &width, &height) == 2) {
+            _mainWin->resize(width, height);
+            QCoreApplication::processEvents();
+            continue;
+        }
+
+        double msec;
+        char type[32];
+        int n = 0;
+        if ((line[0] == '#') || (sscanf(line, "%lf %31s %n", &msec, type, &n) < 2)) {
+            continue;
+        }
+        const char *rest = line + n;
+
+        qint64 start = timer.nsecsElapsed();
+        dismiss.start(0);
+        bool sent = false;
+        if (!strcmp(type, "cmd")) {
+            char command[MAX_STRING_LENGTH];
+            snprintf(command, MAX_STRING_LENGTH, "%s", rest);
+            key = std::string(command, strcspn(command, " "));
+            if ((key != "exit") && (key != "quit")) {
+                actuator(command);
+                sent = true;
+            }
+        }
+        else {
+            double x, y;
+            int button, buttons, modifiers;
+            key = std::string("mouse-") + type;
+            if (sscanf(rest, "%lf %lf %d %d %d", &x, &y, &button, &buttons,
+                &modifiers) == 5) {
+                sent = replay_mouse(type, QPointF(x, y), button, buttons,
+                    modifiers);
+            }
+        }
+        if (!sent) {
+            dismiss.stop();
+            continue;
+        }
+        QCoreApplication::processEvents();
+        dismiss.stop();
+        latency[key].push_back((timer.nsecsElapsed() - start) / 1e6);
+        events++;
+    }
+    fclose(log);
+
+    fprintf(stdout, "replay: %d events in %.1f ms, %lld repaints, peak memory %lld KB\n",
+        events, timer.nsecsElapsed() / 1e6,
+        (long long)(repaints - repaintsBefore), (long long)peak_memory_kb());
+    fprintf(stdout, "%-24s %6s %9s %9s %9s %9s\n",
+        "event", "count", "p50 ms", "p90 ms", "p99 ms", "max ms");
+    for (auto& entry : latency) {
+        std::vector<double>& v = entry.second;
+        std::sort(v.begin(), v.end());
+        fprintf(stdout, "%-24s %6d %9.3f %9.3f %9.3f %9.3f\n",
+            entry.first.c_str(), (int)v.size(), percentile(v, 0.5),
+            percentile(v, 0.9), percentile(v, 0.99), v.back());
+    }
+    return 0;
+}
+
+/* A design's line in the --estimate report. */
+typedef struct EstimateRow_ {
+    std::string file;
+    int ok;
+    int stitches;
+    int colors;
+    int trims;
+    EmbReal seconds;
+    EmbReal top;
+    EmbReal bobbin;
+    DensityReport density;
+} EstimateRow;
+
+/* Estimate the run time and thread of each design named in paths and of
+ * every design in the folders named, and find the areas of each over
+ * the density limit, sharing the files between the cores, then print a
+ * line for each in the order given and the totals.
+ * Returns non-zero if any design could not be read.
+ */
+static int
+estimate_files(const QStringList& paths)
+{
+    std::vector<EstimateRow> rows;
+    for (const QString& path : paths) {
+        QStringList files;
+        if (QFileInfo(path).isDir()) {
+            QDirIterator it(path, QDir::Files, QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                QString file = it.next();
+                if (validFileFormat(file.toStdString())) {
+                    files += file;
+                }
+            }
+            files.sort();
+        }
+        else {
+            files += path;
+        }
+        for (const QString& file : files) {
+            EstimateRow row = {};
+            row.file = file.toStdString();
+            rows.push_back(row);
+        }
+    }
+
+    EmbReal stitch_time = settings[ST_STITCH_TIME].r;
+    EmbReal needle_speed = settings[ST_NEEDLE_SPEED].r;
+    EmbReal cell = settings[ST_DENSITY_CELL].r;
+    EmbReal limit = settings[ST_DENSITY_LIMIT].r;
+    int n = (int)rows.size();
+    parallel_for(n, [&](int i) {
+        EstimateRow& row = rows[i];
+        EmbPattern* pattern = embPattern_create();
+        if (!pattern) {
+            return;
+        }
+        bool read;
+        {
+            std::lock_guard<std::mutex> lock(pattern_io);
+            read = embPattern_readAuto(pattern, row.file.c_str());
+        }
+        if (read) {
+            StitchEstimate e;
+            estimate_init(&e, stitch_time, needle_speed);
+            estimate_pattern(&e, pattern);
+            row.ok = 1;
+            row.stitches = e.stitches;
+            row.colors = e.colors;
+            row.trims = e.trims;
+            row.seconds = e.seconds;
+            for (int k=0; k<e.colors; k++) {
+                row.top += e.top[k];
+            }
+            row.bobbin = e.bobbin;
+            estimate_free(&e);
+            density_pattern(pattern, cell, limit, &row.density);
+        }
+        embPattern_free(pattern);
+    });
+
+    int failed = 0;
+    EstimateRow total = {};
+    fprintf(stdout, "%-40s %9s %6s %6s %10s %9s %9s %7s %5s\n",
+        "design", "stitches", "colors", "trims", "run time", "top m",
+        "bobbin m", "peak", "dense");
+    for (const EstimateRow& row : rows) {
+        if (!row.ok) {
+            fprintf(stdout, "%-40s could not be read\n", row.file.c_str());
+            failed++;
+            continue;
+        }
+        fprintf(stdout, "%-40s %9d %6d %6d %10s %9.2f %9.2f %7.2f %5d\n",
+            row.file.c_str(), row.stitches, row.colors, row.trims,
+            qPrintable(format_run_time(row.seconds)), row.top / 1000.0,
+            row.bobbin / 1000.0, row.density.peak, row.density.regions);
+        total.stitches += row.stitches;
+        total.colors += row.colors;
+        total.trims += row.trims;
+        total.seconds += row.seconds;
+        total.top += row.top;
+        total.bobbin += row.bobbin;
+        total.density.peak = std::max(total.density.peak, row.density.peak);
+        total.density.regions += row.density.regions;
+    }
+    fprintf(stdout, "%-40s %9d %6d %6d %10s %9.2f %9.2f %7.2f %5d\n",
+        "total", total.stitches, total.colors, total.trims,
+        qPrintable(format_run_time(total.seconds)), total.top / 1000.0,
+        total.bobbin / 1000.0, total.density.peak, total.density.regions);
+    return failed ? 1 : 0;
+}
+
+/* A design's part of the --match-threads report. */
+typedef struct MatchRow_ {
+    std::string file;
+    std::string output;
+    int ok;
+    std::vector<std::string> lines;
+} MatchRow;
+
+/* Change the colour of every thread in each design named to the nearest
+ * thread in the catalog, sharing the designs between the cores. Each is
+ * written next to the original with the catalog's name added, and the
+ * colours chosen are printed. Returns non-zero if any design could not
+ * be read or written.
+ */
+static int
+match_thread_files(const char* catalogFile, const QStringList& files)
+{
+    ThreadCatalog catalog;
+    if (!catalog.load(catalogFile)) {
+        fprintf(stderr, "Could not read any threads from %s.\n", catalogFile);
+        return 1;
+    }
+
+    std::vector<MatchRow> rows(files.size());
+    for (int i=0; i<(int)files.size(); i++) {
+        QFileInfo info(files[i]);
+        rows[i].file = files[i].toStdString();
+        rows[i].output = (info.path() + "/" + info.completeBaseName() + "-"
+            + catalog.name + "." + info.suffix()).toStdString();
+    }
+
+    int n = (int)rows.size();
+    parallel_for(n, [&](int i) {
+        MatchRow& row = rows[i];
+        EmbPattern* pattern = embPattern_create();
+        if (!pattern) {
+            return;
+        }
+        bool read;
+        {
+            std::lock_guard<std::mutex> lock(pattern_io);
+            read = embPattern_readAuto(pattern, row.file.c_str());
+        }
+        if (read) {
+            for (int k=0; k<pattern->thread_list->count; k++) {
+                EmbThread* thread = &pattern->thread_list->thread[k];
+                QRgb rgb = qRgb(thread->color.r, thread->color.g,
+                    thread->color.b);
+                EmbReal distance;
+                int match = catalog.nearest(rgb, &distance);
+                QRgb to = catalog.colors[match];
+                thread->color.r = qRed(to);
+                thread->color.g = qGreen(to);
+                thread->color.b = qBlue(to);
+                snprintf(thread->catalogNumber, sizeof(thread->catalogNumber),
+                    "%s", qPrintable(catalog.codes[match]));
+                snprintf(thread->description, sizeof(thread->description),
+                    "%s", qPrintable(catalog.names[match]));
+                char line[MAX_STRING_LENGTH];
+                snprintf(line, MAX_STRING_LENGTH,
+                    "    %s -> %s %-10s %-24s dE %5.2f",
+                    qPrintable(QColor(rgb).name()),
+                    qPrintable(QColor(to).name()),
+                    qPrintable(catalog.codes[match]),
+                    qPrintable(catalog.names[match]), distance);
+                row.lines.push_back(line);
+            }
+            std::lock_guard<std::mutex> lock(pattern_io);
+            row.ok = embPattern_writeAuto(pattern, row.output.c_str());
+        }
+        embPattern_free(pattern);
+    });
+
+    int failed = 0;
+    for (const MatchRow& row : rows) {
+        if (!row.ok) {
+            fprintf(stdout, "%s could not be converted\n", row.file.c_str());
+            failed++;
+            continue;
+        }
+        fprintf(stdout, "%s -> %s\n", row.file.c_str(), row.output.c_str());
+        for (const std::string& line : row.lines) {
+            fprintf(stdout, "%s\n", line.c_str());
+        }
+    }
+    return failed ? 1 : 0;
+}
+
+/* Split each design named between hoops of the size given as WIDTHxHEIGHT
+ * in mm, overlapping by ST_HOOP_OVERLAP, and print the files written.
+ * Returns non-zero if any design could not be read, split or written.
+ */
+static int
+split_hoop_files(const char* hoop, const QStringList& files)
+{
+    double width, height;
+    if ((sscanf(hoop, "%lfx%lf", &width, &height) != 2)
+        || (width <= 0.0) || (height <= 0.0)) {
+        fprintf(stderr, "The hoop should be given as WIDTHxHEIGHT in mm.\n");
+        return 1;
+    }
+    int failed = 0;
+    for (const QString& file : files) {
+        EmbPattern* pattern = embPattern_create();
+        if (!pattern) {
+            return 1;
+        }
+        std::vector<HoopFile> hoops;
+        int status = HOOP_OK;
+        if (!embPattern_readAuto(pattern, qPrintable(file))) {
+            fprintf(stdout, "%s could not be read\n", qPrintable(file));
+            failed++;
+        }
+        else if ((status = split_hoops(pattern, file, width, height,
+            settings[ST_HOOP_OVERLAP].r, hoops)) != HOOP_OK) {
+            fprintf(stdout, "%s could not be split: %s\n", qPrintable(file),
+                hoop_message(status));
+            failed++;
+        }
+        else {
+            fprintf(stdout, "%s: %d hoops\n", qPrintable(file), (int)hoops.size());
+            for (const HoopFile& h : hoops) {
+                fprintf(stdout, "    %-40s column %2d row %2d %9d stitches%s\n",
+                    h.file.c_str(), h.column + 1, h.row + 1, h.stitches,
+                    h.ok ? "" : ", could not be written");
+                failed += h.ok ? 0 : 1;
+            }
+        }
+        embPattern_free(pattern);
+    }
+    return failed ? 1 : 0;
+}
 
 int
 main(int argc, char* argv[])
 {
+    startup_clock.start();
+    const char *record_file = NULL;
+    const char *replay_file = NULL;
+    bool headless = false;
+    for (int i = 1; i < argc-1; i++) {
+        if (!strcmp(argv[i], "--record")) {
+            record_file = argv[i+1];
+        }
+        if (!strcmp(argv[i], "--replay")) {
+            replay_file = argv[i+1];
+        }
+        if (!strcmp(argv[i], "--estimate")
+            || !strcmp(argv[i], "--match-threads")
+            || !strcmp(argv[i], "--split-hoop")) {
+            headless = true;
+        }
+    }
+    /* Replays and the batch options run without a display unless a
+     * platform was asked for.
+     */
+    if ((replay_file || headless)
+        && qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
 #if defined(Q_OS_MAC)
     Application app(argc, argv);
 #else
@@ -3109,6 +3995,9 @@ main(int argc, char* argv[])
     app.setApplicationVersion(version);
 
     QStringList files;
+    QStringList estimate_paths;
+    const char *match_catalog = NULL;
+    const char *split_hoop = NULL;
 
     for (int i = 1; i < argc; i++) {
         QString arg(argv[i]);
@@ -3125,6 +4014,30 @@ main(int argc, char* argv[])
         else if (arg == "--cov") {
             test_program = true;
         }
+        else if (arg == "--bench-memory") {
+            bench_memory = true;
+        }
+        else if (arg == "--bench-stitches") {
+            bench_stitches = true;
+        }
+        else if (arg == "--trace-startup") {
+            trace_startup = true;
+        }
+        else if (arg == "--profile-scripts") {
+            profile_scripts = true;
+        }
+        else if (((arg == "--record") || (arg == "--replay")) && (i+1 < argc)) {
+            i++;
+        }
+        else if ((arg == "--estimate") && (i+1 < argc)) {
+            estimate_paths += QString(argv[++i]);
+        }
+        else if ((arg == "--match-threads") && (i+1 < argc)) {
+            match_catalog = argv[++i];
+        }
+        else if ((arg == "--split-hoop") && (i+1 < argc)) {
+            split_hoop = argv[++i];
+        }
         else if (QFile::exists(argv[i]) && validFileFormat(arg.toStdString())) {
             files += arg;
         }
@@ -3137,9 +4050,31 @@ main(int argc, char* argv[])
     if (exitApp) {
         return 1;
     }
+    if (bench_stitches) {
+        benchmark_stitches();
+        return 0;
+    }
+    if (!estimate_paths.isEmpty()) {
+        read_settings();
+        return estimate_files(estimate_paths);
+    }
+    if (match_catalog) {
+        return match_thread_files(match_catalog, files);
+    }
+    if (split_hoop) {
+        read_settings();
+        return split_hoop_files(split_hoop, files);
+    }
+    startup_phase("create application");
 
+    session_log.replaying = (replay_file != NULL);
     _mainWin = new MainWindow();
 
+    if (bench_memory) {
+        benchmark_object_memory(1000);
+        return 0;
+    }
+
     QObject::connect(&app, SIGNAL(lastWindowClosed()), _mainWin, SLOT(quit()));
 
     _mainWin->setWindowTitle("Embroidermodder " + app.applicationVersion());
@@ -3150,6 +4085,21 @@ main(int argc, char* argv[])
      */
     if (files.size() > 0) {
         _mainWin->openFilesSelected(files);
+        startup_phase("open files");
+    }
+
+    /* The first pass of the event loop is when the window is painted and
+     * takes input.
+     */
+    QTimer::singleShot(0, [](){ startup_phase("first event loop pass"); });
+
+    if (replay_file) {
+        QTimer::singleShot(0, [&app, replay_file](){
+            app.exit(session_log.replay(replay_file));
+        });
+    }
+    else if (record_file && !session_log.record(record_file)) {
+        return 1;
     }
 
     return app.exec();
@@ -16,6 +16,11 @@
 #include "embroidermodder.h"
 
 extern bool test_program;
+extern bool profile_scripts;
+
+static CompiledScript *cached_script(const char *const *lines, int n);
+static const char *execute_command(int action_id, char *line, char *args,
+    char **argv, EmbReal *reals, int argc);
 
 MainWindow* _mainWin = 0;
 MdiArea* mdiArea = 0;
@@ -55,6 +60,20 @@ string_equal(const char *a, const char *b)
     return !strcmp(a, b);
 }
 
+/* The title of each menu, indexed by MENU_* id. */
+static const char *menu_titles[TOTAL_MENUS] = {
+    "&File",
+    "&Edit",
+    "&Pan",
+    "&Zoom",
+    "&View",
+    "&Settings",
+    "&Window",
+    "&Help",
+    "&Draw",
+    "Open &Recent"
+};
+
 /* Create menu. */
 void
 create_menu(int32_t menu, const int32_t *def, bool topLevel)
@@ -141,29 +160,204 @@ MainWindow::create_toolbar(ToolbarData t)
     }
 }
 
+#define ATLAS_COLUMNS                16
+
+/* Set up the atlas for a theme, taking the slot order from the cached
+ * index if there is one. No icon files are touched here.
+ */
+IconAtlas::IconAtlas(QString theme_)
+{
+    theme = theme_;
+    themeDir = qApp->applicationDirPath() + "/icons/" + theme;
+    cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+        + "/icons";
+
+    QFile index(cacheDir + "/" + theme + ".index");
+    if (index.open(QIODevice::ReadOnly)) {
+        QList<QByteArray> lines = index.readAll().split('\n');
+        for (const QByteArray& line : lines) {
+            if (!line.isEmpty()) {
+                slot(QString::fromUtf8(line));
+            }
+        }
+    }
+}
+
+/* The slot for stub, adding it to the end if it is new. */
+int32_t
+IconAtlas::slot(const QString& stub)
+{
+    auto it = slots.constFind(stub);
+    if (it != slots.constEnd()) {
+        return it.value();
+    }
+    int32_t n = stubs.size();
+    stubs.append(stub);
+    slots.insert(stub, n);
+    return n;
+}
+
+/* A short digest of the name, modification time and size of every icon
+ * file in the atlas. Only the files are stat'ed, none are read.
+ */
+QString
+IconAtlas::fingerprint()
+{
+    if (stampCount == stubs.size()) {
+        return stamp;
+    }
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    for (const QString& stub : stubs) {
+        QFileInfo info(themeDir + "/" + stub + ".png");
+        hash.addData(stub.toUtf8());
+        hash.addData(QByteArray::number(info.exists()
+            ? info.lastModified().toMSecsSinceEpoch() : -1));
+        hash.addData(QByteArray::number(info.size()));
+    }
+    stamp = QString::fromLatin1(hash.result().toHex().left(16));
+    stampCount = stubs.size();
+    return stamp;
+}
+
+/* . */
+QString
+IconAtlas::cachePath(int size)
+{
+    return cacheDir + "/" + theme + "-" + QString::number(size)
+        + "-" + fingerprint() + ".png";
+}
+
+/* Record the slot order so the next start can reuse the sheets. */
+void
+IconAtlas::saveIndex()
+{
+    QSaveFile index(cacheDir + "/" + theme + ".index");
+    if (index.open(QIODevice::WriteOnly)) {
+        index.write(stubs.join('\n').toUtf8());
+        index.commit();
+    }
+}
+
+/* The sheet for icons of the given size, covering every slot handed out
+ * so far. A sheet cached for other icon files is rebuilt.
+ */
+const QPixmap&
+IconAtlas::sheet(int size)
+{
+    if (sheetCounts.value(size, -1) == stubs.size()) {
+        return sheets[size];
+    }
+
+    QString path = cachePath(size);
+    QFileInfo cached(path);
+    QPixmap pm;
+    if (cached.exists() && pm.load(path)) {
+        filesRead++;
+    }
+    else {
+        int rows = (stubs.size() + ATLAS_COLUMNS - 1) / ATLAS_COLUMNS;
+        QImage image(ATLAS_COLUMNS*size, qMax(rows, 1)*size,
+            QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::transparent);
+        QPainter painter(&image);
+        painter.setRenderHint(QPainter::SmoothPixmapTransform);
+        for (int i=0; i<stubs.size(); i++) {
+            QImage icon(themeDir + "/" + stubs[i] + ".png");
+            filesRead++;
+            if (icon.isNull()) {
+                continue;
+            }
+            QRect cell((i % ATLAS_COLUMNS)*size, (i / ATLAS_COLUMNS)*size, size, size);
+            painter.drawImage(cell, icon.scaled(size, size,
+                Qt::KeepAspectRatio, Qt::SmoothTransformation));
+        }
+        painter.end();
+        pm = QPixmap::fromImage(image);
+        sheetsBuilt++;
+
+        /* Sheets for other icon files are no use any more. */
+        QDir dir(cacheDir);
+        dir.mkpath(".");
+        QString prefix = theme + "-" + QString::number(size) + "-";
+        for (const QString& old : dir.entryList({prefix + "*.png"}, QDir::Files)) {
+            dir.remove(old);
+        }
+        pm.save(path, "PNG");
+        saveIndex();
+    }
+
+    /* Cells cut from an older, smaller sheet are still right. */
+    sheets.insert(size, pm);
+    sheetCounts.insert(size, stubs.size());
+    return sheets[size];
+}
+
+/* The icon in slot at size by size device pixels, for a screen with
+ * device pixel ratio dpr.
+ */
+QPixmap
+IconAtlas::pixmap(int32_t slot, int size, qreal dpr)
+{
+    if ((slot < 0) || (slot >= stubs.size()) || (size <= 0)) {
+        return QPixmap();
+    }
+    int64_t key = ((int64_t)size << 40) | ((int64_t)qRound(dpr*100.0) << 24) | slot;
+    auto it = cells.constFind(key);
+    if (it != cells.constEnd()) {
+        return it.value();
+    }
+    const QPixmap& pm = sheet(size);
+    QPixmap cell = pm.copy((slot % ATLAS_COLUMNS)*size, (slot / ATLAS_COLUMNS)*size,
+        size, size);
+    cell.setDevicePixelRatio(dpr);
+    cells.insert(key, cell);
+    return cell;
+}
+
+/* . */
+void
+AtlasIconEngine::paint(QPainter* painter, const QRect& rect, QIcon::Mode mode, QIcon::State state)
+{
+    qreal dpr = painter->device() ? painter->device()->devicePixelRatioF() : 1.0;
+    painter->drawPixmap(rect, scaledPixmap(rect.size(), mode, state, dpr));
+}
+
+/* . */
+QPixmap
+AtlasIconEngine::pixmap(const QSize& size, QIcon::Mode mode, QIcon::State state)
+{
+    return scaledPixmap(size, mode, state, 1.0);
+}
+
+/* The icon for a size in logical pixels on a screen scaled by scale, drawn
+ * from the atlas at the device pixel size.
+ */
+QPixmap
+AtlasIconEngine::scaledPixmap(const QSize& size, QIcon::Mode mode, QIcon::State state, qreal scale)
+{
+    Q_UNUSED(state);
+    int side = qRound(qMin(size.width(), size.height()) * scale);
+    QPixmap pm = atlas->pixmap(iconSlot, side, scale);
+    if ((mode == QIcon::Normal) || pm.isNull()) {
+        return pm;
+    }
+    QStyleOption option;
+    option.palette = QApplication::palette();
+    return QApplication::style()->generatedIconPixmap(mode, pm, &option);
+}
+
 /* Create icon using stub. */
 QIcon
 MainWindow::create_icon(QString stub)
 {
-    QString appDir = qApp->applicationDirPath();
-    QString icontheme(settings[ST_ICON_THEME].s);
-    return QIcon(appDir + "/icons/" + icontheme + "/" + stub + ".png");
+    return QIcon(new AtlasIconEngine(icons, icons->slot(stub)));
 }
 
 /* Create icon using action table. */
 QIcon
 MainWindow::create_icon(int32_t stub)
 {
-    int i;
-    QString appDir = qApp->applicationDirPath();
-    QString icontheme(settings[ST_ICON_THEME].s);
-    for (i=0; i<N_ACTIONS; i++) {
-        if (action_table[i].id == stub) {
-            break;
-        }
-    }
-    QString stub_s(action_table[i].icon);
-    return QIcon(appDir + "/icons/" + icontheme + "/" + stub_s + ".png");
+    return QIcon(new AtlasIconEngine(icons, actionIcons[stub]));
 }
 
 void
@@ -228,9 +422,11 @@ MainWindow::createAllToolbars()
     //NOTE: Qt4.7 wont load icons without an extension...
     linetypeSelector->addItem(create_icon("linetypebylayer"), "ByLayer");
     linetypeSelector->addItem(create_icon("linetypebyblock"), "ByBlock");
-    linetypeSelector->addItem(create_icon("linetypecontinuous"), "Continuous");
-    linetypeSelector->addItem(create_icon("linetypehidden"), "Hidden");
-    linetypeSelector->addItem(create_icon("linetypecenter"), "Center");
+    linetypeSelector->addItem(create_icon("linetypecontinuous"), "Continuous", OBJ_LTYPE_CONT);
+    linetypeSelector->addItem(create_icon("linetypehidden"), "Hidden", OBJ_LTYPE_HIDDEN);
+    linetypeSelector->addItem(create_icon("linetypecenter"), "Center", OBJ_LTYPE_CENTER);
+    linetypeSelector->addItem(create_icon("linetypesatin"), "Satin", OBJ_LTYPE_SATIN);
+    linetypeSelector->addItem(create_icon("linetypefishbone"), "Fishbone", OBJ_LTYPE_FISHBONE);
     linetypeSelector->addItem(create_icon("linetypeother"), "Other...");
     toolbarHash[TOOLBAR_PROPERTIES]->addWidget(linetypeSelector);
     connect(linetypeSelector, SIGNAL(currentIndexChanged(int)), this, SLOT(linetypeSelectorIndexChanged(int)));
@@ -580,6 +776,20 @@ activeScene(void)
     return 0;
 }
 
+/* The view showing scene, each MdiWindow has exactly one of each. */
+View *
+scene_view(QGraphicsScene *scene)
+{
+    if (!scene) {
+        return 0;
+    }
+    QList<QGraphicsView*> views = scene->views();
+    if (views.isEmpty()) {
+        return 0;
+    }
+    return qobject_cast<View*>(views.first());
+}
+
 /* Active undo stack. */
 QUndoStack *
 MainWindow::activeUndoStack(void)
@@ -761,11 +971,27 @@ MainWindow::colorSelectorIndexChanged(int index)
     }
 }
 
-/* . */
+/* Make the line type at index current and give it to the selected
+ * objects. Satin and fishbone lines are sewn as columns on stitch-only
+ * saves, see saveObjectAsStitches().
+ */
 void
 MainWindow::linetypeSelectorIndexChanged(int index)
 {
     debug_message("linetypeSelectorIndexChanged(%d)" + std::to_string(index));
+
+    MdiWindow* mdiWin = qobject_cast<MdiWindow*>(mdiArea->activeSubWindow());
+    if (mdiWin) {
+        mdiWin->curLineType = linetypeSelector->itemText(index);
+    }
+    QVariant lineType = linetypeSelector->itemData(index);
+    View* view = activeView();
+    if (!lineType.isValid() || !view) {
+        return;
+    }
+    for (QGraphicsItem* item : view->gscene->selectedItems()) {
+        item->setData(OBJ_LTYPE, lineType);
+    }
 }
 
 /* lineweightSelectorIndexChanged index */
@@ -1010,7 +1236,7 @@ preview_on_action(std::string args)
 /*
  * NOTE: This native is different than the rest in that the Y+ is down
  * (scripters need not worry about this)
- * EmbReal startX, EmbReal startY, const QPainterPath& p, std::string rubberMode
+ * EmbReal startX, EmbReal startY, const QPainterPath& p, int32_t rubberMode
  */
 std::string
 add_polyline_action(std::string args)
@@ -1060,7 +1286,7 @@ add_polyline_action(std::string args)
 
     path.translate(-startX, -startY);
 
-    add_polyline(startX, startY, path, OBJ_RUBBER_OFF);
+    add_polyline(startX, startY, path, RUBBER_OFF);
     */
     return "";
 }
@@ -1092,8 +1318,13 @@ MainWindow::MainWindow() : QMainWindow(0)
 {
     QString appDir = qApp->applicationDirPath();
     read_settings();
+    startup_phase("read settings");
 
     QString icon_theme(settings[ST_ICON_THEME].s);
+    icons = new IconAtlas(icon_theme);
+    for (int i=0; i<N_ACTIONS; i++) {
+        actionIcons[action_table[i].id] = icons->slot(action_table[i].icon);
+    }
     //Verify that files/directories needed are actually present.
     QFileInfo check = QFileInfo(appDir + "/icons");
     if (!check.exists()) {
@@ -1111,26 +1342,8 @@ MainWindow::MainWindow() : QMainWindow(0)
             translate_str("Cannot locate: ") + check.absoluteFilePath());
     }
 
-    QString lang(settings[ST_LANGUAGE].s);
-    debug_message("language: " + lang.toStdString());
-    if (lang == "system") {
-        lang = QLocale::system().languageToString(QLocale::system().language()).toLower();
-    }
-
-    //Load translations for the Embroidermodder 2 GUI
-    QTranslator translatorEmb;
-    translatorEmb.load(appDir + "/translations/" + lang + "/embroidermodder2_" + lang);
-    qApp->installTranslator(&translatorEmb);
-
-    //Load translations for the commands
-    QTranslator translatorCmd;
-    translatorCmd.load(appDir + "/translations/" + lang + "/commands_" + lang);
-    qApp->installTranslator(&translatorCmd);
-
-    //Load translations provided by Qt - this covers dialog buttons and other common things.
-    QTranslator translatorQt;
-    translatorQt.load("qt_" + QLocale::system().name(), QLibraryInfo::location(QLibraryInfo::TranslationsPath)); //TODO: ensure this always loads, ship a copy of this with the app
-    qApp->installTranslator(&translatorQt);
+    translations.setLanguage(settings[ST_LANGUAGE].s);
+    startup_phase("load translations");
 
     //Init
     _mainWin = this;
@@ -1141,19 +1354,10 @@ MainWindow::MainWindow() : QMainWindow(0)
     move(pos);
     resize(size);
 
-    //Menus
-    menuHash[MENU_FILE] = new QMenu(translate_str("&File"), this);
-    menuHash[MENU_EDIT] = new QMenu(translate_str("&Edit"), this);
-    menuHash[MENU_VIEW] = new QMenu(translate_str("&View"), this);
-    menuHash[MENU_SETTINGS] = new QMenu(translate_str("&Settings"), this);
-    menuHash[MENU_WINDOW] = new QMenu(translate_str("&Window"), this);
-    menuHash[MENU_HELP] = new QMenu(translate_str("&Help"), this);
-    menuHash[MENU_DRAW] = new QMenu(translate_str("&Draw"), this);
-
-    //SubMenus
-    menuHash[MENU_RECENT] = new QMenu(translate_str("Open &Recent"), this);
-    menuHash[MENU_ZOOM] = new QMenu(translate_str("&Zoom"), this);
-    menuHash[MENU_PAN] = new QMenu(translate_str("&Pan"), this);
+    //Menus and submenus
+    for (int i=0; i<TOTAL_MENUS; i++) {
+        menuHash[i] = new QMenu(translate_str(menu_titles[i]), this);
+    }
 
     //Toolbars
     for (int i=0; i<TOTAL_TOOLBARS; i++) {
@@ -1177,6 +1381,7 @@ MainWindow::MainWindow() : QMainWindow(0)
     setMinimumSize(800, 480); //Require Minimum WVGA
 
     loadFormats();
+    startup_phase("file formats");
 
     //create the mdiArea
     QFrame* vbox = new QFrame(this);
@@ -1184,20 +1389,14 @@ MainWindow::MainWindow() : QMainWindow(0)
     //layout->setMargin(0);
     vbox->setFrameStyle(QFrame::StyledPanel | QFrame::Sunken);
     mdiArea = new MdiArea(vbox);
-    mdiArea->useLogo = settings[ST_MDI_USE_LOGO].i;
-    mdiArea->useTexture = settings[ST_MDI_USE_TEXTURE].i;
-    mdiArea->useColor = settings[ST_MDI_USE_COLOR].i;
-    mdiArea->bgLogo.load(QString(settings[ST_MDI_LOGO].s));
-    mdiArea->bgTexture.load(QString(settings[ST_MDI_TEXTURE].s));
-    mdiArea->bgColor = QColor(settings[ST_MDI_COLOR].i);
+    mdiArea->applyBackgroundSettings(settings);
     mdiArea->setViewMode(QMdiArea::TabbedView);
     mdiArea->setHorizontalScrollBarPolicy(Qt::ScrollBarAsNeeded);
     mdiArea->setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);
     mdiArea->setActivationOrder(QMdiArea::ActivationHistoryOrder);
     layout->addWidget(mdiArea);
     setCentralWidget(vbox);
-
-    mdiArea->forceRepaint();
+    startup_phase("mdi area");
 
     //create the Command Prompt
     prompt = new CmdPrompt();
@@ -1243,6 +1442,7 @@ MainWindow::MainWindow() : QMainWindow(0)
     connect(prompt, SIGNAL(showSettings()), this, SLOT(settingsPrompt()));
 
     connect(prompt, SIGNAL(historyAppended(QString)), this, SLOT(promptHistoryAppended(QString)));
+    startup_phase("command prompt");
 
     /* create the Object Property Editor */
     dockPropEdit = new PropertyEditor(
@@ -1250,23 +1450,31 @@ MainWindow::MainWindow() : QMainWindow(0)
         settings[ST_SELECTION_PICK_ADD].i, prompt, this);
     addDockWidget(Qt::LeftDockWidgetArea, dockPropEdit);
     connect(dockPropEdit, SIGNAL(pickAddModeToggled()), this, SLOT(pickAddModeToggled()));
+    startup_phase("property editor");
 
     /* create the Command History Undo Editor */
     dockUndoEdit = new UndoEditor(appDir + "/icons/" + icon_theme, prompt, this);
     addDockWidget(Qt::LeftDockWidgetArea, dockUndoEdit);
+    startup_phase("undo editor");
 
     //setDockOptions(QMainWindow::AnimatedDocks | QMainWindow::AllowTabbedDocks | QMainWindow::VerticalTabs); //TODO: Load these from settings
     //tabifyDockWidget(dockPropEdit, dockUndoEdit); //TODO: load this from settings
 
     statusbar = new StatusBar(this);
     this->setStatusBar(statusbar);
+    startup_phase("status bar");
 
     createAllActions();
+    startup_phase("create actions");
     createAllMenus();
+    startup_phase("create menus");
     createAllToolbars();
+    startup_phase("create toolbars");
 
     iconResize(settings[ST_ICON_SIZE].i);
     updateMenuToolbarStatusbar();
+    startup_phase("icon size (%d icon files read, %d atlas sheets built)",
+        icons->filesRead, icons->sheetsBuilt);
 
     //Show date in statusbar after it has been updated
     QDate date = QDate::currentDate();
@@ -1274,8 +1482,9 @@ MainWindow::MainWindow() : QMainWindow(0)
     statusbar->showMessage(datestr);
 
     showNormal();
+    startup_phase("show main window");
 
-    if (settings[ST_TIP_OF_THE_DAY].i) {
+    if (settings[ST_TIP_OF_THE_DAY].i && !session_log.replaying) {
         actuator("tips");
     }
 }
@@ -1289,6 +1498,8 @@ MainWindow::~MainWindow()
     //Prevent memory leaks by deleting any unpasted objects
     qDeleteAll(cutCopyObjectList.begin(), cutCopyObjectList.end());
     cutCopyObjectList.clear();
+
+    delete icons;
 }
 
 /* MainWindow::createAllActions
@@ -1322,13 +1533,11 @@ MainWindow::createAllActions()
         ActionData a = action_table[i];
 
         std::string icon_s(a.icon);
-        QString tooltip(a.tooltip);
-        QString statustip(a.statustip);
         std::string shortcut(a.shortcut);
-        QIcon icon = create_icon(a.icon);
+        QIcon icon = create_icon(a.id);
 
-        QAction *ACTION = new QAction(icon, tooltip, this);
-        ACTION->setStatusTip(statustip);
+        QAction *ACTION = new QAction(icon, translate_str(a.tooltip), this);
+        ACTION->setStatusTip(translate_str(a.statustip));
         ACTION->setObjectName(icon_s);
         if (shortcut != "") {
             ACTION->setShortcut(
@@ -1382,11 +1591,228 @@ MainWindow::createAllActions()
 const char *
 run_script(char **script)
 {
-    std::string output = "";
-    for (int i=0; !string_equal(script[i], "END"); i++) {
-        debug_message(script[i]);
-        output += actuator(script[i]);
+    int n = 0;
+    while (!string_equal(script[n], "END")) {
+        n++;
     }
+    return cached_script(script, n)->run();
+}
+
+/* Run the script in the file fname, one command per line. Blank lines
+ * and lines starting with '#' are skipped.
+ */
+const char *
+run_script_file(char *fname)
+{
+    static char error[2*MAX_STRING_LENGTH];
+    QFile file(fname);
+    if (!file.open(QIODevice::ReadOnly)) {
+        snprintf(error, 2*MAX_STRING_LENGTH,
+            "ERROR: could not open the script \"%s\".", fname);
+        return error;
+    }
+    QList<QByteArray> contents = file.readAll().split('\n');
+    std::vector<const char*> lines;
+    for (QByteArray& line : contents) {
+        if (line.endsWith('\r')) {
+            line.chop(1);
+        }
+        lines.push_back(line.constData());
+    }
+    return cached_script(lines.data(), (int)lines.size())->run();
+}
+
+/* The compiled form of the n lines, compiling them the first time they
+ * are seen. The cache is keyed by the hash of the text, so the same
+ * script reached by a different path is still compiled once. Scripts
+ * whose hashes collide are compared by their text and kept side by side.
+ *
+ * At most SCRIPT_CACHE_SIZE scripts are kept; past that the least
+ * recently used one that isn't running is dropped.
+ */
+static CompiledScript *
+cached_script(const char *const *lines, int n)
+{
+    static QMultiHash<uint32_t, CompiledScript*> cache;
+    static uint64_t tick = 0;
+    uint32_t h = FNV1A_OFFSET;
+    for (int i=0; i<n; i++) {
+        h = fnv1a_extend(h, lines[i]);
+        h = fnv1a_extend(h, "\n");
+    }
+    tick++;
+
+    for (auto it = cache.constFind(h); it != cache.constEnd() && it.key() == h; ++it) {
+        if (it.value()->matches(lines, n)) {
+            it.value()->lastUsed = tick;
+            return it.value();
+        }
+    }
+
+    if (cache.size() >= SCRIPT_CACHE_SIZE) {
+        auto oldest = cache.end();
+        for (auto it = cache.begin(); it != cache.end(); ++it) {
+            if (!it.value()->running
+                && (oldest == cache.end() || it.value()->lastUsed < oldest.value()->lastUsed)) {
+                oldest = it;
+            }
+        }
+        if (oldest != cache.end()) {
+            delete oldest.value();
+            cache.erase(oldest);
+        }
+    }
+
+    CompiledScript *script = new CompiledScript();
+    script->compile(lines, n);
+    script->hash = h;
+    script->lastUsed = tick;
+    cache.insert(h, script);
+    return script;
+}
+
+/* Replace the script with the n lines given. */
+void
+CompiledScript::compile(const char *const *lines, int n)
+{
+    ops.clear();
+    text.clear();
+    argv.clear();
+    reals.clear();
+    source.clear();
+    for (int i=0; i<n; i++) {
+        source += lines[i];
+        source += '\n';
+        add_line(lines[i]);
+    }
+}
+
+/* Whether the script was compiled from exactly these lines. */
+bool
+CompiledScript::matches(const char *const *lines, int n)
+{
+    size_t pos = 0;
+    for (int i=0; i<n; i++) {
+        size_t length = strlen(lines[i]);
+        if (source.compare(pos, length, lines[i]) || (source[pos+length] != '\n')) {
+            return false;
+        }
+        pos += length + 1;
+    }
+    return pos == source.size();
+}
+
+/* Look up the command at the start of line, split the line into its
+ * arguments and convert each one to a number once, here, rather than
+ * every time it runs. Numbers are read with atof(), so a word reads as 0.
+ */
+void
+CompiledScript::add_line(const char *line)
+{
+    while (*line == ' ' || *line == '\t') {
+        line++;
+    }
+    if (!*line || *line == '#') {
+        return;
+    }
+
+    ScriptOp op;
+    op.line = (int32_t)text.size();
+    text.insert(text.end(), line, line + strlen(line) + 1);
+
+    int length = (int)strcspn(line, " \t");
+    int index = command_index(line, length);
+    op.id = (index < 0) ? -1 : command_table[index].id;
+
+    const char *p = line + length;
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    op.args = op.line + (int32_t)(p - line);
+
+    op.argv = (int32_t)argv.size();
+    op.argc = 0;
+    for (p = line; *p && (op.argc < MAX_ARGS); op.argc++) {
+        length = (int)strcspn(p, " \t");
+        argv.push_back((int32_t)text.size());
+        text.insert(text.end(), p, p + length);
+        text.push_back(0);
+        reals.push_back(atof(text.data() + argv.back()));
+        p += length;
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+    }
+    ops.push_back(op);
+}
+
+/* Run operation i and return its output. */
+const char *
+CompiledScript::step(int i)
+{
+    static char unknown[2*MAX_STRING_LENGTH];
+    char *args_v[MAX_ARGS];
+    EmbReal reals_v[MAX_ARGS];
+    const ScriptOp& op = ops[i];
+    char *line = text.data() + op.line;
+
+    /* This could produce silly amounts of output, so watch this line. */
+    debug_message("action: %d", op.id);
+
+    if (op.id < 0) {
+        snprintf(unknown, 2*MAX_STRING_LENGTH,
+            "<br/><font color=\"red\">Unknown command \"%s\". Press F1 for help.</font>",
+            line);
+        return unknown;
+    }
+
+    /* Missing arguments read as empty, which is what atof() made of them. */
+    for (int j=0; j<MAX_ARGS; j++) {
+        args_v[j] = (char*)"";
+        reals_v[j] = 0.0;
+    }
+    for (int j=0; j<op.argc; j++) {
+        args_v[j] = text.data() + argv[op.argv + j];
+        reals_v[j] = reals[op.argv + j];
+    }
+    return execute_command(op.id, line, text.data() + op.args, args_v,
+        reals_v, op.argc);
+}
+
+/* Run every operation in turn, collecting their output. With
+ * --profile-scripts the time each command takes is printed as it goes.
+ *
+ * A script that runs itself is refused: there is no control flow to stop
+ * it, so it would never finish.
+ */
+const char *
+CompiledScript::run(void)
+{
+    static QElapsedTimer clock;
+    if (running) {
+        return "ERROR: a script cannot run itself.";
+    }
+    running = true;
+    if (!clock.isValid()) {
+        clock.start();
+    }
+
+    output.clear();
+    qint64 total = clock.nsecsElapsed();
+    for (int i=0; i<(int)ops.size(); i++) {
+        qint64 start = clock.nsecsElapsed();
+        output += step(i);
+        if (profile_scripts) {
+            fprintf(stderr, "script %08x: %4d %9.3f ms  %s\n", hash, i,
+                (clock.nsecsElapsed() - start) / 1e6, text.data() + ops[i].line);
+        }
+    }
+    if (profile_scripts) {
+        fprintf(stderr, "script %08x: %d commands in %.3f ms\n", hash,
+            (int)ops.size(), (clock.nsecsElapsed() - total) / 1e6);
+    }
+
+    running = false;
     return output.c_str();
 }
 
@@ -1426,51 +1852,49 @@ run_script(char **script)
 const char *
 actuator(char line[MAX_STRING_LENGTH])
 {
-    char argv[MAX_ARGS][MAX_STRING_LENGTH];
-    char args[MAX_STRING_LENGTH];
+    /* One per level of nesting, so a command that calls actuator() keeps
+     * its own arguments, and kept between calls so the text a command
+     * returns outlives it.
+     */
+    static CompiledScript commands[ACTUATOR_MAX_DEPTH];
+    static int depth = 0;
+    if (depth >= ACTUATOR_MAX_DEPTH) {
+        return "ERROR: commands nested too deeply.";
+    }
+    if (background_busy) {
+        return "ERROR: busy with the last command.";
+    }
+    if (depth == 0) {
+        session_log.command(line);
+    }
+    CompiledScript& command = commands[depth];
+    const char *lines[1] = {line};
+    command.compile(lines, 1);
+    if (command.ops.empty()) {
+        return "";
+    }
+    depth++;
+    const char *output = command.step(0);
+    depth--;
+    return output;
+}
+
+/* Carry out one command. argv[0] is the command name and reals holds
+ * each argument already converted to a number, while args is the text
+ * after the command name.
+ */
+static const char *
+execute_command(int action_id, char *line, char *args, char **argv,
+    EmbReal *reals, int argc)
+{
     char command[MAX_STRING_LENGTH];
     char error_str[MAX_STRING_LENGTH];
-    int i, j, argc;
     View* gview = activeView();
     QUndoStack* stack = NULL;
     if (gview) {
         stack = gview->undoStack;
     }
 
-    argc = 0;
-    j = 0;
-    for (i=0; i<strlen(line); i++) {
-        argv[argc][j] = line[i];
-        if (line[i] == ' ') {
-            argv[argc][j] = 0;
-            j = 0;
-        }
-        else {
-            j++;
-        }
-    }
-    argv[argc][j] = 0;
-
-    int action_id = -1;
-
-    for (i=0; i<N_COMMANDS; i++) {
-        if (string_equal(argv[0], command_table[i].command)) {
-            action_id = command_table[i].id;
-            break;
-        }
-    }
-
-    strcpy(args, line + strlen(command_table[action_id].command) + 1);
-
-    /* This could produce silly amounts of output, so watch this line. */
-    debug_message("action: %d", action_id);
-
-    if (action_id < 0) {
-        char out[2*MAX_STRING_LENGTH];
-        sprintf(out, "<br/><font color=\"red\">Unknown command \"%s\". Press F1 for help.</font>", line);
-        return out;
-    }
-
     switch (action_id) {
 
     /* Open the about dialog. */
@@ -1576,6 +2000,39 @@ actuator(char line[MAX_STRING_LENGTH])
         return "";
     }
 
+    /* heart|dolphin|snowflake [x y]
+     * Trace the design about (x, y), or the origin.
+     */
+    case COMMAND_ADD_HEART:
+    case COMMAND_ADD_DOLPHIN:
+    case COMMAND_ADD_SNOWFLAKE: {
+        int design = DESIGN_HEART5;
+        if (action_id == COMMAND_ADD_DOLPHIN) {
+            design = DESIGN_DOLPHIN;
+        }
+        if (action_id == COMMAND_ADD_SNOWFLAKE) {
+            design = DESIGN_SNOWFLAKE;
+        }
+        double x = 0.0, y = 0.0;
+        sscanf(args, "%lf %lf", &x, &y);
+        EmbVector position = {(EmbReal)x, (EmbReal)y};
+        add_design(design, position);
+        return "";
+    }
+
+    /* star [x y [radius [points]]] */
+    case COMMAND_ADD_STAR: {
+        double x = 0.0, y = 0.0, radius = 1.0;
+        int points = 5;
+        sscanf(args, "%lf %lf %lf %d", &x, &y, &radius, &points);
+        if (points < 3 || points > 1024) {
+            return "The star needs between 3 and 1024 points.";
+        }
+        EmbVector center = {(EmbReal)x, (EmbReal)y};
+        add_star(center, radius, points);
+        return "";
+    }
+
     /* . */
     case COMMAND_ADD_TO_SELECTION: {
         return "";
@@ -1610,19 +2067,19 @@ actuator(char line[MAX_STRING_LENGTH])
 
     /* . */
     case COMMAND_CALCULATE_ANGLE: {
-        EmbReal x1 = atof(argv[0]);
-        EmbReal y1 = atof(argv[1]);
-        EmbReal x2 = atof(argv[2]);
-        EmbReal y2 = atof(argv[3]);
+        EmbReal x1 = reals[1];
+        EmbReal y1 = reals[2];
+        EmbReal x2 = reals[3];
+        EmbReal y2 = reals[4];
         return std::to_string(QLineF(x1, -y1, x2, -y2).angle()).c_str();
     }
 
     /* . */
     case COMMAND_CALCULATE_DISTANCE: {
-        EmbReal x1 = atof(argv[0]);
-        EmbReal y1 = atof(argv[1]);
-        EmbReal x2 = atof(argv[2]);
-        EmbReal y2 = atof(argv[3]);
+        EmbReal x1 = reals[1];
+        EmbReal y1 = reals[2];
+        EmbReal x2 = reals[3];
+        EmbReal y2 = reals[4];
         return std::to_string(QLineF(x1, y1, x2, y2).length()).c_str();
     }
 
@@ -1882,10 +2339,10 @@ actuator(char line[MAX_STRING_LENGTH])
      */
     case COMMAND_MIRROR_SELECTED: {
         if (gview) {
-            EmbReal x1 = atof(argv[0]);
-            EmbReal y1 = atof(argv[1]);
-            EmbReal x2 = atof(argv[2]);
-            EmbReal y2 = atof(argv[3]);
+            EmbReal x1 = reals[1];
+            EmbReal y1 = reals[2];
+            EmbReal x2 = reals[3];
+            EmbReal y2 = reals[4];
             gview->mirrorSelected(x1, -y1, x2, -y2);
         }
         return "";
@@ -1912,8 +2369,8 @@ actuator(char line[MAX_STRING_LENGTH])
     /* . */
     case COMMAND_MOVE_SELECTED: {
         EmbVector delta;
-        delta.x = atof(argv[0]);
-        delta.y = -atof(argv[1]);
+        delta.x = reals[1];
+        delta.y = -reals[2];
         View* gview = activeView();
         if (gview) {
             gview->moveSelected(delta);
@@ -2008,12 +2465,12 @@ actuator(char line[MAX_STRING_LENGTH])
     }
 
     case COMMAND_PERPENDICULAR_DISTANCE: {
-        EmbReal px = atof(argv[0]);
-        EmbReal py = atof(argv[1]);
-        EmbReal x1 = atof(argv[2]);
-        EmbReal y1 = atof(argv[3]);
-        EmbReal x2 = atof(argv[4]);
-        EmbReal y2 = atof(argv[5]);
+        EmbReal px = reals[1];
+        EmbReal py = reals[2];
+        EmbReal x1 = reals[3];
+        EmbReal y1 = reals[4];
+        EmbReal x2 = reals[5];
+        EmbReal y2 = reals[6];
         QLineF line(x1, y1, x2, y2);
         QLineF norm = line.normalVector();
         EmbReal dx = px-x1;
@@ -2153,9 +2610,9 @@ actuator(char line[MAX_STRING_LENGTH])
     case COMMAND_ROTATE_SELECTED: {
         if (gview) {
             EmbVector v;
-            v.x = atof(argv[0]);
-            v.y = -atof(argv[1]);
-            EmbReal rot = atof(argv[2]);
+            v.x = reals[1];
+            v.y = -reals[2];
+            EmbReal rot = reals[3];
             gview->rotateSelected(v, -rot);
         }
         return "";
@@ -2199,17 +2656,185 @@ actuator(char line[MAX_STRING_LENGTH])
         return "";
     }
 
-    /* Run the lines in another script before continuing.
+    /* Run the lines in another script before continuing. */
     case COMMAND_RUN: {
-        return run_script_file(argv[0]);
-    } */
+        return run_script_file(argv[1]);
+    }
+
+    /* simulate [speed] | simulate seek seconds | simulate stop
+     * Play the design stitch by stitch at speed times the machine's pace,
+     * or stop if it is already playing.
+     */
+    case COMMAND_SIMULATE: {
+        if (!gview) {
+            return "";
+        }
+        StitchSimulation& sim = gview->simulation;
+        if (!strcmp(argv[1], "seek")) {
+            sim.seek(reals[2]);
+            return "";
+        }
+        if (!strcmp(argv[1], "stop") || (gview->state & VIEW_STATE_SIMULATE)) {
+            sim.stop();
+            return "";
+        }
+        EmbReal speed = (argc > 1) ? reals[1] : 1.0;
+        if (!sim.start(speed)) {
+            return "There are no stitches to simulate.";
+        }
+        QString report = "Estimated run time "
+            + format_run_time(sim.duration()) + ".";
+        if (prompt) {
+            prompt->appendHistory(report);
+        }
+        return "";
+    }
+
+    /* Show or hide the stitch density map. */
+    case COMMAND_DENSITY: {
+        if (!gview) {
+            return "";
+        }
+        if (!strcmp(argv[1], "stop") || (gview->state & VIEW_STATE_DENSITY)) {
+            gview->density.stop();
+            return "";
+        }
+        gview->density.start();
+        if (prompt) {
+            prompt->appendHistory(QString("Showing stitches per mm² in %1 mm "
+                "cells, red over %2.")
+                .arg(settings[ST_DENSITY_CELL].r)
+                .arg(settings[ST_DENSITY_LIMIT].r));
+        }
+        return "";
+    }
+
+    /* Split the design between hoops, each written to its own file. The
+     * hoop is the one in the settings unless a width and height, and
+     * optionally an overlap, are given.
+     */
+    case COMMAND_SPLIT_HOOP: {
+        if (!gview) {
+            return "";
+        }
+        EmbReal width = (argc > 2) ? reals[1] : settings[ST_HOOP_WIDTH].r;
+        EmbReal height = (argc > 2) ? reals[2] : settings[ST_HOOP_HEIGHT].r;
+        EmbReal overlap = (argc > 3) ? reals[3] : settings[ST_HOOP_OVERLAP].r;
+        if ((width <= 0.0) || (height <= 0.0) || (overlap < 0.0)) {
+            return "The hoop needs a width and height and an overlap of 0 or more.";
+        }
+        MdiWindow* mdiWin = _mainWin->activeMdiWindow();
+        QString fileName = mdiWin ? mdiWin->curFile : QString();
+        if (!QFileInfo(fileName).exists()) {
+            fileName = QFileDialog::getSaveFileName(_mainWin,
+                translate_str("Split Between Hoops"),
+                QString::fromStdString(settings[ST_RECENT_DIRECTORY].s),
+                _mainWin->formatFilterSave);
+            if (fileName.isEmpty()) {
+                return "";
+            }
+        }
+
+        EmbPattern* pattern = embPattern_create();
+        if (!pattern) {
+            return "Could not allocate memory for embroidery pattern.";
+        }
+        build_stitches(gview, pattern);
+        std::vector<HoopFile> files;
+        int status = split_hoops(pattern, fileName, width, height, overlap,
+            files);
+        embPattern_free(pattern);
+        if (status != HOOP_OK) {
+            return hoop_message(status);
+        }
+        if (prompt) {
+            prompt->appendHistory(QString("Split between %1 hoops of %2 x %3 mm.")
+                .arg(files.size()).arg(width).arg(height));
+            for (const HoopFile& file : files) {
+                prompt->appendHistory(QString("  %1, column %2 row %3: %4 stitches%5")
+                    .arg(QString::fromStdString(file.file))
+                    .arg(file.column + 1).arg(file.row + 1).arg(file.stitches)
+                    .arg(file.ok ? "" : ", could not be written"));
+            }
+        }
+        return "";
+    }
+
+    /* Replace the selected closed objects with their union or
+     * intersection, or the lowest of them less the others.
+     */
+    case COMMAND_UNION:
+    case COMMAND_DIFFERENCE:
+    case COMMAND_INTERSECTION: {
+        if (!gview) {
+            return "";
+        }
+        int op = CLIP_UNION;
+        if (action_id == COMMAND_DIFFERENCE) {
+            op = CLIP_DIFFERENCE;
+        }
+        else if (action_id == COMMAND_INTERSECTION) {
+            op = CLIP_INTERSECTION;
+        }
+        int rings = gview->combineSelected(op);
+        if (rings == -2) {
+            return "Could not combine the objects, so they were kept.";
+        }
+        if (rings < 0) {
+            return "Select two or more circles, ellipses, rectangles, polygons or closed paths.";
+        }
+        if (prompt) {
+            if (rings) {
+                prompt->appendHistory(QString("Combined into a path of %1 outlines.")
+                    .arg(rings));
+            }
+            else {
+                prompt->appendHistory("Nothing is left, so the objects were kept.");
+            }
+        }
+        return "";
+    }
+
+    /* Add an outline a distance outside each selected closed object, or
+     * inside for a negative distance.
+     */
+    case COMMAND_OFFSET: {
+        if (!gview) {
+            return "";
+        }
+        if (reals[1] == 0.0) {
+            return "The offset needs a distance other than 0.";
+        }
+        int made = gview->offsetSelected(reals[1]);
+        if (prompt) {
+            prompt->appendHistory(QString("Offset %1 objects by %2 mm.")
+                .arg(made).arg(reals[1]));
+        }
+        return "";
+    }
+
+    /* Change every object's colour to the nearest thread in a catalog. */
+    case COMMAND_MATCH_THREADS: {
+        if (!gview) {
+            return "";
+        }
+        ThreadCatalog catalog;
+        if (!catalog.load(argv[1])) {
+            return "Could not read any threads from that catalog.";
+        }
+        int changed = gview->matchThreads(catalog);
+        if (prompt) {
+            prompt->appendHistory(QString("Matched %1 objects to %2 (%3 threads).")
+                .arg(changed).arg(catalog.name).arg(catalog.size()));
+        }
+        return "";
+    }
 
     case COMMAND_SCALE_SELECTED: {
         EmbVector v;
-        char *argv[5];
-        v.x = atof(argv[0]);
-        v.y = -atof(argv[1]);
-        EmbReal factor = atof(argv[2]);
+        v.x = reals[1];
+        v.y = -reals[2];
+        EmbReal factor = reals[3];
 
         if (factor <= 0.0) {
             QMessageBox::critical(_mainWin,
@@ -2234,9 +2859,9 @@ actuator(char line[MAX_STRING_LENGTH])
 
     /* . */
     case COMMAND_SET_COLOR: {
-        int r = atoi(argv[1]);
-        int g = atoi(argv[2]);
-        int b = atoi(argv[3]);
+        int r = (int)reals[1];
+        int g = (int)reals[2];
+        int b = (int)reals[3];
 
         if (r < 0 || r > 255) {
             return "ERROR SET_COLOR: r value must be in range 0-255";
@@ -2356,31 +2981,43 @@ actuator(char line[MAX_STRING_LENGTH])
         return args;
     }
 
+    /* Rubber modes, point keys and text keys are translated to their
+     * slots once here so the objects themselves never compare strings.
+     */
     case COMMAND_SET_RUBBER_MODE: {
-        /*
         if (gview) {
-            std::string mode = QString::fromStdString(a[0].s).toUpper().toStdString();
-
-            if (contains(rubber_modes, mode)) {
-                gview->setRubberMode("OBJ_RUBBER_" + mode);
-            }
-            else {
+            int32_t mode = string_array_index(rubber_modes, args);
+            if (mode < 0) {
                 return "ERROR: setRubberMode(): unknown rubberMode value";
-                //return context->throwError(QScriptContext::UnknownError, "setRubberMode(): unknown rubberMode value");
             }
+            gview->setRubberMode(mode);
         }
-        */
         return "";
     }
 
     /* QString key, EmbReal x, EmbReal y
      */
     case COMMAND_SET_RUBBER_POINT: {
-        /*
-        _mainWin->setRubberPoint(a[0].s.toUpper(), a[1].r, a[2].r);
-        */
         if (gview) {
-            //gview->setRubberPoint(key, QPointF(x, -y));
+            char key[MAX_STRING_LENGTH];
+            double x, y;
+            int32_t index;
+            /* The width is MAX_STRING_LENGTH - 1. */
+            if (sscanf(args, "%199s %lf %lf", key, &x, &y) != 3) {
+                return "ERROR: setRubberPoint(): requires 3 arguments.";
+            }
+            if ((sscanf(key, "POLYGON_POINT_%d", &index) == 1)
+                || (sscanf(key, "POLYLINE_POINT_%d", &index) == 1)) {
+                if (!gview->setRubberVertex(index, QPointF(x, -y))) {
+                    return "ERROR: setRubberPoint(): vertices must be set in order.";
+                }
+                return "";
+            }
+            int32_t slot = string_array_index(rubber_point_keys, key);
+            if (slot <= RUBBER_POINT_QSNAP) {
+                return "ERROR: setRubberPoint(): unknown key.";
+            }
+            gview->setRubberPoint(slot, QPointF(x, -y));
         }
         return "";
     }
@@ -2390,11 +3027,19 @@ actuator(char line[MAX_STRING_LENGTH])
      */
     case COMMAND_SET_RUBBER_TEXT: {
         if (gview) {
-            // if (!contains(args, " ")) { return "requires 2 arguments." }
-            // QString key = get_first_word(args);
-            // QString txt = args + key[len(args)] + 1;
-            // _mainWin->setRubberText(key, a[1].s);
-            // gview->setRubberText(key, txt);
+            char key[MAX_STRING_LENGTH];
+            if (sscanf(args, "%199s", key) != 1) {
+                return "ERROR: setRubberText(): requires 2 arguments.";
+            }
+            int32_t slot = string_array_index(rubber_text_keys, key);
+            if (slot < 0) {
+                return "ERROR: setRubberText(): unknown key.";
+            }
+            const char *txt = args + strlen(key);
+            if (*txt == ' ') {
+                txt++;
+            }
+            gview->setRubberText(slot, QString(txt));
         }
         return "";
     }
@@ -2404,29 +3049,24 @@ actuator(char line[MAX_STRING_LENGTH])
      */
     case COMMAND_SPARE_RUBBER: {
         if (gview) {
-            int64_t id = std::stoi(args);
-            gview->spareRubber(id);
-        }
-
-        //QString objID = QString::fromStdString(a[0].s).toUpper();
-
-        /*
-        if (objID == "PATH") {
-            _mainWin->nativespare_rubber_action(SPARE_RUBBER_PATH);
-        }
-        else if (objID == "POLYGON") {
-            _mainWin->nativespare_rubber_action(SPARE_RUBBER_POLYGON);
-        }
-        else if (objID == "POLYLINE") {
-            _mainWin->nativespare_rubber_action(SPARE_RUBBER_POLYLINE);
-        }
-        else {
-            bool ok = false;
-            qint64 id = objID.toLongLong(&ok);
-            if (!ok) return "TYPE ERROR: spare_rubber_action(): error converting object ID into an int64");
-            _mainWin->nativespare_rubber_action(id);
+            if (string_equal(args, "PATH")) {
+                gview->spareRubber(SPARE_RUBBER_PATH);
+            }
+            else if (string_equal(args, "POLYGON")) {
+                gview->spareRubber(SPARE_RUBBER_POLYGON);
+            }
+            else if (string_equal(args, "POLYLINE")) {
+                gview->spareRubber(SPARE_RUBBER_POLYLINE);
+            }
+            else {
+                char *end = NULL;
+                int64_t id = strtoll(args, &end, 10);
+                if ((end == args) || (id < 0)) {
+                    return "TYPE ERROR: spare_rubber_action(): error converting object ID into an int64";
+                }
+                gview->spareRubber(id);
+            }
         }
-        */
         return "";
     }
 
@@ -3015,6 +3655,42 @@ MainWindow::closeEvent(QCloseEvent* event)
     event->accept();
 }
 
+/* Installing a new catalog sends every window a LanguageChange. The
+ * menus, toolbars and actions are built from the tables in core.c, so
+ * they are retitled from the same source strings.
+ */
+void
+MainWindow::changeEvent(QEvent* event)
+{
+    if (event->type() == QEvent::LanguageChange) {
+        retranslate();
+    }
+    QMainWindow::changeEvent(event);
+}
+
+/* Show the menus, toolbars and actions in the current language. */
+void
+MainWindow::retranslate()
+{
+    for (int i=0; i<TOTAL_MENUS; i++) {
+        if (menuHash[i]) {
+            menuHash[i]->setTitle(translate_str(menu_titles[i]));
+        }
+    }
+    for (int i=0; i<TOTAL_TOOLBARS; i++) {
+        if (toolbarHash[i]) {
+            toolbarHash[i]->setWindowTitle(translate_str(toolbar_data[i].key));
+        }
+    }
+    for (int i=0; i<N_ACTIONS; i++) {
+        QAction* action = actionHash[action_table[i].id];
+        if (action) {
+            action->setText(translate_str(action_table[i].tooltip));
+            action->setStatusTip(translate_str(action_table[i].statustip));
+        }
+    }
+}
+
 /* MainWindow::onCloseWindow
  */
 void
@@ -3290,6 +3966,8 @@ UndoableCommand::UndoableCommand(std::string command_, QString text, Geometry* o
 {
     gview = v;
     object = obj;
+    objID = obj->objID;
+    restoreCount = v->tombstones.restoreCount;
     command = command_;
     setText(text);
 }
@@ -3299,6 +3977,8 @@ UndoableCommand::UndoableCommand(EmbVector delta_, QString text, Geometry* obj,
 {
     gview = v;
     object = obj;
+    objID = obj->objID;
+    restoreCount = v->tombstones.restoreCount;
     command = "move";
     setText(text);
     delta = delta_;
@@ -3310,6 +3990,8 @@ UndoableCommand::UndoableCommand(
 {
     gview = v;
     object = obj;
+    objID = obj->objID;
+    restoreCount = v->tombstones.restoreCount;
     setText(text);
     command = command;
     if (command == "scale") {
@@ -3348,11 +4030,17 @@ UndoableCommand::UndoableCommand(
 void
 UndoableCommand::undo()
 {
+    if ((command != "nav") && (command != "delete") && !target()) {
+        debug_message("ERROR: object %lld is missing, cannot undo.", (long long)objID);
+        return;
+    }
+
     if (command == "add") {
         gview->deleteObject(object);
     }
     else if (command == "delete") {
-        gview->addObject(object);
+        object = gview->restoreObject(objID);
+        restoreCount = gview->tombstones.restoreCount;
     }
     else if (command == "move") {
         object->moveBy(-delta.x, -delta.y);
@@ -3370,7 +4058,11 @@ UndoableCommand::undo()
     else if (command == "mirror") {
         mirror();
     }
+    else if (command == "recolor") {
+        object->setObjectColor(fromColor);
+    }
     else if (command == "nav") {
+        gview->navigator.finish();
         if (!done) {
             toTransform = gview->transform();
             toCenter = gview->center();
@@ -3386,8 +4078,22 @@ UndoableCommand::undo()
 void
 UndoableCommand::redo()
 {
+    if ((command != "nav") && (command != "add") && !target()) {
+        debug_message("ERROR: object %lld is missing, cannot redo.", (long long)objID);
+        return;
+    }
+
     if (command == "add") {
-        gview->addObject(object);
+        /* On the first redo the object is new and has never been buried. */
+        if (gview->tombstones.contains(objID)) {
+            object = gview->restoreObject(objID);
+            restoreCount = gview->tombstones.restoreCount;
+        }
+        else {
+            gview->addObject(object);
+            /* The id is only given out once the object is in the scene. */
+            objID = object->objID;
+        }
     }
     else if (command == "delete") {
         gview->deleteObject(object);
@@ -3408,6 +4114,9 @@ UndoableCommand::redo()
     else if (command == "mirror") {
         mirror();
     }
+    else if (command == "recolor") {
+        object->setObjectColor(toColor);
+    }
     else if (command == "nav") {
         if (!done) {
             if (navType == "ZoomInToPoint")  {
@@ -3444,12 +4153,27 @@ UndoableCommand::redo()
             toCenter = gview->center();
         }
         else {
+            gview->navigator.finish();
             gview->setTransform(toTransform);
             gview->centerAt(toCenter);
         }
     }
 }
 
+/* Objects are freed when they are buried in the tombstone store, so once
+ * anything has been restored the pointer we hold may be stale and the
+ * object is looked up again by its id.
+ */
+Geometry*
+UndoableCommand::target()
+{
+    if (restoreCount != gview->tombstones.restoreCount) {
+        object = gview->objectFromId(objID);
+        restoreCount = gview->tombstones.restoreCount;
+    }
+    return object;
+}
+
 /* . */
 void
 UndoableCommand::rotate(EmbVector pivot, EmbReal rot)
@@ -3466,10 +4190,14 @@ UndoableCommand::rotate(EmbVector pivot, EmbReal rot)
 UndoableCommand::UndoableCommand(QString type, View* v, QUndoCommand* parent) : QUndoCommand(parent)
 {
     gview = v;
+    object = 0;
+    objID = 0;
+    restoreCount = 0;
     navType = type;
     setText(QObject::tr("Navigation"));
     command = "nav";
     done = false;
+    gview->navigator.finish();
     fromTransform = gview->transform();
     fromCenter = gview->center();
 }
@@ -3493,6 +4221,8 @@ UndoableCommand::UndoableCommand(const QPointF beforePoint, const QPointF afterP
 {
     gview = v;
     object = obj;
+    objID = obj->objID;
+    restoreCount = v->tombstones.restoreCount;
     setText(text);
     command = "gripedit";
     before = beforePoint;
@@ -3504,6 +4234,8 @@ UndoableCommand::UndoableCommand(EmbReal x1, EmbReal y1, EmbReal x2, EmbReal y2,
 {
     gview = v;
     object = obj;
+    objID = obj->objID;
+    restoreCount = v->tombstones.restoreCount;
     setText(text);
     command = "mirror";
     mirrorLine = QLineF(x1, y1, x2, y2);
@@ -22,27 +22,780 @@
 
 #include "core.h"
 
-#define DESIGN_HEART4          0
-#define DESIGN_HEART5          1
-#define DESIGN_DOLPHIN         2
-#define DESIGN_SNOWFLAKE       3
-
-/* TODO fix this */
-EmbReal dolphin_x[] = {
-    1.0, 1.0
+/* Fourier coefficients for the dolphin and snowflake designs as
+ * {amplitude, phase, frequency} triples, see fourier_series().
+ *
+ * These are transcribed from the /dolphinx, /dolphiny blocks of
+ * assets/commands/dolphin.toml and the x, y expressions of
+ * assets/commands/snowflake.toml, with each a/b*sin(c/d - e*t) written
+ * as {a/b, c/d, -e} and each a/b*sin(k*t + c/d) as {a/b, c/d, k}. Keep
+ * them in step if the designs change.
+ */
+const EmbReal dolphin_x[] = {
+    4.0/23, 62.0/33, -58.0,
+    8.0/11, 10.0/9, -56.0,
+    17.0/24, 38.0/35, -55.0,
+    30.0/89, 81.0/23, -54.0,
+    3.0/17, 53.0/18, -53.0,
+    21.0/38, 29.0/19, -52.0,
+    11.0/35, 103.0/40, -51.0,
+    7.0/16, 79.0/18, -50.0,
+    4.0/15, 270.0/77, -49.0,
+    19.0/35, 59.0/27, -48.0,
+    37.0/43, 71.0/17, -47.0,
+    1.0, 18.0/43, -45.0,
+    21.0/26, 37.0/26, -44.0,
+    27.0/19, 111.0/32, -42.0,
+    8.0/39, 13.0/25, -41.0,
+    23.0/30, 27.0/8, -40.0,
+    23.0/21, 32.0/35, -37.0,
+    18.0/37, 91.0/31, -36.0,
+    45.0/22, 29.0/37, -35.0,
+    56.0/45, 11.0/8, -33.0,
+    4.0/7, 32.0/19, -32.0,
+    54.0/23, 74.0/29, -31.0,
+    28.0/19, 125.0/33, -30.0,
+    19.0/9, 73.0/27, -29.0,
+    16.0/17, 737.0/736, -28.0,
+    52.0/33, 130.0/29, -27.0,
+    41.0/23, 43.0/30, -25.0,
+    29.0/20, 67.0/26, -24.0,
+    64.0/25, 136.0/29, -23.0,
+    162.0/37, 59.0/34, -21.0,
+    871.0/435, 199.0/51, -20.0,
+    61.0/42, 58.0/17, -19.0,
+    159.0/25, 77.0/31, -17.0,
+    241.0/15, 94.0/31, -13.0,
+    259.0/18, 114.0/91, -12.0,
+    356.0/57, 23.0/25, -11.0,
+    2283.0/137, 23.0/25, -10.0,
+    1267.0/45, 139.0/42, -9.0,
+    613.0/26, 41.0/23, -8.0,
+    189.0/16, 122.0/47, -6.0,
+    385.0/6, 151.0/41, -5.0,
+    2551.0/38, 106.0/35, -4.0,
+    1997.0/18, 6.0/5, -2.0,
+    -43357.0/47, 81.0/26, -1.0,
+    -4699.0/35, 25.0/31, 3.0,
+    -1029.0/34, 20.0/21, 7.0,
+    -250.0/17, 7.0/40, 14.0,
+    -140.0/17, 14.0/25, 15.0,
+    -194.0/29, 29.0/44, 16.0,
+    -277.0/52, 37.0/53, 18.0,
+    -94.0/41, 33.0/31, 22.0,
+    -57.0/28, 44.0/45, 26.0,
+    -128.0/61, 11.0/14, 34.0,
+    -111.0/95, 55.0/37, 38.0,
+    -85.0/71, 4.0/45, 39.0,
+    -25.0/29, 129.0/103, 43.0,
+    -7.0/37, 9.0/20, 46.0,
+    -17.0/32, 11.0/28, 57.0,
+    -5.0/16, 32.0/39, 59.0,
 };
-EmbReal dolphin_y[] = {
-    1.0, 1.0
+
+const EmbReal dolphin_y[] = {
+    5.0/11, 163.0/37, -59.0,
+    7.0/22, 19.0/41, -58.0,
+    30.0/41, 1.0, -57.0,
+    37.0/29, 137.0/57, -56.0,
+    5.0/7, 17.0/6, -55.0,
+    11.0/39, 46.0/45, -52.0,
+    25.0/28, 116.0/83, -51.0,
+    25.0/34, 11.0/20, -47.0,
+    8.0/27, 81.0/41, -46.0,
+    44.0/39, 78.0/37, -45.0,
+    11.0/25, 107.0/37, -44.0,
+    7.0/20, 7.0/16, -41.0,
+    30.0/31, 19.0/5, -40.0,
+    37.0/27, 148.0/59, -39.0,
+    44.0/39, 17.0/27, -38.0,
+    13.0/11, 7.0/11, -37.0,
+    28.0/33, 119.0/39, -36.0,
+    27.0/13, 244.0/81, -35.0,
+    13.0/23, 113.0/27, -34.0,
+    47.0/38, 127.0/32, -33.0,
+    155.0/59, 173.0/45, -29.0,
+    105.0/37, 22.0/43, -27.0,
+    106.0/27, 23.0/37, -26.0,
+    97.0/41, 53.0/29, -25.0,
+    83.0/45, 109.0/31, -24.0,
+    81.0/31, 96.0/29, -23.0,
+    56.0/37, 29.0/10, -22.0,
+    44.0/13, 29.0/19, -19.0,
+    18.0/5, 34.0/31, -18.0,
+    163.0/51, 75.0/17, -17.0,
+    152.0/31, 61.0/18, -16.0,
+    146.0/19, 47.0/20, -15.0,
+    353.0/35, 55.0/48, -14.0,
+    355.0/28, 102.0/25, -12.0,
+    1259.0/63, 71.0/18, -11.0,
+    17.0/35, 125.0/52, -10.0,
+    786.0/23, 23.0/26, -6.0,
+    2470.0/41, 77.0/30, -5.0,
+    2329.0/47, 47.0/21, -4.0,
+    2527.0/33, 23.0/14, -3.0,
+    -9931.0/33, 51.0/35, -2.0,
+    -11506.0/19, 56.0/67, 1.0,
+    -2081.0/42, 9.0/28, 7.0,
+    -537.0/14, 3.0/25, 8.0,
+    -278.0/29, 23.0/33, 9.0,
+    -107.0/15, 35.0/26, 13.0,
+    -56.0/19, 5.0/9, 20.0,
+    -5.0/9, 1.0/34, 21.0,
+    -17.0/24, 36.0/23, 28.0,
+    -21.0/11, 27.0/37, 30.0,
+    -138.0/83, 1.0/7, 31.0,
+    -10.0/17, 29.0/48, 32.0,
+    -31.0/63, 27.0/28, 42.0,
+    -4.0/27, 29.0/43, 43.0,
+    -13.0/24, 5.0/21, 48.0,
+    -4.0/7, 29.0/23, 49.0,
+    -26.0/77, 29.0/27, 50.0,
+    19.0/14, 61.0/48, 53.0,
+    34.0/25, 37.0/26, 54.0,
 };
-int32_t dolphin_terms = 2;
 
-EmbReal snowflake_x[] = {
-    1.0, 1.0
+const EmbReal snowflake_x[] = {
+    4.0/7, 20.0/11, -318.0,
+    3.0/13, 19.0/11, -317.0,
+    3.0/5, 21.0/16, -316.0,
+    1.0/6, 17.0/5, -315.0,
+    2.0/9, 20.0/19, -314.0,
+    5.0/9, 35.0/9, -313.0,
+    7.0/12, 9.0/8, -310.0,
+    5.0/16, 33.0/8, -309.0,
+    5.0/11, 31.0/11, -308.0,
+    4.0/7, 3.0/8, -307.0,
+    4.0/11, 9.0/8, -306.0,
+    7.0/8, 21.0/11, -305.0,
+    2.0/3, 55.0/13, -304.0,
+    5.0/9, 17.0/7, -303.0,
+    3.0/10, 3.0/13, -302.0,
+    4.0/11, 60.0/17, -301.0,
+    6.0/11, 48.0/11, -300.0,
+    9.0/19, 1.0/6, -299.0,
+    4.0/5, 19.0/11, -298.0,
+    7.0/13, 25.0/8, -297.0,
+    7.0/11, 19.0/7, -296.0,
+    1.0/2, 1.0, -295.0,
+    4.0/9, 24.0/11, -294.0,
+    1.0/3, 7.0/2, -291.0,
+    6.0/17, 15.0/13, -290.0,
+    11.0/17, 32.0/7, -288.0,
+    3.0/8, 33.0/8, -287.0,
+    4.0/7, 15.0/7, -286.0,
+    4.0/5, 48.0/11, -284.0,
+    6.0/7, 10.0/7, -283.0,
+    6.0/7, 20.0/11, -282.0,
+    3.0/8, 11.0/7, -281.0,
+    5.0/7, 23.0/6, -280.0,
+    1.0/21, 19.0/12, -279.0,
+    4.0/9, 1.0/5, -278.0,
+    5.0/8, 5.0/9, -276.0,
+    9.0/10, 2.0/3, -274.0,
+    5.0/8, 5.0/11, -273.0,
+    1.0/6, 9.0/2, -272.0,
+    12.0/25, 29.0/12, -271.0,
+    7.0/13, 59.0/15, -270.0,
+    5.0/7, 23.0/9, -269.0,
+    3.0/4, 9.0/2, -268.0,
+    5.0/11, 37.0/9, -267.0,
+    10.0/11, 11.0/7, -266.0,
+    1.0/3, 3.0/7, -264.0,
+    7.0/9, 33.0/17, -262.0,
+    5.0/8, 9.0/8, -261.0,
+    5.0/8, 38.0/13, -260.0,
+    11.0/21, 36.0/13, -259.0,
+    3.0/11, 1.0/29, -258.0,
+    8.0/15, 31.0/8, -257.0,
+    2.0/5, 3.0/13, -256.0,
+    1.0/2, 47.0/10, -255.0,
+    1.0/10, 33.0/10, -254.0,
+    2.0/5, 1.0/2, -253.0,
+    4.0/7, 33.0/7, -252.0,
+    6.0/17, 3.0/8, -250.0,
+    5.0/7, 25.0/9, -249.0,
+    7.0/9, 35.0/8, -248.0,
+    2.0/7, 81.0/20, -247.0,
+    5.0/8, 25.0/6, -244.0,
+    5.0/16, 11.0/21, -243.0,
+    11.0/13, 167.0/42, -242.0,
+    11.0/15, 18.0/5, -241.0,
+    13.0/14, 37.0/11, -240.0,
+    1.0/4, 20.0/9, -239.0,
+    9.0/14, 52.0/15, -238.0,
+    9.0/14, 17.0/14, -237.0,
+    6.0/13, 69.0/17, -236.0,
+    5.0/8, 74.0/21, -235.0,
+    7.0/15, 76.0/25, -234.0,
+    10.0/11, 15.0/8, -232.0,
+    5.0/11, 5.0/9, -230.0,
+    1.0/8, 8.0/3, -229.0,
+    5.0/9, 2.0/7, -227.0,
+    4.0/13, 32.0/9, -226.0,
+    2.0/3, 45.0/11, -225.0,
+    1.0/30, 53.0/15, -223.0,
+    7.0/11, 4.0/11, -222.0,
+    10.0/19, 31.0/13, -221.0,
+    1.0, 13.0/7, -219.0,
+    9.0/14, 33.0/7, -216.0,
+    2.0/3, 19.0/9, -215.0,
+    3.0/5, 27.0/11, -214.0,
+    9.0/11, 43.0/10, -210.0,
+    5.0/7, 13.0/8, -209.0,
+    5.0/9, 21.0/5, -208.0,
+    2.0/7, 14.0/9, -206.0,
+    9.0/8, 23.0/7, -205.0,
+    18.0/13, 11.0/9, -203.0,
+    7.0/4, 47.0/12, -201.0,
+    10.0/7, 8.0/9, -200.0,
+    7.0/10, 6.0/11, -199.0,
+    5.0/3, 7.0/6, -198.0,
+    19.0/11, 11.0/6, -196.0,
+    15.0/8, 9.0/8, -195.0,
+    8.0/17, 9.0/7, -192.0,
+    8.0/3, 39.0/10, -191.0,
+    23.0/10, 2.0/7, -188.0,
+    3.0/4, 3.0/5, -187.0,
+    7.0/12, 50.0/11, -185.0,
+    57.0/29, 4.0, -184.0,
+    9.0/8, 6.0/7, -183.0,
+    9.0/7, 15.0/13, -182.0,
+    5.0/13, 16.0/7, -181.0,
+    18.0/7, 5.0/14, -180.0,
+    17.0/9, 35.0/12, -179.0,
+    5.0/4, 5.0/7, -178.0,
+    22.0/23, 3.0/4, -176.0,
+    3.0/8, 48.0/13, -175.0,
+    15.0/11, 13.0/11, -174.0,
+    25.0/17, 23.0/5, -173.0,
+    18.0/11, 19.0/8, -172.0,
+    11.0/16, 5.0/3, -170.0,
+    39.0/38, 15.0/7, -169.0,
+    7.0/6, 36.0/11, -166.0,
+    15.0/11, 11.0/6, -163.0,
+    17.0/13, 3.0, -162.0,
+    11.0/9, 20.0/7, -161.0,
+    9.0/7, 35.0/9, -160.0,
+    7.0/6, 3.0/2, -159.0,
+    8.0/7, 9.0/10, -158.0,
+    12.0/25, 13.0/5, -156.0,
+    6.0/13, 25.0/13, -154.0,
+    9.0/13, 7.0/8, -152.0,
+    23.0/10, 33.0/14, -151.0,
+    8.0/11, 36.0/11, -150.0,
+    15.0/7, 26.0/7, -149.0,
+    6.0/5, 53.0/12, -148.0,
+    14.0/11, 3.0/2, -147.0,
+    9.0/8, 4.0/3, -146.0,
+    5.0/8, 18.0/13, -145.0,
+    15.0/7, 3.0/8, -143.0,
+    5.0/8, 5.0/6, -142.0,
+    6.0/7, 35.0/9, -139.0,
+    16.0/13, 1.0/2, -138.0,
+    9.0/4, 7.0/2, -137.0,
+    20.0/9, 15.0/8, -135.0,
+    11.0/8, 9.0/4, -134.0,
+    1.0, 19.0/10, -133.0,
+    22.0/7, 48.0/11, -132.0,
+    23.0/14, 1.0, -131.0,
+    19.0/9, 27.0/8, -130.0,
+    19.0/5, 20.0/7, -129.0,
+    18.0/5, 76.0/25, -128.0,
+    27.0/8, 4.0/5, -126.0,
+    37.0/8, 3.0/8, -125.0,
+    62.0/11, 11.0/3, -124.0,
+    49.0/11, 7.0/6, -123.0,
+    21.0/22, 23.0/12, -122.0,
+    223.0/74, 11.0/3, -121.0,
+    11.0/5, 19.0/5, -120.0,
+    13.0/4, 33.0/13, -119.0,
+    27.0/8, 22.0/5, -117.0,
+    24.0/7, 13.0/7, -114.0,
+    69.0/17, 18.0/17, -113.0,
+    10.0/9, 2.0/7, -112.0,
+    133.0/66, 12.0/7, -111.0,
+    2.0/5, 47.0/24, -110.0,
+    13.0/5, 11.0/6, -108.0,
+    16.0/7, 39.0/11, -105.0,
+    11.0/5, 25.0/9, -104.0,
+    151.0/50, 19.0/7, -103.0,
+    19.0/7, 12.0/5, -101.0,
+    26.0/7, 101.0/25, -99.0,
+    43.0/21, 41.0/14, -98.0,
+    13.0/3, 31.0/9, -97.0,
+    10.0/13, 1.0, -95.0,
+    17.0/7, 39.0/10, -93.0,
+    145.0/48, 3.0, -92.0,
+    37.0/6, 47.0/13, -91.0,
+    5.0/6, 36.0/13, -89.0,
+    9.0/4, 3.0/7, -87.0,
+    48.0/13, 26.0/17, -86.0,
+    7.0/3, 28.0/19, -82.0,
+    31.0/6, 8.0/7, -81.0,
+    36.0/7, 12.0/7, -80.0,
+    38.0/9, 25.0/9, -79.0,
+    17.0/2, 37.0/14, -76.0,
+    16.0/3, 19.0/20, -75.0,
+    81.0/16, 4.0/5, -74.0,
+    67.0/10, 19.0/15, -73.0,
+    40.0/11, 32.0/11, -72.0,
+    71.0/13, 21.0/20, -71.0,
+    68.0/15, 46.0/15, -70.0,
+    52.0/15, 27.0/10, -69.0,
+    57.0/14, 7.0/8, -67.0,
+    7.0/4, 42.0/13, -66.0,
+    39.0/11, 43.0/21, -65.0,
+    30.0/11, 33.0/8, -64.0,
+    7.0/5, 20.0/7, -63.0,
+    4.0/7, 13.0/14, -62.0,
+    39.0/10, 16.0/9, -61.0,
+    7.0/6, 137.0/34, -59.0,
+    16.0/13, 107.0/27, -58.0,
+    26.0/27, 17.0/5, -57.0,
+    4.0/3, 9.0/14, -56.0,
+    46.0/11, 5.0/3, -55.0,
+    11.0/6, 13.0/4, -54.0,
+    19.0/4, 17.0/5, -53.0,
+    19.0/7, 43.0/11, -52.0,
+    25.0/12, 30.0/7, -51.0,
+    15.0/7, 5.0/11, -50.0,
+    53.0/5, 21.0/13, -49.0,
+    62.0/13, 67.0/15, -48.0,
+    122.0/9, 48.0/13, -47.0,
+    20.0/13, 1.0, -46.0,
+    7.0/6, 32.0/7, -43.0,
+    12.0/7, 13.0/25, -42.0,
+    11.0/17, 9.0/10, -40.0,
+    11.0/9, 2.0, -39.0,
+    4.0/3, 19.0/7, -38.0,
+    12.0/5, 47.0/11, -37.0,
+    10.0/7, 12.0/7, -36.0,
+    108.0/17, 3.0/4, -35.0,
+    25.0/9, 19.0/5, -34.0,
+    7.0/13, 22.0/5, -33.0,
+    9.0/4, 13.0/11, -32.0,
+    181.0/15, 25.0/11, -31.0,
+    202.0/11, 57.0/13, -29.0,
+    2.0/11, 26.0/7, -28.0,
+    129.0/13, 38.0/15, -25.0,
+    13.0/6, 1.0/8, -24.0,
+    77.0/13, 11.0/8, -23.0,
+    19.0/6, 15.0/7, -22.0,
+    18.0/7, 29.0/10, -21.0,
+    9.0, 13.0/5, -18.0,
+    342.0/7, 11.0/6, -17.0,
+    3.0/5, 49.0/11, -15.0,
+    38.0/3, 19.0/7, -14.0,
+    994.0/9, 25.0/8, -13.0,
+    22.0/9, 49.0/12, -10.0,
+    97.0/9, 1.0/14, -8.0,
+    559.0/7, 47.0/14, -7.0,
+    19.0/13, 5.0/6, -6.0,
+    3.0, 57.0/17, -4.0,
+    28.0/5, 1.0, -3.0,
+    10.0/3, 22.0/7, -2.0,
+    1507.0/3, 29.0/8, -1.0,
+    -1407.0/13, 8.0/11, 5.0,
+    -15.0/2, 2.0/5, 9.0,
+    -1193.0/9, 28.0/27, 11.0,
+    -209.0/15, 2.0/5, 12.0,
+    -116.0/15, 40.0/39, 16.0,
+    -1105.0/33, 1.0/3, 19.0,
+    -45.0/13, 7.0/6, 20.0,
+    -91.0/46, 4.0/7, 26.0,
+    -43.0/16, 12.0/11, 27.0,
+    -46.0/13, 14.0/9, 30.0,
+    -29.0/10, 3.0/14, 41.0,
+    -31.0/11, 15.0/14, 44.0,
+    -22.0/7, 10.0/7, 45.0,
+    -7.0/8, 22.0/15, 60.0,
+    -54.0/53, 5.0/4, 68.0,
+    -214.0/15, 5.0/9, 77.0,
+    -54.0/11, 1.0/13, 78.0,
+    -47.0/6, 5.0/11, 83.0,
+    -1.0/2, 8.0/7, 84.0,
+    -2.0/3, 4.0/9, 85.0,
+    -7.0/3, 7.0/6, 88.0,
+    -15.0/4, 1.0/6, 90.0,
+    -35.0/6, 17.0/18, 94.0,
+    -77.0/26, 2.0/7, 96.0,
+    -64.0/11, 34.0/23, 100.0,
+    -13.0/6, 14.0/11, 102.0,
+    -19.0/7, 5.0/6, 106.0,
+    -13.0/6, 10.0/11, 107.0,
+    -42.0/13, 8.0/7, 109.0,
+    -69.0/35, 10.0/21, 115.0,
+    -12.0/7, 17.0/16, 116.0,
+    -8.0/3, 5.0/9, 118.0,
+    -1.0/6, 17.0/12, 127.0,
+    -13.0/7, 8.0/7, 136.0,
+    -7.0/10, 7.0/5, 140.0,
+    -15.0/7, 19.0/14, 141.0,
+    -6.0/11, 5.0/16, 144.0,
+    -3.0/2, 9.0/14, 153.0,
+    -6.0/5, 3.0/10, 155.0,
+    -3.0/8, 10.0/11, 157.0,
+    -20.0/11, 19.0/14, 164.0,
+    -7.0/5, 7.0/6, 165.0,
+    -8.0/13, 20.0/13, 167.0,
+    -7.0/8, 3.0/7, 168.0,
+    -5.0/14, 16.0/13, 171.0,
+    -22.0/7, 3.0/13, 177.0,
+    -23.0/8, 7.0/8, 186.0,
+    -13.0/7, 11.0/9, 189.0,
+    -9.0/5, 32.0/21, 190.0,
+    -27.0/28, 1.0, 193.0,
+    -5.0/12, 1.0/2, 194.0,
+    -44.0/43, 6.0/5, 197.0,
+    -5.0/11, 1.0/5, 202.0,
+    -8.0/7, 1.0/23, 204.0,
+    -16.0/15, 7.0/10, 207.0,
+    -1.0/2, 2.0/5, 211.0,
+    -5.0/8, 3.0/5, 212.0,
+    -10.0/13, 6.0/5, 213.0,
+    -21.0/16, 4.0/3, 217.0,
+    -11.0/5, 24.0/25, 218.0,
+    -2.0/3, 5.0/9, 220.0,
+    -13.0/10, 7.0/8, 224.0,
+    -17.0/8, 1.0/9, 228.0,
+    -3.0/7, 14.0/9, 231.0,
+    -5.0/12, 9.0/11, 233.0,
+    -3.0/5, 4.0/7, 245.0,
+    -2.0/3, 15.0/11, 246.0,
+    -3.0/8, 4.0/7, 251.0,
+    -2.0/9, 19.0/20, 263.0,
+    -1.0/2, 13.0/11, 265.0,
+    -3.0/8, 3.0/2, 275.0,
+    -17.0/35, 9.0/13, 277.0,
+    -3.0/7, 3.0/11, 285.0,
+    -9.0/10, 25.0/19, 289.0,
+    -4.0/9, 20.0/13, 292.0,
+    -12.0/25, 5.0/4, 293.0,
+    -3.0/5, 9.0/8, 311.0,
+    -33.0/32, 1.0/2, 312.0,
 };
-EmbReal snowflake_y[] = {
-    1.0, 1.0
+
+const EmbReal snowflake_y[] = {
+    3.0/7, 24.0/11, -318.0,
+    5.0/12, 3.0, -317.0,
+    5.0/14, 21.0/16, -316.0,
+    9.0/19, 31.0/9, -315.0,
+    2.0/9, 13.0/6, -314.0,
+    3.0/5, 9.0/7, -312.0,
+    2.0/5, 49.0/12, -311.0,
+    1.0/13, 30.0/7, -310.0,
+    4.0/13, 19.0/12, -309.0,
+    1.0/3, 32.0/7, -307.0,
+    5.0/8, 22.0/5, -306.0,
+    4.0/11, 25.0/11, -305.0,
+    8.0/15, 9.0/8, -304.0,
+    1.0/8, 35.0/9, -303.0,
+    3.0/5, 51.0/25, -302.0,
+    2.0/5, 9.0/8, -301.0,
+    4.0/7, 2.0/7, -300.0,
+    2.0/7, 50.0/11, -299.0,
+    3.0/13, 35.0/8, -297.0,
+    5.0/14, 14.0/5, -295.0,
+    8.0/13, 47.0/14, -294.0,
+    2.0/9, 25.0/8, -293.0,
+    8.0/17, 136.0/45, -291.0,
+    2.0/7, 17.0/7, -290.0,
+    3.0/5, 8.0/7, -288.0,
+    3.0/13, 19.0/8, -286.0,
+    6.0/11, 10.0/19, -285.0,
+    9.0/10, 121.0/40, -283.0,
+    8.0/5, 21.0/5, -282.0,
+    1.0/10, 87.0/25, -281.0,
+    7.0/13, 22.0/7, -279.0,
+    3.0/7, 8.0/5, -278.0,
+    4.0/5, 3.0/14, -277.0,
+    7.0/10, 19.0/13, -276.0,
+    1.0/5, 6.0/13, -274.0,
+    7.0/10, 20.0/9, -273.0,
+    1.0/3, 9.0/4, -272.0,
+    4.0/13, 47.0/11, -271.0,
+    18.0/17, 22.0/7, -269.0,
+    1.0/7, 31.0/9, -268.0,
+    7.0/10, 43.0/17, -267.0,
+    8.0/11, 24.0/7, -266.0,
+    5.0/8, 13.0/6, -264.0,
+    9.0/10, 17.0/13, -262.0,
+    4.0/11, 31.0/8, -261.0,
+    1.0/5, 66.0/19, -260.0,
+    1.0/10, 23.0/5, -259.0,
+    3.0/10, 66.0/19, -255.0,
+    1.0/8, 6.0/7, -253.0,
+    9.0/13, 16.0/5, -252.0,
+    3.0/7, 8.0/9, -251.0,
+    4.0/11, 30.0/13, -250.0,
+    7.0/11, 66.0/19, -247.0,
+    1.0/19, 2.0, -246.0,
+    1.0/4, 16.0/7, -245.0,
+    8.0/17, 41.0/10, -244.0,
+    15.0/16, 2.0/11, -240.0,
+    5.0/7, 19.0/18, -239.0,
+    1.0/6, 5.0/12, -238.0,
+    5.0/11, 16.0/17, -236.0,
+    3.0/10, 25.0/12, -235.0,
+    8.0/17, 16.0/7, -233.0,
+    5.0/8, 47.0/12, -231.0,
+    9.0/11, 11.0/8, -230.0,
+    3.0/11, 33.0/7, -229.0,
+    9.0/10, 20.0/7, -226.0,
+    4.0/9, 39.0/14, -225.0,
+    4.0/9, 10.0/9, -224.0,
+    6.0/7, 19.0/13, -222.0,
+    7.0/9, 29.0/7, -221.0,
+    8.0/11, 33.0/8, -220.0,
+    16.0/9, 2.0/7, -219.0,
+    25.0/14, 1.0/8, -218.0,
+    8.0/11, 5.0/9, -217.0,
+    9.0/11, 11.0/10, -216.0,
+    21.0/13, 27.0/7, -215.0,
+    3.0/7, 1.0/12, -213.0,
+    13.0/9, 15.0/16, -212.0,
+    23.0/8, 1.0/8, -210.0,
+    1.0, 32.0/11, -209.0,
+    9.0/13, 1.0/9, -208.0,
+    7.0/9, 33.0/10, -206.0,
+    2.0/3, 9.0/4, -205.0,
+    3.0/4, 1.0/2, -204.0,
+    3.0/13, 11.0/17, -203.0,
+    3.0/7, 31.0/12, -202.0,
+    19.0/12, 17.0/8, -201.0,
+    7.0/8, 75.0/19, -200.0,
+    6.0/5, 21.0/10, -198.0,
+    3.0/2, 7.0/5, -194.0,
+    28.0/27, 3.0/2, -193.0,
+    4.0/9, 16.0/5, -192.0,
+    22.0/13, 13.0/6, -189.0,
+    18.0/11, 19.0/10, -188.0,
+    1.0, 7.0/6, -187.0,
+    16.0/7, 13.0/11, -186.0,
+    9.0/5, 11.0/9, -184.0,
+    16.0/11, 2.0/5, -183.0,
+    10.0/13, 10.0/3, -182.0,
+    9.0/7, 38.0/9, -181.0,
+    45.0/13, 8.0/9, -180.0,
+    7.0/9, 35.0/8, -179.0,
+    2.0/3, 35.0/8, -176.0,
+    10.0/7, 6.0/19, -175.0,
+    40.0/13, 15.0/7, -174.0,
+    20.0/13, 1.0/2, -173.0,
+    3.0/11, 20.0/7, -171.0,
+    17.0/16, 50.0/11, -169.0,
+    2.0/9, 1.0/31, -168.0,
+    4.0/9, 7.0/2, -165.0,
+    1.0/12, 26.0/17, -164.0,
+    21.0/22, 27.0/26, -163.0,
+    13.0/12, 17.0/8, -162.0,
+    19.0/14, 39.0/10, -160.0,
+    18.0/11, 5.0/7, -159.0,
+    3.0/5, 15.0/14, -158.0,
+    11.0/9, 35.0/8, -157.0,
+    5.0/8, 30.0/7, -156.0,
+    3.0/2, 28.0/11, -155.0,
+    4.0/5, 5.0/11, -151.0,
+    25.0/19, 11.0/10, -150.0,
+    10.0/11, 11.0/14, -148.0,
+    13.0/9, 7.0/4, -147.0,
+    7.0/13, 19.0/6, -146.0,
+    1.0/5, 37.0/14, -145.0,
+    11.0/8, 42.0/13, -144.0,
+    20.0/11, 32.0/9, -143.0,
+    2.0/3, 22.0/5, -141.0,
+    10.0/11, 9.0/7, -140.0,
+    8.0/7, 23.0/9, -138.0,
+    5.0/2, 9.0/19, -137.0,
+    7.0/5, 193.0/48, -136.0,
+    5.0/8, 67.0/66, -135.0,
+    8.0/7, 7.0/15, -134.0,
+    13.0/6, 13.0/7, -133.0,
+    19.0/7, 16.0/5, -132.0,
+    16.0/7, 39.0/11, -131.0,
+    28.0/17, 69.0/35, -130.0,
+    84.0/17, 7.0/8, -129.0,
+    114.0/23, 10.0/9, -128.0,
+    29.0/11, 1.0/7, -127.0,
+    63.0/10, 65.0/32, -124.0,
+    74.0/17, 37.0/16, -121.0,
+    31.0/16, 35.0/11, -120.0,
+    19.0/5, 23.0/12, -119.0,
+    82.0/27, 27.0/7, -118.0,
+    49.0/11, 8.0/3, -117.0,
+    29.0/14, 63.0/16, -116.0,
+    9.0/13, 35.0/8, -114.0,
+    29.0/19, 5.0/4, -113.0,
+    13.0/7, 20.0/7, -112.0,
+    9.0/7, 11.0/23, -111.0,
+    19.0/8, 27.0/26, -110.0,
+    1.0, 4.0/7, -109.0,
+    119.0/40, 22.0/5, -108.0,
+    7.0/5, 47.0/46, -107.0,
+    5.0/3, 1.0/6, -106.0,
+    2.0, 14.0/5, -105.0,
+    7.0/3, 10.0/3, -104.0,
+    3.0/2, 15.0/4, -103.0,
+    19.0/11, 3.0/4, -102.0,
+    74.0/17, 13.0/10, -99.0,
+    98.0/33, 26.0/11, -98.0,
+    36.0/11, 13.0/3, -97.0,
+    43.0/12, 26.0/25, -96.0,
+    13.0/2, 3.0/13, -95.0,
+    6.0/7, 24.0/7, -94.0,
+    16.0/5, 6.0/5, -93.0,
+    5.0/7, 9.0/14, -92.0,
+    55.0/12, 27.0/14, -90.0,
+    15.0/11, 14.0/3, -88.0,
+    7.0/3, 7.0/10, -87.0,
+    11.0/4, 2.0/9, -86.0,
+    13.0/4, 35.0/12, -84.0,
+    26.0/9, 38.0/9, -83.0,
+    7.0/2, 5.0/7, -82.0,
+    31.0/8, 27.0/8, -78.0,
+    91.0/6, 35.0/8, -77.0,
+    37.0/5, 7.0/10, -76.0,
+    70.0/13, 17.0/11, -73.0,
+    76.0/25, 56.0/19, -70.0,
+    19.0/8, 17.0/8, -68.0,
+    59.0/13, 42.0/17, -67.0,
+    28.0/17, 49.0/13, -64.0,
+    9.0/7, 79.0/17, -63.0,
+    1.0/8, 7.0/11, -62.0,
+    39.0/8, 49.0/15, -61.0,
+    53.0/18, 33.0/8, -59.0,
+    9.0/7, 41.0/9, -58.0,
+    8.0/7, 65.0/14, -57.0,
+    10.0/11, 16.0/7, -56.0,
+    68.0/13, 42.0/13, -55.0,
+    21.0/10, 7.0/8, -54.0,
+    6.0/7, 41.0/14, -53.0,
+    31.0/11, 55.0/12, -51.0,
+    59.0/17, 27.0/7, -50.0,
+    124.0/9, 37.0/11, -49.0,
+    24.0/11, 3.0/5, -48.0,
+    65.0/6, 12.0/5, -47.0,
+    11.0/7, 49.0/11, -45.0,
+    13.0/25, 11.0/13, -42.0,
+    7.0/4, 5.0/8, -40.0,
+    43.0/42, 2.0/5, -39.0,
+    20.0/9, 4.0/7, -38.0,
+    19.0/8, 4.0/11, -37.0,
+    5.0/4, 15.0/4, -36.0,
+    1.0/5, 11.0/13, -34.0,
+    12.0/7, 23.0/5, -32.0,
+    409.0/34, 39.0/10, -31.0,
+    10.0/7, 5.0/2, -30.0,
+    180.0/11, 3.0, -29.0,
+    23.0/8, 53.0/12, -26.0,
+    71.0/8, 56.0/13, -25.0,
+    12.0/5, 10.0/21, -24.0,
+    10.0/3, 34.0/9, -22.0,
+    27.0/16, 12.0/11, -21.0,
+    49.0/6, 13.0/7, -20.0,
+    69.0/2, 19.0/14, -19.0,
+    475.0/9, 3.0/10, -17.0,
+    68.0/13, 57.0/28, -16.0,
+    40.0/17, 1.0/6, -15.0,
+    77.0/13, 29.0/11, -12.0,
+    4954.0/39, 15.0/4, -11.0,
+    1075.0/11, 4.0, -5.0,
+    191.0/24, 5.0/4, -4.0,
+    84.0/17, 2.0/7, -3.0,
+    -12.0/5, 0.0, 74.0,
+    -4.0/5, 0.0, 166.0,
+    -1523.0/3, 12.0/11, 1.0,
+    -25.0/3, 17.0/18, 2.0,
+    -13.0/8, 1.0/9, 6.0,
+    -5333.0/62, 9.0/7, 7.0,
+    -56.0/9, 5.0/12, 8.0,
+    -65.0/8, 2.0/5, 9.0,
+    -106.0/9, 1.0/8, 10.0,
+    -1006.0/9, 11.0/7, 13.0,
+    -67.0/8, 6.0/5, 14.0,
+    -25.0/8, 15.0/11, 18.0,
+    -40.0/11, 1.0/16, 23.0,
+    -4.0/7, 6.0/5, 27.0,
+    -41.0/8, 7.0/12, 28.0,
+    -8.0/5, 5.0/6, 33.0,
+    -137.0/17, 4.0/5, 35.0,
+    -29.0/12, 22.0/15, 41.0,
+    -25.0/9, 6.0/7, 43.0,
+    -12.0/25, 16.0/11, 44.0,
+    -31.0/6, 4.0/3, 46.0,
+    -19.0/5, 16.0/13, 52.0,
+    -19.0/11, 8.0/17, 60.0,
+    -16.0/7, 6.0/13, 65.0,
+    -25.0/12, 11.0/13, 66.0,
+    -8.0/9, 4.0/11, 69.0,
+    -25.0/7, 7.0/5, 71.0,
+    -11.0/10, 3.0/2, 72.0,
+    -14.0/5, 7.0/9, 75.0,
+    -107.0/14, 3.0/4, 79.0,
+    -67.0/8, 2.0/11, 80.0,
+    -161.0/27, 5.0/11, 81.0,
+    -55.0/18, 3.0/7, 85.0,
+    -161.0/40, 1.0/21, 89.0,
+    -32.0/7, 38.0/25, 91.0,
+    -1.0, 19.0/20, 100.0,
+    -27.0/5, 2.0/13, 101.0,
+    -26.0/9, 1.0/44, 115.0,
+    -17.0/11, 1.0/16, 122.0,
+    -87.0/22, 2.0/3, 123.0,
+    -37.0/8, 9.0/11, 125.0,
+    -10.0/7, 8.0/7, 126.0,
+    -7.0/8, 3.0/5, 139.0,
+    -3.0/7, 5.0/6, 142.0,
+    -71.0/36, 5.0/16, 149.0,
+    -7.0/6, 1.0/9, 152.0,
+    -63.0/25, 29.0/19, 153.0,
+    -27.0/20, 8.0/15, 154.0,
+    -8.0/15, 12.0/13, 161.0,
+    -5.0/3, 13.0/10, 167.0,
+    -17.0/25, 3.0/5, 170.0,
+    -10.0/9, 3.0/8, 172.0,
+    -5.0/7, 5.0/8, 177.0,
+    -1.0/2, 7.0/6, 178.0,
+    -34.0/13, 5.0/8, 185.0,
+    -11.0/13, 38.0/39, 190.0,
+    -25.0/19, 11.0/8, 191.0,
+    -11.0/12, 18.0/19, 195.0,
+    -51.0/26, 2.0/7, 196.0,
+    -14.0/9, 4.0/11, 197.0,
+    -19.0/12, 1.0, 199.0,
+    -19.0/11, 11.0/8, 207.0,
+    -6.0/11, 1.0/20, 211.0,
+    -11.0/7, 1.0/14, 214.0,
+    -7.0/13, 8.0/11, 223.0,
+    -3.0/5, 12.0/13, 227.0,
+    -4.0/5, 29.0/19, 228.0,
+    -11.0/10, 2.0/7, 232.0,
+    -1.0/6, 7.0/11, 234.0,
+    -1.0, 60.0/59, 237.0,
+    -5.0/11, 7.0/8, 241.0,
+    -1.0/2, 8.0/7, 242.0,
+    -7.0/15, 15.0/16, 243.0,
+    -5.0/8, 2.0/3, 248.0,
+    -1.0/3, 4.0/11, 249.0,
+    -2.0/3, 8.0/7, 254.0,
+    -10.0/19, 14.0/11, 256.0,
+    -4.0/9, 8.0/11, 257.0,
+    -3.0/4, 3.0/7, 258.0,
+    -1.0, 2.0/7, 263.0,
+    -3.0/10, 1.0/28, 265.0,
+    -1.0/2, 1.0, 270.0,
+    -12.0/13, 5.0/8, 275.0,
+    -1.0/4, 16.0/13, 280.0,
+    -1.0/10, 5.0/8, 284.0,
+    -13.0/25, 3.0/7, 287.0,
+    -9.0/13, 3.0/5, 289.0,
+    -22.0/23, 17.0/13, 292.0,
+    -9.0/11, 17.0/11, 296.0,
+    -3.0/7, 12.0/11, 298.0,
+    -5.0/6, 1.0/2, 308.0,
+    -7.0/15, 1.0/3, 313.0,
 };
-int32_t snowflake_terms = 2;
 
 /* . */
 const char *object_names[] = {
@@ -74,6 +827,45 @@ const char *object_names[] = {
     "END"
 };
 
+/* The display name for an object type. Every object of a type shares the
+ * same static string rather than storing its own copy.
+ */
+const char *
+object_type_name(int type)
+{
+    switch (type) {
+    case OBJ_TYPE_ARC:
+        return "Arc";
+    case OBJ_TYPE_CIRCLE:
+        return "Circle";
+    case OBJ_TYPE_ELLIPSE:
+        return "Ellipse";
+    case OBJ_TYPE_DIMLEADER:
+        return "Dimension Leader";
+    case OBJ_TYPE_IMAGE:
+        return "Image";
+    case OBJ_TYPE_LINE:
+        return "Line";
+    case OBJ_TYPE_PATH:
+        return "Path";
+    case OBJ_TYPE_POINT:
+        return "Point";
+    case OBJ_TYPE_POLYGON:
+        return "Polygon";
+    case OBJ_TYPE_POLYLINE:
+        return "Polyline";
+    case OBJ_TYPE_RECTANGLE:
+        return "Rectangle";
+    case OBJ_TYPE_TEXTSINGLE:
+        return "Single Line Text";
+    case OBJ_TYPE_TEXTMULTI:
+        return "Multi Line Text";
+    default:
+        break;
+    }
+    return "Unknown";
+}
+
 /* TODO: "Aligned"
  * TODO: "Fit"
  */
@@ -96,7 +888,8 @@ const char *justify_options[] = {
     "END"
 };
 
-char rubber_modes[N_RUBBER_MODES][MAX_STRING_LENGTH] = {
+const char *rubber_modes[] = {
+    "OFF",
     "CIRCLE_1P_RAD",
     "CIRCLE_1P_DIA",
     "CIRCLE_2P",
@@ -115,6 +908,53 @@ char rubber_modes[N_RUBBER_MODES][MAX_STRING_LENGTH] = {
     "POLYLINE",
     "RECTANGLE",
     "TEXTSINGLE",
+    "GRIP",
+    "IMAGE",
+    "END"
+};
+
+/* Script names for the RUBBER_POINT_* slots, only used to translate
+ * keys once when a script sets a point.
+ */
+const char *rubber_point_keys[] = {
+    "QSNAP",
+    "GRIP_POINT",
+    "LINE_START",
+    "LINE_END",
+    "DIMLEADER_LINE_START",
+    "DIMLEADER_LINE_END",
+    "ELLIPSE_LINE_POINT1",
+    "ELLIPSE_LINE_POINT2",
+    "ELLIPSE_AXIS1_POINT1",
+    "ELLIPSE_AXIS1_POINT2",
+    "ELLIPSE_AXIS2_POINT2",
+    "ELLIPSE_CENTER",
+    "ELLIPSE_WIDTH",
+    "ELLIPSE_ROT",
+    "IMAGE_START",
+    "IMAGE_END",
+    "CIRCLE_CENTER",
+    "CIRCLE_RADIUS",
+    "CIRCLE_DIAMETER",
+    "CIRCLE_TAN1",
+    "CIRCLE_TAN2",
+    "CIRCLE_TAN3",
+    "POLYGON_CENTER",
+    "POLYGON_NUM_SIDES",
+    "POLYGON_INSCRIBE_POINT",
+    "POLYGON_CIRCUMSCRIBE_POINT",
+    "RECTANGLE_START",
+    "RECTANGLE_END",
+    "TEXT_POINT",
+    "TEXT_HEIGHT_ROTATION",
+    "END"
+};
+
+/* Script names for the RUBBER_TEXT_* slots. */
+const char *rubber_text_keys[] = {
+    "TEXT_FONT",
+    "TEXT_JUSTIFY",
+    "TEXT_RAPID",
     "END"
 };
 
@@ -250,50 +1090,173 @@ report_distance(EmbVector point1, EmbVector point2)
     report_vector("Delta", delta);
 }
 
-/* . */
-void
-update_curve(int style, int numPoints, EmbVector scale)
+#define N_TERMS(a) ((int)(sizeof(a)/sizeof(a[0])))
+
+/* One point of a design at parameter t in [0, 2 pi]. */
+static EmbVector
+design_point(int design, EmbReal t)
+{
+    EmbVector v = embVector_make(0.0, 0.0);
+    switch (design) {
+    case DESIGN_DOLPHIN: {
+        v.x = fourier_series(t, dolphin_x, N_TERMS(dolphin_x));
+        v.y = fourier_series(t, dolphin_y, N_TERMS(dolphin_y));
+        break;
+    }
+
+    case DESIGN_SNOWFLAKE: {
+        v.x = fourier_series(t, snowflake_x, N_TERMS(snowflake_x));
+        v.y = fourier_series(t, snowflake_y, N_TERMS(snowflake_y));
+        break;
+    }
+
+    case DESIGN_HEART4: {
+        EmbReal r = (sin(t)*sqrt(fabs(cos(t))))/(sin(t) + 7.0/5.0)
+            - 2.0*sin(t) + 2.0;
+        v.x = cos(t)*r;
+        v.y = sin(t)*r;
+        break;
+    }
+
+    case DESIGN_HEART5: {
+        v.x = 16.0*pow(sin(t), 3);
+        v.y = 13.0*cos(t) - 5.0*cos(2.0*t) - 2.0*cos(3.0*t) - cos(4.0*t);
+        break;
+    }
+
+    default:
+        break;
+    }
+    return v;
+}
+
+/* Bisect the interval [t0, t1] while the curve bows more than tolerance
+ * away from the chord between its ends. The bow of a short arc is about
+ * its curvature times the square of its length over 8, so tight turns
+ * get more points than the straight runs. Only the end point of each
+ * piece is written; the caller has already written p0. Points past
+ * max_out are counted but not written.
+ */
+static void
+curve_subdivide(int design, EmbReal t0, EmbReal t1, EmbVector p0,
+    EmbVector p1, EmbVector scale, EmbReal tolerance, int depth,
+    EmbVector *out, int *count, int max_out)
 {
+    if (depth < CURVE_MAX_DEPTH) {
+        EmbReal t = 0.5*(t0 + t1);
+        EmbVector mid = design_point(design, t);
+        mid.x *= scale.x;
+        mid.y *= scale.y;
+        EmbVector chord = embVector_make(0.5*(p0.x + p1.x), 0.5*(p0.y + p1.y));
+        EmbReal dx = mid.x - chord.x;
+        EmbReal dy = mid.y - chord.y;
+        if (dx*dx + dy*dy > tolerance*tolerance) {
+            curve_subdivide(design, t0, t, p0, mid, scale, tolerance,
+                depth+1, out, count, max_out);
+            curve_subdivide(design, t, t1, mid, p1, scale, tolerance,
+                depth+1, out, count, max_out);
+            return;
+        }
+    }
+    if (*count < max_out) {
+        out[*count] = p1;
+    }
+    (*count)++;
+}
+
+/* Trace a closed design into out, returning the number of points written.
+ *
+ * The curve is first sampled at numPoints even steps of the parameter,
+ * the Fourier designs in one batch, then each step is refined against
+ * tolerance (in scaled units) by curve_subdivide(). A tolerance of zero
+ * or less keeps the even sampling.
+ *
+ * Like snprintf(), the return value is the length of the whole trace. If
+ * it is more than max_out only the first max_out points were written, and
+ * the caller should try again with room for that many. Returns 0 if the
+ * design can't be traced.
+ */
+int
+curve_points(int design, int numPoints, EmbVector scale,
+    EmbReal tolerance, EmbVector *out, int max_out)
+{
+    if (numPoints < 3 || max_out < 1) {
+        return 0;
+    }
+
     EmbReal h = (2.0*embConstantPi) / numPoints;
-    for (int i = 0; i <= numPoints; i++) {
-        EmbVector v = embVector_make(1.0f, 1.0f);
-        EmbReal t = h * i;
+    EmbReal *xs = malloc(2*(numPoints+1)*sizeof(EmbReal));
+    if (!xs) {
+        return 0;
+    }
+    EmbReal *ys = xs + numPoints + 1;
 
-        switch (style) {
-        case DESIGN_DOLPHIN: {
-            v.x = fourier_series(t, dolphin_x, dolphin_terms);
-            v.y = fourier_series(t, dolphin_y, dolphin_terms);
-            break;
-        }
+    switch (design) {
+    case DESIGN_DOLPHIN:
+        fourier_series_batch(dolphin_x, N_TERMS(dolphin_x), 0.0, h,
+            numPoints+1, xs);
+        fourier_series_batch(dolphin_y, N_TERMS(dolphin_y), 0.0, h,
+            numPoints+1, ys);
+        break;
 
-        case DESIGN_SNOWFLAKE: {
-            v.x = fourier_series(t, snowflake_x, snowflake_terms);
-            v.y = fourier_series(t, snowflake_y, snowflake_terms);
-            break;
-        }
+    case DESIGN_SNOWFLAKE:
+        fourier_series_batch(snowflake_x, N_TERMS(snowflake_x), 0.0, h,
+            numPoints+1, xs);
+        fourier_series_batch(snowflake_y, N_TERMS(snowflake_y), 0.0, h,
+            numPoints+1, ys);
+        break;
 
-        case DESIGN_HEART4: {
-            v.x = cos(t)*((sin(t)*sqrt(abs(cos(t))))/(sin(t)+7/5) - 2*sin(t) + 2);
-            v.y = sin(t)*((sin(t)*sqrt(abs(cos(t))))/(sin(t)+7/5) - 2*sin(t) + 2);
-            break;
+    default:
+        for (int i=0; i<=numPoints; i++) {
+            EmbVector v = design_point(design, h*i);
+            xs[i] = v.x;
+            ys[i] = v.y;
         }
+        break;
+    }
 
-        case DESIGN_HEART5: {
-            v.x = 16*pow(sin(t), 3);
-            v.y = 13*cos(t) - 5*cos(2*t) - 2*cos(3*t) - cos(4*t);
-            break;
+    int count = 1;
+    EmbVector p0 = embVector_make(xs[0]*scale.x, ys[0]*scale.y);
+    out[0] = p0;
+    for (int i=0; i<numPoints; i++) {
+        EmbVector p1 = embVector_make(xs[i+1]*scale.x, ys[i+1]*scale.y);
+        if (tolerance > 0.0) {
+            curve_subdivide(design, h*i, h*(i+1), p0, p1, scale,
+                tolerance, 0, out, &count, max_out);
         }
-
-        default:
-            break;
+        else {
+            if (count < max_out) {
+                out[count] = p1;
+            }
+            count++;
         }
-
-        v.x *= scale.x;
-        v.y *= scale.y;
-        /* setRubberPoint("POLYGON_POINT_" + i.toString(), v); */
+        p0 = p1;
     }
 
-    /* setRubberText("POLYGON_NUM_POINTS", numPoints.toString()); */
+    free(xs);
+    return count;
+}
+
+/* The 2*numPoints corners of a star about center, alternating between
+ * the outer points, the first of which is at outer, and the inner
+ * corners at inner_radius. Returns the number of corners written.
+ */
+int
+star_points(EmbVector center, EmbVector outer, EmbReal inner_radius,
+    int numPoints, EmbVector *out)
+{
+    EmbReal dx = outer.x - center.x;
+    EmbReal dy = outer.y - center.y;
+    EmbReal start = atan2(dy, dx);
+    EmbReal outer_radius = sqrt(dx*dx + dy*dy);
+    EmbReal step = embConstantPi / numPoints;
+    for (int i=0; i<2*numPoints; i++) {
+        EmbReal r = (i%2 == 0) ? outer_radius : inner_radius;
+        EmbReal angle = start + step*i;
+        out[i].x = center.x + r*cos(angle);
+        out[i].y = center.y + r*sin(angle);
+    }
+    return 2*numPoints;
 }
 
 /* . */
@@ -2913,7 +3876,13 @@ void text_single_prompt(char *str)
 }
 */
 
-/* . */
+/* The interactive star command that would call this is still the
+ * commented out state machine above, as are the heart, dolphin and
+ * snowflake previews, so there is no live rubber preview yet: star and
+ * the design commands take their parameters on the prompt and
+ * star_points() and curve_points() do the geometry. Wiring the preview
+ * up is left for when the interactive commands are ported.
+ */
 void
 updateStar(EmbVector mouse)
 {
@@ -19,6 +19,15 @@
 
 #include "embroidermodder.h"
 
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
 void addPath(View *view, Geometry *obj);
 void saveObject(int objType, View *view, Geometry *obj);
 void saveObjectAsStitches(int objType, View *view, Geometry *obj);
@@ -31,10 +40,33 @@ void toPolyline(
     QColor color,
     QString lineType,
     QString lineWeight);
+void toFill(QPointF objPos, QPainterPath objPath, QColor color);
+void toColumn(QPointF objPos, QPainterPath objPath, QColor color,
+    int lineType);
 
 
 bool save(View *view, QString f);
 
+/* A closed region to be filled, as the rings of its outline. */
+typedef struct FillRegion_ {
+    std::vector<EmbVector> points;
+    std::vector<int> ring_ends;
+    int color;
+} FillRegion;
+
+/* The runs collected from the scene while saving to a stitch only format,
+ * with the colours numbered in the order they first appear so the
+ * layering of the design is kept.
+ */
+typedef struct StitchPlan_ {
+    std::vector<StitchRun> runs;
+    std::vector<std::vector<EmbVector>> points;
+    std::vector<QRgb> colors;
+    std::vector<FillRegion> fills;
+} StitchPlan;
+
+static StitchPlan *stitch_plan = NULL;
+
 
 const CommandData subcommand_table[MAX_COMMANDS] = {
     {
@@ -76,7 +108,7 @@ add_geometry(char **argv, int argc)
     
     /* add_arc_action.
      *
-     * EmbReal startX, EmbReal startY, EmbReal midX, EmbReal midY, EmbReal endX, EmbReal endY, std::string rubberMode
+     * EmbReal startX, EmbReal startY, EmbReal midX, EmbReal midY, EmbReal endX, EmbReal endY, int32_t rubberMode
      */
     case SUBCOMMAND_ARC: {
         if (argc < 7) {
@@ -91,7 +123,7 @@ add_geometry(char **argv, int argc)
 		arcObj->gdata.arc.end.x = -atof(argv[6]);
         /*
 		arcObj->setObjectRubberMode(rubberMode);
-		if (rubberMode != "OBJ_RUBBER_OFF") {
+		if (rubberMode != RUBBER_OFF) {
 			gview->addToRubberRoom(arcObj);
 		}
 		scene->addItem(arcObj);
@@ -101,7 +133,7 @@ add_geometry(char **argv, int argc)
 
     /* add_circle_action.
      *
-     * EmbReal centerX, EmbReal centerY, EmbReal radius, bool fill, std::string rubberMode
+     * EmbReal centerX, EmbReal centerY, EmbReal radius, bool fill, int32_t rubberMode
      */
     case SUBCOMMAND_CIRCLE: {
 		Geometry* obj = new Geometry(OBJ_TYPE_CIRCLE);
@@ -109,24 +141,24 @@ add_geometry(char **argv, int argc)
 		obj->gdata.circle.center.y = -atof(argv[2]);
 		obj->gdata.circle.radius = atof(argv[3]);
 		bool fill = false;
-		obj->objRubberMode = "OBJ_RUBBER_OFF";
+		obj->objRubberMode = RUBBER_OFF;
 
 		/*
 		//TODO: circle fill
-		if (rubberMode != "OBJ_RUBBER_OFF") {
+		if (rubberMode != RUBBER_OFF) {
 			gview->addToRubberRoom(obj);
 			gscene->addItem(obj);
 			gscene->update();
 		}
 		else {
-			UndoableAddCommand* cmd = new UndoableAddCommand(obj->data(OBJ_NAME).toString(), obj, gview, 0);
+			UndoableAddCommand* cmd = new UndoableAddCommand(obj->typeName(), obj, gview, 0);
 			stack->push(cmd);
 		}
 		*/
         return "";
     }
 
-    /* EmbReal x1, EmbReal y1, EmbReal x2, EmbReal y2, EmbReal rot, std::string rubberMode
+    /* EmbReal x1, EmbReal y1, EmbReal x2, EmbReal y2, EmbReal rot, int32_t rubberMode
      */
     case SUBCOMMAND_DIM_LEADER: {
 		Geometry* obj = new Geometry(OBJ_TYPE_DIMLEADER);
@@ -137,13 +169,13 @@ add_geometry(char **argv, int argc)
 		Geometry* obj = new Geometry(x1, -y1, x2, -y2,_mainWin->getCurrentColor());
 		obj->setRotation(-rot);
 		obj->setObjectRubberMode(rubberMode);
-		if (rubberMode != "OBJ_RUBBER_OFF") {
+		if (rubberMode != RUBBER_OFF) {
 			gview->addToRubberRoom(obj);
 			gscene->addItem(obj);
 			gscene->update();
 		}
 		else {
-			UndoableAddCommand* cmd = new UndoableAddCommand(obj->data(OBJ_NAME).toString(), obj, gview, 0);
+			UndoableAddCommand* cmd = new UndoableAddCommand(obj->typeName(), obj, gview, 0);
 			stack->push(cmd);
 		}
 		*/
@@ -152,7 +184,7 @@ add_geometry(char **argv, int argc)
 
     /* Add an ellipse to the scene.
      *
-     * EmbReal centerX, EmbReal centerY, EmbReal width, EmbReal height, EmbReal rot, bool fill, std::string rubberMode
+     * EmbReal centerX, EmbReal centerY, EmbReal width, EmbReal height, EmbReal rot, bool fill, int32_t rubberMode
      */
     case SUBCOMMAND_ELLIPSE: {
 		Geometry* obj = new Geometry(OBJ_TYPE_ELLIPSE);
@@ -161,13 +193,13 @@ add_geometry(char **argv, int argc)
 		obj->setRotation(-rot);
 		obj->setObjectRubberMode(rubberMode);
 		//TODO: ellipse fill
-		if (rubberMode != "OBJ_RUBBER_OFF") {
+		if (rubberMode != RUBBER_OFF) {
 			gview->addToRubberRoom(obj);
 			gscene->addItem(obj);
 			gscene->update();
 		}
 		else {
-			UndoableAddCommand* cmd = new UndoableAddCommand(obj->data(OBJ_NAME).toString(), obj, gview, 0);
+			UndoableAddCommand* cmd = new UndoableAddCommand(obj->typeName(), obj, gview, 0);
 			stack->push(cmd);
 		}
 		*/
@@ -213,7 +245,7 @@ add_geometry(char **argv, int argc)
 
     /*
      * .
-     * EmbReal x1, EmbReal y1, EmbReal x2, EmbReal y2, EmbReal rot, std::string rubberMode
+     * EmbReal x1, EmbReal y1, EmbReal x2, EmbReal y2, EmbReal rot, int32_t rubberMode
      */
     case SUBCOMMAND_LINE: {
         /*
@@ -227,13 +259,13 @@ add_geometry(char **argv, int argc)
 		LineObject* obj = new LineObject(line,_mainWin->getCurrentColor());
 		obj->setRotation(-rot);
 		obj->setObjectRubberMode(rubberMode);
-		if (rubberMode != "OBJ_RUBBER_OFF") {
+		if (rubberMode != RUBBER_OFF) {
 			gview->addToRubberRoom(obj);
 			gscene->addItem(obj);
 			gscene->update();
 		}
 		else {
-			UndoableAddCommand* cmd = new UndoableAddCommand(obj->data(OBJ_NAME).toString(), obj, gview, 0);
+			UndoableAddCommand* cmd = new UndoableAddCommand(obj->typeName(), obj, gview, 0);
 			stack->push(cmd);
 		}
         */
@@ -244,7 +276,7 @@ add_geometry(char **argv, int argc)
      * NOTE: This native is different than the rest in that
      * the Y+ is down (scripters need not worry about this).
      *
-     * EmbReal startX, EmbReal startY, const QPainterPath& p, std::string rubberMode
+     * EmbReal startX, EmbReal startY, const QPainterPath& p, int32_t rubberMode
      */
     case SUBCOMMAND_PATH: {
         /*
@@ -265,7 +297,7 @@ add_geometry(char **argv, int argc)
 		v.y = -y;
 
 		Geometry* obj = new Geometry(v, _mainWin->getCurrentColor(), Qt::SolidLine);
-		UndoableAddCommand* cmd = new UndoableAddCommand(obj->data(OBJ_NAME).toString(), obj, gview, 0);
+		UndoableAddCommand* cmd = new UndoableAddCommand(obj->typeName(), obj, gview, 0);
 		stack->push(cmd);
 		*/
         return "";
@@ -275,19 +307,19 @@ add_geometry(char **argv, int argc)
      * args
      *
      * NOTE: This native is different than the rest in that the Y+ is down (scripters need not worry about this)
-     * EmbReal startX, EmbReal startY, const QPainterPath& p, std::string rubberMode
+     * EmbReal startX, EmbReal startY, const QPainterPath& p, int32_t rubberMode
      */
     case SUBCOMMAND_POLYGON: {
         /*
 		PolygonObject* obj = new PolygonObject(startX, startY, p,_mainWin->getCurrentColor());
 		obj->setObjectRubberMode(rubberMode);
-		if (rubberMode != "OBJ_RUBBER_OFF") {
+		if (rubberMode != RUBBER_OFF) {
 			gview->addToRubberRoom(obj);
 			gscene->addItem(obj);
 			gscene->update();
 		}
 		else {
-			UndoableAddCommand* cmd = new UndoableAddCommand(obj->data(OBJ_NAME).toString(), obj, gview, 0);
+			UndoableAddCommand* cmd = new UndoableAddCommand(obj->typeName(), obj, gview, 0);
 			stack->push(cmd);
 		}
 
@@ -361,20 +393,23 @@ add_geometry(char **argv, int argc)
 		rect.bottom = -atof(argv[3]);
 		EmbReal rot = atof(argv[4]);
 		bool fill = (argv[5] == "1");
-		std::string rubberMode = argv[6];
+		int32_t rubberMode = string_array_index(rubber_modes, argv[6]);
+		if (rubberMode < 0) {
+			rubberMode = RUBBER_OFF;
+		}
 
 		/*
 		Geometry* obj = new Geometry(rect, _mainWin->getCurrentColor(), Qt::SolidLine);
 		obj->setRotation(-rot);
 		obj->objRubberMode = rubberMode;
 		//TODO: rect fill
-		if (rubberMode != "OBJ_RUBBER_OFF") {
+		if (rubberMode != RUBBER_OFF) {
 			gview->addToRubberRoom(obj);
 			gscene->addItem(obj);
 			gscene->update();
 		}
 		else {
-			UndoableAddCommand* cmd = new UndoableAddCommand(obj->data(OBJ_NAME).toString(), obj, gview, 0);
+			UndoableAddCommand* cmd = new UndoableAddCommand(obj->typeName(), obj, gview, 0);
 			stack->push(cmd);
 		}
 		*/
@@ -406,7 +441,7 @@ add_geometry(char **argv, int argc)
     /* add_slot_action
      * args
      *
-     * EmbReal centerX, EmbReal centerY, EmbReal diameter, EmbReal length, EmbReal rot, bool fill, std::string rubberMode
+     * EmbReal centerX, EmbReal centerY, EmbReal diameter, EmbReal length, EmbReal rot, bool fill, int32_t rubberMode
      */
     case SUBCOMMAND_SLOT: {
         //TODO: Use UndoableAddCommand for slots
@@ -425,7 +460,7 @@ add_geometry(char **argv, int argc)
 
     /* add_text_multi_action
      *
-     * QString str, EmbReal x, EmbReal y, EmbReal rot, bool fill, std::string rubberMode
+     * QString str, EmbReal x, EmbReal y, EmbReal rot, bool fill, int32_t rubberMode
      */
     case SUBCOMMAND_TEXT_MULTI: {
         /*
@@ -436,7 +471,7 @@ add_geometry(char **argv, int argc)
 
     /* add_text_single_action
      *
-     * QString str, EmbReal x, EmbReal y, EmbReal rot, bool fill, std::string rubberMode
+     * QString str, EmbReal x, EmbReal y, EmbReal rot, bool fill, int32_t rubberMode
      */
     case SUBCOMMAND_TEXT_SINGLE: {
         /*
@@ -456,13 +491,13 @@ add_geometry(char **argv, int argc)
 		obj->setRotation(-rot);
 		//TODO: single line text fill
 		obj->setObjectRubberMode(rubberMode);
-		if (rubberMode != "OBJ_RUBBER_OFF") {
+		if (rubberMode != RUBBER_OFF) {
 			gview->addToRubberRoom(obj);
 			gscene->addItem(obj);
 			gscene->update();
 		}
 		else {
-			UndoableAddCommand* cmd = new UndoableAddCommand(obj->data(OBJ_NAME).toString(), obj, gview, 0);
+			UndoableAddCommand* cmd = new UndoableAddCommand(obj->typeName(), obj, gview, 0);
 			stack->push(cmd);
 		}
 		*/
@@ -524,7 +559,7 @@ closest_point(QPointF position, std::vector<QPointF> points)
 
 /* Add_polyline. */
 void
-add_polyline(QPainterPath p, std::string rubberMode)
+add_polyline(QPainterPath p, int32_t rubberMode)
 {
     View* gview = activeView();
     QGraphicsScene* gscene = gview->scene();
@@ -536,17 +571,68 @@ add_polyline(QPainterPath p, std::string rubberMode)
     obj->normalPath = p;
     obj->updatePath();
     obj->objRubberMode = rubberMode;
-    if (rubberMode != "OBJ_RUBBER_OFF") {
+    if (rubberMode != RUBBER_OFF) {
         gview->addToRubberRoom(obj);
         gscene->addItem(obj);
         gscene->update();
     }
     else {
-        UndoableCommand* cmd = new UndoableCommand("add", obj->data(OBJ_NAME).toString(), obj, gview);
+        UndoableCommand* cmd = new UndoableCommand("add", obj->typeName(), obj, gview);
         stack->push(cmd);
     }
 }
 
+/* Trace one of the parametric designs around position as a closed
+ * polyline, at the sampling and scale given in assets/commands.
+ */
+void
+add_design(int design, EmbVector position)
+{
+    int numPoints = 512;
+    if (design == DESIGN_SNOWFLAKE) {
+        numPoints = 2048;
+    }
+    EmbVector scale = {0.04, 0.04};
+    std::vector<EmbVector> points(8*numPoints + 1);
+    int n = curve_points(design, numPoints, scale, 0.01, points.data(),
+        (int)points.size());
+    if (n > (int)points.size()) {
+        points.resize(n);
+        n = curve_points(design, numPoints, scale, 0.01, points.data(), n);
+    }
+    if (n < 2) {
+        return;
+    }
+
+    /* Qt Y+ is down. */
+    QPainterPath path;
+    path.moveTo(position.x + points[0].x, -(position.y + points[0].y));
+    for (int i=1; i<n; i++) {
+        path.lineTo(position.x + points[i].x, -(position.y + points[i].y));
+    }
+    path.closeSubpath();
+    add_polyline(path, RUBBER_OFF);
+}
+
+/* Add a star of numPoints points with its first point straight up from
+ * center and its inner corners at half the radius.
+ */
+void
+add_star(EmbVector center, EmbReal radius, int numPoints)
+{
+    std::vector<EmbVector> points(2*numPoints);
+    EmbVector outer = {center.x, center.y + radius};
+    int n = star_points(center, outer, 0.5*radius, numPoints, points.data());
+
+    QPainterPath path;
+    path.moveTo(points[0].x, -points[0].y);
+    for (int i=1; i<n; i++) {
+        path.lineTo(points[i].x, -points[i].y);
+    }
+    path.closeSubpath();
+    add_polyline(path, RUBBER_OFF);
+}
+
 /* Construct a new Geometry object of arc type.
  * Initialize common object properties.
  *
@@ -566,6 +652,8 @@ Geometry::init(int type_, QRgb rgb, Qt::PenStyle lineType, QGraphicsItem* parent
     setData(OBJ_TYPE, Type);
 
     setFlag(QGraphicsItem::ItemIsSelectable, true);
+    /* Needed so the view's extents follow moves, rotations and scaling. */
+    setFlag(QGraphicsItem::ItemSendsGeometryChanges, true);
 
     objPen.setColor(rgb);
     lwtPen.setColor(rgb);
@@ -576,49 +664,11 @@ Geometry::init(int type_, QRgb rgb, Qt::PenStyle lineType, QGraphicsItem* parent
     lwtPen.setCapStyle(Qt::RoundCap);
     lwtPen.setJoinStyle(Qt::RoundJoin);
 
-    objID = QDateTime::currentMSecsSinceEpoch();
+    /* Given out by the document's ObjectTable when added to a scene. */
+    objID = 0;
 
     setObjectLineWeight("0.35"); //TODO: pass in proper lineweight
 
-    switch (Type) {
-    case OBJ_TYPE_ARC:
-        setData(OBJ_NAME, "Arc");
-        break;
-    case OBJ_TYPE_CIRCLE:
-        setData(OBJ_NAME, "Circle");
-        break;
-    case OBJ_TYPE_ELLIPSE:
-        setData(OBJ_NAME, "Ellipse");
-        break;
-    case OBJ_TYPE_DIMLEADER:
-        setData(OBJ_NAME, "Dimension Leader");
-        break;
-    case OBJ_TYPE_LINE:
-        setData(OBJ_NAME, "Line");
-        break;
-    case OBJ_TYPE_POINT:
-        setData(OBJ_NAME, "Point");
-        break;
-    case OBJ_TYPE_POLYGON:
-        setData(OBJ_NAME, "Polygon");
-        break;
-    case OBJ_TYPE_POLYLINE:
-        setData(OBJ_NAME, "Polyline");
-        break;
-    case OBJ_TYPE_RECTANGLE:
-        setData(OBJ_NAME, "Rectangle");
-        break;
-    case OBJ_TYPE_TEXTSINGLE:
-        setData(OBJ_NAME, "Single Line Text");
-        break;
-    case OBJ_TYPE_TEXTMULTI:
-        setData(OBJ_NAME, "Multi Line Text");
-        break;
-    default:
-        setData(OBJ_NAME, "Unknown");
-        break;
-    }
-
 /*
     init_line(line); //TODO: getCurrentLineType
     init_point(vector); //TODO: getCurrentLineType
@@ -654,32 +704,7 @@ Geometry::update(void)
         setObjectSize(gdata.ellipse.radius.x, gdata.ellipse.radius.y);
         setObjectCenter(gdata.ellipse.center);
         break;
-    case OBJ_TYPE_DIMLEADER:
-        setData(OBJ_NAME, "Dimension Leader");
-        break;
-    case OBJ_TYPE_LINE:
-        setData(OBJ_NAME, "Line");
-        break;
-    case OBJ_TYPE_POINT:
-        setData(OBJ_NAME, "Point");
-        break;
-    case OBJ_TYPE_POLYGON:
-        setData(OBJ_NAME, "Polygon");
-        break;
-    case OBJ_TYPE_POLYLINE:
-        setData(OBJ_NAME, "Polyline");
-        break;
-    case OBJ_TYPE_RECTANGLE:
-        setData(OBJ_NAME, "Rectangle");
-        break;
-    case OBJ_TYPE_TEXTSINGLE:
-        setData(OBJ_NAME, "Single Line Text");
-        break;
-    case OBJ_TYPE_TEXTMULTI:
-        setData(OBJ_NAME, "Multi Line Text");
-        break;
     default:
-        setData(OBJ_NAME, "Unknown");
         break;
     }
     updatePath();
@@ -758,10 +783,89 @@ Geometry::Geometry(Geometry* obj, QGraphicsItem* parent) : QGraphicsPathItem(par
     Type = obj->Type;
     setRotation(obj->rotation());
     setScale(obj->scale());
-    memcpy(&gdata, &(obj->gdata), sizeof(GeometryData));
+    gdata = obj->gdata;
     update();
 }
 
+/* Pack the object into a compressed record for the tombstone store.
+ *
+ * The shape data is a plain C union so it is copied as raw bytes, the Qt
+ * members use their QDataStream operators.
+ */
+QByteArray
+Geometry::serialize(void)
+{
+    QByteArray record;
+    QDataStream out(&record, QIODevice::WriteOnly);
+    out << (qint32)TOMBSTONE_VERSION << (qint32)Type << (qint64)objID;
+    out << pos() << rotation() << scale();
+    out << objPen << lwtPen << objLine << path() << normalPath;
+    out << lineStylePath << arrowStylePath;
+    out << arrowStyleAngle << arrowStyleLength << lineStyleAngle << lineStyleLength;
+    out << objText << objTextFont << objTextJustify << objTextPath;
+    out << arcStartPoint << arcMidPoint << arcEndPoint;
+    out << (quint64)flags << text_size << (qint32)gripIndex << (qint64)mode;
+    out.writeRawData((const char*)&gdata, sizeof(ShapeData));
+    return qCompress(record);
+}
+
+/* Rebuild an object from a record made by serialize.
+ * Returns NULL if the record is damaged or from another version.
+ */
+Geometry *
+Geometry::deserialize(QByteArray blob)
+{
+    QByteArray record = qUncompress(blob);
+    QDataStream in(record);
+    qint32 version, type;
+    qint64 id;
+    in >> version >> type >> id;
+    if (version != TOMBSTONE_VERSION) {
+        debug_message("ERROR: tombstone record has version %d, expected %d.",
+            version, TOMBSTONE_VERSION);
+        return NULL;
+    }
+
+    Geometry* obj = new Geometry(type);
+    obj->objID = id;
+
+    QPointF position;
+    qreal rot, sc;
+    in >> position >> rot >> sc;
+    obj->setPos(position);
+    obj->setRotation(rot);
+    obj->setScale(sc);
+
+    QPainterPath p;
+    in >> obj->objPen >> obj->lwtPen >> obj->objLine >> p >> obj->normalPath;
+    in >> obj->lineStylePath >> obj->arrowStylePath;
+    in >> obj->arrowStyleAngle >> obj->arrowStyleLength;
+    in >> obj->lineStyleAngle >> obj->lineStyleLength;
+    in >> obj->objText >> obj->objTextFont >> obj->objTextJustify >> obj->objTextPath;
+    in >> obj->arcStartPoint >> obj->arcMidPoint >> obj->arcEndPoint;
+
+    quint64 objFlags;
+    qint32 grip;
+    qint64 objMode;
+    in >> objFlags >> obj->text_size >> grip >> objMode;
+    obj->flags = objFlags;
+    obj->gripIndex = grip;
+    obj->mode = objMode;
+
+    in.readRawData((char*)&(obj->gdata), sizeof(ShapeData));
+    if (in.status() != QDataStream::Ok) {
+        debug_message("ERROR: tombstone record for object %lld is truncated.",
+            (long long)id);
+        delete obj;
+        return NULL;
+    }
+
+    obj->setPen(obj->objPen);
+    obj->setShape(p);
+    obj->objRubberMode = RUBBER_OFF;
+    return obj;
+}
+
 /* Geometry::allGripPoints */
 std::vector<QPointF>
 Geometry::allGripPoints()
@@ -838,6 +942,100 @@ Geometry::allGripPoints()
 Geometry::~Geometry()
 {
     debug_message("Geometry Destructor()");
+    /* By the time QGraphicsItem removes us from the scene itemChange no
+     * longer reaches this class, so drop out of the extents here.
+     */
+    View* gview = scene_view(scene());
+    if (gview) {
+        gview->forgetExtents(this);
+        gview->density.forget(this);
+        gview->objects.remove(this);
+    }
+    delete rubber;
+}
+
+/* Keep the view's scene and selection extents, its id table and its
+ * density map in step with this object.
+ */
+QVariant
+Geometry::itemChange(GraphicsItemChange change, const QVariant& value)
+{
+    View* gview = scene_view(scene());
+    switch (change) {
+    case ItemSceneChange:
+        if (gview) {
+            gview->forgetExtents(this);
+            gview->density.forget(this);
+            gview->objects.remove(this);
+        }
+        break;
+    case ItemSceneHasChanged:
+        if (gview) {
+            gview->objects.insert(this);
+            gview->trackExtents(this);
+            gview->density.changed(this);
+        }
+        break;
+    case ItemPositionHasChanged:
+    case ItemTransformHasChanged:
+    case ItemRotationHasChanged:
+    case ItemScaleHasChanged:
+        if (gview) {
+            gview->trackExtents(this);
+            gview->density.changed(this);
+        }
+        break;
+    case ItemSelectedHasChanged:
+        if (gview) {
+            gview->trackExtents(this);
+        }
+        break;
+    default:
+        break;
+    }
+    return QGraphicsPathItem::itemChange(change, value);
+}
+
+/* Replace the object's path. QGraphicsPathItem::setPath isn't virtual
+ * and reports nothing through itemChange, so Geometry changes its shape
+ * only through here to keep the view's extents and density map current.
+ */
+void
+Geometry::setShape(const QPainterPath& p)
+{
+    QGraphicsPathItem::setPath(p);
+    boundsChanged(true);
+}
+
+/* Tell the view that the bounding box may have moved: after a new path
+ * (shape is true, the density map needs the stitches again) or a new pen
+ * (only the extents do).
+ */
+void
+Geometry::boundsChanged(bool shape)
+{
+    View* gview = scene_view(scene());
+    if (!gview) {
+        return;
+    }
+    gview->trackExtents(this);
+    if (objRubberMode != RUBBER_OFF) {
+        gview->density.forget(this);
+    }
+    else if (shape) {
+        gview->density.changed(this);
+    }
+}
+
+/* Set object colour. */
+void
+Geometry::setObjectColor(QRgb rgb)
+{
+    objPen.setColor(rgb);
+    lwtPen.setColor(rgb);
+    setPen(objPen);
+    boundsChanged(false);
+    update();
 }
 
 /* Set object line weight. */
@@ -855,6 +1053,7 @@ Geometry::setObjectLineWeight(std::string lineWeight)
     else {
         lwtPen.setWidthF(std::stof(lineWeight));
     }
+    boundsChanged(false);
     /*
     else {
         QMessageBox::warning(0, translate_str("Error - Negative Lineweight"),
@@ -867,12 +1066,14 @@ Geometry::setObjectLineWeight(std::string lineWeight)
 }
 
 /* Geometry::objectRubberPoint
- * key */
+ * slot: one of the RUBBER_POINT_* slots; slots that haven't been set
+ * follow the scene's snap point.
+ */
 QPointF
-Geometry::objectRubberPoint(QString  key)
+Geometry::objectRubberPoint(int32_t slot)
 {
-    if (objRubberPoints.contains(key)) {
-        return objRubberPoints.value(key);
+    if (rubber && (rubber->pointsSet & (1ULL << slot))) {
+        return rubber->points[slot];
     }
 
     QGraphicsScene* gscene = scene();
@@ -882,23 +1083,80 @@ Geometry::objectRubberPoint(QString  key)
     return QPointF();
 }
 
-/* Geometry::objectRubberText
- * key
+/* Geometry::setRubberPoint
+ * slot, point
+ */
+void
+Geometry::setRubberPoint(int32_t slot, const QPointF& point)
+{
+    if ((slot <= RUBBER_POINT_QSNAP) || (slot >= N_RUBBER_POINTS)) {
+        return;
+    }
+    if (!rubber) {
+        rubber = new RubberData();
+    }
+    rubber->points[slot] = point;
+    rubber->pointsSet |= (1ULL << slot);
+}
+
+/* Geometry::setRubberVertex
+ * index, point
+ *
+ * Polygon and polyline rubber objects grow one vertex at a time,
+ * so the path is only rebuilt when a vertex changes. An index may
+ * replace an existing vertex or append the next one; anything further
+ * would leave a run of vertices at the origin, so it is refused.
+ */
+bool
+Geometry::setRubberVertex(int32_t index, const QPointF& point)
+{
+    if (index < 0) {
+        return false;
+    }
+    if (!rubber) {
+        rubber = new RubberData();
+    }
+    if (index > (int32_t)rubber->vertices.size()) {
+        return false;
+    }
+    if (index == (int32_t)rubber->vertices.size()) {
+        rubber->vertices.push_back(point);
+    }
+    else {
+        rubber->vertices[index] = point;
+    }
+    rubber->verticesChanged = true;
+    return true;
+}
+
+/* Geometry::setRubberText
+ * slot, txt
  */
-QString
-Geometry::objectRubberText(QString  key)
+void
+Geometry::setRubberText(int32_t slot, const QString& txt)
 {
-    if (objRubberTexts.contains(key)) {
-        return objRubberTexts.value(key);
+    if ((slot < 0) || (slot >= N_RUBBER_TEXTS)) {
+        return;
+    }
+    if (!rubber) {
+        rubber = new RubberData();
     }
-    return QString();
+    rubber->texts[slot] = txt;
+}
+
+/* Geometry::clearRubberPoints */
+void
+Geometry::clearRubberPoints(void)
+{
+    delete rubber;
+    rubber = 0;
 }
 
 /* If gripped, force this object to be drawn even if it is offscreen. */
 QRectF
 Geometry::boundingRect()
 {
-    if (objRubberMode == "OBJ_RUBBER_GRIP") {
+    if (objRubberMode == RUBBER_GRIP) {
         return scene()->sceneRect();
     }
     return path().boundingRect();
@@ -1135,24 +1393,24 @@ Geometry::updateRubber(QPainter* painter)
 {
     switch (Type) {
     case OBJ_TYPE_DIMLEADER: {
-        if (objRubberMode == "OBJ_RUBBER_DIMLEADER_LINE") {
-            QPointF sceneStartPoint = objectRubberPoint("DIMLEADER_LINE_START");
-            QPointF sceneQSnapPoint = objectRubberPoint("DIMLEADER_LINE_END");
+        if (objRubberMode == RUBBER_DIMLEADER_LINE) {
+            QPointF sceneStartPoint = objectRubberPoint(RUBBER_POINT_DIMLEADER_LINE_START);
+            QPointF sceneQSnapPoint = objectRubberPoint(RUBBER_POINT_DIMLEADER_LINE_END);
 
             setObjectEndPoint1(to_EmbVector(sceneStartPoint));
             setObjectEndPoint2(to_EmbVector(sceneQSnapPoint));
         }
-        else if (objRubberMode == "OBJ_RUBBER_GRIP") {
+        else if (objRubberMode == RUBBER_GRIP) {
             if (painter) {
-                QPointF gripPoint = objectRubberPoint("GRIP_POINT");
+                QPointF gripPoint = objectRubberPoint(RUBBER_POINT_GRIP);
                 if (gripPoint == objectEndPoint1()) {
-                    painter->drawLine(objLine.p2(), mapFromScene(objectRubberPoint(QString())));
+                    painter->drawLine(objLine.p2(), mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP)));
                 }
                 else if (gripPoint == objectEndPoint2()) {
-                    painter->drawLine(objLine.p1(), mapFromScene(objectRubberPoint(QString())));
+                    painter->drawLine(objLine.p1(), mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP)));
                 }
                 else if (gripPoint == objectMidPoint()) {
-                    painter->drawLine(objLine.translated(mapFromScene(objectRubberPoint(QString()))-mapFromScene(gripPoint)));
+                    painter->drawLine(objLine.translated(mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP))-mapFromScene(gripPoint)));
                 }
             }
         }
@@ -1160,22 +1418,22 @@ Geometry::updateRubber(QPainter* painter)
     }
 
     case OBJ_TYPE_ELLIPSE: {
-        if (objRubberMode == "OBJ_RUBBER_ELLIPSE_LINE") {
-            QPointF sceneLinePoint1 = objectRubberPoint("ELLIPSE_LINE_POINT1");
-            QPointF sceneLinePoint2 = objectRubberPoint("ELLIPSE_LINE_POINT2");
+        if (objRubberMode == RUBBER_ELLIPSE_LINE) {
+            QPointF sceneLinePoint1 = objectRubberPoint(RUBBER_POINT_ELLIPSE_LINE_POINT1);
+            QPointF sceneLinePoint2 = objectRubberPoint(RUBBER_POINT_ELLIPSE_LINE_POINT2);
             QPointF itemLinePoint1  = mapFromScene(sceneLinePoint1);
             QPointF itemLinePoint2  = mapFromScene(sceneLinePoint2);
             QLineF itemLine(itemLinePoint1, itemLinePoint2);
             if (painter) drawRubberLine(itemLine, painter, "VIEW_COLOR_CROSSHAIR");
             updatePath();
         }
-        else if (objRubberMode == "OBJ_RUBBER_ELLIPSE_MAJORDIAMETER_MINORRADIUS") {
-            QPointF sceneAxis1Point1 = objectRubberPoint("ELLIPSE_AXIS1_POINT1");
-            QPointF sceneAxis1Point2 = objectRubberPoint("ELLIPSE_AXIS1_POINT2");
-            QPointF sceneCenterPoint = objectRubberPoint("ELLIPSE_CENTER");
-            QPointF sceneAxis2Point2 = objectRubberPoint("ELLIPSE_AXIS2_POINT2");
-            EmbReal ellipseWidth = objectRubberPoint("ELLIPSE_WIDTH").x();
-            EmbReal ellipseRot = objectRubberPoint("ELLIPSE_ROT").x();
+        else if (objRubberMode == RUBBER_ELLIPSE_MAJORDIAMETER_MINORRADIUS) {
+            QPointF sceneAxis1Point1 = objectRubberPoint(RUBBER_POINT_ELLIPSE_AXIS1_POINT1);
+            QPointF sceneAxis1Point2 = objectRubberPoint(RUBBER_POINT_ELLIPSE_AXIS1_POINT2);
+            QPointF sceneCenterPoint = objectRubberPoint(RUBBER_POINT_ELLIPSE_CENTER);
+            QPointF sceneAxis2Point2 = objectRubberPoint(RUBBER_POINT_ELLIPSE_AXIS2_POINT2);
+            EmbReal ellipseWidth = objectRubberPoint(RUBBER_POINT_ELLIPSE_WIDTH).x();
+            EmbReal ellipseRot = objectRubberPoint(RUBBER_POINT_ELLIPSE_ROT).x();
 
             //TODO: incorporate perpendicularDistance() into libcgeometry
             EmbReal px = sceneAxis2Point2.x();
@@ -1201,12 +1459,12 @@ Geometry::updateRubber(QPainter* painter)
             if (painter) drawRubberLine(itemLine, painter, "VIEW_COLOR_CROSSHAIR");
             updatePath();
         }
-        else if (objRubberMode == "OBJ_RUBBER_ELLIPSE_MAJORRADIUS_MINORRADIUS") {
-            QPointF sceneAxis1Point2 = objectRubberPoint("ELLIPSE_AXIS1_POINT2");
-            QPointF sceneCenterPoint = objectRubberPoint("ELLIPSE_CENTER");
-            QPointF sceneAxis2Point2 = objectRubberPoint("ELLIPSE_AXIS2_POINT2");
-            EmbReal ellipseWidth = objectRubberPoint("ELLIPSE_WIDTH").x();
-            EmbReal ellipseRot = objectRubberPoint("ELLIPSE_ROT").x();
+        else if (objRubberMode == RUBBER_ELLIPSE_MAJORRADIUS_MINORRADIUS) {
+            QPointF sceneAxis1Point2 = objectRubberPoint(RUBBER_POINT_ELLIPSE_AXIS1_POINT2);
+            QPointF sceneCenterPoint = objectRubberPoint(RUBBER_POINT_ELLIPSE_CENTER);
+            QPointF sceneAxis2Point2 = objectRubberPoint(RUBBER_POINT_ELLIPSE_AXIS2_POINT2);
+            EmbReal ellipseWidth = objectRubberPoint(RUBBER_POINT_ELLIPSE_WIDTH).x();
+            EmbReal ellipseRot = objectRubberPoint(RUBBER_POINT_ELLIPSE_ROT).x();
 
             //TODO: incorporate perpendicularDistance() into libcgeometry
             EmbReal px = sceneAxis2Point2.x();
@@ -1232,7 +1490,7 @@ Geometry::updateRubber(QPainter* painter)
             if (painter) drawRubberLine(itemLine, painter, "VIEW_COLOR_CROSSHAIR");
             updatePath();
         }
-        else if (objRubberMode == "OBJ_RUBBER_GRIP") {
+        else if (objRubberMode == RUBBER_GRIP) {
             //TODO: updateRubber() gripping for Geometry
         }
 
@@ -1240,9 +1498,9 @@ Geometry::updateRubber(QPainter* painter)
     }
 
     case OBJ_TYPE_IMAGE: {
-        if (objRubberMode == "OBJ_RUBBER_IMAGE") {
-            QPointF sceneStartPoint = objectRubberPoint("IMAGE_START");
-            QPointF sceneEndPoint = objectRubberPoint("IMAGE_END");
+        if (objRubberMode == RUBBER_IMAGE) {
+            QPointF sceneStartPoint = objectRubberPoint(RUBBER_POINT_IMAGE_START);
+            QPointF sceneEndPoint = objectRubberPoint(RUBBER_POINT_IMAGE_END);
             EmbReal x = sceneStartPoint.x();
             EmbReal y = sceneStartPoint.y();
             EmbReal w = sceneEndPoint.x() - sceneStartPoint.x();
@@ -1250,36 +1508,35 @@ Geometry::updateRubber(QPainter* painter)
             setObjectRect(x,y,w,h);
             updatePath();
         }
-        else if (objRubberMode == "OBJ_RUBBER_GRIP") {
+        else if (objRubberMode == RUBBER_GRIP) {
             //TODO: updateRubber() gripping for ImageObject
         }
         break;
     }
 
     case OBJ_TYPE_LINE: {
-        std::string rubberMode = objRubberMode;
-        if (rubberMode == "OBJ_RUBBER_LINE") {
-            QPointF sceneStartPoint = objectRubberPoint("LINE_START");
-            QPointF sceneQSnapPoint = objectRubberPoint("LINE_END");
+        if (objRubberMode == RUBBER_LINE) {
+            QPointF sceneStartPoint = objectRubberPoint(RUBBER_POINT_LINE_START);
+            QPointF sceneQSnapPoint = objectRubberPoint(RUBBER_POINT_LINE_END);
 
             setObjectEndPoint1(to_EmbVector(sceneStartPoint));
             setObjectEndPoint2(to_EmbVector(sceneQSnapPoint));
 
             drawRubberLine(objLine, painter, "VIEW_COLOR_CROSSHAIR");
         }
-        else if (rubberMode == "OBJ_RUBBER_GRIP") {
+        else if (objRubberMode == RUBBER_GRIP) {
             if (painter) {
-                QPointF gripPoint = objectRubberPoint("GRIP_POINT");
+                QPointF gripPoint = objectRubberPoint(RUBBER_POINT_GRIP);
                 if (gripPoint == objectEndPoint1()) {
-                    painter->drawLine(objLine.p2(), mapFromScene(objectRubberPoint(QString())));
+                    painter->drawLine(objLine.p2(), mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP)));
                 }
                 else if (gripPoint == objectEndPoint2()) {
-                    painter->drawLine(objLine.p1(), mapFromScene(objectRubberPoint(QString())));
+                    painter->drawLine(objLine.p1(), mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP)));
                 }
                 else if (gripPoint == objectMidPoint())
-                    painter->drawLine(objLine.translated(mapFromScene(objectRubberPoint(QString()))-mapFromScene(gripPoint)));
+                    painter->drawLine(objLine.translated(mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP))-mapFromScene(gripPoint)));
 
-                QLineF rubLine(mapFromScene(gripPoint), mapFromScene(objectRubberPoint(QString())));
+                QLineF rubLine(mapFromScene(gripPoint), mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP)));
                 drawRubberLine(rubLine, painter, "VIEW_COLOR_CROSSHAIR");
             }
         }
@@ -1287,9 +1544,9 @@ Geometry::updateRubber(QPainter* painter)
     }
 
     case OBJ_TYPE_CIRCLE: {
-        if (objRubberMode == "OBJ_RUBBER_CIRCLE_1P_RAD") {
-            QPointF sceneCenterPoint = objectRubberPoint("CIRCLE_CENTER");
-            QPointF sceneQSnapPoint = objectRubberPoint("CIRCLE_RADIUS");
+        if (objRubberMode == RUBBER_CIRCLE_1P_RAD) {
+            QPointF sceneCenterPoint = objectRubberPoint(RUBBER_POINT_CIRCLE_CENTER);
+            QPointF sceneQSnapPoint = objectRubberPoint(RUBBER_POINT_CIRCLE_RADIUS);
             QPointF itemCenterPoint = mapFromScene(sceneCenterPoint);
             QPointF itemQSnapPoint = mapFromScene(sceneQSnapPoint);
             QLineF itemLine(itemCenterPoint, itemQSnapPoint);
@@ -1300,9 +1557,9 @@ Geometry::updateRubber(QPainter* painter)
             if (painter) drawRubberLine(itemLine, painter, "VIEW_COLOR_CROSSHAIR");
             updatePath();
         }
-        else if (objRubberMode == "OBJ_RUBBER_CIRCLE_1P_DIA") {
-            QPointF sceneCenterPoint = objectRubberPoint("CIRCLE_CENTER");
-            QPointF sceneQSnapPoint = objectRubberPoint("CIRCLE_DIAMETER");
+        else if (objRubberMode == RUBBER_CIRCLE_1P_DIA) {
+            QPointF sceneCenterPoint = objectRubberPoint(RUBBER_POINT_CIRCLE_CENTER);
+            QPointF sceneQSnapPoint = objectRubberPoint(RUBBER_POINT_CIRCLE_DIAMETER);
             QPointF itemCenterPoint = mapFromScene(sceneCenterPoint);
             QPointF itemQSnapPoint = mapFromScene(sceneQSnapPoint);
             QLineF itemLine(itemCenterPoint, itemQSnapPoint);
@@ -1313,19 +1570,19 @@ Geometry::updateRubber(QPainter* painter)
             if (painter) drawRubberLine(itemLine, painter, "VIEW_COLOR_CROSSHAIR");
             updatePath();
         }
-        else if (objRubberMode == "OBJ_RUBBER_CIRCLE_2P") {
-            QPointF sceneTan1Point = objectRubberPoint("CIRCLE_TAN1");
-            QPointF sceneQSnapPoint = objectRubberPoint("CIRCLE_TAN2");
+        else if (objRubberMode == RUBBER_CIRCLE_2P) {
+            QPointF sceneTan1Point = objectRubberPoint(RUBBER_POINT_CIRCLE_TAN1);
+            QPointF sceneQSnapPoint = objectRubberPoint(RUBBER_POINT_CIRCLE_TAN2);
             QLineF sceneLine(sceneTan1Point, sceneQSnapPoint);
             setObjectCenter(to_EmbVector(sceneLine.pointAt(0.5)));
             EmbReal diameter = sceneLine.length();
             setObjectDiameter(diameter);
             updatePath();
         }
-        else if (objRubberMode == "OBJ_RUBBER_CIRCLE_3P") {
-            QPointF sceneTan1Point = objectRubberPoint("CIRCLE_TAN1");
-            QPointF sceneTan2Point = objectRubberPoint("CIRCLE_TAN2");
-            QPointF sceneTan3Point = objectRubberPoint("CIRCLE_TAN3");
+        else if (objRubberMode == RUBBER_CIRCLE_3P) {
+            QPointF sceneTan1Point = objectRubberPoint(RUBBER_POINT_CIRCLE_TAN1);
+            QPointF sceneTan2Point = objectRubberPoint(RUBBER_POINT_CIRCLE_TAN2);
+            QPointF sceneTan3Point = objectRubberPoint(RUBBER_POINT_CIRCLE_TAN3);
 
             EmbArc arc;
             arc.start = to_EmbVector(sceneTan1Point);
@@ -1339,18 +1596,18 @@ Geometry::updateRubber(QPainter* painter)
             setObjectRadius(radius);
             updatePath();
         }
-        else if (objRubberMode == "OBJ_RUBBER_GRIP") {
+        else if (objRubberMode == RUBBER_GRIP) {
             if (painter) {
-                QPointF gripPoint = objectRubberPoint("GRIP_POINT");
+                QPointF gripPoint = objectRubberPoint(RUBBER_POINT_GRIP);
                 if (gripPoint == scenePos()) {
-                    painter->drawEllipse(rect().translated(mapFromScene(objectRubberPoint(QString()))-mapFromScene(gripPoint)));
+                    painter->drawEllipse(rect().translated(mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP))-mapFromScene(gripPoint)));
                 }
                 else {
-                    EmbReal gripRadius = QLineF(scenePos(), objectRubberPoint(QString())).length();
+                    EmbReal gripRadius = QLineF(scenePos(), objectRubberPoint(RUBBER_POINT_QSNAP)).length();
                     painter->drawEllipse(QPointF(), gripRadius, gripRadius);
                 }
 
-                QLineF rubLine(mapFromScene(gripPoint), mapFromScene(objectRubberPoint(QString())));
+                QLineF rubLine(mapFromScene(gripPoint), mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP)));
                 drawRubberLine(rubLine, painter, "VIEW_COLOR_CROSSHAIR");
             }
         }
@@ -1358,11 +1615,11 @@ Geometry::updateRubber(QPainter* painter)
     }
 
     case OBJ_TYPE_POINT: {
-        if (objRubberMode == "OBJ_RUBBER_GRIP") {
+        if (objRubberMode == RUBBER_GRIP) {
             if (painter) {
-                QPointF gripPoint = objectRubberPoint("GRIP_POINT");
+                QPointF gripPoint = objectRubberPoint(RUBBER_POINT_GRIP);
                 if (gripPoint == scenePos()) {
-                    QLineF rubLine(mapFromScene(gripPoint), mapFromScene(objectRubberPoint(QString())));
+                    QLineF rubLine(mapFromScene(gripPoint), mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP)));
                     drawRubberLine(rubLine, painter, "VIEW_COLOR_CROSSHAIR");
                 }
             }
@@ -1371,36 +1628,28 @@ Geometry::updateRubber(QPainter* painter)
     }
 
     case OBJ_TYPE_POLYGON: {
-        std::string rubberMode = objRubberMode;
-        if (rubberMode == "OBJ_RUBBER_POLYGON") {
-            setObjectPos(objectRubberPoint("POLYGON_POINT_0"));
+        if (objRubberMode == RUBBER_POLYGON) {
+            if (!rubber || rubber->vertices.empty()) return;
+            setObjectPos(rubber->vertices[0]);
 
-            bool ok = false;
-            QString numStr = objectRubberText("POLYGON_NUM_POINTS");
-            if (numStr.isNull()) return;
-            int num = numStr.toInt(&ok);
-            if (!ok) return;
+            //Ensure the path isn't updated until a vertex is changed again
+            if (!rubber->verticesChanged) return;
+            rubber->verticesChanged = false;
 
-            QString appendStr;
             QPainterPath rubberPath;
-            rubberPath.moveTo(mapFromScene(objectRubberPoint("POLYGON_POINT_0")));
-            for (int i = 1; i <= num; i++) {
-                appendStr = "POLYGON_POINT_" + QString().setNum(i);
-                QPointF appendPoint = mapFromScene(objectRubberPoint(appendStr));
-                rubberPath.lineTo(appendPoint);
+            rubberPath.moveTo(mapFromScene(rubber->vertices[0]));
+            for (int i = 1; i < (int)rubber->vertices.size(); i++) {
+                rubberPath.lineTo(mapFromScene(rubber->vertices[i]));
             }
             //rubberPath.lineTo(0,0);
             //updatePath(rubberPath);
-
-            //Ensure the path isn't updated until the number of points is changed again
-            objRubberTexts.insert("POLYGON_NUM_POINTS", QString());
         }
-        else if (rubberMode == "OBJ_RUBBER_POLYGON_INSCRIBE") {
-            setObjectPos(objectRubberPoint("POLYGON_CENTER"));
+        else if (objRubberMode == RUBBER_POLYGON_INSCRIBE) {
+            setObjectPos(objectRubberPoint(RUBBER_POINT_POLYGON_CENTER));
 
-            quint16 numSides = objectRubberPoint("POLYGON_NUM_SIDES").x();
+            quint16 numSides = objectRubberPoint(RUBBER_POINT_POLYGON_NUM_SIDES).x();
 
-            QPointF inscribePoint = mapFromScene(objectRubberPoint("POLYGON_INSCRIBE_POINT"));
+            QPointF inscribePoint = mapFromScene(objectRubberPoint(RUBBER_POINT_POLYGON_INSCRIBE_POINT));
             QLineF inscribeLine = QLineF(QPointF(0,0), inscribePoint);
             EmbReal inscribeAngle = inscribeLine.angle();
             EmbReal inscribeInc = 360.0/numSides;
@@ -1418,12 +1667,12 @@ Geometry::updateRubber(QPainter* painter)
             // \todo fix this
             //updatePath(inscribePath);
         }
-        else if (rubberMode == "OBJ_RUBBER_POLYGON_CIRCUMSCRIBE") {
-            setObjectPos(objectRubberPoint("POLYGON_CENTER"));
+        else if (objRubberMode == RUBBER_POLYGON_CIRCUMSCRIBE) {
+            setObjectPos(objectRubberPoint(RUBBER_POINT_POLYGON_CENTER));
 
-            quint16 numSides = objectRubberPoint("POLYGON_NUM_SIDES").x();
+            quint16 numSides = objectRubberPoint(RUBBER_POINT_POLYGON_NUM_SIDES).x();
 
-            QPointF circumscribePoint = mapFromScene(objectRubberPoint("POLYGON_CIRCUMSCRIBE_POINT"));
+            QPointF circumscribePoint = mapFromScene(objectRubberPoint(RUBBER_POINT_POLYGON_CIRCUMSCRIBE_POINT));
             QLineF circumscribeLine = QLineF(QPointF(0,0), circumscribePoint);
             EmbReal circumscribeAngle = circumscribeLine.angle();
             EmbReal circumscribeInc = 360.0/numSides;
@@ -1452,10 +1701,10 @@ Geometry::updateRubber(QPainter* painter)
             // \todo fix this
             // updatePath(circumscribePath);
         }
-        else if (rubberMode == "OBJ_RUBBER_GRIP") {
+        else if (objRubberMode == RUBBER_GRIP) {
             if (painter) {
                 int elemCount = normalPath.elementCount();
-                QPointF gripPoint = objectRubberPoint("GRIP_POINT");
+                QPointF gripPoint = objectRubberPoint(RUBBER_POINT_GRIP);
                 if (gripIndex == -1) gripIndex = findIndex(gripPoint);
                 if (gripIndex == -1) return;
 
@@ -1469,10 +1718,10 @@ Geometry::updateRubber(QPainter* painter)
                 QPainterPath::Element en = normalPath.elementAt(n);
                 QPointF emPoint = QPointF(em.x, em.y);
                 QPointF enPoint = QPointF(en.x, en.y);
-                painter->drawLine(emPoint, mapFromScene(objectRubberPoint(QString())));
-                painter->drawLine(enPoint, mapFromScene(objectRubberPoint(QString())));
+                painter->drawLine(emPoint, mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP)));
+                painter->drawLine(enPoint, mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP)));
 
-                QLineF rubLine(mapFromScene(gripPoint), mapFromScene(objectRubberPoint(QString())));
+                QLineF rubLine(mapFromScene(gripPoint), mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP)));
                 drawRubberLine(rubLine, painter, "VIEW_COLOR_CROSSHAIR");
             }
         }
@@ -1480,36 +1729,28 @@ Geometry::updateRubber(QPainter* painter)
     }
 
     case OBJ_TYPE_POLYLINE: {
-        std::string rubberMode = objRubberMode;
-        if (rubberMode == "OBJ_RUBBER_POLYLINE") {
-            setObjectPos(objectRubberPoint("POLYLINE_POINT_0"));
+        if (objRubberMode == RUBBER_POLYLINE) {
+            if (!rubber || rubber->vertices.empty()) return;
+            setObjectPos(rubber->vertices[0]);
 
-            QLineF rubberLine(normalPath.currentPosition(), mapFromScene(objectRubberPoint(QString())));
+            QLineF rubberLine(normalPath.currentPosition(), mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP)));
             if (painter) drawRubberLine(rubberLine, painter, "VIEW_COLOR_CROSSHAIR");
 
-            bool ok = false;
-            QString numStr = objectRubberText("POLYLINE_NUM_POINTS");
-            if (numStr.isNull()) return;
-            int num = numStr.toInt(&ok);
-            if (!ok) return;
+            //Ensure the path isn't updated until a vertex is changed again
+            if (!rubber->verticesChanged) return;
+            rubber->verticesChanged = false;
 
-            QString appendStr;
             QPainterPath rubberPath;
-            for (int i = 1; i <= num; i++) {
-                appendStr = "POLYLINE_POINT_" + QString().setNum(i);
-                QPointF appendPoint = mapFromScene(objectRubberPoint(appendStr));
-                rubberPath.lineTo(appendPoint);
+            for (int i = 1; i < (int)rubber->vertices.size(); i++) {
+                rubberPath.lineTo(mapFromScene(rubber->vertices[i]));
             }
             // \todo fix this
             //updatePath(rubberPath);
-
-            //Ensure the path isn't updated until the number of points is changed again
-            objRubberTexts.insert("POLYLINE_NUM_POINTS", QString());
         }
-        else if (rubberMode == "OBJ_RUBBER_GRIP") {
+        else if (objRubberMode == RUBBER_GRIP) {
             if (painter) {
                 int elemCount = normalPath.elementCount();
-                QPointF gripPoint = objectRubberPoint("GRIP_POINT");
+                QPointF gripPoint = objectRubberPoint(RUBBER_POINT_GRIP);
                 if (gripIndex == -1) gripIndex = findIndex(gripPoint);
                 if (gripIndex == -1) return;
 
@@ -1517,23 +1758,23 @@ Geometry::updateRubber(QPainter* painter)
                     // First
                     QPainterPath::Element ef = normalPath.elementAt(1);
                     QPointF efPoint = QPointF(ef.x, ef.y);
-                    painter->drawLine(efPoint, mapFromScene(objectRubberPoint(QString())));
+                    painter->drawLine(efPoint, mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP)));
                 }
                 else if (gripIndex == elemCount-1) { //Last
                     QPainterPath::Element el = normalPath.elementAt(gripIndex-1);
                     QPointF elPoint = QPointF(el.x, el.y);
-                    painter->drawLine(elPoint, mapFromScene(objectRubberPoint(QString())));
+                    painter->drawLine(elPoint, mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP)));
                 }
                 else { //Middle
                     QPainterPath::Element em = normalPath.elementAt(gripIndex-1);
                     QPainterPath::Element en = normalPath.elementAt(gripIndex+1);
                     QPointF emPoint = QPointF(em.x, em.y);
                     QPointF enPoint = QPointF(en.x, en.y);
-                    painter->drawLine(emPoint, mapFromScene(objectRubberPoint(QString())));
-                    painter->drawLine(enPoint, mapFromScene(objectRubberPoint(QString())));
+                    painter->drawLine(emPoint, mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP)));
+                    painter->drawLine(enPoint, mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP)));
                 }
 
-                QLineF rubLine(mapFromScene(gripPoint), mapFromScene(objectRubberPoint(QString())));
+                QLineF rubLine(mapFromScene(gripPoint), mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP)));
                 drawRubberLine(rubLine, painter, "VIEW_COLOR_CROSSHAIR");
             }
         }
@@ -1541,10 +1782,9 @@ Geometry::updateRubber(QPainter* painter)
     }
 
     case OBJ_TYPE_RECTANGLE: {
-        std::string rubberMode = objRubberMode;
-        if (objRubberMode == "OBJ_RUBBER_RECTANGLE") {
-            QPointF sceneStartPoint = objectRubberPoint("RECTANGLE_START");
-            QPointF sceneEndPoint = objectRubberPoint("RECTANGLE_END");
+        if (objRubberMode == RUBBER_RECTANGLE) {
+            QPointF sceneStartPoint = objectRubberPoint(RUBBER_POINT_RECTANGLE_START);
+            QPointF sceneEndPoint = objectRubberPoint(RUBBER_POINT_RECTANGLE_END);
             EmbReal x = sceneStartPoint.x();
             EmbReal y = sceneStartPoint.y();
             EmbReal w = sceneEndPoint.x() - sceneStartPoint.x();
@@ -1552,12 +1792,12 @@ Geometry::updateRubber(QPainter* painter)
             setObjectRect(x,y,w,h);
             updatePath();
         }
-        else if (rubberMode == "OBJ_RUBBER_GRIP") {
+        else if (objRubberMode == RUBBER_GRIP) {
             if (painter) {
                 //TODO: Make this work with rotation & scaling
                 /*
-                QPointF gripPoint = objectRubberPoint("GRIP_POINT");
-                QPointF after = objectRubberPoint(QString());
+                QPointF gripPoint = objectRubberPoint(RUBBER_POINT_GRIP);
+                QPointF after = objectRubberPoint(RUBBER_POINT_QSNAP);
                 QPointF delta = after-gripPoint;
                 if     (gripPoint == objectTopLeft()) { painter->drawPolygon(mapFromScene(QRectF(after.x(), after.y(), objectWidth()-delta.x(), objectHeight()-delta.y()))); }
                 else if (gripPoint == objectTopRight()) {
@@ -1566,15 +1806,15 @@ Geometry::updateRubber(QPainter* painter)
                 else if (gripPoint == objectBottomLeft()) { painter->drawPolygon(mapFromScene(QRectF(objectTopLeft().x()+delta.x(), objectTopLeft().y(), objectWidth()-delta.x(), objectHeight()+delta.y()))); }
                 else if (gripPoint == objectBottomRight()) { painter->drawPolygon(mapFromScene(QRectF(objectTopLeft().x(), objectTopLeft().y(), objectWidth()+delta.x(), objectHeight()+delta.y()))); }
 
-                QLineF rubLine(mapFromScene(gripPoint), mapFromScene(objectRubberPoint(QString())));
+                QLineF rubLine(mapFromScene(gripPoint), mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP)));
                 drawRubberLine(rubLine, painter, "VIEW_COLOR_CROSSHAIR");
                 */
 
-                QPointF gripPoint = objectRubberPoint("GRIP_POINT");
-                QPointF after = objectRubberPoint(QString());
+                QPointF gripPoint = objectRubberPoint(RUBBER_POINT_GRIP);
+                QPointF after = objectRubberPoint(RUBBER_POINT_QSNAP);
                 QPointF delta = after-gripPoint;
 
-                QLineF rubLine(mapFromScene(gripPoint), mapFromScene(objectRubberPoint(QString())));
+                QLineF rubLine(mapFromScene(gripPoint), mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP)));
                 drawRubberLine(rubLine, painter, "VIEW_COLOR_CROSSHAIR");
             }
         }
@@ -1582,23 +1822,23 @@ Geometry::updateRubber(QPainter* painter)
     }
 
     case OBJ_TYPE_TEXTSINGLE: {
-        if (objRubberMode == "OBJ_RUBBER_TEXTSINGLE") {
-            setObjectTextFont(objectRubberText("TEXT_FONT"));
-            setObjectTextJustify(objectRubberText("TEXT_JUSTIFY"));
-            setObjectPos(objectRubberPoint("TEXT_POINT"));
-            QPointF hr = objectRubberPoint("TEXT_HEIGHT_ROTATION");
+        if (objRubberMode == RUBBER_TEXTSINGLE) {
+            setObjectTextFont(objectRubberText(RUBBER_TEXT_FONT));
+            setObjectTextJustify(objectRubberText(RUBBER_TEXT_JUSTIFY));
+            setObjectPos(objectRubberPoint(RUBBER_POINT_TEXT_POINT));
+            QPointF hr = objectRubberPoint(RUBBER_POINT_TEXT_HEIGHT_ROTATION);
             setObjectTextSize(hr.x());
             setRotation(hr.y());
-            setObjectText(objectRubberText("TEXT_RAPID"));
+            setObjectText(objectRubberText(RUBBER_TEXT_RAPID));
         }
-        else if (objRubberMode == "OBJ_RUBBER_GRIP") {
+        else if (objRubberMode == RUBBER_GRIP) {
             if (painter) {
-                QPointF gripPoint = objectRubberPoint("GRIP_POINT");
+                QPointF gripPoint = objectRubberPoint(RUBBER_POINT_GRIP);
                 if (gripPoint == scenePos()) {
-                    painter->drawPath(path().translated(mapFromScene(objectRubberPoint(QString()))-mapFromScene(gripPoint)));
+                    painter->drawPath(path().translated(mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP))-mapFromScene(gripPoint)));
                 }
 
-                QLineF rubLine(mapFromScene(gripPoint), mapFromScene(objectRubberPoint(QString())));
+                QLineF rubLine(mapFromScene(gripPoint), mapFromScene(objectRubberPoint(RUBBER_POINT_QSNAP)));
                 drawRubberLine(rubLine, painter, "VIEW_COLOR_CROSSHAIR");
             }
         }
@@ -1741,7 +1981,7 @@ Geometry::setRect(EmbReal x, EmbReal y, EmbReal w, EmbReal h)
 {
     QPainterPath p;
     p.addRect(x, y, w, h);
-    setPath(p);
+    setShape(p);
 }
 
 /* . */
@@ -1751,7 +1991,7 @@ Geometry::setLine(const QLineF& li)
     QPainterPath p;
     p.moveTo(li.p1());
     p.lineTo(li.p2());
-    setPath(p);
+    setShape(p);
     objLine = li;
 }
 
@@ -1762,7 +2002,7 @@ Geometry::setLine(EmbReal x1, EmbReal y1, EmbReal x2, EmbReal y2)
     QPainterPath p;
     p.moveTo(x1,y1);
     p.lineTo(x2,y2);
-    setPath(p);
+    setShape(p);
     objLine.setLine(x1,y1,x2,y2);
 }
 
@@ -1773,7 +2013,9 @@ Geometry::vulcanize(void)
     debug_message("DimLeaderObject vulcanize()");
     updateRubber();
 
-    objRubberMode = "OBJ_RUBBER_OFF";
+    objRubberMode = RUBBER_OFF;
+    clearRubberPoints();
+    boundsChanged(true);
 
     if (Type == OBJ_TYPE_POLYGON) {
         if (!normalPath.elementCount()) {
@@ -1915,6 +2157,7 @@ Geometry::objectSavePath()
         break;
     }
 
+    case OBJ_TYPE_HATCH:
     case OBJ_TYPE_POLYGON: {
         path = normalPath;
         path.closeSubpath();
@@ -1938,6 +2181,7 @@ Geometry::objectSavePath()
     switch (Type) {
     case OBJ_TYPE_CIRCLE:
     case OBJ_TYPE_ELLIPSE:
+    case OBJ_TYPE_HATCH:
     case OBJ_TYPE_POLYLINE:
     case OBJ_TYPE_POLYGON:
     case OBJ_TYPE_PATH:
@@ -2414,7 +2658,7 @@ Geometry::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidg
     }
 
     case OBJ_TYPE_LINE: {
-        if (objRubberMode != "OBJ_RUBBER_LINE") {
+        if (objRubberMode != RUBBER_LINE) {
             painter->drawLine(objLine);
         }
 
@@ -2543,7 +2787,6 @@ void
 Geometry::ImageObject::init(EmbReal x, EmbReal y, EmbReal w, EmbReal h, QRgb rgb, Qt::PenStyle lineType)
 {
     setData(OBJ_TYPE, OBJ_TYPE_IMAGE);
-    setData(OBJ_NAME, "Image");
 
     setFlag(QGraphicsItem::ItemIsSelectable, true);
 
@@ -2641,7 +2884,6 @@ void
 Geometry::init(EmbVector position, const QPainterPath& p, QRgb rgb, Qt::PenStyle lineType)
 {
     setData(OBJ_TYPE, OBJ_TYPE_PATH);
-    setData(OBJ_NAME, "Path");
 
     setFlag(QGraphicsItem::ItemIsSelectable, true);
 
@@ -2686,7 +2928,7 @@ Geometry::updatePath()
         path.arcTo(rect(), startAngle, spanAngle);
         //NOTE: Reverse the path so that the inside area isn't considered part of the arc
         path.arcTo(rect(), startAngle+spanAngle, -spanAngle);
-        setPath(path);
+        setShape(path);
         break;
     }
 
@@ -2698,7 +2940,7 @@ Geometry::updatePath()
         path.arcTo(r, 0, 360);
         //NOTE: Reverse the path so that the inside area isn't considered part of the circle
         path.arcTo(r, 0, -360);
-        setPath(path);
+        setShape(path);
         break;
     }
 
@@ -2707,7 +2949,7 @@ Geometry::updatePath()
         path.arcTo(r, 0, 360);
         //NOTE: Reverse the path so that the inside area isn't considered part of the ellipse
         path.arcTo(r, 0, -360);
-        setPath(path);
+        setShape(path);
         break;
     }
 
@@ -2723,7 +2965,7 @@ Geometry::updatePath()
         path.lineTo(r.topRight());
         path.lineTo(r.bottomRight());
         path.moveTo(r.bottomLeft());
-        setPath(path);
+        setShape(path);
         break;
     }
 
@@ -2732,14 +2974,14 @@ Geometry::updatePath()
         closedPath.closeSubpath();
         QPainterPath reversePath = closedPath.toReversed();
         reversePath.connectPath(closedPath);
-        setPath(reversePath);
+        setShape(reversePath);
         break;
     }
 
     case OBJ_TYPE_PATH: {
         QPainterPath reversePath = normalPath.toReversed();
         reversePath.connectPath(normalPath);
-        setPath(reversePath);
+        setShape(reversePath);
         break;
     }
 
@@ -2775,14 +3017,481 @@ Geometry::updatePath(const QPainterPath& p)
     normalPath = p;
     QPainterPath reversePath = normalPath.toReversed();
     reversePath.connectPath(normalPath);
-    setPath(reversePath);
+    setShape(reversePath);
+}
+
+/* Whether the steady clock has passed the time_point at data. */
+static int
+deadline_expired(void *data)
+{
+    return std::chrono::steady_clock::now()
+        >= *(std::chrono::steady_clock::time_point*)data;
+}
+
+/* Order the runs of one colour with a nearest neighbour seed starting
+ * from members[first], refined with 2-opt and Or-opt passes until they
+ * stop helping or the deadline passes. The group's start is left free,
+ * since where it begins depends on the colour before it.
+ */
+static std::vector<StitchStep>
+sequence_seed(const StitchPlan& plan, const std::vector<int>& members,
+    int first, const SequenceDeadline *deadline)
+{
+    int n = (int)members.size();
+    std::vector<StitchStep> steps(n);
+    sequence_nearest(plan.runs.data(), members.data(), n, first,
+        steps.data(), deadline);
+    for (;;) {
+        int moves = sequence_2opt_pass(plan.runs.data(), steps.data(), n,
+            deadline);
+        moves += sequence_oropt_pass(plan.runs.data(), steps.data(), n,
+            deadline);
+        if (!moves) {
+            break;
+        }
+    }
+    return steps;
+}
+
+/* Choose the order to sew the runs of plan in, colour by colour, to keep
+ * the jumps, trims and travel between them down.
+ *
+ * The colours are ordered independently, so they are shared between the
+ * cores, and any cores to spare try more seeds for each colour. All of
+ * it stops after SEQUENCE_TIME_BUDGET_MSEC. Then each colour is turned
+ * round if its far end is nearer to where the last colour finished, and
+ * the closed runs are entered at the points nearest the needle. What
+ * that saved is added to reports.
+ */
+static std::vector<StitchStep>
+sequence_plan(const StitchPlan& plan, QStringList& reports)
+{
+    std::vector<StitchStep> order;
+    if (plan.runs.empty()) {
+        return order;
+    }
+    const StitchRun *runs = plan.runs.data();
+
+    std::vector<std::vector<int>> groups(plan.colors.size());
+    for (int i=0; i<(int)plan.runs.size(); i++) {
+        groups[plan.runs[i].color].push_back(i);
+    }
+
+    /* The order of the scene, to report against. */
+    std::vector<StitchStep> scene;
+    for (const std::vector<int>& members : groups) {
+        for (int run : members) {
+            StitchStep s = {run, 0, 0};
+            scene.push_back(s);
+        }
+    }
+
+    /* Every (colour, seed) pair is its own task, so a plan with one big
+     * colour still keeps all the cores busy.
+     */
+    int threads = std::max(1, (int)std::thread::hardware_concurrency());
+    int per_group = std::max(1, threads / (int)groups.size());
+    std::vector<std::pair<int, int>> tasks;
+    std::vector<int> seeds(groups.size(), 0);
+    for (int g=0; g<(int)groups.size(); g++) {
+        seeds[g] = std::min(per_group, (int)groups[g].size());
+        for (int seed=0; seed<seeds[g]; seed++) {
+            tasks.push_back(std::make_pair(g, seed));
+        }
+    }
+
+    auto deadline_time = std::chrono::steady_clock::now()
+        + std::chrono::milliseconds(SEQUENCE_TIME_BUDGET_MSEC);
+    SequenceDeadline deadline = {deadline_expired, &deadline_time};
+    std::vector<std::vector<StitchStep>> tried(tasks.size());
+    parallel_for((int)tasks.size(), [&](int t) {
+        const std::vector<int>& members = groups[tasks[t].first];
+        int n = (int)members.size();
+        int first = tasks[t].second * n / seeds[tasks[t].first];
+        tried[t] = sequence_seed(plan, members, first, &deadline);
+    });
+
+    /* Keep the shortest travel each colour found. */
+    std::vector<std::vector<StitchStep>> results(groups.size());
+    std::vector<EmbReal> best_travel(groups.size(), 0.0);
+    for (int t=0; t<(int)tasks.size(); t++) {
+        int g = tasks[t].first;
+        std::vector<StitchStep>& steps = tried[t];
+        EmbReal travel = sequence_travel(runs, steps.data(),
+            (int)steps.size(), step_entry(runs, steps[0]));
+        if (results[g].empty() || (travel < best_travel[g])) {
+            results[g].swap(steps);
+            best_travel[g] = travel;
+        }
+    }
+
+    EmbVector at = {0.0, 0.0};
+    for (std::vector<StitchStep>& steps : results) {
+        if (steps.empty()) {
+            continue;
+        }
+        int n = (int)steps.size();
+        if (order.empty()) {
+            at = step_entry(runs, steps[0]);
+        }
+        EmbReal ahead = embVector_distance(at, step_entry(runs, steps[0]));
+        EmbReal behind = embVector_distance(at, step_exit(runs, steps[n-1]));
+        if (behind < ahead) {
+            sequence_reverse(steps.data(), n);
+        }
+        sequence_entries(runs, steps.data(), n, at);
+        at = step_exit(runs, steps[n-1]);
+        order.insert(order.end(), steps.begin(), steps.end());
+    }
+
+    int jumps_before = 0, trims_before = 0, jumps = 0, trims = 0;
+    sequence_count(runs, scene.data(), (int)scene.size(), SEQUENCE_TRIM_LENGTH,
+        &jumps_before, &trims_before);
+    sequence_count(runs, order.data(), (int)order.size(), SEQUENCE_TRIM_LENGTH,
+        &jumps, &trims);
+    EmbReal travel_before = sequence_travel(runs, scene.data(),
+        (int)scene.size(), step_entry(runs, scene[0]));
+    EmbReal travel = sequence_travel(runs, order.data(), (int)order.size(),
+        step_entry(runs, order[0]));
+    QString report = QString("Stitch order: %1 jumps (was %2), %3 trims "
+        "(was %4), %5 mm of travel saved.")
+        .arg(jumps).arg(jumps_before).arg(trims).arg(trims_before)
+        .arg(travel_before - travel, 0, 'f', 1);
+    debug_message(qPrintable(report));
+    reports << report;
+    return order;
+}
+
+/* Turn the regions queued by toFill() into rows of stitches and add them
+ * to plan as runs of their own, to be sequenced with the rest. The
+ * regions are shared between the cores.
+ */
+static void
+fill_plan(StitchPlan& plan)
+{
+    int n = (int)plan.fills.size();
+    if (n == 0) {
+        return;
+    }
+    EmbReal spacing = settings[ST_FILL_SPACING].r;
+    EmbReal angle = settings[ST_FILL_ANGLE].r;
+    EmbReal stitch_length = settings[ST_FILL_STITCH_LENGTH].r;
+    int stagger = settings[ST_FILL_STAGGER].i;
+
+    std::vector<FillStitches> results(n);
+    memset(results.data(), 0, n*sizeof(FillStitches));
+    std::atomic<int> failed(0);
+    parallel_for(n, [&](int g) {
+        const FillRegion& region = plan.fills[g];
+        if (!fill_region(region.points.data(), region.ring_ends.data(),
+            (int)region.ring_ends.size(), spacing, angle, stitch_length,
+            stagger, &results[g])) {
+            failed++;
+        }
+    });
+    if (failed) {
+        debug_message("Could not allocate memory for %d fills", (int)failed);
+    }
+
+    for (int g=0; g<n; g++) {
+        const FillStitches& fill = results[g];
+        for (int i=0, start=0; i<fill.runs; start=fill.run_ends[i], i++) {
+            if (fill.run_ends[i] == start) {
+                continue;
+            }
+            plan.points.push_back(std::vector<EmbVector>(fill.points + start,
+                fill.points + fill.run_ends[i]));
+            StitchRun run;
+            run.points = plan.points.back().data();
+            run.count = (int)plan.points.back().size();
+            run.color = plan.fills[g].color;
+            run.closed = 0;
+            plan.runs.push_back(run);
+        }
+        fill_free(&results[g]);
+    }
+}
+
+/* Hand a stitch that made it through the filter to the pattern. */
+static void
+write_to_pattern(void *data, EmbReal x, EmbReal y, int flags)
+{
+    embPattern_addStitchAbs((EmbPattern *)data, x, y, flags, 1);
+}
+
+/* Write the runs to pattern in the order given, with a colour change
+ * between colours and a jump between runs. What the filter did is added
+ * to reports.
+ *
+ * Every stitch goes through a StitchFilter on its way, which keeps them
+ * within ST_MAX_STITCH_LENGTH and ST_MIN_STITCH_LENGTH, splitting the
+ * jumps too, and trims a run of jumps after ST_TRIM_NUM_JUMPS of them or
+ * once it travels further than SEQUENCE_TRIM_LENGTH.
+ */
+static void
+write_stitches(EmbPattern *pattern, const StitchPlan& plan,
+    const std::vector<StitchStep>& order, QStringList& reports)
+{
+    const StitchRun *runs = plan.runs.data();
+    StitchFilter filter;
+    filter_init(&filter, settings[ST_MAX_STITCH_LENGTH].r,
+        settings[ST_MIN_STITCH_LENGTH].r, settings[ST_TRIM_NUM_JUMPS].i,
+        SEQUENCE_TRIM_LENGTH, write_to_pattern, pattern);
+    int color = -1;
+    EmbVector at = {0.0, 0.0};
+    for (int i=0; i<(int)order.size(); i++) {
+        StitchStep step = order[i];
+        const StitchRun& run = runs[step.run];
+        if (run.color != color) {
+            if (color >= 0) {
+                filter_stitch(&filter, at.x, at.y, STOP);
+            }
+            EmbThread thread;
+            memset(&thread, 0, sizeof(EmbThread));
+            thread.color.r = qRed(plan.colors[run.color]);
+            thread.color.g = qGreen(plan.colors[run.color]);
+            thread.color.b = qBlue(plan.colors[run.color]);
+            embPattern_addThread(pattern, thread);
+            color = run.color;
+        }
+
+        EmbVector entry = step_entry(runs, step);
+        EmbReal gap = embVector_distance(at, entry);
+        int flags = NORMAL;
+        if ((i == 0) || (gap > SEQUENCE_JOIN_TOLERANCE)) {
+            flags = JUMP;
+        }
+        filter_stitch(&filter, entry.x, entry.y, flags);
+
+        for (int k=1; k<run.count; k++) {
+            int j = k;
+            if (run.closed) {
+                j = (step.entry + k) % run.count;
+            }
+            else if (step.reversed) {
+                j = run.count - 1 - k;
+            }
+            filter_stitch(&filter, run.points[j].x, run.points[j].y,
+                NORMAL);
+        }
+        if (run.closed) {
+            filter_stitch(&filter, entry.x, entry.y, NORMAL);
+        }
+        at = step_exit(runs, step);
+    }
+    if (color >= 0) {
+        filter_stitch(&filter, at.x, at.y, END);
+    }
+
+    QString report = QString("Stitches: %1 written of %2, %3 added by "
+        "splitting long stitches, %4 short ones dropped, %5 jump runs "
+        "trimmed.")
+        .arg(filter.stitches_out).arg(filter.stitches_in).arg(filter.split)
+        .arg(filter.dropped).arg(filter.trims);
+    debug_message(qPrintable(report));
+    reports << report;
+}
+
+/* Write the stitches the objects of view's scene sew to pattern.
+ *
+ * Hatches and filled shapes are turned into rows of fill stitches by
+ * fill_plan(), then the objects are put in an order that keeps the jump
+ * stitches down by sequence_plan(), colour by colour. Only gathering the
+ * objects touches the scene, so the rest runs in the background. Returns
+ * the reports of the sequencing and the stitch filter, for the caller
+ * to show if it wants to.
+ */
+QStringList
+build_stitches(View* view, EmbPattern* pattern)
+{
+    StitchPlan plan;
+    stitch_plan = &plan;
+    QList<QGraphicsItem*> list = view->scene()->items(Qt::AscendingOrder);
+    for (int i=0; i<(int)list.size(); i++) {
+        QGraphicsItem* item = list[i];
+        int objType = item->data(OBJ_TYPE).toInt();
+        Geometry* obj = static_cast<Geometry*>(item);
+        if (!obj) {
+            continue;
+        }
+        saveObjectAsStitches(objType, view, obj);
+    }
+    stitch_plan = NULL;
+
+    QStringList reports;
+    run_in_background([&]() {
+        fill_plan(plan);
+        write_stitches(pattern, plan, sequence_plan(plan, reports), reports);
+    });
+    return reports;
+}
+
+/* Split the stitches of pattern between the fewest hoops of width by
+ * height mm that cover it, overlapping by overlap mm, see hoop_plan().
+ * Each hoop is clipped on its own core, then written, one at a time, to
+ * a file named after fileName with -hoop1, -hoop2 and so on added in
+ * sewing order, and a HoopFile for each is put in files. Returns the
+ * status from hoop_plan(), see hoop_message().
+ */
+int
+split_hoops(EmbPattern* pattern, QString fileName, EmbReal width,
+    EmbReal height, EmbReal overlap, std::vector<HoopFile>& files)
+{
+    files.clear();
+    HoopPlan plan;
+    int status = hoop_plan(&plan, pattern, width, height, overlap);
+    if (status != HOOP_OK) {
+        hoop_free(&plan);
+        return status;
+    }
+    QFileInfo info(fileName);
+    for (int i=0; i<plan.count; i++) {
+        HoopFile file = {};
+        file.file = (info.path() + "/" + info.completeBaseName()
+            + QString("-hoop%1.").arg(i+1) + info.suffix()).toStdString();
+        file.column = plan.tiles[i].column;
+        file.row = plan.tiles[i].row;
+        files.push_back(file);
+    }
+
+    int n = plan.count;
+    parallel_for(n, [&](int i) {
+        EmbPattern* hoop = embPattern_create();
+        if (!hoop) {
+            return;
+        }
+        files[i].stitches = hoop_pattern(&plan, i, pattern, hoop);
+        {
+            std::lock_guard<std::mutex> lock(pattern_io);
+            files[i].ok = embPattern_writeAuto(hoop, files[i].file.c_str());
+        }
+        embPattern_free(hoop);
+    });
+    hoop_free(&plan);
+    return HOOP_OK;
+}
+
+/* Collect the stitches a StitchFilter lets through into a run, turned
+ * back into scene coordinates.
+ */
+static void
+write_to_run(void *data, EmbReal x, EmbReal y, int flags)
+{
+    if (!(flags & END)) {
+        EmbVector v = {x, -y};
+        ((std::vector<EmbVector> *)data)->push_back(v);
+    }
+}
+
+/* The stitches obj sews on its own, in scene coordinates, a list of
+ * points for each run. They go through the same filter as a save, but
+ * the runs aren't put in order so the travel between them is left out.
+ */
+void
+object_stitch_runs(View* view, Geometry* obj,
+    std::vector<std::vector<EmbVector>>& runs)
+{
+    runs.clear();
+    if (obj->objRubberMode != RUBBER_OFF) {
+        return;
+    }
+    StitchPlan plan;
+    stitch_plan = &plan;
+    saveObjectAsStitches(obj->data(OBJ_TYPE).toInt(), view, obj);
+    stitch_plan = NULL;
+    fill_plan(plan);
+
+    for (const StitchRun& run : plan.runs) {
+        runs.push_back(std::vector<EmbVector>());
+        StitchFilter filter;
+        filter_init(&filter, settings[ST_MAX_STITCH_LENGTH].r,
+            settings[ST_MIN_STITCH_LENGTH].r, 0, 0.0, write_to_run,
+            &runs.back());
+        for (int i=0; i<run.count; i++) {
+            filter_stitch(&filter, run.points[i].x, run.points[i].y,
+                i ? NORMAL : JUMP);
+        }
+        EmbVector end = run.points[run.count-1];
+        if (run.closed) {
+            end = run.points[0];
+            filter_stitch(&filter, end.x, end.y, NORMAL);
+        }
+        filter_stitch(&filter, end.x, end.y, END);
+    }
+}
+
+/* Add the outline of obj in scene coordinates to set, tidied into rings
+ * with the inside on their left. Returns false for objects that don't
+ * enclose an area, paths with a subpath left open among them, or if
+ * memory ran out.
+ */
+bool
+object_polygons(Geometry* obj, PolygonSet* set)
+{
+    switch (obj->data(OBJ_TYPE).toInt()) {
+    case OBJ_TYPE_CIRCLE:
+    case OBJ_TYPE_ELLIPSE:
+    case OBJ_TYPE_PATH:
+    case OBJ_TYPE_POLYGON:
+    case OBJ_TYPE_RECTANGLE:
+        break;
+    default:
+        return false;
+    }
+    if (obj->objRubberMode != RUBBER_OFF) {
+        return false;
+    }
+
+    QPainterPath path = obj->objectSavePath();
+    QPointF position = obj->scenePos();
+    QTransform flatten = QTransform::fromScale(CLIP_CURVE_SCALE, CLIP_CURVE_SCALE);
+    QList<QPolygonF> polygons = path.toSubpathPolygons(flatten);
+    if (obj->data(OBJ_TYPE).toInt() == OBJ_TYPE_PATH) {
+        for (const QPolygonF& polygon : polygons) {
+            if (polygon.isEmpty() || (polygon.first() != polygon.last())) {
+                return false;
+            }
+        }
+    }
+    PolygonSet outline;
+    memset(&outline, 0, sizeof(PolygonSet));
+    bool ok = true;
+    for (const QPolygonF& polygon : polygons) {
+        for (const QPointF& p : polygon) {
+            ok = ok && polygon_add_point(&outline,
+                to_EmbVector(p / CLIP_CURVE_SCALE + position));
+        }
+        ok = ok && polygon_close_ring(&outline);
+    }
+    int rule = (path.fillRule() == Qt::WindingFill) ? CLIP_NONZERO : CLIP_EVEN_ODD;
+    ok = ok && polygon_boolean(&outline, rule, NULL, CLIP_NONZERO, CLIP_UNION, set);
+    polygon_free(&outline);
+    return ok;
+}
+
+/* The rings of set as closed subpaths. */
+QPainterPath
+polygon_path(const PolygonSet* set)
+{
+    QPainterPath path;
+    int start = 0;
+    for (int r=0; r<set->rings; r++) {
+        int end = set->ring_ends[r];
+        path.moveTo(to_QPointF(set->points[start]));
+        for (int i=start+1; i<end; i++) {
+            path.lineTo(to_QPointF(set->points[i]));
+        }
+        path.closeSubpath();
+        start = end;
+    }
+    return path;
 }
 
 /* Returns whether the save to file process was successful.
  *
- * \todo Before saving to a stitch only format, Embroidermodder needs
- * to calculate the optimal path to minimize jump stitches. Also
- * based upon which layer needs to be stitched first,
+ * Stitch only formats get their stitches from build_stitches().
+ *
+ * \todo Based upon which layer needs to be stitched first,
  * the path to the next object needs to be hidden beneath fills
  * that will come later. When finding the optimal path, we need
  * to take into account the color of the thread, as we do not want
@@ -2817,18 +3526,24 @@ save(View* view, QString fileName)
         return false;
     }
 
-    QList<QGraphicsItem*> list = gscene->items(Qt::AscendingOrder);
-    for (int i=0; i<(int)list.size(); i++) {
-        QGraphicsItem* item = list[i];
-        int objType = item->data(OBJ_TYPE).toInt();
-        Geometry* obj = static_cast<Geometry*>(item);
-        if (!obj) {
-            continue;
-        }
-        if (view->formatType == EMBFORMAT_STITCHONLY) {
-            saveObjectAsStitches(objType, view, obj);
+    view->pattern = pattern;
+    if (view->formatType == EMBFORMAT_STITCHONLY) {
+        QStringList reports = build_stitches(view, pattern);
+        if (prompt) {
+            for (const QString& report : reports) {
+                prompt->appendHistory(report);
+            }
         }
-        else {
+    }
+    else {
+        QList<QGraphicsItem*> list = gscene->items(Qt::AscendingOrder);
+        for (int i=0; i<(int)list.size(); i++) {
+            QGraphicsItem* item = list[i];
+            int objType = item->data(OBJ_TYPE).toInt();
+            Geometry* obj = static_cast<Geometry*>(item);
+            if (!obj) {
+                continue;
+            }
             saveObject(objType, view, obj);
         }
     }
@@ -2847,6 +3562,7 @@ save(View* view, QString fileName)
 
     //TODO: check the embLog for errors and if any exist, report them.
     embPattern_free(pattern);
+    view->pattern = NULL;
 
     return writeSuccessful;
 }
@@ -2860,6 +3576,33 @@ saveObjectAsStitches(int objType, View *view, Geometry *obj)
     QPainterPath path = obj->objectSavePath();
     QPointF position = obj->scenePos();
     QColor color = obj->objPen.color();
+    int lineType = obj->data(OBJ_LTYPE).toInt();
+    if ((lineType == OBJ_LTYPE_SATIN) || (lineType == OBJ_LTYPE_FISHBONE)) {
+        if (objType == OBJ_TYPE_TEXTSINGLE) {
+            /* A column round the outline of a glyph would cover it up,
+             * so closed outlines are sewn with a running stitch.
+             */
+            for (const QPainterPath& glyphs : obj->objectSavePathList()) {
+                QPainterPath outlines, strokes;
+                for (const QPolygonF& polygon : glyphs.toSubpathPolygons()) {
+                    if ((polygon.size() > 2)
+                        && (polygon.first() == polygon.last())) {
+                        outlines.addPolygon(polygon);
+                    }
+                    else {
+                        strokes.addPolygon(polygon);
+                    }
+                }
+                toPolyline(view, position, outlines, "0", color,
+                    "CONTINUOUS", "BYLAYER");
+                toColumn(position, strokes, color, lineType);
+            }
+        }
+        else {
+            toColumn(position, path, color, lineType);
+        }
+        return;
+    }
     switch (objType) {
     case OBJ_TYPE_ARC: {
         debug_message("TODO: save Arc object");
@@ -2870,6 +3613,9 @@ saveObjectAsStitches(int objType, View *view, Geometry *obj)
         break;
     }
     case OBJ_TYPE_CIRCLE: {
+        if (obj->flags & PROP_FILLED) {
+            toFill(position, path, color);
+        }
         // TODO: proper layer/lineType/lineWeight
         // TODO: Improve precision, replace simplified
         toPolyline(view, position, path.simplified(), "0", color, "CONTINUOUS", "BYLAYER");
@@ -2908,6 +3654,9 @@ saveObjectAsStitches(int objType, View *view, Geometry *obj)
         break;
     }
     case OBJ_TYPE_ELLIPSE: {
+        if (obj->flags & PROP_FILLED) {
+            toFill(position, path, color);
+        }
         // TODO: proper layer/lineType/lineWeight
         // TODO: Improve precision, replace simplified
         toPolyline(view, position, path.simplified(), "0", color, "CONTINUOUS", "BYLAYER");
@@ -2922,7 +3671,7 @@ saveObjectAsStitches(int objType, View *view, Geometry *obj)
         break;
     }
     case OBJ_TYPE_HATCH: {
-        debug_message("TODO: save Hatch object");
+        toFill(position, path, color);
         break;
     }
     case OBJ_TYPE_IMAGE: {
@@ -2948,6 +3697,9 @@ saveObjectAsStitches(int objType, View *view, Geometry *obj)
     /* PATH? */
 
     case OBJ_TYPE_POLYGON: {
+        if (obj->flags & PROP_FILLED) {
+            toFill(position, path, color);
+        }
         toPolyline(view, obj->scenePos(), obj->objectSavePath(), "0", color, "CONTINUOUS", "BYLAYER");
         break;
     }
@@ -2963,6 +3715,9 @@ saveObjectAsStitches(int objType, View *view, Geometry *obj)
 
     // TODO: proper layer/lineType/lineWeight
     case OBJ_TYPE_RECTANGLE: {
+        if (obj->flags & PROP_FILLED) {
+            toFill(position, path, color);
+        }
         toPolyline(view, obj->scenePos(), obj->objectSavePath(), "0", color, "CONTINUOUS", "BYLAYER");
         break;
     }
@@ -3165,10 +3920,146 @@ addPath(View *view, Geometry *obj)
     */
 }
 
+/* The index of color in the stitch plan being saved, adding it if it
+ * is new.
+ */
+static int
+plan_color(QColor color)
+{
+    for (int i=0; i<(int)stitch_plan->colors.size(); i++) {
+        if (stitch_plan->colors[i] == color.rgb()) {
+            return i;
+        }
+    }
+    stitch_plan->colors.push_back(color.rgb());
+    return (int)stitch_plan->colors.size() - 1;
+}
+
+/* toFill
+ *
+ * Queue the closed region objPath encloses to be filled with rows of
+ * stitches by fill_plan(). Its subpaths are flattened into the rings of
+ * one region, so the holes in it stay empty.
+ */
+void
+toFill(QPointF objPos, QPainterPath objPath, QColor color)
+{
+    if (!stitch_plan) {
+        return;
+    }
+
+    FillRegion region;
+    region.color = plan_color(color);
+    for (const QPolygonF& polygon : objPath.toSubpathPolygons()) {
+        int count = (int)polygon.size();
+        if ((count > 1) && (polygon.first() == polygon.last())) {
+            count--;
+        }
+        if (count < 3) {
+            continue;
+        }
+        for (int i=0; i<count; i++) {
+            EmbVector v = {polygon[i].x() + objPos.x(),
+                -(polygon[i].y() + objPos.y())};
+            region.points.push_back(v);
+        }
+        region.ring_ends.push_back((int)region.points.size());
+    }
+    if (!region.ring_ends.empty()) {
+        stitch_plan->fills.push_back(region);
+    }
+}
+
+/* Pass each stitch of a column straight on to the run being built. */
+static void
+emit_to_run(void *data, EmbVector v)
+{
+    static_cast<std::vector<EmbVector>*>(data)->push_back(v);
+}
+
+/* toColumn
+ *
+ * Sew objPath as a satin or fishbone column, according to lineType, into
+ * the stitch plan being saved. A path of exactly two open subpaths that
+ * run alongside each other, see column_rails(), is taken as the pair of
+ * rails to sew between, turned to run the same way if they were drawn in
+ * opposite directions. Otherwise each subpath is a centerline with the
+ * column ST_COLUMN_WIDTH wide about it.
+ *
+ * The stitches are written straight into the plan's storage for the run.
+ */
+void
+toColumn(QPointF objPos, QPainterPath objPath, QColor color, int lineType)
+{
+    if (!stitch_plan) {
+        return;
+    }
+
+    int colorIndex = plan_color(color);
+    std::vector<std::vector<EmbVector>> lines;
+    bool rails = true;
+    for (const QPolygonF& polygon : objPath.toSubpathPolygons()) {
+        std::vector<EmbVector> points;
+        points.reserve(polygon.size());
+        for (const QPointF& p : polygon) {
+            EmbVector v = {p.x() + objPos.x(), -(p.y() + objPos.y())};
+            points.push_back(v);
+        }
+        if (points.size() < 2) {
+            continue;
+        }
+        if ((points.size() > 2) && (polygon.first() == polygon.last())) {
+            rails = false;
+        }
+        lines.push_back(points);
+    }
+    int reversed = 0;
+    rails = rails && (lines.size() == 2)
+        && column_rails(lines[0].data(), (int)lines[0].size(),
+            lines[1].data(), (int)lines[1].size(), &reversed);
+    if (rails && reversed) {
+        std::reverse(lines[1].begin(), lines[1].end());
+    }
+
+    EmbReal width = settings[ST_COLUMN_WIDTH].r;
+    EmbReal spacing = settings[ST_COLUMN_SPACING].r;
+    EmbReal pull = settings[ST_PULL_COMPENSATION].r;
+    for (int i=0; i<(int)lines.size(); i++) {
+        const std::vector<EmbVector>& left = lines[i];
+        const std::vector<EmbVector> *right = NULL;
+        if (rails) {
+            right = &lines[1];
+        }
+
+        stitch_plan->points.push_back(std::vector<EmbVector>());
+        std::vector<EmbVector>& stitches = stitch_plan->points.back();
+        column_stitches(left.data(), (int)left.size(),
+            right ? right->data() : NULL, right ? (int)right->size() : 0,
+            width, spacing, pull, lineType, emit_to_run, &stitches);
+        if (stitches.empty()) {
+            stitch_plan->points.pop_back();
+        }
+        else {
+            StitchRun run;
+            run.points = stitches.data();
+            run.count = (int)stitches.size();
+            run.color = colorIndex;
+            run.closed = 0;
+            stitch_plan->runs.push_back(run);
+        }
+        if (rails) {
+            break;
+        }
+    }
+}
+
 /* toPolyline
  *
  * NOTE: This function should be used to interpret various object types
  * and save them as polylines for stitchOnly formats.
+ *
+ * Each subpath becomes a run of the stitch plan being saved, with curves
+ * flattened and the Y axis turned the right way up for the pattern.
  */
 void
 toPolyline(
@@ -3180,28 +4071,34 @@ toPolyline(
     QString lineType,
     QString lineWeight)
 {
-    EmbArray* pointList = 0;
-    QPainterPath::Element element;
-    for (int i = 0; i < objPath.elementCount(); ++i) {
-        element = objPath.elementAt(i);
-        if (!pointList) {
-            pointList = embArray_create(EMB_POINT);
-        }
-        EmbPoint po;
-        po.position.x = element.x + objPos.x();
-        po.position.y = -(element.y + objPos.y());
-        embArray_addPoint(pointList, po);
+    if (!stitch_plan) {
+        return;
     }
 
-    EmbColor color_out;
-    color_out.r = color.red();
-    color_out.g = color.green();
-    color_out.b = color.blue();
-
-    /* TODO: FIX
-    EmbPolyline* polyObject = embPolyline_init(pointList, color_out, 1); //TODO: proper lineType
-    embPattern_addPolylineAbs(view->pattern, polyObject);
-    */
+    int colorIndex = plan_color(color);
+    for (const QPolygonF& polygon : objPath.toSubpathPolygons()) {
+        std::vector<EmbVector> points;
+        for (const QPointF& p : polygon) {
+            EmbVector v = {p.x() + objPos.x(), -(p.y() + objPos.y())};
+            points.push_back(v);
+        }
+        if (points.empty()) {
+            continue;
+        }
+        StitchRun run;
+        run.closed = (points.size() > 2) && (polygon.first() == polygon.last());
+        if (run.closed) {
+            points.pop_back();
+        }
+        run.color = colorIndex;
+        run.count = (int)points.size();
+        /* Moving a vector keeps its buffer, so this stays valid as the
+         * plan grows.
+         */
+        stitch_plan->points.push_back(points);
+        run.points = stitch_plan->points.back().data();
+        stitch_plan->runs.push_back(run);
+    }
 }
 
 /* Set object text. */
@@ -3313,7 +4210,7 @@ void Geometry::setObjectText(QString str)
     QPainterPath gripPath = objTextPath;
     gripPath.connectPath(objTextPath);
     gripPath.addRect(-0.00000001, -0.00000001, 0.00000002, 0.00000002);
-    setPath(gripPath);
+    setShape(gripPath);
 }
 
 /* font
@@ -3918,3 +4815,113 @@ Geometry::script_prompt(std::string str)
 */
     }
 }
+
+/* Report how much memory each object type costs.
+ *
+ * Builds count objects of each type outside of any scene and measures
+ * the heap growth, so Qt's per item allocations are included. Without
+ * glibc only the fixed size of the class is reported.
+ */
+void
+benchmark_object_memory(int count)
+{
+    int types[] = {
+        OBJ_TYPE_ARC,
+        OBJ_TYPE_CIRCLE,
+        OBJ_TYPE_DIMLEADER,
+        OBJ_TYPE_ELLIPSE,
+        OBJ_TYPE_LINE,
+        OBJ_TYPE_PATH,
+        OBJ_TYPE_POINT,
+        OBJ_TYPE_POLYGON,
+        OBJ_TYPE_POLYLINE,
+        OBJ_TYPE_RECTANGLE,
+        OBJ_TYPE_TEXTSINGLE,
+        OBJ_TYPE_NULL
+    };
+    std::vector<Geometry*> objects;
+    objects.reserve(count);
+
+    fprintf(stdout, "sizeof(Geometry)   %8d bytes\n", (int)sizeof(Geometry));
+    fprintf(stdout, "sizeof(ShapeData)  %8d bytes\n", (int)sizeof(ShapeData));
+    fprintf(stdout, "sizeof(RubberData) %8d bytes, only while drawing\n",
+        (int)sizeof(RubberData));
+    fprintf(stdout, "\n%-20s %12s\n", "type", "bytes/object");
+    for (int i=0; types[i] != OBJ_TYPE_NULL; i++) {
+#if defined(__GLIBC__)
+        size_t before = mallinfo2().uordblks;
+#endif
+        for (int j=0; j<count; j++) {
+            objects.push_back(new Geometry(types[i]));
+        }
+#if defined(__GLIBC__)
+        size_t after = mallinfo2().uordblks;
+        fprintf(stdout, "%-20s %12.1f\n", object_type_name(types[i]),
+            (double)(after - before) / count);
+#else
+        fprintf(stdout, "%-20s %12d\n", object_type_name(types[i]),
+            (int)sizeof(Geometry));
+#endif
+        qDeleteAll(objects);
+        objects.clear();
+    }
+}
+
+/* Run fn repeats times and return the mean time each took in ms. */
+static double
+time_msec(int repeats, const std::function<void()>& fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i=0; i<repeats; i++) {
+        fn();
+    }
+    std::chrono::duration<double, std::milli> total
+        = std::chrono::steady_clock::now() - start;
+    return total.count() / repeats;
+}
+
+/* Time the stitch generators on fixed shapes with the default settings,
+ * on one core.
+ *
+ * fill: a 200 mm round hoop, as a 256 sided polygon, filled in tatami
+ * rows.
+ * column: a satin column along a centerline of a million points 0.05 mm
+ * apart, the stitches kept as toColumn() keeps them.
+ */
+void
+benchmark_stitches(void)
+{
+    const int sides = 256;
+    std::vector<EmbVector> disc(sides);
+    for (int i=0; i<sides; i++) {
+        EmbReal a = 2.0 * embConstantPi * i / sides;
+        disc[i].x = 100.0 * cos(a);
+        disc[i].y = 100.0 * sin(a);
+    }
+    int ring_ends[1] = {sides};
+    FillStitches fill;
+    memset(&fill, 0, sizeof(FillStitches));
+    double fill_msec = time_msec(100, [&]() {
+        fill.count = 0;
+        fill.runs = 0;
+        fill_region(disc.data(), ring_ends, 1, 0.4, 0.0, 3.0, 4, &fill);
+    });
+    fprintf(stdout, "%-28s %10.3f ms %10d stitches\n",
+        "fill 200 mm disc", fill_msec, fill.count);
+    fill_free(&fill);
+
+    const int points = 1000000;
+    std::vector<EmbVector> line(points);
+    for (int i=0; i<points; i++) {
+        line[i].x = 0.05 * i;
+        line[i].y = 5.0 * sin(0.0025 * i);
+    }
+    std::vector<EmbVector> stitches;
+    double column_msec = time_msec(10, [&]() {
+        stitches.clear();
+        column_stitches(line.data(), points, NULL, 0, 2.0, 0.4, 0.2,
+            OBJ_LTYPE_SATIN, emit_to_run, &stitches);
+    });
+    fprintf(stdout, "%-28s %10.3f ms %10d stitches\n",
+        "satin 1M point centerline", column_msec, (int)stitches.size());
+}
@@ -140,12 +140,32 @@ Settings_Dialog::chooseColor(int color_id)
 	}
 }
 
-/* Read settings from file.
+/* The path of the settings file.
  *
- * This file needs to be read from the users home directory to ensure it is writable.
+ * This file needs to be in the users home directory to ensure it is writable.
+ */
+static std::string
+settings_path(void)
+{
+#if defined(Q_OS_UNIX) || defined(Q_OS_MAC)
+    QString settings_dir = QDir::homePath() + "/.embroidermodder2";
+//    settings[ST_SAVE_HISTORY].s = QDir::homePath() + "/.embroidermodder2/prompt.log";
+#else
+    QString settings_dir = qApp->applicationDirPath();
+//    settings[ST_SAVE_HISTORY] = appDir + "prompt.log";
+#endif
+    return settings_dir.toStdString() + "/settings.ini";
+}
+
+/* Read settings from file.
  *
  * \brief Read the settings from file which are editable by the user.
  * These files need to be placed in the install folder.
+ *
+ * Every setting starts at its default, then the file is read in one go and
+ * parsed in a single pass: each "key=value" line is split in place and the
+ * key is looked up with setting_index. Unknown keys and malformed lines are
+ * skipped, so an old or hand edited file can't break startup.
  */
 int
 read_settings(void)
@@ -160,92 +180,63 @@ read_settings(void)
      }
     */
 
-#if defined(Q_OS_UNIX) || defined(Q_OS_MAC)
-    QString settings_dir = QDir::homePath() + "/.embroidermodder2";
-//    settings[ST_SAVE_HISTORY].s = QDir::homePath() + "/.embroidermodder2/prompt.log";
-#else
-    QString settings_dir = qApp->applicationDirPath();
-//    settings[ST_SAVE_HISTORY] = appDir + "prompt.log";
-#endif
+    for (int i=0; i<SETTINGS_TOTAL; i++) {
+        Setting s = settings_data[i];
+        set_node(settings+s.id, s.type, s.value);
+    }
 
-    std::string fname = settings_dir.toStdString() + "/em2_settings.ini";
-    FILE *f = NULL; //fopen(fname.c_str(), "r");
+    std::string fname = settings_path();
+    FILE *f = fopen(fname.c_str(), "rb");
     if (!f) {
-        printf("WARNING: Failed to open settings file (%s), continuing with defaults.",
+        printf("WARNING: Failed to open settings file (%s), continuing with defaults.\n",
             fname.c_str());
-        for (int i=0; i<SETTINGS_TOTAL; i++) {
-            Setting s = settings_data[i];
-            switch (s.type) {
-            case 'i':
-                settings[s.id].i = atoi(s.value);
-                break;
-            case 'r':
-                settings[s.id].r = atof(s.value);
-                break;
-            case 's':
-                strcpy(settings[s.id].s, s.value);
-                break;
-            default:
-                break;
-            }
-        }
+        return 1;
     }
-    else {
-        char config[MAX_SETTINGS][MAX_STRING_LENGTH];
-        char c;
-        int line = 0;
-        int line_pos = 0;
-        while (fread(&c, 1, 1, f)) {
-            if (c == '\r') {
-                continue;
-            }
-            config[line][line_pos] = c;
-            line_pos++;
-            if (c != '\n') {
-                continue;
-            }
-            config[line][line_pos] = 0;
-            line++;
-            line_pos = 0;
-            if (line == MAX_SETTINGS) {
-                puts("WARNING too many lines in the settings file.");
-                break;
-            }
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    std::vector<char> buffer(size > 0 ? size + 1 : 1);
+    size_t length = fread(buffer.data(), 1, buffer.size() - 1, f);
+    fclose(f);
+    buffer[length] = 0;
+
+    int n_read = 0;
+    char *line = buffer.data();
+    char *end = line + length;
+    while (line < end) {
+        char *next = (char*)memchr(line, '\n', end - line);
+        if (!next) {
+            next = end;
+        }
+        *next = 0;
+        if ((next > line) && (next[-1] == '\r')) {
+            next[-1] = 0;
         }
-        config[line][line_pos] = 0;
-        fclose(f);
 
-        for (int i=0; i<SETTINGS_TOTAL; i++) {
-            int eq_pos = str_contains(config[line], '=');
-            if (eq_pos < 0) {
-                continue;
-            }
-            Setting s = settings_data[i];
-            char *value = config[i] + eq_pos + 1;
-            switch (s.type) {
-            case 'i':
-                settings[s.id].i = atoi(value);
-                break;
-            case 'r':
-                settings[s.id].r = atof(value);
-                break;
-            case 's':
-                strcpy(settings[s.id].s, value);
-                break;
-            default:
-                break;
+        char *eq = strchr(line, '=');
+        if (eq) {
+            *eq = 0;
+            int index = setting_index(line);
+            if (index >= 0) {
+                Setting s = settings_data[index];
+                set_node(settings+s.id, s.type, eq + 1);
+                n_read++;
             }
         }
+        line = next + 1;
     }
 
-    debug_message("Configuration loaded.");
+    debug_message("Configuration loaded, %d settings read.", n_read);
 
     return 1;
 }
 
 /* Write settings to file.
  *
- * This file needs to be read from the users home directory to ensure it is writable
+ * The file is written to a temporary file next to it which is then renamed
+ * over the old one, so a crash or a full disk part way through leaves the
+ * previous settings intact rather than a truncated file.
  */
 void
 write_settings(void)
@@ -257,36 +248,153 @@ write_settings(void)
     settings[ST_WINDOW_SIZE_X].i = (int)_mainWin->size().width();
     settings[ST_WINDOW_SIZE_Y].i = (int)_mainWin->size().height();
 
-#if defined(Q_OS_UNIX) || defined(Q_OS_MAC)
-    std::string settingsPath = QDir::homePath().toStdString() + "/.embroidermodder2/settings.ini";
-#else
-    std::string settingsPath = qApp->applicationDirPath().toStdString() + "/settings.ini";
-#endif
-    FILE *file = fopen(settingsPath.c_str(), "w");
-
-    if (!file) {
-        debug_message("ERROR: failed to open settings file for output.");
-        return;
-    }
+    QString settingsPath = QString::fromStdString(settings_path());
+    QDir().mkpath(QFileInfo(settingsPath).absolutePath());
 
+    QByteArray contents;
     for (int i=0; i<SETTINGS_TOTAL; i++) {
-        char line[2*MAX_STRING_LENGTH];
+        char line[2*MAX_STRING_LENGTH+4];
         Setting s = settings_data[i];
         switch (s.type) {
         case 'i':
-            fprintf(file, "%s=%d\n", s.key, settings[s.id].i);
+            snprintf(line, sizeof line, "%s=%d\n", s.key, settings[s.id].i);
             break;
         case 'r':
-            fprintf(file, "%s=%f\n", s.key, settings[s.id].r);
+            snprintf(line, sizeof line, "%s=%f\n", s.key, settings[s.id].r);
             break;
         case 's':
-            fprintf(file, "%s=%s\n", s.key, settings[s.id].s);
+            snprintf(line, sizeof line, "%s=%s\n", s.key, settings[s.id].s);
             break;
         default:
-            break;
+            continue;
+        }
+        contents.append(line);
+    }
+
+    QSaveFile file(settingsPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        debug_message("ERROR: failed to open settings file for output.");
+        return;
+    }
+    file.write(contents);
+    if (!file.commit()) {
+        debug_message("ERROR: failed to write settings file, the old one is kept.");
+    }
+}
+
+/* Which parts of the interface show the setting key, as REFRESH_* flags. */
+static uint32_t
+setting_refresh(int key)
+{
+    switch (key) {
+    case ST_LANGUAGE:
+        return REFRESH_LANGUAGE;
+    case ST_MDI_USE_LOGO:
+    case ST_MDI_USE_TEXTURE:
+    case ST_MDI_USE_COLOR:
+    case ST_MDI_LOGO:
+    case ST_MDI_TEXTURE:
+    case ST_MDI_COLOR:
+        return REFRESH_MDI_BACKGROUND;
+    case ST_ICON_SIZE:
+        return REFRESH_ICON_SIZE;
+    case ST_SHOW_SCROLLBARS:
+        return REFRESH_SCROLLBARS;
+    case ST_CROSSHAIR_COLOR:
+        return REFRESH_CROSSHAIR;
+    case ST_BG_COLOR:
+        return REFRESH_BACKGROUND;
+    case ST_SELECTBOX_LEFT_COLOR:
+    case ST_SELECTBOX_LEFT_FILL:
+    case ST_SELECTBOX_RIGHT_COLOR:
+    case ST_SELECTBOX_RIGHT_FILL:
+    case ST_SELECTBOX_ALPHA:
+        return REFRESH_SELECTBOX;
+    case ST_PROMPT_TEXT_COLOR:
+    case ST_PROMPT_BG_COLOR:
+    case ST_PROMPT_FONT_FAMILY:
+    case ST_PROMPT_FONT_STYLE:
+    case ST_PROMPT_FONT_SIZE:
+        return REFRESH_PROMPT;
+    case ST_GRID_COLOR:
+        return REFRESH_GRID;
+    case ST_RULER_COLOR:
+        return REFRESH_RULER;
+    case ST_LWT_SHOW:
+    case ST_LWT_REAL:
+        return REFRESH_LINEWEIGHT;
+    case ST_SELECTION_PICK_ADD:
+        return REFRESH_PICK_ADD;
+    default:
+        break;
+    }
+    return 0;
+}
+
+/* The REFRESH_* flags for every setting that differs between a and b. */
+static uint32_t
+settings_diff(Node *a, Node *b)
+{
+    uint32_t refresh = 0;
+    for (int i=0; i<SETTINGS_TOTAL; i++) {
+        Setting s = settings_data[i];
+        if (!node_equal(a+s.id, b+s.id, s.type)) {
+            refresh |= setting_refresh(s.id);
         }
     }
-    fclose(file);
+    return refresh;
+}
+
+/* Show the values in d in the parts of the interface named by refresh. */
+static void
+apply_settings(Node *d, uint32_t refresh)
+{
+    if (refresh & REFRESH_MDI_BACKGROUND) {
+        mdiArea->applyBackgroundSettings(d);
+    }
+    if (refresh & REFRESH_ICON_SIZE) {
+        _mainWin->iconResize(d[ST_ICON_SIZE].i);
+    }
+    if (refresh & REFRESH_SCROLLBARS) {
+        _mainWin->updateAllViewScrollBars(d[ST_SHOW_SCROLLBARS].i);
+    }
+    if (refresh & REFRESH_CROSSHAIR) {
+        _mainWin->updateAllViewCrossHairColors(d[ST_CROSSHAIR_COLOR].i);
+    }
+    if (refresh & REFRESH_BACKGROUND) {
+        _mainWin->updateAllViewBackgroundColors(d[ST_BG_COLOR].i);
+    }
+    if (refresh & REFRESH_SELECTBOX) {
+        _mainWin->updateAllViewSelectBoxColors(
+            d[ST_SELECTBOX_LEFT_COLOR].i,
+            d[ST_SELECTBOX_LEFT_FILL].i,
+            d[ST_SELECTBOX_RIGHT_COLOR].i,
+            d[ST_SELECTBOX_RIGHT_FILL].i,
+            d[ST_SELECTBOX_ALPHA].i);
+    }
+    if (refresh & REFRESH_PROMPT) {
+        prompt->setPromptTextColor(QColor(d[ST_PROMPT_TEXT_COLOR].i));
+        prompt->setPromptBackgroundColor(QColor(d[ST_PROMPT_BG_COLOR].i));
+        prompt->setPromptFontFamily(d[ST_PROMPT_FONT_FAMILY].s);
+        prompt->setPromptFontStyle(d[ST_PROMPT_FONT_STYLE].s);
+        prompt->setPromptFontSize(d[ST_PROMPT_FONT_SIZE].i);
+    }
+    if (refresh & REFRESH_GRID) {
+        _mainWin->updateAllViewGridColors(d[ST_GRID_COLOR].i);
+    }
+    if (refresh & REFRESH_RULER) {
+        _mainWin->updateAllViewRulerColors(d[ST_RULER_COLOR].i);
+    }
+    if (refresh & REFRESH_LINEWEIGHT) {
+        statusbar->toggle("LWT", d[ST_LWT_SHOW].i);
+        statusbar->toggle("REAL", d[ST_LWT_REAL].i);
+    }
+    if (refresh & REFRESH_PICK_ADD) {
+        _mainWin->updatePickAddMode(d[ST_SELECTION_PICK_ADD].i);
+    }
+    if (refresh & REFRESH_LANGUAGE) {
+        translations.setLanguage(d[ST_LANGUAGE].s);
+    }
 }
 
 /* Create settings dialog object. */
@@ -294,6 +402,13 @@ Settings_Dialog::Settings_Dialog(QString  showTab, QWidget* parent) : QDialog(pa
 {
     setMinimumSize(750,550);
 
+    /* Start every copy from the current settings so that accepting or
+     * rejecting only sees the entries the user actually edited.
+     */
+    memcpy(dialog, settings, sizeof dialog);
+    memcpy(preview, settings, sizeof preview);
+    memcpy(accept_, settings, sizeof accept_);
+
     tabWidget = new QTabWidget(this);
 
     //TODO: Add icons to tabs
@@ -1571,7 +1686,7 @@ Settings_Dialog::checkBoxGeneralMdiBGUseLogoStateChanged(int checked)
 {
     preview[ST_MDI_USE_LOGO].i = checked;
     mdiArea->useLogo = checked;
-    mdiArea->forceRepaint();
+    mdiArea->invalidateBackground();
 }
 
 void
@@ -1591,8 +1706,9 @@ Settings_Dialog::chooseGeneralMdiBackgroundLogo()
 	}
 
 	//Update immediately so it can be previewed
-	mdiArea->bgLogo.load(accept_[ST_MDI_LOGO].s);
-	mdiArea->forceRepaint();
+	mdiArea->bgLogoFile = accept_[ST_MDI_LOGO].s;
+	mdiArea->bgLogo.load(mdiArea->bgLogoFile);
+	mdiArea->invalidateBackground();
 }
 
 void
@@ -1600,7 +1716,7 @@ Settings_Dialog::checkBoxGeneralMdiBGUseTextureStateChanged(int checked)
 {
     preview[ST_MDI_USE_TEXTURE].i = checked;
     mdiArea->useTexture = checked;
-    mdiArea->forceRepaint();
+    mdiArea->invalidateBackground();
 }
 
 void Settings_Dialog::chooseGeneralMdiBackgroundTexture()
@@ -1619,15 +1735,16 @@ void Settings_Dialog::chooseGeneralMdiBackgroundTexture()
 	}
 
 	//Update immediately so it can be previewed
-	mdiArea->bgTexture.load(accept_[ST_MDI_TEXTURE].s);
-	mdiArea->forceRepaint();
+	mdiArea->bgTextureFile = accept_[ST_MDI_TEXTURE].s;
+	mdiArea->bgTexture.load(mdiArea->bgTextureFile);
+	mdiArea->invalidateBackground();
 }
 
 void Settings_Dialog::checkBoxGeneralMdiBGUseColorStateChanged(int checked)
 {
     preview[ST_MDI_USE_COLOR].i = checked;
     mdiArea->useColor = checked;
-    mdiArea->forceRepaint();
+    mdiArea->invalidateBackground();
 }
 
 void Settings_Dialog::chooseGeneralMdiBackgroundColor()
@@ -1639,7 +1756,7 @@ void Settings_Dialog::currentGeneralMdiBackgroundColorChanged(const QColor& colo
 {
     preview[ST_MDI_COLOR].i = color.rgb();
     mdiArea->bgColor = color;
-    mdiArea->forceRepaint();
+    mdiArea->invalidateBackground();
 }
 
 void Settings_Dialog::checkBoxShowScrollBarsStateChanged(int checked)
@@ -1685,6 +1802,7 @@ Settings_Dialog::colorChanged(const QColor& color, Node *d, int color_id)
 
     case ST_MDI_COLOR: {
         mdiArea->bgColor = QColor(d[ST_MDI_COLOR].i);
+        mdiArea->invalidateBackground();
         break;
     }
 
@@ -2014,39 +2132,32 @@ void Settings_Dialog::acceptChanges()
     copy_node(dialog, accept_, ST_LWT_SHOW);
     copy_node(dialog, accept_, ST_LWT_REAL);
 
-    memcpy(settings, dialog, SETTINGS_TOTAL * sizeof settings[0]);
+    /* Only the settings that actually changed are copied, and only the
+     * parts of the interface that show them are refreshed. The previews
+     * may have left the views showing other values, so those count too.
+     */
+    uint32_t refresh = settings_diff(settings, dialog)
+        | settings_diff(preview, dialog);
+    int n_changed = 0;
+    for (int i=0; i<SETTINGS_TOTAL; i++) {
+        Setting s = settings_data[i];
+        if (!node_equal(settings+s.id, dialog+s.id, s.type)) {
+            copy_node(settings, dialog, s.id);
+            n_changed++;
+        }
+    }
 
     // Make sure the user sees the changes applied immediately
-    mdiArea->useLogo = dialog[ST_MDI_USE_LOGO].i;
-    mdiArea->useTexture = dialog[ST_MDI_USE_TEXTURE].i;
-    mdiArea->useColor = dialog[ST_MDI_USE_COLOR].i;
-    mdiArea->bgLogo.load(dialog[ST_MDI_LOGO].s);
-    mdiArea->bgTexture.load(dialog[ST_MDI_TEXTURE].s);
-    mdiArea->bgColor = dialog[ST_MDI_COLOR].i;
-    _mainWin->iconResize(dialog[ST_ICON_SIZE].i);
-    _mainWin->updateAllViewScrollBars(dialog[ST_SHOW_SCROLLBARS].i);
-    _mainWin->updateAllViewCrossHairColors(dialog[ST_CROSSHAIR_COLOR].i);
-    _mainWin->updateAllViewBackgroundColors(dialog[ST_BG_COLOR].i);
-    _mainWin->updateAllViewSelectBoxColors(
-        dialog[ST_SELECTBOX_LEFT_COLOR].i,
-        dialog[ST_SELECTBOX_LEFT_FILL].i,
-        dialog[ST_SELECTBOX_RIGHT_COLOR].i,
-        dialog[ST_SELECTBOX_RIGHT_FILL].i,
-        dialog[ST_SELECTBOX_ALPHA].i);
-    prompt->setPromptTextColor(QColor(dialog[ST_PROMPT_TEXT_COLOR].i));
-    prompt->setPromptBackgroundColor(QColor(dialog[ST_PROMPT_BG_COLOR].i));
-    prompt->setPromptFontFamily(dialog[ST_PROMPT_FONT_FAMILY].s);
-    prompt->setPromptFontStyle(dialog[ST_PROMPT_FONT_STYLE].s);
-    prompt->setPromptFontSize(dialog[ST_PROMPT_FONT_SIZE].i);
-    _mainWin->updateAllViewGridColors(dialog[ST_GRID_COLOR].i);
-    _mainWin->updateAllViewRulerColors(dialog[ST_RULER_COLOR].i);
-    statusbar->toggle("LWT", dialog[ST_LWT_SHOW].i);
-    statusbar->toggle("REAL", dialog[ST_LWT_REAL].i);
-    _mainWin->updatePickAddMode(dialog[ST_SELECTION_PICK_ADD].i);
-
-    mdiArea->forceRepaint();
-
-    write_settings();
+    apply_settings(dialog, refresh);
+    if (refresh & REFRESH_LANGUAGE) {
+        QMessageBox::information(this, translate_str("Language"),
+            translate_str("The menus and toolbars now use the new language. "
+                "Docked windows and dialogs will use it after a restart."));
+    }
+
+    if (n_changed) {
+        write_settings();
+    }
     accept();
 }
 
@@ -2057,33 +2168,11 @@ Settings_Dialog::rejectChanges()
     //TODO: inform the user if they have changed settings
 
     //Update the view since the user must accept the preview
-    mdiArea->useLogo = dialog[ST_MDI_USE_LOGO].i;
-    mdiArea->useTexture = dialog[ST_MDI_USE_TEXTURE].i;
-    mdiArea->useColor = dialog[ST_MDI_USE_COLOR].i;
-    mdiArea->bgLogo.load(dialog[ST_MDI_LOGO].s);
-    mdiArea->bgTexture.load(dialog[ST_MDI_TEXTURE].s);
-    mdiArea->bgColor = dialog[ST_MDI_COLOR].i;
-    _mainWin->updateAllViewScrollBars(dialog[ST_SHOW_SCROLLBARS].i);
-    _mainWin->updateAllViewCrossHairColors(dialog[ST_CROSSHAIR_COLOR].i);
-    _mainWin->updateAllViewBackgroundColors(dialog[ST_BG_COLOR].i);
-    _mainWin->updateAllViewSelectBoxColors(
-        dialog[ST_SELECTBOX_LEFT_COLOR].i,
-        dialog[ST_SELECTBOX_LEFT_FILL].i,
-        dialog[ST_SELECTBOX_RIGHT_COLOR].i,
-        dialog[ST_SELECTBOX_RIGHT_FILL].i,
-        dialog[ST_SELECTBOX_ALPHA].i);
-    prompt->setPromptTextColor(QColor(dialog[ST_PROMPT_TEXT_COLOR].i));
-    prompt->setPromptBackgroundColor(QColor(dialog[ST_PROMPT_BG_COLOR].i));
-    prompt->setPromptFontFamily(dialog[ST_PROMPT_FONT_FAMILY].s);
-    prompt->setPromptFontStyle(dialog[ST_PROMPT_FONT_STYLE].s);
-    prompt->setPromptFontSize(dialog[ST_PROMPT_FONT_SIZE].r);
-    _mainWin->updateAllViewGridColors(dialog[ST_GRID_COLOR].i);
-    _mainWin->updateAllViewRulerColors(dialog[ST_RULER_COLOR].i);
+    apply_settings(dialog, settings_diff(preview, dialog)
+        | settings_diff(accept_, dialog));
     statusbar->toggle("LWT", settings[ST_LWT_SHOW].i);
     statusbar->toggle("REAL", settings[ST_LWT_REAL].i);
 
-    mdiArea->forceRepaint();
-
     reject();
 }
 
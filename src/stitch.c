@@ -0,0 +1,1703 @@
+/*
+ *  Embroidermodder 2.
+ *
+ *  ------------------------------------------------------------
+ *
+ *  Copyright 2013-2023 The Embroidermodder Team
+ *  Embroidermodder 2 is Open Source Software.
+ *  See LICENSE for licensing terms.
+ *
+ *  ------------------------------------------------------------
+ *
+ *  Use Python's PEP7 style guide.
+ *      https://peps.python.org/pep-0007/
+ *
+ *  Stitch planning: turning the outlines of a design into the order
+ *  and the stitches the machine sews.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "core.h"
+
+/* Distance between two points. */
+static EmbReal
+distance(EmbVector a, EmbVector b)
+{
+    EmbReal dx = a.x - b.x;
+    EmbReal dy = a.y - b.y;
+    return sqrt(dx*dx + dy*dy);
+}
+
+/* The point where step s puts the needle in first. */
+EmbVector
+step_entry(const StitchRun *runs, StitchStep s)
+{
+    const StitchRun *run = runs + s.run;
+    if (run->closed) {
+        return run->points[s.entry];
+    }
+    return run->points[s.reversed ? run->count - 1 : 0];
+}
+
+/* The point where step s leaves the needle. A closed run is sewn all the
+ * way round, so it finishes where it started.
+ */
+EmbVector
+step_exit(const StitchRun *runs, StitchStep s)
+{
+    const StitchRun *run = runs + s.run;
+    if (run->closed) {
+        return run->points[s.entry];
+    }
+    return run->points[s.reversed ? 0 : run->count - 1];
+}
+
+/* Sum of the gaps the needle travels between the steps, starting
+ * from start.
+ */
+EmbReal
+sequence_travel(const StitchRun *runs, const StitchStep *steps, int n,
+    EmbVector start)
+{
+    EmbReal total = 0.0;
+    EmbVector at = start;
+    for (int i=0; i<n; i++) {
+        total += distance(at, step_entry(runs, steps[i]));
+        at = step_exit(runs, steps[i]);
+    }
+    return total;
+}
+
+/* Count the gaps between the steps that need a jump, and those long
+ * enough to need a trim as well.
+ */
+void
+sequence_count(const StitchRun *runs, const StitchStep *steps, int n,
+    EmbReal trim_length, int *jumps, int *trims)
+{
+    for (int i=1; i<n; i++) {
+        EmbReal gap = distance(step_exit(runs, steps[i-1]),
+            step_entry(runs, steps[i]));
+        if (gap > SEQUENCE_JOIN_TOLERANCE) {
+            (*jumps)++;
+        }
+        if (gap > trim_length) {
+            (*trims)++;
+        }
+    }
+}
+
+/* Index of the point of a closed run nearest to v. While sequencing,
+ * stride skips through long outlines; the final choice uses every point.
+ */
+static int
+nearest_point(const StitchRun *run, EmbVector v, int stride)
+{
+    int best = 0;
+    EmbReal best_d = distance(v, run->points[0]);
+    for (int i=stride; i<run->count; i+=stride) {
+        EmbReal d = distance(v, run->points[i]);
+        if (d < best_d) {
+            best_d = d;
+            best = i;
+        }
+    }
+    return best;
+}
+
+/* Whether the sequencer should stop where it is. */
+static int
+expired(const SequenceDeadline *deadline)
+{
+    return deadline && deadline->expired(deadline->data);
+}
+
+/* Stride for sampling the points of a closed run. */
+static int
+coarse_stride(const StitchRun *run)
+{
+    return run->count / SEQUENCE_ENTRY_SAMPLES + 1;
+}
+
+/* Seed an order for the n runs listed in members by starting at members
+ * [first] and always going on to the nearest run not yet sewn, entering
+ * it at whichever end or point is closest. Each step looks at every run
+ * left, so if the deadline passes part way the rest are taken in the
+ * order they were listed.
+ */
+void
+sequence_nearest(const StitchRun *runs, const int *members, int n, int first,
+    StitchStep *steps, const SequenceDeadline *deadline)
+{
+    char *used = calloc(n, 1);
+    if (!used) {
+        for (int i=0; i<n; i++) {
+            steps[i].run = members[i];
+            steps[i].reversed = 0;
+            steps[i].entry = 0;
+        }
+        return;
+    }
+
+    steps[0].run = members[first];
+    steps[0].reversed = 0;
+    steps[0].entry = 0;
+    used[first] = 1;
+    EmbVector at = step_exit(runs, steps[0]);
+    for (int i=1; i<n; i++) {
+        if (expired(deadline)) {
+            for (int j=0; j<n; j++) {
+                if (!used[j]) {
+                    steps[i].run = members[j];
+                    steps[i].reversed = 0;
+                    steps[i].entry = 0;
+                    i++;
+                }
+            }
+            break;
+        }
+        int best = -1;
+        StitchStep best_step = {0, 0, 0};
+        EmbReal best_d = 0.0;
+        for (int j=0; j<n; j++) {
+            if (used[j]) {
+                continue;
+            }
+            const StitchRun *run = runs + members[j];
+            StitchStep s = {members[j], 0, 0};
+            if (run->closed) {
+                s.entry = nearest_point(run, at, coarse_stride(run));
+            }
+            else {
+                EmbReal forward = distance(at, run->points[0]);
+                EmbReal backward = distance(at, run->points[run->count-1]);
+                s.reversed = backward < forward;
+            }
+            EmbReal d = distance(at, step_entry(runs, s));
+            if ((best < 0) || (d < best_d)) {
+                best = j;
+                best_d = d;
+                best_step = s;
+            }
+        }
+        used[best] = 1;
+        steps[i] = best_step;
+        at = step_exit(runs, best_step);
+    }
+    free(used);
+}
+
+/* Reverse steps i to j, sewing each open run the other way. */
+static void
+reverse_steps(StitchStep *steps, int i, int j)
+{
+    while (i < j) {
+        StitchStep t = steps[i];
+        steps[i] = steps[j];
+        steps[j] = t;
+        steps[i].reversed = !steps[i].reversed;
+        steps[j].reversed = !steps[j].reversed;
+        i++;
+        j--;
+    }
+    if (i == j) {
+        steps[i].reversed = !steps[i].reversed;
+    }
+}
+
+/* One sweep of 2-opt: reverse any stretch of the order that shortens
+ * the travel, returning the number of reversals made. The start of the
+ * order is free, so only the gaps between steps count. The sweep stops
+ * early once the deadline passes.
+ */
+int
+sequence_2opt_pass(const StitchRun *runs, StitchStep *steps, int n,
+    const SequenceDeadline *deadline)
+{
+    int improved = 0;
+    for (int i=0; i<n-1; i++) {
+        if (expired(deadline)) {
+            break;
+        }
+        for (int j=i+1; j<n; j++) {
+            EmbReal before = 0.0;
+            EmbReal after = 0.0;
+            if (i > 0) {
+                EmbVector prev = step_exit(runs, steps[i-1]);
+                before += distance(prev, step_entry(runs, steps[i]));
+                after += distance(prev, step_exit(runs, steps[j]));
+            }
+            if (j < n-1) {
+                EmbVector next = step_entry(runs, steps[j+1]);
+                before += distance(step_exit(runs, steps[j]), next);
+                after += distance(step_entry(runs, steps[i]), next);
+            }
+            if (after < before - SEQUENCE_JOIN_TOLERANCE) {
+                reverse_steps(steps, i, j);
+                improved++;
+            }
+        }
+    }
+    return improved;
+}
+
+/* One sweep of Or-opt: lift out each stretch of up to three steps and put
+ * it back, either way round, wherever that shortens the travel most.
+ * Returns the number of moves made. The sweep stops early once the
+ * deadline passes.
+ */
+int
+sequence_oropt_pass(const StitchRun *runs, StitchStep *steps, int n,
+    const SequenceDeadline *deadline)
+{
+    int improved = 0;
+    StitchStep moved[3];
+    for (int len=1; len<=3 && len<n; len++) {
+        for (int i=0; i+len<=n; i++) {
+            if (expired(deadline)) {
+                return improved;
+            }
+            int j = i + len - 1;
+            EmbVector in = step_entry(runs, steps[i]);
+            EmbVector out = step_exit(runs, steps[j]);
+
+            /* What taking the stretch out saves. */
+            EmbReal removed = 0.0;
+            if (i > 0) {
+                removed += distance(step_exit(runs, steps[i-1]), in);
+            }
+            if (j < n-1) {
+                removed += distance(out, step_entry(runs, steps[j+1]));
+            }
+            if ((i > 0) && (j < n-1)) {
+                removed -= distance(step_exit(runs, steps[i-1]),
+                    step_entry(runs, steps[j+1]));
+            }
+
+            /* Try it between steps k and k+1 of what is left, where k = -1
+             * is the very start.
+             */
+            EmbReal best = removed - SEQUENCE_JOIN_TOLERANCE;
+            int best_k = -2;
+            int best_flip = 0;
+            for (int k=-1; k<n; k++) {
+                if ((k >= i-1) && (k <= j)) {
+                    continue;
+                }
+                for (int flip=0; flip<2; flip++) {
+                    EmbVector a = flip ? out : in;
+                    EmbVector b = flip ? in : out;
+                    EmbReal added = 0.0;
+                    if (k >= 0) {
+                        added += distance(step_exit(runs, steps[k]), a);
+                    }
+                    if (k+1 < n) {
+                        added += distance(b, step_entry(runs, steps[k+1]));
+                    }
+                    if ((k >= 0) && (k+1 < n)) {
+                        added -= distance(step_exit(runs, steps[k]),
+                            step_entry(runs, steps[k+1]));
+                    }
+                    if (added < best) {
+                        best = added;
+                        best_k = k;
+                        best_flip = flip;
+                    }
+                }
+            }
+            if (best_k == -2) {
+                continue;
+            }
+
+            memcpy(moved, steps + i, len*sizeof(StitchStep));
+            if (best_flip) {
+                reverse_steps(moved, 0, len-1);
+            }
+            if (best_k < i) {
+                /* Shift steps k+1 .. i-1 along to make room. */
+                memmove(steps + best_k + 1 + len, steps + best_k + 1,
+                    (i - best_k - 1)*sizeof(StitchStep));
+                memcpy(steps + best_k + 1, moved, len*sizeof(StitchStep));
+            }
+            else {
+                /* Shift steps j+1 .. k back over the gap. */
+                memmove(steps + i, steps + j + 1,
+                    (best_k - j)*sizeof(StitchStep));
+                memcpy(steps + best_k - len + 1, moved, len*sizeof(StitchStep));
+            }
+            improved++;
+        }
+    }
+    return improved;
+}
+
+/* With the order settled, enter every closed run at its point nearest
+ * to where the needle is, starting from start.
+ */
+void
+sequence_entries(const StitchRun *runs, StitchStep *steps, int n,
+    EmbVector start)
+{
+    EmbVector at = start;
+    for (int i=0; i<n; i++) {
+        const StitchRun *run = runs + steps[i].run;
+        if (run->closed) {
+            steps[i].entry = nearest_point(run, at, 1);
+        }
+        at = step_exit(runs, steps[i]);
+    }
+}
+
+/* Sew the whole order backwards, for when its far end is nearer the
+ * needle than its start.
+ */
+void
+sequence_reverse(StitchStep *steps, int n)
+{
+    if (n > 0) {
+        reverse_steps(steps, 0, n-1);
+    }
+}
+
+/* An edge of the outline being filled, in the rotated frame where the
+ * rows run along x.
+ */
+typedef struct FillEdge_ {
+    EmbReal y0;
+    EmbReal y1;
+    EmbReal x;
+    EmbReal dxdy;
+} FillEdge;
+
+/* Where one row crosses the inside of the outline. */
+typedef struct FillSpan_ {
+    EmbReal x0;
+    EmbReal x1;
+    int row;
+    int next;
+    int joined;
+} FillSpan;
+
+static int
+compare_edges(const void *a, const void *b)
+{
+    EmbReal ya = ((const FillEdge *)a)->y0;
+    EmbReal yb = ((const FillEdge *)b)->y0;
+    return (ya > yb) - (ya < yb);
+}
+
+/* Make room for n more of the items of size bytes in *buffer. */
+static int
+reserve(void **buffer, int *capacity, int count, int n, size_t size)
+{
+    if (count + n <= *capacity) {
+        return 1;
+    }
+    int grown = 2 * (*capacity) + n + 64;
+    void *p = realloc(*buffer, grown * size);
+    if (!p) {
+        return 0;
+    }
+    *buffer = p;
+    *capacity = grown;
+    return 1;
+}
+
+/* Add the stitches of one row from x0 to x1 at height y, rotated back by
+ * (c, s), to the fill. The needle goes in wherever the row crosses the
+ * grid of stitch_length steps shifted by phase, so that neighbouring rows
+ * break in a staggered brick pattern, except where that would leave a
+ * stitch under a quarter of stitch_length at either end.
+ */
+static int
+fill_row(FillStitches *fill, EmbReal x0, EmbReal x1, EmbReal y, int reversed,
+    EmbReal stitch_length, EmbReal phase, EmbReal c, EmbReal s)
+{
+    EmbReal margin = 0.25 * stitch_length;
+    EmbReal first = (ceil((x0 + margin) / stitch_length - phase) + phase)
+        * stitch_length;
+    int inner = 0;
+    if (first < x1 - margin) {
+        inner = (int)floor((x1 - margin - first) / stitch_length) + 1;
+    }
+    if (!reserve((void **)&fill->points, &fill->capacity, fill->count,
+        inner + 2, sizeof(EmbVector))) {
+        return 0;
+    }
+
+    EmbVector *out = fill->points + fill->count;
+    int n = inner + 2;
+    for (int i=0; i<n; i++) {
+        int k = reversed ? n - 1 - i : i;
+        EmbReal x = first + (k - 1) * stitch_length;
+        if (k == 0) {
+            x = x0;
+        }
+        else if (k == n - 1) {
+            x = x1;
+        }
+        out[i].x = x*c - y*s;
+        out[i].y = x*s + y*c;
+    }
+    fill->count += n;
+    return 1;
+}
+
+/* Fill the region bounded by the closed rings in points, ring i ending
+ * before ring_ends[i], with rows spacing apart at angle degrees. Holes
+ * are rings inside others: the region is what the even-odd rule makes
+ * of them.
+ *
+ * The outline is turned so the rows run along x and its edges sorted
+ * into an edge table. Walking up the rows, edges move from the table to
+ * the active list as the row reaches them and drop out as it passes
+ * them, each keeping its crossing up to date with one addition. The
+ * crossings of each row pair off into spans.
+ *
+ * Spans that follow on from one another row after row are chained into
+ * runs sewn back and forth, so the fill breaks into as few runs as the
+ * shape allows. The stitches are added to fill, which may already hold
+ * others. Returns 0 if it runs out of memory.
+ */
+int
+fill_region(const EmbVector *points, const int *ring_ends, int rings,
+    EmbReal spacing, EmbReal angle, EmbReal stitch_length, int stagger,
+    FillStitches *fill)
+{
+    if (rings < 1) {
+        return 1;
+    }
+    int n = ring_ends[rings-1];
+    if ((n < 3) || (spacing <= 0.0) || (stitch_length <= 0.0)) {
+        return 1;
+    }
+    if (stagger < 1) {
+        stagger = 1;
+    }
+    EmbReal c = cos(angle * embConstantPi / 180.0);
+    EmbReal s = sin(angle * embConstantPi / 180.0);
+
+    EmbReal *xs = malloc(2 * n * sizeof(EmbReal));
+    FillEdge *edges = malloc(n * sizeof(FillEdge));
+    FillEdge **active = malloc(n * sizeof(FillEdge *));
+    if (!xs || !edges || !active) {
+        free(xs);
+        free(edges);
+        free(active);
+        return 0;
+    }
+    EmbReal *ys = xs + n;
+
+    /* Into the frame of the rows. */
+    for (int i=0; i<n; i++) {
+        xs[i] = points[i].x*c + points[i].y*s;
+        ys[i] = points[i].y*c - points[i].x*s;
+    }
+
+    int n_edges = 0;
+    EmbReal top = ys[0];
+    EmbReal bottom = ys[0];
+    for (int r=0, start=0; r<rings; start=ring_ends[r], r++) {
+        for (int i=start; i<ring_ends[r]; i++) {
+            int j = (i+1 < ring_ends[r]) ? i+1 : start;
+            top = (ys[i] > top) ? ys[i] : top;
+            bottom = (ys[i] < bottom) ? ys[i] : bottom;
+            if (ys[i] == ys[j]) {
+                continue;
+            }
+            int lo = (ys[i] < ys[j]) ? i : j;
+            int hi = (lo == i) ? j : i;
+            edges[n_edges].y0 = ys[lo];
+            edges[n_edges].y1 = ys[hi];
+            edges[n_edges].dxdy = (xs[hi] - xs[lo]) / (ys[hi] - ys[lo]);
+            edges[n_edges].x = xs[lo];
+            n_edges++;
+        }
+    }
+    qsort(edges, n_edges, sizeof(FillEdge), compare_edges);
+
+    FillSpan *spans = NULL;
+    int n_spans = 0;
+    int span_capacity = 0;
+    int ok = 1;
+    int n_active = 0;
+    int next_edge = 0;
+    int prev_start = 0;
+    int prev_end = 0;
+    int rows = (int)floor((top - bottom) / spacing);
+    EmbReal step = FILL_JOIN_ROWS * spacing;
+    for (int row=0; ok && row<=rows; row++) {
+        EmbReal y = bottom + (row + 0.5) * spacing;
+        if (y >= top) {
+            break;
+        }
+
+        /* Drop the edges the row has passed, step the rest along. */
+        int kept = 0;
+        for (int i=0; i<n_active; i++) {
+            if (active[i]->y1 > y) {
+                active[i]->x += active[i]->dxdy * spacing;
+                active[kept++] = active[i];
+            }
+        }
+        n_active = kept;
+        while ((next_edge < n_edges) && (edges[next_edge].y0 <= y)) {
+            FillEdge *e = edges + next_edge++;
+            if (e->y1 > y) {
+                e->x += (y - e->y0) * e->dxdy;
+                active[n_active++] = e;
+            }
+        }
+
+        /* Crossings barely move from row to row, so insertion sort is
+         * close to linear here.
+         */
+        for (int i=1; i<n_active; i++) {
+            FillEdge *e = active[i];
+            int j = i;
+            while ((j > 0) && (active[j-1]->x > e->x)) {
+                active[j] = active[j-1];
+                j--;
+            }
+            active[j] = e;
+        }
+
+        if (!reserve((void **)&spans, &span_capacity, n_spans, n_active/2,
+            sizeof(FillSpan))) {
+            ok = 0;
+            break;
+        }
+        int row_start = n_spans;
+        for (int i=0; i+1<n_active; i+=2) {
+            FillSpan *span = spans + n_spans++;
+            span->x0 = active[i]->x;
+            span->x1 = active[i+1]->x;
+            span->row = row;
+            span->next = -1;
+            span->joined = 0;
+        }
+
+        /* Join each span to the first free one it overlaps in the row
+         * before, if the needle can step between their ends.
+         */
+        if (prev_end > prev_start) {
+            int p = prev_start;
+            for (int i=row_start; i<n_spans; i++) {
+                while ((p < prev_end) && (spans[p].x1 < spans[i].x0)) {
+                    p++;
+                }
+                if ((p >= prev_end) || (spans[p].x0 > spans[i].x1)) {
+                    continue;
+                }
+                if ((fabs(spans[p].x0 - spans[i].x0) < step)
+                    && (fabs(spans[p].x1 - spans[i].x1) < step)) {
+                    spans[p].next = i;
+                    spans[i].joined = 1;
+                    p++;
+                }
+            }
+        }
+        prev_start = row_start;
+        prev_end = n_spans;
+    }
+
+    /* Sew each chain back and forth from its lowest row. */
+    for (int i=0; ok && i<n_spans; i++) {
+        if (spans[i].joined) {
+            continue;
+        }
+        int reversed = 0;
+        for (int k=i; ok && k>=0; k=spans[k].next) {
+            EmbReal y = bottom + (spans[k].row + 0.5) * spacing;
+            EmbReal phase = (EmbReal)(spans[k].row % stagger) / stagger;
+            ok = fill_row(fill, spans[k].x0, spans[k].x1, y, reversed,
+                stitch_length, phase, c, s);
+            reversed = !reversed;
+        }
+        if (ok && reserve((void **)&fill->run_ends, &fill->run_capacity,
+            fill->runs, 1, sizeof(int))) {
+            fill->run_ends[fill->runs++] = fill->count;
+        }
+        else {
+            ok = 0;
+        }
+    }
+
+    free(spans);
+    free(xs);
+    free(edges);
+    free(active);
+    return ok;
+}
+
+/* Free the buffers of a fill. */
+void
+fill_free(FillStitches *fill)
+{
+    free(fill->points);
+    free(fill->run_ends);
+    memset(fill, 0, sizeof(FillStitches));
+}
+
+/* A walk along a polyline by distance that only ever goes forward, so
+ * following a whole path costs one step per point.
+ */
+typedef struct PathCursor_ {
+    const EmbVector *points;
+    int count;
+    int seg;
+    EmbReal start;
+    EmbReal length;
+    EmbReal blend;
+} PathCursor;
+
+/* The two sides of a column being sewn: either a pair of rails, or one
+ * centerline with the sides width apart about it.
+ */
+typedef struct ColumnRails_ {
+    PathCursor left;
+    PathCursor right;
+    EmbReal left_length;
+    EmbReal right_length;
+    int centered;
+    EmbReal half;
+    EmbReal pull;
+} ColumnRails;
+
+/* Length of the polyline through the count points. */
+static EmbReal
+path_length(const EmbVector *points, int count)
+{
+    EmbReal total = 0.0;
+    for (int i=1; i<count; i++) {
+        total += distance(points[i-1], points[i]);
+    }
+    return total;
+}
+
+static void
+cursor_init(PathCursor *c, const EmbVector *points, int count, EmbReal blend)
+{
+    c->points = points;
+    c->count = count;
+    c->seg = 0;
+    c->start = 0.0;
+    c->length = (count > 1) ? distance(points[0], points[1]) : 0.0;
+    c->blend = blend;
+}
+
+/* v scaled to unit length, or left as it is if it has none. */
+static EmbVector
+unit(EmbVector v)
+{
+    EmbReal length = sqrt(v.x*v.x + v.y*v.y);
+    if (length > 0.0) {
+        v.x /= length;
+        v.y /= length;
+    }
+    return v;
+}
+
+/* Unit normal to the left of segment i. */
+static EmbVector
+segment_normal(const EmbVector *points, int i)
+{
+    EmbVector n;
+    n.x = points[i].y - points[i+1].y;
+    n.y = points[i+1].x - points[i].x;
+    return unit(n);
+}
+
+/* Normal at point i, halfway between those of the segments either side,
+ * so the sides of a column turn smoothly round the corners.
+ */
+static EmbVector
+vertex_normal(const EmbVector *points, int count, int i)
+{
+    EmbVector n = {0.0, 0.0};
+    if (i > 0) {
+        EmbVector a = segment_normal(points, i-1);
+        n.x += a.x;
+        n.y += a.y;
+    }
+    if (i < count-1) {
+        EmbVector b = segment_normal(points, i);
+        n.x += b.x;
+        n.y += b.y;
+    }
+    return unit(n);
+}
+
+/* Move c on to distance s along its path, giving the point there and the
+ * normal. Within c->blend of a corner the normal turns towards the one at
+ * the corner.
+ */
+static void
+cursor_at(PathCursor *c, EmbReal s, EmbVector *at, EmbVector *normal)
+{
+    while ((c->seg < c->count-2) && (s > c->start + c->length)) {
+        c->start += c->length;
+        c->seg++;
+        c->length = distance(c->points[c->seg], c->points[c->seg+1]);
+    }
+    const EmbVector *p = c->points + c->seg;
+    EmbReal u = 0.0;
+    if (c->length > 0.0) {
+        u = (s - c->start) / c->length;
+        u = (u < 0.0) ? 0.0 : ((u > 1.0) ? 1.0 : u);
+    }
+    at->x = p[0].x + u*(p[1].x - p[0].x);
+    at->y = p[0].y + u*(p[1].y - p[0].y);
+    if (normal) {
+        EmbVector n = segment_normal(c->points, c->seg);
+        EmbReal before = u * c->length;
+        EmbReal after = c->length - before;
+        EmbVector corner = n;
+        EmbReal w = 0.0;
+        if ((before < c->blend) && (before <= after)) {
+            corner = vertex_normal(c->points, c->count, c->seg);
+            w = 1.0 - before / c->blend;
+        }
+        else if (after < c->blend) {
+            corner = vertex_normal(c->points, c->count, c->seg+1);
+            w = 1.0 - after / c->blend;
+        }
+        n.x += w*(corner.x - n.x);
+        n.y += w*(corner.y - n.y);
+        *normal = unit(n);
+    }
+}
+
+/* The ends of the row t of the way along the column, each pushed out by
+ * the pull compensation to make up for the thread drawing the sides in.
+ */
+static void
+column_row(ColumnRails *r, EmbReal t, EmbVector *left, EmbVector *right)
+{
+    if (r->centered) {
+        EmbVector at, n;
+        cursor_at(&r->left, t * r->left_length, &at, &n);
+        EmbReal h = r->half + r->pull;
+        left->x = at.x + n.x*h;
+        left->y = at.y + n.y*h;
+        right->x = at.x - n.x*h;
+        right->y = at.y - n.y*h;
+        return;
+    }
+    EmbVector a, b;
+    cursor_at(&r->left, t * r->left_length, &a, NULL);
+    cursor_at(&r->right, t * r->right_length, &b, NULL);
+    EmbVector d = {a.x - b.x, a.y - b.y};
+    d = unit(d);
+    left->x = a.x + d.x*r->pull;
+    left->y = a.y + d.y*r->pull;
+    right->x = b.x - d.x*r->pull;
+    right->y = b.y - d.y*r->pull;
+}
+
+static void
+rails_init(ColumnRails *r, const EmbVector *left, int n_left,
+    const EmbVector *right, int n_right, EmbReal width, EmbReal pull)
+{
+    r->centered = (right == NULL) || (n_right < 2);
+    cursor_init(&r->left, left, n_left, 0.5 * width);
+    r->left_length = path_length(left, n_left);
+    if (!r->centered) {
+        cursor_init(&r->right, right, n_right, 0.0);
+        r->right_length = path_length(right, n_right);
+    }
+    r->half = 0.5 * width;
+    r->pull = pull;
+}
+
+/* Whether left and right can be sewn as the two rails of one column:
+ * walked together by the fraction of their length, they never come more
+ * than COLUMN_MAX_WIDTH apart, never touch and never cross. Sets
+ * *reversed if right runs the other way from left and should be
+ * followed backwards.
+ */
+int
+column_rails(const EmbVector *left, int n_left,
+    const EmbVector *right, int n_right, int *reversed)
+{
+    *reversed = 0;
+    if ((n_left < 2) || (n_right < 2)) {
+        return 0;
+    }
+    EmbReal same = distance(left[0], right[0])
+        + distance(left[n_left-1], right[n_right-1]);
+    EmbReal crossed = distance(left[0], right[n_right-1])
+        + distance(left[n_left-1], right[0]);
+    *reversed = crossed < same;
+
+    EmbReal left_length = path_length(left, n_left);
+    EmbReal right_length = path_length(right, n_right);
+    if ((left_length <= 0.0) || (right_length <= 0.0)) {
+        return 0;
+    }
+    /* The cursors only go forward, so take the samples of right first
+     * and pair them off with those of left in whichever order it runs.
+     */
+    EmbVector samples[COLUMN_RAIL_SAMPLES+1];
+    PathCursor c;
+    cursor_init(&c, right, n_right, 0.0);
+    for (int i=0; i<=COLUMN_RAIL_SAMPLES; i++) {
+        cursor_at(&c, right_length * i / COLUMN_RAIL_SAMPLES, samples + i,
+            NULL);
+    }
+    cursor_init(&c, left, n_left, 0.0);
+    int side = 0;
+    for (int i=0; i<=COLUMN_RAIL_SAMPLES; i++) {
+        EmbVector p, n;
+        cursor_at(&c, left_length * i / COLUMN_RAIL_SAMPLES, &p, &n);
+        EmbVector q = samples[*reversed ? COLUMN_RAIL_SAMPLES - i : i];
+        EmbReal gap = distance(p, q);
+        if ((gap <= 0.0) || (gap > COLUMN_MAX_WIDTH)) {
+            return 0;
+        }
+        int s = (n.x*(q.x - p.x) + n.y*(q.y - p.y) > 0.0) ? 1 : -1;
+        if (side && (s != side)) {
+            return 0;
+        }
+        side = s;
+    }
+    return 1;
+}
+
+/* Sew a column between the rails left and right or, with no right rail,
+ * width wide about the centerline left. The sides are pull further apart
+ * than drawn and the needle goes in every half spacing along them,
+ * handing each stitch to emit as it goes.
+ *
+ * OBJ_LTYPE_SATIN zig-zags straight from side to side. OBJ_LTYPE_FISHBONE
+ * sends each stitch from a side to just past the middle further along,
+ * the stitches overlapping down the middle like the bones of a fish.
+ *
+ * The rails are followed by cursors that only go forward, so the column
+ * costs time in proportion to its length and points and needs no memory
+ * beyond what emit keeps.
+ */
+void
+column_stitches(const EmbVector *left, int n_left,
+    const EmbVector *right, int n_right, EmbReal width, EmbReal spacing,
+    EmbReal pull, int style, StitchEmit emit, void *data)
+{
+    if ((n_left < 2) || (spacing <= 0.0)) {
+        return;
+    }
+    ColumnRails rows, ahead;
+    rails_init(&rows, left, n_left, right, n_right, width, pull);
+    rails_init(&ahead, left, n_left, right, n_right, width, pull);
+    EmbReal length = rows.left_length;
+    if (!rows.centered && (rows.right_length > length)) {
+        length = rows.right_length;
+    }
+    if (length <= 0.0) {
+        return;
+    }
+
+    int n = (int)ceil(2.0 * length / spacing);
+    EmbReal dt = 1.0 / n;
+    for (int k=0; k<=n; k++) {
+        EmbVector l, r;
+        column_row(&rows, k*dt, &l, &r);
+        emit(data, (k % 2) ? r : l);
+        if ((style != OBJ_LTYPE_FISHBONE) || (k == n)) {
+            continue;
+        }
+        EmbReal t = (k + FISHBONE_SLANT) * dt;
+        column_row(&ahead, (t < 1.0) ? t : 1.0, &l, &r);
+        EmbVector far = (k % 2) ? l : r;
+        EmbVector cross;
+        cross.x = 0.5*(l.x + r.x);
+        cross.y = 0.5*(l.y + r.y);
+        cross.x += FISHBONE_OVERLAP * (far.x - cross.x);
+        cross.y += FISHBONE_OVERLAP * (far.y - cross.y);
+        emit(data, cross);
+    }
+}
+
+/* Set up f to pass stitches on to write, splitting moves longer than
+ * max_length and dropping stitches shorter than min_length. A run of
+ * jumps is trimmed once it reaches trim_jumps jumps or travels further
+ * than trim_length; 0 turns either test off.
+ */
+void
+filter_init(StitchFilter *f, EmbReal max_length, EmbReal min_length,
+    int trim_jumps, EmbReal trim_length, StitchWrite write, void *data)
+{
+    memset(f, 0, sizeof(StitchFilter));
+    f->max_length = max_length;
+    f->min_length = min_length;
+    f->trim_jumps = trim_jumps;
+    f->trim_length = trim_length;
+    f->write = write;
+    f->data = data;
+}
+
+/* Write one stitch, counting the jumps in a row. A jump asking for a
+ * trim, or the f->trim_jumps-th of a run, is written as JUMP | TRIM
+ * unless the run has been trimmed already.
+ */
+static void
+filter_write(StitchFilter *f, EmbReal x, EmbReal y, int flags)
+{
+    if (flags & JUMP) {
+        f->jumps++;
+        if ((f->trim_jumps > 0) && (f->jumps >= f->trim_jumps)) {
+            flags |= TRIM;
+        }
+        if ((flags & TRIM) && !f->trimmed) {
+            f->trimmed = 1;
+            f->trims++;
+        }
+        else {
+            flags &= ~TRIM;
+        }
+    }
+    else {
+        f->jumps = 0;
+        f->jump_length = 0.0;
+        f->trimmed = 0;
+    }
+    f->write(f->data, x, y, flags);
+    f->at.x = x;
+    f->at.y = y;
+    f->stitches_out++;
+}
+
+/* Write the stitch held back for being short, if there is one. */
+static void
+filter_flush(StitchFilter *f)
+{
+    if (f->held) {
+        f->held = 0;
+        filter_write(f, f->held_at.x, f->held_at.y, NORMAL);
+    }
+}
+
+/* Pass the stitch at (x, y) through the filter in one step.
+ *
+ * A normal stitch or jump longer than f->max_length is split into equal
+ * pieces short enough for the machine. A TRIM is taken as a jump that
+ * asks to be trimmed, and the first piece of a jump that carries its run
+ * of jumps past f->trim_length asks the same, so the thread is cut
+ * before the frame travels. A normal stitch that lands less
+ * than f->min_length from the last needle point is held back: if the
+ * next is a normal stitch it is dropped, so the two merge, and otherwise
+ * it is written first so every run still ends where it should.
+ *
+ * Nothing is stored beyond the one stitch held back, so the filter adds
+ * no copy of the stitch list and takes constant time per stitch written.
+ */
+void
+filter_stitch(StitchFilter *f, EmbReal x, EmbReal y, int flags)
+{
+    f->stitches_in++;
+    EmbVector to = {x, y};
+    if (flags & TRIM) {
+        flags |= JUMP;
+    }
+    if (!f->started) {
+        f->started = 1;
+        filter_write(f, x, y, flags);
+        return;
+    }
+
+    if (flags == NORMAL) {
+        if (f->held) {
+            f->dropped++;
+            f->held = 0;
+        }
+        if (distance(f->at, to) < f->min_length) {
+            f->held = 1;
+            f->held_at = to;
+            return;
+        }
+    }
+    else {
+        filter_flush(f);
+    }
+
+    EmbReal length = distance(f->at, to);
+    if (flags & JUMP) {
+        f->jump_length += length;
+        if ((f->trim_length > 0.0) && (f->jump_length > f->trim_length)) {
+            flags |= TRIM;
+        }
+    }
+    if (!(flags & (STOP | END)) && (f->max_length > 0.0)
+        && (length > f->max_length)) {
+        int pieces = (int)ceil(length / f->max_length);
+        EmbVector from = f->at;
+        for (int i=1; i<pieces; i++) {
+            EmbReal t = (EmbReal)i / pieces;
+            filter_write(f, from.x + t*(x - from.x), from.y + t*(y - from.y),
+                flags);
+            flags &= ~TRIM;
+        }
+        f->split += pieces - 1;
+    }
+    filter_write(f, x, y, flags);
+}
+
+/* Set e up to estimate a design for a needle taking stitch_time seconds
+ * to go in and out and a frame moving at up to needle_speed mm/s.
+ */
+void
+estimate_init(StitchEstimate *e, EmbReal stitch_time, EmbReal needle_speed)
+{
+    memset(e, 0, sizeof(StitchEstimate));
+    e->stitch_time = stitch_time;
+    e->needle_speed = needle_speed;
+    e->top = calloc(1, sizeof(EmbReal));
+    e->color_capacity = e->top ? 1 : 0;
+    e->colors = 1;
+}
+
+/* Seconds the frame takes to move length mm, speeding up and slowing
+ * down at MACHINE_ACCELERATION and going no faster than speed.
+ */
+static EmbReal
+move_seconds(EmbReal length, EmbReal speed)
+{
+    if ((length <= 0.0) || (speed <= 0.0)) {
+        return 0.0;
+    }
+    EmbReal a = MACHINE_ACCELERATION;
+    if (length <= speed*speed / a) {
+        return 2.0 * sqrt(length / a);
+    }
+    return length / speed + speed / a;
+}
+
+/* Add the stitch at (x, y) to the estimate in e and return the seconds
+ * the machine spends on it.
+ *
+ * A normal stitch takes the longer of stitch_time and the frame's move,
+ * and up to twice stitch_time while the needle gets back up to speed
+ * after a trim or stop. Jumps only move the frame. Trims and colour
+ * changes stop the machine for MACHINE_TRIM_SECONDS and
+ * MACHINE_STOP_SECONDS. The top thread is counted colour by colour.
+ */
+EmbReal
+estimate_stitch(StitchEstimate *e, EmbReal x, EmbReal y, int flags)
+{
+    EmbVector to = {x, y};
+    EmbReal length = e->started ? distance(e->at, to) : 0.0;
+    EmbReal move = move_seconds(length, e->needle_speed);
+    EmbReal t = 0.0;
+    EmbReal thread = 0.0;
+    e->started = 1;
+    e->at = to;
+
+    if (flags & STOP) {
+        t = MACHINE_STOP_SECONDS;
+        e->stops++;
+        e->ramp = 0;
+        if (reserve((void **)&e->top, &e->color_capacity, e->colors, 1,
+            sizeof(EmbReal))) {
+            e->top[e->colors++] = 0.0;
+        }
+    }
+    else if (flags & TRIM) {
+        t = MACHINE_TRIM_SECONDS + move;
+        thread = THREAD_TRIM_TAIL;
+        e->trims++;
+        e->ramp = 0;
+    }
+    else if (flags & JUMP) {
+        t = move;
+        thread = length;
+        e->jumps++;
+    }
+    else if (!(flags & END)) {
+        t = e->stitch_time;
+        if (e->ramp < MACHINE_RAMP_STITCHES) {
+            t *= 2.0 - (EmbReal)e->ramp / MACHINE_RAMP_STITCHES;
+            e->ramp++;
+        }
+        t = (move > t) ? move : t;
+        thread = length + THREAD_PER_PENETRATION;
+        e->bobbin += BOBBIN_RATIO * thread;
+        e->stitches++;
+    }
+
+    if (e->top) {
+        e->top[e->colors-1] += thread;
+    }
+    e->seconds += t;
+    return t;
+}
+
+/* Add every stitch of pattern to the estimate in e. */
+void
+estimate_pattern(StitchEstimate *e, EmbPattern *pattern)
+{
+    for (int i=0; i<pattern->stitch_list->count; i++) {
+        EmbStitch st = pattern->stitch_list->stitch[i];
+        estimate_stitch(e, st.x, st.y, st.flags);
+    }
+}
+
+/* Free the per-colour totals of e. */
+void
+estimate_free(StitchEstimate *e)
+{
+    free(e->top);
+    e->top = NULL;
+    e->colors = 0;
+    e->color_capacity = 0;
+}
+
+/* Spread the stitch from a to b over the cells of g its thread lies in:
+ * it counts one in all, shared by the length in each cell. Cells off
+ * the grid are skipped, so a tile of a larger grid takes only its part.
+ */
+static void
+density_stitch(DensityGrid *g, EmbVector a, EmbVector b)
+{
+    EmbReal right = g->origin.x + g->columns * g->cell;
+    EmbReal bottom = g->origin.y + g->rows * g->cell;
+    if (((a.x < g->origin.x) && (b.x < g->origin.x))
+        || ((a.y < g->origin.y) && (b.y < g->origin.y))
+        || ((a.x >= right) && (b.x >= right))
+        || ((a.y >= bottom) && (b.y >= bottom))) {
+        return;
+    }
+
+    /* Walk the cells the thread crosses in order, finding where it
+     * leaves each by the next cell edge it meets across and down.
+     */
+    EmbReal dx = b.x - a.x;
+    EmbReal dy = b.y - a.y;
+    int column = (int)floor((a.x - g->origin.x) / g->cell);
+    int row = (int)floor((a.y - g->origin.y) / g->cell);
+    int step_x = (dx > 0.0) ? 1 : -1;
+    int step_y = (dy > 0.0) ? 1 : -1;
+    EmbReal next_x = HUGE_VAL;
+    EmbReal next_y = HUGE_VAL;
+    EmbReal delta_x = HUGE_VAL;
+    EmbReal delta_y = HUGE_VAL;
+    if (dx != 0.0) {
+        next_x = (g->origin.x + (column + (dx > 0.0)) * g->cell - a.x) / dx;
+        delta_x = g->cell / fabs(dx);
+    }
+    if (dy != 0.0) {
+        next_y = (g->origin.y + (row + (dy > 0.0)) * g->cell - a.y) / dy;
+        delta_y = g->cell / fabs(dy);
+    }
+    EmbReal t = 0.0;
+    while (t < 1.0) {
+        EmbReal leave = (next_x < next_y) ? next_x : next_y;
+        leave = (leave < 1.0) ? leave : 1.0;
+        if ((column >= 0) && (column < g->columns)
+            && (row >= 0) && (row < g->rows)) {
+            /* A stitch with no length still makes its hole. */
+            EmbReal share = ((dx == 0.0) && (dy == 0.0)) ? 1.0 : leave - t;
+            g->cells[row*g->columns + column] += (float)share;
+        }
+        t = leave;
+        if (next_x < next_y) {
+            column += step_x;
+            next_x += delta_x;
+        }
+        else {
+            row += step_y;
+            next_y += delta_y;
+        }
+    }
+}
+
+/* Count the stitches of a run of count points into g. */
+void
+density_add_run(DensityGrid *g, const EmbVector *points, int count)
+{
+    if (count == 1) {
+        density_stitch(g, points[0], points[0]);
+    }
+    for (int i=1; i<count; i++) {
+        density_stitch(g, points[i-1], points[i]);
+    }
+}
+
+/* Find the densest cell of g, and the groups of cells, touching side to
+ * side, over limit stitches per square millimetre.
+ */
+void
+density_report(const DensityGrid *g, EmbReal limit, DensityReport *report)
+{
+    EmbReal area = g->cell * g->cell;
+    int n = g->columns * g->rows;
+    memset(report, 0, sizeof(DensityReport));
+    int peak = -1;
+    for (int i=0; i<n; i++) {
+        if ((peak < 0) || (g->cells[i] > g->cells[peak])) {
+            peak = i;
+        }
+    }
+    if (peak < 0) {
+        return;
+    }
+    report->peak = g->cells[peak] / area;
+    report->peak_at.x = g->origin.x + (peak % g->columns + 0.5) * g->cell;
+    report->peak_at.y = g->origin.y + (peak / g->columns + 0.5) * g->cell;
+
+    /* Flood fill each group from its first cell, marking cells as they
+     * are reached so each is visited once.
+     */
+    unsigned char *seen = (unsigned char*)calloc(n, 1);
+    int *stack = (int*)malloc(n * sizeof(int));
+    if (!seen || !stack) {
+        free(seen);
+        free(stack);
+        return;
+    }
+    float over = (float)(limit * area);
+    for (int i=0; i<n; i++) {
+        if (seen[i] || (g->cells[i] <= over)) {
+            continue;
+        }
+        report->regions++;
+        int top = 0;
+        stack[top++] = i;
+        seen[i] = 1;
+        while (top > 0) {
+            int c = stack[--top];
+            int column = c % g->columns;
+            int next[4] = {
+                (column > 0) ? c - 1 : -1,
+                (column < g->columns - 1) ? c + 1 : -1,
+                c - g->columns,
+                c + g->columns
+            };
+            report->area += area;
+            for (int k=0; k<4; k++) {
+                int m = next[k];
+                if ((m >= 0) && (m < n) && !seen[m] && (g->cells[m] > over)) {
+                    seen[m] = 1;
+                    stack[top++] = m;
+                }
+            }
+        }
+    }
+    free(seen);
+    free(stack);
+}
+
+/* Count the stitches of pattern into a grid of cell mm cells and report
+ * on it as density_report() does. Jumps, trims and stops aren't sewn so
+ * they count for nothing. Returns 0 if out of memory.
+ */
+int
+density_pattern(EmbPattern *pattern, EmbReal cell, EmbReal limit,
+    DensityReport *report)
+{
+    memset(report, 0, sizeof(DensityReport));
+    int count = pattern->stitch_list->count;
+    if ((count == 0) || (cell <= 0.0)) {
+        return 1;
+    }
+    EmbStitch *st = pattern->stitch_list->stitch;
+    EmbVector low = {st[0].x, st[0].y};
+    EmbVector high = low;
+    for (int i=1; i<count; i++) {
+        low.x = (st[i].x < low.x) ? st[i].x : low.x;
+        low.y = (st[i].y < low.y) ? st[i].y : low.y;
+        high.x = (st[i].x > high.x) ? st[i].x : high.x;
+        high.y = (st[i].y > high.y) ? st[i].y : high.y;
+    }
+
+    DensityGrid g;
+    g.cell = cell;
+    g.origin = low;
+    g.columns = (int)floor((high.x - low.x) / cell) + 1;
+    g.rows = (int)floor((high.y - low.y) / cell) + 1;
+    g.cells = (float*)calloc((size_t)g.columns * g.rows, sizeof(float));
+    if (!g.cells) {
+        return 0;
+    }
+    for (int i=1; i<count; i++) {
+        if (st[i].flags == NORMAL) {
+            EmbVector seg[2] = {{st[i-1].x, st[i-1].y}, {st[i].x, st[i].y}};
+            density_add_run(&g, seg, 2);
+        }
+    }
+    density_report(&g, limit, report);
+    free(g.cells);
+    return 1;
+}
+
+/* Place n fields of size side along [low, high], as few as will cover it
+ * with at least overlap between neighbours, spread evenly. The start of
+ * each field goes in starts. Returns n, or 0 if the fields can't overlap
+ * by that much.
+ */
+static int
+hoop_axis(EmbReal low, EmbReal high, EmbReal side, EmbReal overlap,
+    EmbReal *starts, int max)
+{
+    EmbReal length = high - low;
+    if (length <= side) {
+        if (max >= 1) {
+            starts[0] = low - 0.5*(side - length);
+        }
+        return 1;
+    }
+    if (side <= overlap) {
+        return 0;
+    }
+    int n = (int)ceil((length - overlap) / (side - overlap));
+    n = (n < 2) ? 2 : n;
+    for (int i=0; (i<n) && (i<max); i++) {
+        starts[i] = low + i * (length - side) / (n - 1);
+    }
+    return n;
+}
+
+/* The bounds of every stitch of pattern. Returns 0 if it has none. */
+static int
+pattern_bounds(EmbPattern *pattern, EmbRect *bounds)
+{
+    EmbStitch *st = pattern->stitch_list->stitch;
+    int found = 0;
+    for (int i=0; i<pattern->stitch_list->count; i++) {
+        if (st[i].flags & END) {
+            continue;
+        }
+        if (!found) {
+            bounds->left = bounds->right = st[i].x;
+            bounds->top = bounds->bottom = st[i].y;
+            found = 1;
+        }
+        bounds->left = (st[i].x < bounds->left) ? st[i].x : bounds->left;
+        bounds->top = (st[i].y < bounds->top) ? st[i].y : bounds->top;
+        bounds->right = (st[i].x > bounds->right) ? st[i].x : bounds->right;
+        bounds->bottom = (st[i].y > bounds->bottom) ? st[i].y : bounds->bottom;
+    }
+    return found;
+}
+
+/* Clip the segment a to b to rect, as the fractions t0 to t1 of the way
+ * along it that lie inside (Liang-Barsky). Returns 0 if none of it does.
+ */
+static int
+clip_segment(EmbVector a, EmbVector b, EmbRect rect, EmbReal *t0,
+    EmbReal *t1)
+{
+    EmbReal d[2] = {b.x - a.x, b.y - a.y};
+    EmbReal p[4] = {-d[0], d[0], -d[1], d[1]};
+    EmbReal q[4] = {a.x - rect.left, rect.right - a.x, a.y - rect.top,
+        rect.bottom - a.y};
+    *t0 = 0.0;
+    *t1 = 1.0;
+    for (int i=0; i<4; i++) {
+        if (p[i] == 0.0) {
+            if (q[i] < 0.0) {
+                return 0;
+            }
+            continue;
+        }
+        EmbReal t = q[i] / p[i];
+        if (p[i] < 0.0) {
+            *t0 = (t > *t0) ? t : *t0;
+        }
+        else {
+            *t1 = (t < *t1) ? t : *t1;
+        }
+    }
+    return *t0 <= *t1;
+}
+
+/* Whether some of the stitch a to b lies inside rect, as for
+ * clip_segment(). A stitch that only touches the edge of rect doesn't
+ * count, unless it is a single point.
+ */
+static int
+clip_stitch(EmbVector a, EmbVector b, EmbRect rect, EmbReal *t0,
+    EmbReal *t1)
+{
+    if (!clip_segment(a, b, rect, t0, t1)) {
+        return 0;
+    }
+    return (*t0 < *t1) || ((a.x == b.x) && (a.y == b.y));
+}
+
+/* Lay out the fewest hoops of width by height mm, turned whichever way
+ * takes fewer, that cover pattern with at least overlap mm between
+ * neighbours, and drop any with nothing to sew.
+ *
+ * Each hoop sews the part of the design up to the middle of each
+ * overlap, its cut, and the overlap holds the registration marks. A
+ * hoop's stitches are those that reach inside its cut, just as
+ * hoop_pattern() clips them.
+ *
+ * Returns HOOP_OK, or HOOP_NO_OVERLAP if the hoops can't overlap by that
+ * much, HOOP_TOO_MANY if it takes more than HOOP_MAX_SIDE of them either
+ * way, or HOOP_NO_MEMORY.
+ */
+int
+hoop_plan(HoopPlan *plan, EmbPattern *pattern, EmbReal width,
+    EmbReal height, EmbReal overlap)
+{
+    memset(plan, 0, sizeof(HoopPlan));
+    plan->overlap = overlap;
+    EmbRect bounds;
+    if (!pattern_bounds(pattern, &bounds)) {
+        return HOOP_OK;
+    }
+
+    EmbReal xs[HOOP_MAX_SIDE];
+    EmbReal ys[HOOP_MAX_SIDE];
+    int columns = hoop_axis(bounds.left, bounds.right, width, overlap, xs,
+        HOOP_MAX_SIDE);
+    int rows = hoop_axis(bounds.top, bounds.bottom, height, overlap, ys,
+        HOOP_MAX_SIDE);
+    int turned_columns = hoop_axis(bounds.left, bounds.right, height,
+        overlap, xs, HOOP_MAX_SIDE);
+    int turned_rows = hoop_axis(bounds.top, bounds.bottom, width, overlap,
+        ys, HOOP_MAX_SIDE);
+    if (turned_columns && turned_rows
+        && (!columns || !rows || (turned_columns*turned_rows < columns*rows))) {
+        EmbReal side = width;
+        width = height;
+        height = side;
+        columns = turned_columns;
+        rows = turned_rows;
+    }
+    if (!columns || !rows) {
+        return HOOP_NO_OVERLAP;
+    }
+    if ((columns > HOOP_MAX_SIDE) || (rows > HOOP_MAX_SIDE)) {
+        return HOOP_TOO_MANY;
+    }
+    hoop_axis(bounds.left, bounds.right, width, overlap, xs, HOOP_MAX_SIDE);
+    hoop_axis(bounds.top, bounds.bottom, height, overlap, ys, HOOP_MAX_SIDE);
+
+    plan->tiles = (HoopTile*)malloc(columns * rows * sizeof(HoopTile));
+    if (!plan->tiles) {
+        return HOOP_NO_MEMORY;
+    }
+    plan->columns = columns;
+    plan->rows = rows;
+    plan->width = width;
+    plan->height = height;
+    for (int r=0; r<rows; r++) {
+        for (int c=0; c<columns; c++) {
+            HoopTile *t = &plan->tiles[r*columns + c];
+            t->column = c;
+            t->row = r;
+            t->stitches = 0;
+            t->field.left = xs[c];
+            t->field.top = ys[r];
+            t->field.right = xs[c] + width;
+            t->field.bottom = ys[r] + height;
+            t->cut.left = (c > 0) ? 0.5*(xs[c] + xs[c-1] + width) : t->field.left;
+            t->cut.right = (c < columns-1) ? 0.5*(xs[c+1] + xs[c] + width) : t->field.right;
+            t->cut.top = (r > 0) ? 0.5*(ys[r] + ys[r-1] + height) : t->field.top;
+            t->cut.bottom = (r < rows-1) ? 0.5*(ys[r+1] + ys[r] + height) : t->field.bottom;
+        }
+    }
+
+    /* Count the stitches each hoop sews, to leave out those that sew
+     * nothing. Only the columns and rows whose cuts the stitch's box
+     * reaches need clipping against.
+     */
+    EmbStitch *st = pattern->stitch_list->stitch;
+    for (int i=1; i<pattern->stitch_list->count; i++) {
+        if (st[i].flags != NORMAL) {
+            continue;
+        }
+        EmbVector a = {st[i-1].x, st[i-1].y};
+        EmbVector b = {st[i].x, st[i].y};
+        EmbReal lx = (a.x < b.x) ? a.x : b.x;
+        EmbReal hx = (a.x < b.x) ? b.x : a.x;
+        EmbReal ly = (a.y < b.y) ? a.y : b.y;
+        EmbReal hy = (a.y < b.y) ? b.y : a.y;
+        for (int r=0; r<rows; r++) {
+            EmbRect row = plan->tiles[r*columns].cut;
+            if ((hy < row.top) || (ly > row.bottom)) {
+                continue;
+            }
+            for (int c=0; c<columns; c++) {
+                HoopTile *t = &plan->tiles[r*columns + c];
+                EmbReal t0, t1;
+                if ((hx >= t->cut.left) && (lx <= t->cut.right)
+                    && clip_stitch(a, b, t->cut, &t0, &t1)) {
+                    t->stitches++;
+                }
+            }
+        }
+    }
+    for (int k=0; k<columns*rows; k++) {
+        if (plan->tiles[k].stitches > 0) {
+            plan->tiles[plan->count++] = plan->tiles[k];
+        }
+    }
+    return HOOP_OK;
+}
+
+/* Whether the hoop at column, row is in plan. */
+static int
+hoop_kept(const HoopPlan *plan, int column, int row)
+{
+    for (int i=0; i<plan->count; i++) {
+        if ((plan->tiles[i].column == column) && (plan->tiles[i].row == row)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Sew a cross of arm size centred on (x, y), on its own. */
+static void
+hoop_mark(EmbPattern *to, EmbReal x, EmbReal y, EmbReal size)
+{
+    embPattern_addStitchAbs(to, x - size, y, JUMP, 1);
+    embPattern_addStitchAbs(to, x + size, y, NORMAL, 1);
+    embPattern_addStitchAbs(to, x, y, NORMAL, 1);
+    embPattern_addStitchAbs(to, x, y - size, NORMAL, 1);
+    embPattern_addStitchAbs(to, x, y + size, NORMAL, 1);
+    embPattern_addStitchAbs(to, x, y + size, TRIM, 1);
+}
+
+/* Write the stitches hoop number index of plan sews into to.
+ *
+ * Registration crosses come first, in the middle of the overlap with
+ * each neighbouring hoop: the neighbours sew them in the same place, so
+ * once hooped they show how to line the design up. A stop follows so
+ * the hoop can be checked before the design is sewn.
+ *
+ * Then every stitch of from is clipped to the hoop's cut. Where the
+ * design leaves the cut the thread is trimmed and the needle jumps to
+ * where it comes back, and colours change only where this hoop sews
+ * the new colour. Returns the number of stitches written.
+ */
+int
+hoop_pattern(const HoopPlan *plan, int index, EmbPattern *from,
+    EmbPattern *to)
+{
+    const HoopTile *tile = &plan->tiles[index];
+    EmbRect cut = tile->cut;
+    EmbReal size = 0.5 * plan->overlap;
+    size = (size < HOOP_MARK_SIZE) ? size : HOOP_MARK_SIZE;
+    EmbReal x[2], y[2];
+    for (int k=0; k<2; k++) {
+        x[k] = cut.left + (0.25 + 0.5*k) * (cut.right - cut.left);
+        y[k] = cut.top + (0.25 + 0.5*k) * (cut.bottom - cut.top);
+    }
+    EmbVector at = {0.0, 0.0};
+    EmbVector marks[8];
+    int n_marks = 0;
+    for (int k=0; k<2; k++) {
+        if (hoop_kept(plan, tile->column - 1, tile->row)) {
+            marks[n_marks].x = cut.left;
+            marks[n_marks++].y = y[k];
+        }
+        if (hoop_kept(plan, tile->column + 1, tile->row)) {
+            marks[n_marks].x = cut.right;
+            marks[n_marks++].y = y[k];
+        }
+        if (hoop_kept(plan, tile->column, tile->row - 1)) {
+            marks[n_marks].x = x[k];
+            marks[n_marks++].y = cut.top;
+        }
+        if (hoop_kept(plan, tile->column, tile->row + 1)) {
+            marks[n_marks].x = x[k];
+            marks[n_marks++].y = cut.bottom;
+        }
+    }
+    if (size <= 0.0) {
+        n_marks = 0;
+    }
+    if (n_marks > 0) {
+        EmbThread thread;
+        memset(&thread, 0, sizeof(EmbThread));
+        if (from->thread_list->count > 0) {
+            thread = from->thread_list->thread[0];
+        }
+        embPattern_addThread(to, thread);
+        for (int k=0; k<n_marks; k++) {
+            hoop_mark(to, marks[k].x, marks[k].y, size);
+        }
+        at.x = marks[n_marks-1].x;
+        at.y = marks[n_marks-1].y + size;
+    }
+
+    EmbStitch *st = from->stitch_list->stitch;
+    int threads = from->thread_list->count;
+    int color = 0;
+    int sewing = -1;
+    int written = 0;
+    int trim = 0;
+    for (int i=1; i<from->stitch_list->count; i++) {
+        if (st[i].flags & STOP) {
+            color++;
+        }
+        if (st[i].flags & TRIM) {
+            trim = 1;
+        }
+        if (st[i].flags != NORMAL) {
+            continue;
+        }
+        EmbVector a = {st[i-1].x, st[i-1].y};
+        EmbVector b = {st[i].x, st[i].y};
+        EmbReal t0, t1;
+        if (!clip_stitch(a, b, cut, &t0, &t1)) {
+            trim = 1;
+            continue;
+        }
+        EmbVector p = {a.x + t0*(b.x - a.x), a.y + t0*(b.y - a.y)};
+        EmbVector q = {a.x + t1*(b.x - a.x), a.y + t1*(b.y - a.y)};
+
+        if (color != sewing) {
+            if ((sewing >= 0) || (n_marks > 0)) {
+                embPattern_addStitchAbs(to, at.x, at.y, STOP, 1);
+            }
+            if (color < threads) {
+                embPattern_addThread(to, from->thread_list->thread[color]);
+            }
+            sewing = color;
+        }
+        if ((written == 0) || (p.x != at.x) || (p.y != at.y)) {
+            if (trim && (written > 0)) {
+                embPattern_addStitchAbs(to, at.x, at.y, TRIM, 1);
+            }
+            embPattern_addStitchAbs(to, p.x, p.y, JUMP, 1);
+        }
+        trim = (t1 < 1.0);
+        embPattern_addStitchAbs(to, q.x, q.y, NORMAL, 1);
+        at = q;
+        written++;
+    }
+    embPattern_addStitchAbs(to, at.x, at.y, END, 1);
+    return written;
+}
+
+/* What a status from hoop_plan() means, for the user. */
+const char *
+hoop_message(int status)
+{
+    switch (status) {
+    case HOOP_OK:
+        return "";
+    case HOOP_NO_OVERLAP:
+        return "The hoops can't overlap by more than their size.";
+    case HOOP_TOO_MANY:
+        return "The design needs too many hoops: try a larger hoop.";
+    default:
+        return "Could not allocate memory for the hoops.";
+    }
+}
+
+/* Free the hoops of plan. */
+void
+hoop_free(HoopPlan *plan)
+{
+    free(plan->tiles);
+    plan->tiles = NULL;
+    plan->count = 0;
+}
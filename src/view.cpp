@@ -19,6 +19,8 @@
 
 #include <QtOpenGL>
 
+#include <algorithm>
+
 extern "C" {
 EmbVector embVector_make(EmbReal x, EmbReal y);
 }
@@ -148,6 +150,13 @@ View::View(QGraphicsScene* theScene, QWidget* parent) : QGraphicsView(theScene,
     undoStack = new QUndoStack(this);
     dockUndoEdit->addStack(undoStack);
 
+    /* The budget setting is in KiB. */
+    tombstones.setBudget(1024 * (int64_t)settings[ST_UNDO_MEMORY_BUDGET].i);
+
+    navigator.attach(this);
+    simulation.attach(this);
+    density.attach(this);
+
     installEventFilter(this);
 
     setMouseTracking(true);
@@ -190,10 +199,6 @@ View::View(QGraphicsScene* theScene, QWidget* parent) : QGraphicsView(theScene,
 
 View::~View()
 {
-    //Prevent memory leaks by deleting any objects that were removed from the scene
-    qDeleteAll(hashDeletedObjects.begin(), hashDeletedObjects.end());
-    hashDeletedObjects.clear();
-
     //Prevent memory leaks by deleting any unused instances
     qDeleteAll(previewObjectList.begin(), previewObjectList.end());
     previewObjectList.clear();
@@ -213,17 +218,1145 @@ View::addObject(Geometry* obj)
 {
     gscene->addItem(obj);
     gscene->update();
-    hashDeletedObjects.remove(obj->objID);
 }
 
+/* Remove the object from the scene and pack it into the tombstone store.
+ *
+ * NOTE: obj is freed by this call, anything that needs it again has to go
+ * through restoreObject with the objID.
+ */
 void
 View::deleteObject(Geometry* obj)
 {
-    //NOTE: We really just remove the objects from the scene. deletion actually occurs in the destructor.
+    if (gripBaseObj == obj) {
+        grippingActive = false;
+        gripBaseObj = 0;
+    }
+    if (tempBaseObj == obj) {
+        tempBaseObj = 0;
+    }
+    rubberRoomList.erase(std::remove(rubberRoomList.begin(),
+        rubberRoomList.end(), (QGraphicsItem*)obj), rubberRoomList.end());
     obj->setSelected(false);
     gscene->removeItem(obj);
     gscene->update();
-    hashDeletedObjects.insert(obj->objID, obj);
+    tombstones.bury(obj);
+}
+
+/* Rebuild a deleted object from its tombstone and return it to the scene. */
+Geometry*
+View::restoreObject(int64_t id)
+{
+    Geometry* obj = tombstones.exhume(id);
+    if (!obj) {
+        debug_message("ERROR: no tombstone for object %lld.", (long long)id);
+        return NULL;
+    }
+    addObject(obj);
+    return obj;
+}
+
+/* Find the live object with the given id, NULL if it isn't in the scene. */
+Geometry*
+View::objectFromId(int64_t id)
+{
+    return objects.find(id);
+}
+
+/* Record the current scene bounding box of obj. Objects still being
+ * drawn or gripped aren't part of the design yet.
+ */
+void
+View::trackExtents(Geometry* obj)
+{
+    if (obj->objRubberMode != RUBBER_OFF) {
+        forgetExtents(obj);
+        return;
+    }
+    QRectF r = obj->sceneBoundingRect();
+    sceneExtents.insert(obj, r);
+    if (obj->isSelected()) {
+        selectionExtents.insert(obj, r);
+    }
+    else {
+        selectionExtents.remove(obj);
+    }
+}
+
+/* Stop counting obj towards the extents. */
+void
+View::forgetExtents(Geometry* obj)
+{
+    sceneExtents.remove(obj);
+    selectionExtents.remove(obj);
+}
+
+/* Whether the whole design fits inside a hoop of the given size. */
+bool
+View::fitsHoop(EmbReal width, EmbReal height)
+{
+    QRectF extents = sceneExtents.extents();
+    return (extents.width() <= width) && (extents.height() <= height);
+}
+
+/* Change the colour of every object in the scene to the nearest thread
+ * in catalog, as one step on the undo stack. Designs reuse a handful of
+ * colours across many objects, so each distinct colour is only looked up
+ * once. Returns the number of objects whose colour changed.
+ */
+int
+View::matchThreads(const ThreadCatalog& catalog)
+{
+    QHash<QRgb, QRgb> matched;
+    std::vector<Geometry*> objects;
+    QList<QGraphicsItem*> list = gscene->items(Qt::AscendingOrder);
+    for (QGraphicsItem* item : list) {
+        if (item->data(OBJ_TYPE).toInt() <= OBJ_TYPE_BASE) {
+            continue;
+        }
+        Geometry* obj = static_cast<Geometry*>(item);
+        if (obj->objRubberMode != RUBBER_OFF) {
+            continue;
+        }
+        QRgb rgb = obj->objPen.color().rgb();
+        if (!matched.contains(rgb)) {
+            int thread = catalog.nearest(rgb);
+            matched.insert(rgb, (thread < 0) ? rgb : catalog.colors[thread]);
+        }
+        if (matched.value(rgb) != rgb) {
+            objects.push_back(obj);
+        }
+    }
+    if (objects.empty()) {
+        return 0;
+    }
+
+    undoStack->beginMacro(translate_str("Match threads to ") + catalog.name);
+    for (Geometry* obj : objects) {
+        QString text = translate_str("Recolor 1 ") + obj->typeName();
+        UndoableCommand* cmd = new UndoableCommand("recolor", text, obj, this, 0);
+        cmd->fromColor = obj->objPen.color().rgb();
+        cmd->toColor = matched.value(cmd->fromColor);
+        undoStack->push(cmd);
+    }
+    undoStack->endMacro();
+    return (int)objects.size();
+}
+
+/* The selected objects that enclose an area, from the bottom up, with
+ * each one's outline added to outlines.
+ */
+static std::vector<Geometry*>
+selected_outlines(QGraphicsScene* gscene, std::vector<PolygonSet>& outlines)
+{
+    std::vector<Geometry*> objects;
+    QList<QGraphicsItem*> list = gscene->items(Qt::AscendingOrder);
+    for (QGraphicsItem* item : list) {
+        if (!item->isSelected() || (item->data(OBJ_TYPE).toInt() <= OBJ_TYPE_BASE)) {
+            continue;
+        }
+        Geometry* obj = static_cast<Geometry*>(item);
+        PolygonSet outline;
+        memset(&outline, 0, sizeof(PolygonSet));
+        if (!object_polygons(obj, &outline) || !outline.rings) {
+            polygon_free(&outline);
+            continue;
+        }
+        objects.push_back(obj);
+        outlines.push_back(outline);
+    }
+    return objects;
+}
+
+/* Add a path object with the rings of set, in the colour of like. */
+static void
+add_outline(View* view, const PolygonSet* set, Geometry* like)
+{
+    Geometry* obj = new Geometry(OBJ_TYPE_PATH);
+    obj->normalPath = polygon_path(set);
+    obj->updatePath();
+    obj->setObjectColor(like->objPen.color().rgb());
+    view->undoStack->push(new UndoableCommand("add", obj->typeName(), obj, view));
+}
+
+/* Replace the selected closed objects with one path: their union or
+ * intersection, or for CLIP_DIFFERENCE the lowest of them less the rest.
+ * This is one step on the undo stack. Returns the number of rings in
+ * the result, which is 0 when nothing is left and the objects are kept,
+ * -1 when fewer than two closed objects are selected, or -2 when the
+ * clipping failed and the objects are kept.
+ */
+int
+View::combineSelected(int op)
+{
+    std::vector<PolygonSet> outlines;
+    std::vector<Geometry*> objects = selected_outlines(gscene, outlines);
+    if (objects.size() < 2) {
+        for (PolygonSet& outline : outlines) {
+            polygon_free(&outline);
+        }
+        return -1;
+    }
+
+    PolygonSet result;
+    memset(&result, 0, sizeof(PolygonSet));
+    bool ok = true;
+    if (op == CLIP_INTERSECTION) {
+        ok = polygon_boolean(&outlines[0], CLIP_NONZERO, NULL, CLIP_NONZERO,
+            CLIP_UNION, &result);
+        for (size_t i=1; ok && (i<outlines.size()); i++) {
+            PolygonSet both;
+            memset(&both, 0, sizeof(PolygonSet));
+            ok = polygon_boolean(&result, CLIP_NONZERO, &outlines[i],
+                CLIP_NONZERO, CLIP_INTERSECTION, &both);
+            polygon_free(&result);
+            result = both;
+        }
+    }
+    else {
+        /* The outlines are tidied, so overlaying the rest of them and
+         * counting nonzero windings gives their union.
+         */
+        PolygonSet rest;
+        memset(&rest, 0, sizeof(PolygonSet));
+        size_t first = (op == CLIP_DIFFERENCE) ? 1 : 0;
+        for (size_t i=first; ok && (i<outlines.size()); i++) {
+            const PolygonSet& outline = outlines[i];
+            int start = 0;
+            for (int r=0; ok && (r<outline.rings); r++) {
+                for (int j=start; ok && (j<outline.ring_ends[r]); j++) {
+                    ok = polygon_add_point(&rest, outline.points[j]);
+                }
+                ok = ok && polygon_close_ring(&rest);
+                start = outline.ring_ends[r];
+            }
+        }
+        if (ok && (op == CLIP_DIFFERENCE)) {
+            ok = polygon_boolean(&outlines[0], CLIP_NONZERO, &rest,
+                CLIP_NONZERO, CLIP_DIFFERENCE, &result);
+        }
+        else if (ok) {
+            ok = polygon_boolean(&rest, CLIP_NONZERO, NULL, CLIP_NONZERO,
+                CLIP_UNION, &result);
+        }
+        polygon_free(&rest);
+    }
+    for (PolygonSet& outline : outlines) {
+        polygon_free(&outline);
+    }
+
+    if (!ok) {
+        polygon_free(&result);
+        return -2;
+    }
+    int rings = result.rings;
+    if (rings) {
+        const char *names[] = {"Union", "Intersection", "Difference"};
+        undoStack->beginMacro(translate_str(names[op]));
+        add_outline(this, &result, objects[0]);
+        for (Geometry* obj : objects) {
+            undoStack->push(new UndoableCommand("delete",
+                translate_str("Delete 1 ") + obj->typeName(), obj, this));
+        }
+        undoStack->endMacro();
+    }
+    polygon_free(&result);
+    return rings;
+}
+
+/* Add a path around each selected closed object at distance outside
+ * it, or inside it for a negative distance, as one step on the undo
+ * stack. Returns the number of paths added.
+ */
+int
+View::offsetSelected(EmbReal distance)
+{
+    std::vector<PolygonSet> outlines;
+    std::vector<Geometry*> objects = selected_outlines(gscene, outlines);
+    std::vector<PolygonSet> results(objects.size());
+    int made = 0;
+    for (size_t i=0; i<objects.size(); i++) {
+        if (polygon_offset(&outlines[i], CLIP_NONZERO, distance, &results[i])
+            && results[i].rings) {
+            made++;
+        }
+        polygon_free(&outlines[i]);
+    }
+
+    if (made) {
+        undoStack->beginMacro(translate_str("Offset"));
+        for (size_t i=0; i<objects.size(); i++) {
+            if (results[i].rings) {
+                add_outline(this, &results[i], objects[i]);
+            }
+        }
+        undoStack->endMacro();
+    }
+    for (PolygonSet& result : results) {
+        polygon_free(&result);
+    }
+    return made;
+}
+
+/* Drop one copy of value from an edge set. A NaN coordinate never
+ * compares equal, so find can come back empty.
+ */
+static void
+erase_one(std::multiset<qreal>& edges, qreal value)
+{
+    std::multiset<qreal>::iterator it = edges.find(value);
+    if (it != edges.end()) {
+        edges.erase(it);
+    }
+}
+
+/* Add or replace the rectangle stored for key. */
+void
+ExtentsIndex::insert(const void* key, const QRectF& rect)
+{
+    remove(key);
+    rects.insert(key, rect);
+    left.insert(rect.left());
+    top.insert(rect.top());
+    right.insert(rect.right());
+    bottom.insert(rect.bottom());
+}
+
+/* Remove the rectangle stored for key, if any. */
+void
+ExtentsIndex::remove(const void* key)
+{
+    if (!rects.contains(key)) {
+        return;
+    }
+    QRectF rect = rects.take(key);
+    erase_one(left, rect.left());
+    erase_one(top, rect.top());
+    erase_one(right, rect.right());
+    erase_one(bottom, rect.bottom());
+}
+
+/* . */
+void
+ExtentsIndex::clear()
+{
+    rects.clear();
+    left.clear();
+    top.clear();
+    right.clear();
+    bottom.clear();
+}
+
+/* The bounding box of every rectangle in the index, a null rectangle if
+ * the index is empty.
+ */
+QRectF
+ExtentsIndex::extents()
+{
+    if (rects.isEmpty()) {
+        return QRectF();
+    }
+    return QRectF(QPointF(*left.begin(), *top.begin()),
+        QPointF(*right.rbegin(), *bottom.rbegin()));
+}
+
+/* Register obj, giving it a fresh id if it doesn't have one yet or if
+ * its id already belongs to another object. An object coming back with an
+ * id from elsewhere moves the counter past it so it can't be issued twice.
+ */
+int64_t
+ObjectTable::insert(Geometry* obj)
+{
+    Geometry* owner = find(obj->objID);
+    if ((obj->objID <= 0) || (owner && (owner != obj))) {
+        obj->objID = next++;
+    }
+    else if (obj->objID >= next) {
+        next = obj->objID + 1;
+    }
+    objects.insert(obj->objID, obj);
+    return obj->objID;
+}
+
+/* Drop obj from the table. Its id is not reused. */
+void
+ObjectTable::remove(Geometry* obj)
+{
+    if (find(obj->objID) == obj) {
+        objects.remove(obj->objID);
+    }
+}
+
+/* . */
+void
+ObjectTable::clear()
+{
+    objects.clear();
+}
+
+/* Hook the navigator up to its view. */
+void
+ViewNavigator::attach(View* v)
+{
+    view = v;
+    timer.setInterval(ZOOM_FRAME_MSEC);
+    timer.setTimerType(Qt::PreciseTimer);
+    QObject::connect(&timer, &QTimer::timeout, v, [this](void) { step(); });
+}
+
+/* The scale the view is at, or is heading for while a zoom is animating. */
+EmbReal
+ViewNavigator::scale()
+{
+    if (animating()) {
+        return targetScale;
+    }
+    return sqrt(fabs(view->transform().determinant()));
+}
+
+/* The scale at which the view shows ZOOM_OUT_LIMIT across. */
+EmbReal
+ViewNavigator::minScale()
+{
+    return std::max(view->width(), view->height()) / ZOOM_OUT_LIMIT;
+}
+
+/* The scale at which the view shows ZOOM_IN_LIMIT across. */
+EmbReal
+ViewNavigator::maxScale()
+{
+    return std::max(std::min(view->width(), view->height()), 1) / ZOOM_IN_LIMIT;
+}
+
+/* Zoom by factor so that scenePoint stays under viewPoint. A zoom that
+ * arrives mid-animation compounds with the one in flight.
+ *
+ * The zoom places the view itself, so Qt's own anchoring is switched off
+ * for its duration to save a scroll per transform, and put back by end().
+ */
+void
+ViewNavigator::zoomAbout(const QPointF& scenePoint, const QPoint& viewPoint, EmbReal factor)
+{
+    QTransform t = view->transform();
+    EmbReal current = sqrt(fabs(t.determinant()));
+    if (!animating()) {
+        frames = settings[ST_ZOOM_ANIMATION_FRAMES].i;
+        targetScale = current;
+        savedAnchor = view->transformationAnchor();
+        view->setTransformationAnchor(QGraphicsView::NoAnchor);
+    }
+    targetScale = std::clamp(targetScale * factor, minScale(), maxScale());
+    startScale = current;
+    anchorScene = scenePoint;
+    anchorView = viewPoint;
+
+    if ((frames <= 1) || !view->isVisible()) {
+        timer.stop();
+        applyScale(targetScale);
+        end();
+        return;
+    }
+    clock.start();
+    timer.start();
+}
+
+/* Make sure the scene rect leaves a screen's worth of room around the
+ * visible area, otherwise you cannot pan or zoom past its edges.
+ *
+ * When it has to grow it doubles, so repeated zooming out costs a
+ * logarithmic number of scene index rebuilds rather than one per step.
+ */
+void
+ViewNavigator::growSceneRect(const QRectF& visible)
+{
+    QGraphicsScene* gscene = view->scene();
+    QRectF needed = visible.adjusted(-visible.width(), -visible.height(),
+        visible.width(), visible.height());
+    QRectF current = gscene->sceneRect();
+    if (current.contains(needed)) {
+        return;
+    }
+    QRectF grown = current.united(needed);
+    grown.adjust(-grown.width()/2, -grown.height()/2,
+        grown.width()/2, grown.height()/2);
+    gscene->setSceneRect(grown);
+}
+
+/* Jump to the end of any running animation. */
+void
+ViewNavigator::finish()
+{
+    if (!animating()) {
+        return;
+    }
+    timer.stop();
+    applyScale(targetScale);
+    end();
+}
+
+/* After the last step of a zoom: restore the view's anchor and let it
+ * catch up with the new scale.
+ */
+void
+ViewNavigator::end()
+{
+    view->setTransformationAnchor(savedAnchor);
+    view->zoomStepped(anchorView);
+}
+
+/* Set the view's scale to s, keeping the anchor point in place.
+ *
+ * The scene point that must sit at the viewport center follows from the
+ * new transform alone, so there is a single centerOn. centerOn rounds to
+ * whole scroll bar steps, the remainder is taken up on the scroll bars.
+ */
+void
+ViewNavigator::applyScale(EmbReal s)
+{
+    QTransform t = view->transform();
+    EmbReal k = s / sqrt(fabs(t.determinant()));
+    QTransform scaled(t.m11()*k, t.m12()*k, t.m21()*k, t.m22()*k, 0.0, 0.0);
+
+    QRectF viewport(view->viewport()->rect());
+    QPointF offset = scaled.inverted().map(viewport.center() - QPointF(anchorView));
+    QPointF center = anchorScene + offset;
+    QSizeF visible(viewport.width()/s, viewport.height()/s);
+    growSceneRect(QRectF(center - QPointF(visible.width()/2, visible.height()/2), visible));
+
+    view->setTransform(scaled);
+    view->centerOn(center);
+
+    QPoint error = view->mapFromScene(anchorScene) - anchorView;
+    if (error.x()) {
+        view->horizontalScrollBar()->setValue(view->horizontalScrollBar()->value() + error.x());
+    }
+    if (error.y()) {
+        view->verticalScrollBar()->setValue(view->verticalScrollBar()->value() + error.y());
+    }
+}
+
+/* One animation frame. Progress comes from the clock rather than a frame
+ * count, so the zoom always takes the same time and a slow frame is
+ * skipped over instead of slowing the animation down. The scale is
+ * interpolated geometrically with an ease out.
+ */
+void
+ViewNavigator::step()
+{
+    EmbReal t = clock.elapsed() / (EmbReal)(frames * ZOOM_FRAME_MSEC);
+    if (t >= 1.0) {
+        finish();
+        return;
+    }
+    t = 1.0 - (1.0 - t)*(1.0 - t);
+    applyScale(startScale * pow(targetScale/startScale, t));
+    view->zoomStepped(anchorView);
+}
+
+/* Hook the playback timer up to v. */
+void
+StitchSimulation::attach(View* v)
+{
+    view = v;
+    timer.setInterval(SIMULATE_FRAME_MSEC);
+    timer.setTimerType(Qt::PreciseTimer);
+    QObject::connect(&timer, &QTimer::timeout, v, [this](void) { step(); });
+}
+
+/* Build the stitches of the design and play them from the start at speed
+ * times the machine's own pace. Returns false if there is nothing to sew.
+ */
+bool
+StitchSimulation::start(EmbReal speed_)
+{
+    EmbPattern* pattern = embPattern_create();
+    if (!pattern) {
+        debug_message("Could not allocate memory for embroidery pattern");
+        return false;
+    }
+    build_stitches(view, pattern);
+
+    int n = pattern->stitch_list->count;
+    points.resize(n);
+    flags.resize(n);
+    colors.resize(n);
+    times.resize(n);
+    StitchEstimate estimate;
+    estimate_init(&estimate, settings[ST_STITCH_TIME].r,
+        settings[ST_NEEDLE_SPEED].r);
+    int thread = 0;
+    for (int i=0; i<n; i++) {
+        EmbStitch st = pattern->stitch_list->stitch[i];
+        points[i] = QPointF(st.x, -st.y);
+        flags[i] = st.flags;
+        if (thread < pattern->thread_list->count) {
+            EmbColor c = pattern->thread_list->thread[thread].color;
+            colors[i] = qRgb(c.r, c.g, c.b);
+        }
+        else {
+            colors[i] = qRgb(0, 0, 0);
+        }
+        if (st.flags & STOP) {
+            thread++;
+        }
+        estimate_stitch(&estimate, st.x, st.y, st.flags);
+        times[i] = estimate.seconds;
+    }
+    estimate_free(&estimate);
+    embPattern_free(pattern);
+    if (n == 0) {
+        return false;
+    }
+
+    speed = (speed_ > 0.0) ? speed_ : 1.0;
+    offset = 0.0;
+    shown = 0;
+    frame = QImage();
+    view->state |= VIEW_STATE_SIMULATE;
+    clock.start();
+    timer.start();
+    return true;
+}
+
+/* Stop playing and show the design again. */
+void
+StitchSimulation::stop()
+{
+    timer.stop();
+    view->state &= ~(uint64_t)VIEW_STATE_SIMULATE;
+    frame = QImage();
+    points.clear();
+    flags.clear();
+    colors.clear();
+    times.clear();
+    view->viewport()->update();
+}
+
+/* Seconds of machine time played so far. */
+EmbReal
+StitchSimulation::position()
+{
+    if (!playing()) {
+        return offset;
+    }
+    EmbReal t = offset + speed * clock.elapsed() / 1000.0;
+    return std::min(duration(), t);
+}
+
+/* Carry on playing from seconds into the run. */
+void
+StitchSimulation::seek(EmbReal seconds)
+{
+    offset = std::max((EmbReal)0.0, std::min(duration(), seconds));
+    clock.start();
+    if (!times.empty() && !playing()) {
+        timer.start();
+    }
+    step();
+}
+
+/* Bring the frame up to the stitch being sewn now. */
+void
+StitchSimulation::step()
+{
+    EmbReal now = position();
+    int upto = std::upper_bound(times.begin(), times.end(), now)
+        - times.begin();
+    if (upto >= (int)times.size()) {
+        upto = (int)times.size();
+        offset = duration();
+        timer.stop();
+    }
+    if (upto != shown) {
+        render(upto);
+        view->viewport()->update();
+    }
+}
+
+/* Draw stitches up to upto into the frame, going back to an empty frame
+ * first if the view has moved or upto is behind what is drawn.
+ */
+void
+StitchSimulation::render(int upto)
+{
+    QSize size = view->viewport()->size();
+    QTransform transform = view->viewportTransform();
+    if ((frame.size() != size) || (frameTransform != transform)
+        || (upto < shown)) {
+        frame = QImage(size, QImage::Format_ARGB32_Premultiplied);
+        frame.fill(Qt::transparent);
+        frameTransform = transform;
+        shown = 0;
+    }
+    if (upto <= shown) {
+        return;
+    }
+
+    QPainter painter(&frame);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setTransform(frameTransform);
+    QPen pen;
+    pen.setCosmetic(true);
+    std::vector<QLineF> lines;
+    QRgb color = colors[std::max(shown, 1) - 1];
+    for (int i=std::max(shown, 1); i<=upto; i++) {
+        bool sewn = (i < upto) && (flags[i] == NORMAL);
+        if ((i == upto) || (colors[i] != color)) {
+            pen.setColor(QColor(color));
+            painter.setPen(pen);
+            painter.drawLines(lines.data(), (int)lines.size());
+            lines.clear();
+            if (i < upto) {
+                color = colors[i];
+            }
+        }
+        if (sewn) {
+            lines.push_back(QLineF(points[i-1], points[i]));
+        }
+    }
+    shown = upto;
+}
+
+/* Cover the scene with the stitches sewn so far and mark the needle.
+ * The painter is in scene coordinates.
+ */
+void
+StitchSimulation::draw(QPainter* painter)
+{
+    if (times.empty()) {
+        return;
+    }
+    if (view->viewportTransform() != frameTransform) {
+        render(shown);
+    }
+    painter->save();
+    painter->resetTransform();
+    painter->fillRect(QRect(QPoint(0, 0), view->viewport()->size()),
+        view->backgroundBrush());
+    painter->drawImage(0, 0, frame);
+    if (shown > 0) {
+        QPoint needle = view->mapFromScene(points[shown-1]);
+        painter->setPen(QPen(QColor(view->crosshairColor)));
+        painter->drawEllipse(needle, 3, 3);
+    }
+    painter->restore();
+}
+
+/* Hook the refresh timer up to v. */
+void
+StitchDensity::attach(View* v)
+{
+    view = v;
+    timer.setSingleShot(true);
+    timer.setInterval(DENSITY_REFRESH_MSEC);
+    QObject::connect(&timer, &QTimer::timeout, v, [this](void) { refresh(); });
+}
+
+/* Plan and count the whole design and show the map over it. */
+void
+StitchDensity::start()
+{
+    cell = std::max((EmbReal)0.05, settings[ST_DENSITY_CELL].r);
+    limit = std::max((EmbReal)0.01, settings[ST_DENSITY_LIMIT].r);
+    objects.clear();
+    tiles.clear();
+    dirty.clear();
+    dirtyArea = QRectF();
+    running = true;
+    QList<QGraphicsItem*> list = view->scene()->items(Qt::AscendingOrder);
+    for (QGraphicsItem* item : list) {
+        if (item->data(OBJ_TYPE).toInt() > OBJ_TYPE_BASE) {
+            dirty.insert(static_cast<Geometry*>(item));
+        }
+    }
+    view->state |= VIEW_STATE_DENSITY;
+    refresh();
+}
+
+/* Hide the map and let go of everything counted. */
+void
+StitchDensity::stop()
+{
+    timer.stop();
+    running = false;
+    view->state &= ~(uint64_t)VIEW_STATE_DENSITY;
+    objects.clear();
+    tiles.clear();
+    dirty.clear();
+    dirtyArea = QRectF();
+    view->viewport()->update();
+}
+
+/* Plan obj again shortly, along with anything else changed by then. */
+void
+StitchDensity::changed(Geometry* obj)
+{
+    if (!running) {
+        return;
+    }
+    dirty.insert(obj);
+    timer.start();
+}
+
+/* Take obj's stitches off the map, as it is leaving the scene. */
+void
+StitchDensity::forget(Geometry* obj)
+{
+    if (!running) {
+        return;
+    }
+    dirty.remove(obj);
+    if (objects.contains(obj)) {
+        dirtyArea |= objects.take(obj).bounds;
+        timer.start();
+    }
+}
+
+/* Plan the objects that have changed and recount the tiles they cover,
+ * before and after.
+ */
+void
+StitchDensity::refresh()
+{
+    for (Geometry* obj : dirty) {
+        ObjectRuns& entry = objects[obj];
+        dirtyArea |= entry.bounds;
+        object_stitch_runs(view, obj, entry.runs);
+        entry.bounds = QRectF();
+        for (const std::vector<EmbVector>& run : entry.runs) {
+            for (EmbVector v : run) {
+                entry.bounds |= QRectF(v.x - cell, v.y - cell, 2*cell, 2*cell);
+            }
+        }
+        dirtyArea |= entry.bounds;
+    }
+    dirty.clear();
+    if (!dirtyArea.isEmpty()) {
+        recount(dirtyArea);
+        dirtyArea = QRectF();
+    }
+    view->viewport()->update();
+}
+
+/* The scene rectangle of the tile at x, y. */
+QRectF
+StitchDensity::tileRect(int x, int y)
+{
+    EmbReal side = DENSITY_TILE * cell;
+    return QRectF(x * side, y * side, side, side);
+}
+
+/* The colour of a cell at ratio times the limit: clear when empty, then
+ * blue through green to yellow up to the limit and red over it.
+ */
+static QRgb
+density_color(EmbReal ratio)
+{
+    if (ratio <= 0.0) {
+        return qRgba(0, 0, 0, 0);
+    }
+    if (ratio > 1.0) {
+        return qPremultiply(qRgba(255, 0, 0, 200));
+    }
+    int alpha = 60 + (int)(120 * ratio);
+    if (ratio < 0.5) {
+        int t = (int)(510 * ratio);
+        return qPremultiply(qRgba(0, t, 255 - t, alpha));
+    }
+    int t = (int)(510 * (ratio - 0.5));
+    return qPremultiply(qRgba(t, 255, 0, alpha));
+}
+
+/* Count every tile that meets area again from the stitches of the objects
+ * over it, sharing the tiles between the cores. Tiles left empty are
+ * dropped.
+ */
+void
+StitchDensity::recount(const QRectF& area)
+{
+    EmbReal side = DENSITY_TILE * cell;
+    int left = (int)floor(area.left() / side);
+    int top = (int)floor(area.top() / side);
+    int right = (int)floor(area.right() / side);
+    int bottom = (int)floor(area.bottom() / side);
+    std::vector<QPoint> keys;
+    for (int y=top; y<=bottom; y++) {
+        for (int x=left; x<=right; x++) {
+            keys.push_back(QPoint(x, y));
+        }
+    }
+
+    /* The tiles reach past area, so take the objects over any of them. */
+    QRectF covered = tileRect(left, top) | tileRect(right, bottom);
+    std::vector<const ObjectRuns*> sources;
+    for (auto it = objects.cbegin(); it != objects.cend(); ++it) {
+        if (it.value().bounds.intersects(covered)) {
+            sources.push_back(&it.value());
+        }
+    }
+
+    int n = (int)keys.size();
+    std::vector<Tile> counted(n);
+    parallel_for(n, [&](int i) {
+        QRectF rect = tileRect(keys[i].x(), keys[i].y());
+        Tile& tile = counted[i];
+        tile.cells.assign(DENSITY_TILE * DENSITY_TILE, 0.0f);
+        DensityGrid g;
+        g.cells = tile.cells.data();
+        g.columns = DENSITY_TILE;
+        g.rows = DENSITY_TILE;
+        g.origin.x = rect.left();
+        g.origin.y = rect.top();
+        g.cell = cell;
+        bool empty = true;
+        for (const ObjectRuns* source : sources) {
+            if (!source->bounds.intersects(rect)) {
+                continue;
+            }
+            for (const std::vector<EmbVector>& run : source->runs) {
+                density_add_run(&g, run.data(), (int)run.size());
+            }
+            empty = false;
+        }
+        if (empty) {
+            tile.cells.clear();
+            return;
+        }
+        tile.image = QImage(DENSITY_TILE, DENSITY_TILE,
+            QImage::Format_ARGB32_Premultiplied);
+        EmbReal scale = 1.0 / (cell * cell * limit);
+        for (int row=0; row<DENSITY_TILE; row++) {
+            QRgb* line = (QRgb*)tile.image.scanLine(row);
+            for (int column=0; column<DENSITY_TILE; column++) {
+                line[column] = density_color(
+                    tile.cells[row*DENSITY_TILE + column] * scale);
+            }
+        }
+    });
+
+    for (int i=0; i<n; i++) {
+        if (counted[i].cells.empty()) {
+            tiles.remove(keys[i]);
+        }
+        else {
+            tiles.insert(keys[i], std::move(counted[i]));
+        }
+    }
+}
+
+/* Lay the map over the parts of the scene being drawn. The painter is in
+ * scene coordinates.
+ */
+void
+StitchDensity::draw(QPainter* painter)
+{
+    QRectF exposed = view->mapToScene(view->viewport()->rect()).boundingRect();
+    for (auto it = tiles.cbegin(); it != tiles.cend(); ++it) {
+        QRectF rect = tileRect(it.key().x(), it.key().y());
+        if (rect.intersects(exposed)) {
+            painter->drawImage(rect, it.value().image);
+        }
+    }
+}
+
+/* Create an empty tombstone store with no budget. */
+TombstoneStore::TombstoneStore()
+{
+    budget = 0;
+    memoryUsed = 0;
+    diskUsed = 0;
+    restoreCount = 0;
+    spill = NULL;
+}
+
+/* Destroy the store, the spill file is removed with it. */
+TombstoneStore::~TombstoneStore()
+{
+    clear();
+}
+
+/* Set the number of bytes of records to keep in memory.
+ * A budget of zero or less keeps everything in memory.
+ */
+void
+TombstoneStore::setBudget(int64_t bytes)
+{
+    budget = bytes;
+    enforceBudget();
+}
+
+/* Pack obj into a record and free it. */
+void
+TombstoneStore::bury(Geometry* obj)
+{
+    Tombstone t;
+    t.blob = obj->serialize();
+    t.offset = -1;
+    t.size = t.blob.size();
+    int64_t id = obj->objID;
+    delete obj;
+
+    if (records.contains(id)) {
+        Tombstone old = records.take(id);
+        if (old.offset < 0) {
+            memoryUsed -= old.size;
+        }
+        else {
+            diskUsed -= old.size;
+        }
+    }
+    records.insert(id, t);
+    order.enqueue(id);
+    memoryUsed += t.size;
+    enforceBudget();
+    compact();
+}
+
+/* Rebuild the object with the given id, removing its record.
+ * Returns NULL if there is no such record.
+ */
+Geometry*
+TombstoneStore::exhume(int64_t id)
+{
+    if (!records.contains(id)) {
+        return NULL;
+    }
+    Tombstone t = records.take(id);
+    if (t.offset < 0) {
+        memoryUsed -= t.size;
+    }
+    else {
+        diskUsed -= t.size;
+        if (!spill || !spill->seek(t.offset)) {
+            debug_message("ERROR: failed to seek in the tombstone spill file.");
+            return NULL;
+        }
+        t.blob = spill->read(t.size);
+        if (t.blob.size() != t.size) {
+            debug_message("ERROR: short read from the tombstone spill file.");
+            return NULL;
+        }
+    }
+
+    /* Once every record is gone the spill file can start over. */
+    if (records.isEmpty()) {
+        order.clear();
+        if (spill) {
+            spill->resize(0);
+        }
+    }
+    compact();
+
+    restoreCount++;
+    return Geometry::deserialize(t.blob);
+}
+
+/* Drop every record. */
+void
+TombstoneStore::clear()
+{
+    records.clear();
+    order.clear();
+    memoryUsed = 0;
+    diskUsed = 0;
+    if (spill) {
+        delete spill;
+        spill = NULL;
+    }
+}
+
+/* Drop the ids in the queue whose records have been exhumed, buried
+ * again or spilled, once they outnumber the records in memory, and
+ * rewrite the spill file without the records read back from it once
+ * they take up more than half of it.
+ */
+void
+TombstoneStore::compact()
+{
+    if (order.size() > 2*(records.size() + TOMBSTONE_SLACK)) {
+        QSet<int64_t> queued;
+        QQueue<int64_t> kept;
+        while (!order.isEmpty()) {
+            int64_t id = order.dequeue();
+            if (records.contains(id) && (records[id].offset < 0)
+                && !queued.contains(id)) {
+                queued.insert(id);
+                kept.enqueue(id);
+            }
+        }
+        order = kept;
+    }
+
+    if (!spill || (spill->size() <= 2*diskUsed + TOMBSTONE_SPILL_SLACK)) {
+        return;
+    }
+    QTemporaryFile* packed = new QTemporaryFile(QDir::tempPath() + "/embroidermodder-XXXXXX.tomb");
+    if (!packed->open()) {
+        debug_message("ERROR: failed to open the tombstone spill file.");
+        delete packed;
+        return;
+    }
+    QHash<int64_t, int64_t> offsets;
+    for (auto it = records.cbegin(); it != records.cend(); ++it) {
+        const Tombstone& t = it.value();
+        if (t.offset < 0) {
+            continue;
+        }
+        QByteArray blob;
+        if (spill->seek(t.offset)) {
+            blob = spill->read(t.size);
+        }
+        int64_t offset = packed->size();
+        if ((blob.size() != t.size) || !packed->seek(offset)
+            || (packed->write(blob) != t.size)) {
+            debug_message("ERROR: failed to compact the tombstone spill file.");
+            delete packed;
+            return;
+        }
+        offsets.insert(it.key(), offset);
+    }
+    for (auto it = offsets.cbegin(); it != offsets.cend(); ++it) {
+        records[it.key()].offset = it.value();
+    }
+    delete spill;
+    spill = packed;
+}
+
+/* Spill the oldest records to disk until the memory used is within budget. */
+void
+TombstoneStore::enforceBudget()
+{
+    if (budget <= 0) {
+        return;
+    }
+    while ((memoryUsed > budget) && !order.isEmpty()) {
+        int64_t id = order.dequeue();
+        if (!records.contains(id)) {
+            continue;
+        }
+        Tombstone &t = records[id];
+        if (t.offset >= 0) {
+            continue;
+        }
+        if (!spill) {
+            spill = new QTemporaryFile(QDir::tempPath() + "/embroidermodder-XXXXXX.tomb");
+            if (!spill->open()) {
+                debug_message("ERROR: failed to open the tombstone spill file.");
+                delete spill;
+                spill = NULL;
+                return;
+            }
+        }
+        int64_t offset = spill->size();
+        if (!spill->seek(offset) || (spill->write(t.blob) != t.size)) {
+            debug_message("ERROR: failed to write to the tombstone spill file.");
+            return;
+        }
+        t.offset = offset;
+        t.blob.clear();
+        memoryUsed -= t.size;
+        diskUsed += t.size;
+    }
 }
 
 /*
@@ -323,7 +1456,7 @@ View::vulcanizeObject(Geometry* obj)
     gscene->removeItem(obj); //Prevent Qt Runtime Warning, QGraphicsScene::addItem: item has already been added to this scene
     obj->vulcanize();
 
-    UndoableCommand* cmd = new UndoableCommand("add", obj->data(OBJ_NAME).toString(), obj, this, 0);
+    UndoableCommand* cmd = new UndoableCommand("add", obj->typeName(), obj, this, 0);
     if (cmd) {
         undoStack->push(cmd);
     }
@@ -339,56 +1472,74 @@ void
 View::clearRubberRoom()
 {
     foreach(QGraphicsItem* item, rubberRoomList) {
+        if (item->data(OBJ_TYPE) == OBJ_TYPE_NULL) {
+            continue;
+        }
         Geometry* base = static_cast<Geometry*>(item);
-        if (base) {
-            std::string type = std::to_string(base->type());
-            if ((type == "OBJ_TYPE_PATH" && contains(spareRubberList, "SPARE_RUBBER_PATH")) ||
-               (type == "OBJ_TYPE_POLYGON"  && contains(spareRubberList, "SPARE_RUBBER_POLYGON")) ||
-               (type == "OBJ_TYPE_POLYLINE" && contains(spareRubberList, "SPARE_RUBBER_POLYLINE")) ||
-                (contains(spareRubberList, std::to_string(base->objID)))) {
-                if (!base->path().elementCount()) {
-                    QMessageBox::critical(this,
-                        translate_str("Empty Rubber Object Error"),
-                        translate_str("The rubber object added contains no points. "
-                        "The command that created this object has flawed logic. "
-                        "The object will be deleted."));
-                    gscene->removeItem(item);
-                    delete item;
-                }
-                else
-                    vulcanizeObject(base);
-            }
-            else {
+        uint32_t typeFlag = 0;
+        switch (base->Type) {
+        case OBJ_TYPE_PATH:
+            typeFlag = 1 << (-SPARE_RUBBER_PATH);
+            break;
+        case OBJ_TYPE_POLYGON:
+            typeFlag = 1 << (-SPARE_RUBBER_POLYGON);
+            break;
+        case OBJ_TYPE_POLYLINE:
+            typeFlag = 1 << (-SPARE_RUBBER_POLYLINE);
+            break;
+        default:
+            break;
+        }
+        bool spared = (spareRubberTypes & typeFlag)
+            || (std::count(spareRubberIds.begin(), spareRubberIds.end(), base->objID) != 0);
+        if (spared) {
+            if (!base->path().elementCount()) {
+                QMessageBox::critical(this,
+                    translate_str("Empty Rubber Object Error"),
+                    translate_str("The rubber object added contains no points. "
+                    "The command that created this object has flawed logic. "
+                    "The object will be deleted."));
                 gscene->removeItem(item);
                 delete item;
             }
+            else
+                vulcanizeObject(base);
+        }
+        else {
+            gscene->removeItem(item);
+            delete item;
         }
     }
 
     rubberRoomList.clear();
-    spareRubberList.clear();
+    spareRubberTypes = 0;
+    spareRubberIds.clear();
     gscene->update();
 }
 
 /**
- * .
+ * Spare either the object with the given id or, for the negative
+ * SPARE_RUBBER_* ids, every rubber object of that type.
  */
 void
 View::spareRubber(int64_t id)
 {
-    spareRubberList.push_back(std::to_string(id));
+    if (id < 0) {
+        spareRubberTypes |= 1 << (-id);
+        return;
+    }
+    spareRubberIds.push_back(id);
 }
 
 /**
  * .
  */
 void
-View::setRubberMode(std::string mode)
+View::setRubberMode(int32_t mode)
 {
     foreach(QGraphicsItem* item, rubberRoomList) {
-        Geometry* base = static_cast<Geometry*>(item);
-        if (base) {
-            base->objRubberMode = mode;
+        if (item->data(OBJ_TYPE) != OBJ_TYPE_NULL) {
+            static_cast<Geometry*>(item)->objRubberMode = mode;
         }
     }
     gscene->update();
@@ -398,26 +1549,47 @@ View::setRubberMode(std::string mode)
  * .
  */
 void
-View::setRubberPoint(QString  key, const QPointF& point)
+View::setRubberPoint(int32_t slot, const QPointF& point)
 {
-    foreach(QGraphicsItem* item, rubberRoomList)
-    {
-        Geometry* base = static_cast<Geometry*>(item);
-        if (base) { base->objRubberPoints.insert(key, point); }
+    foreach(QGraphicsItem* item, rubberRoomList) {
+        if (item->data(OBJ_TYPE) != OBJ_TYPE_NULL) {
+            static_cast<Geometry*>(item)->setRubberPoint(slot, point);
+        }
+    }
+    gscene->update();
+}
+
+/**
+ * Returns false if any rubber object refused the vertex.
+ */
+bool
+View::setRubberVertex(int32_t index, const QPointF& point)
+{
+    bool ok = true;
+    foreach(QGraphicsItem* item, rubberRoomList) {
+        if (item->data(OBJ_TYPE) != OBJ_TYPE_NULL) {
+            if (!static_cast<Geometry*>(item)->setRubberVertex(index, point)) {
+                ok = false;
+            }
+        }
     }
     gscene->update();
+    return ok;
 }
 
 /**
  * .
  */
 void
-View::setRubberText(QString  key, QString  txt)
+View::setRubberText(int32_t slot, QString txt)
 {
-    foreach(QGraphicsItem* item, rubberRoomList)
-    {
-        Geometry* base = static_cast<Geometry*>(item);
-        if (base) { base->objRubberTexts.insert(key, txt); }
+    if ((slot < 0) || (slot >= N_RUBBER_TEXTS)) {
+        return;
+    }
+    foreach(QGraphicsItem* item, rubberRoomList) {
+        if (item->data(OBJ_TYPE) != OBJ_TYPE_NULL) {
+            static_cast<Geometry*>(item)->setRubberText(slot, txt);
+        }
     }
     gscene->update();
 }
@@ -932,6 +2104,15 @@ View::draw_crosshair(QPainter* painter, const QRectF& rect)
 void
 View::drawForeground(QPainter* painter, const QRectF& rect)
 {
+    session_log.repaints++;
+
+    if (state & VIEW_STATE_SIMULATE) {
+        simulation.draw(painter);
+    }
+    else if (state & VIEW_STATE_DENSITY) {
+        density.draw(painter);
+    }
+
     // Draw grip points for all selected objects
 
     QPen gripPen(QColor::fromRgb(gripColorCool));
@@ -1101,13 +2282,8 @@ View::zoomIn()
     if (!allowZoomIn()) {
         return;
     }
-    QApplication::setOverrideCursor(Qt::WaitCursor);
-    QPointF cntr = mapToScene(QPoint(width()/2,height()/2));
-    EmbReal s = settings[ST_ZOOMSCALE_IN].r;
-    scale(s, s);
-
-    centerOn(cntr);
-    QApplication::restoreOverrideCursor();
+    QPoint cntr = viewport()->rect().center();
+    navigator.zoomAbout(mapToScene(cntr), cntr, settings[ST_ZOOMSCALE_IN].r);
 }
 
 /**
@@ -1117,14 +2293,11 @@ void
 View::zoomOut()
 {
     debug_message("View zoomOut()");
-    if (!allowZoomOut()) { return; }
-    QApplication::setOverrideCursor(Qt::WaitCursor);
-    QPointF cntr = mapToScene(QPoint(width()/2,height()/2));
-    EmbReal s = settings[ST_ZOOMSCALE_OUT].r;
-    scale(s, s);
-
-    centerOn(cntr);
-    QApplication::restoreOverrideCursor();
+    if (!allowZoomOut()) {
+        return;
+    }
+    QPoint cntr = viewport()->rect().center();
+    navigator.zoomAbout(mapToScene(cntr), cntr, settings[ST_ZOOMSCALE_OUT].r);
 }
 
 /**
@@ -1145,18 +2318,13 @@ void
 View::zoomSelected()
 {
     QApplication::setOverrideCursor(Qt::WaitCursor);
-    std::vector<QGraphicsItem*> itemList = selected_items();
-    QPainterPath selectedRectPath;
-    foreach(QGraphicsItem* item, itemList)
-    {
-        selectedRectPath.addPolygon(item->mapToScene(item->boundingRect()));
-    }
-    QRectF selectedRect = selectedRectPath.boundingRect();
+    QRectF selectedRect = selectionExtents.extents();
     if (selectedRect.isNull())
     {
         QMessageBox::information(this, translate_str("ZoomSelected Preselect"), translate_str("Preselect objects before invoking the zoomSelected command."));
         //TODO: Support Post selection of objects
     }
+    navigator.finish();
     fitInView(selectedRect, Qt::KeepAspectRatio);
     QApplication::restoreOverrideCursor();
 }
@@ -1168,12 +2336,13 @@ void
 View::zoomExtents()
 {
     QApplication::setOverrideCursor(Qt::WaitCursor);
-    QRectF extents = gscene->itemsBoundingRect();
+    QRectF extents = sceneExtents.extents();
     if (extents.isNull()) {
         extents.setWidth(settings[ST_GRID_SIZE_X].r);
         extents.setHeight(settings[ST_GRID_SIZE_Y].r);
         extents.moveCenter(QPointF(0,0));
     }
+    navigator.finish();
     fitInView(extents, Qt::KeepAspectRatio);
     QApplication::restoreOverrideCursor();
 }
@@ -1268,6 +2437,8 @@ View::selectionChanged()
 void
 View::mouseDoubleClickEvent(QMouseEvent* event)
 {
+    session_log.mouse("double", event->position(), event->button(),
+        event->buttons(), event->modifiers());
     if (event->button() == Qt::LeftButton) {
         QGraphicsItem* item = gscene->itemAt(mapToScene(event->pos()), QTransform());
         if (item) {
@@ -1282,6 +2453,8 @@ View::mouseDoubleClickEvent(QMouseEvent* event)
 void
 View::mousePressEvent(QMouseEvent* event)
 {
+    session_log.mouse("press", event->position(), event->button(),
+        event->buttons(), event->modifiers());
     updateMouseCoords(event->position().x(), event->position().y());
     if (event->button() == Qt::LeftButton) {
         if (_mainWin->isCommandActive()) {
@@ -1429,7 +2602,7 @@ View::mousePressEvent(QMouseEvent* event)
             for (int i=0; i<(int)itemList.size(); i++) {
                 Geometry* base = static_cast<Geometry*>(itemList[i]);
                 if (base) {
-                    UndoableCommand* cmd = new UndoableCommand("add", base->data(OBJ_NAME).toString(), base, this, 0);
+                    UndoableCommand* cmd = new UndoableCommand("add", base->typeName(), base, this, 0);
                     if (cmd) {
                         undoStack->push(cmd);
                     }
@@ -1441,6 +2614,7 @@ View::mousePressEvent(QMouseEvent* event)
             selectingActive = false;
         }
         if (zoomWindowActive) {
+            navigator.finish();
             fitInView(path.boundingRect(), Qt::KeepAspectRatio);
             clearSelection();
         }
@@ -1472,14 +2646,7 @@ View::recalculateLimits()
     //NOTE: Increase the sceneRect limits if the point we want to go to lies outside of sceneRect's limits
     //      If the sceneRect limits aren't increased, you cannot pan past its limits
     QRectF viewRect(mapToScene(rect().topLeft()), mapToScene(rect().bottomRight()));
-    QRectF sceneRect(gscene->sceneRect());
-    QRectF newRect = viewRect.adjusted(-viewRect.width(), -viewRect.height(), viewRect.width(), viewRect.height());
-    if (!sceneRect.contains(newRect.topLeft()) || !sceneRect.contains(newRect.bottomRight())) {
-        gscene->setSceneRect(sceneRect.adjusted(-viewRect.width(),
-                                                -viewRect.height(),
-                                                viewRect.width(),
-                                                viewRect.height()));
-    }
+    navigator.growSceneRect(viewRect.normalized());
 }
 
 void
@@ -1516,6 +2683,8 @@ View::alignScenePointWithViewPoint(const QPointF& scenePoint, const QPoint& view
 void
 View::mouseMoveEvent(QMouseEvent* event)
 {
+    session_log.mouse("move", event->position(), event->button(),
+        event->buttons(), event->modifiers());
     updateMouseCoords(event->position().x(), event->position().y());
     movePoint = event->pos();
     sceneMovePoint = mapToScene(movePoint);
@@ -1615,6 +2784,8 @@ View::mouseMoveEvent(QMouseEvent* event)
 void
 View::mouseReleaseEvent(QMouseEvent* event)
 {
+    session_log.mouse("release", event->position(), event->button(),
+        event->buttons(), event->modifiers());
     updateMouseCoords(event->position().x(), event->position().y());
     if (event->button() == Qt::LeftButton) {
         if (movingActive) {
@@ -1650,43 +2821,29 @@ View::mouseReleaseEvent(QMouseEvent* event)
     gscene->update();
 }
 
-/**
- * .
+/* Whether the view, or the zoom it is animating towards, can still show
+ * less of the scene.
  */
 bool
 View::allowZoomIn()
 {
-    QPointF origin  = mapToScene(0,0);
-    QPointF corner  = mapToScene(width(), height());
-    EmbReal maxWidth  = corner.x() - origin.x();
-    EmbReal maxHeight = corner.y() - origin.y();
-
-    EmbReal zoomInLimit = 0.0000000001;
-    if (std::min(maxWidth, maxHeight) < zoomInLimit) {
-        debug_message("ZoomIn limit reached. (limit=%d)", zoomInLimit);
+    if (navigator.scale() >= navigator.maxScale()) {
+        debug_message("ZoomIn limit reached. (limit=%g)", ZOOM_IN_LIMIT);
         return false;
     }
-
     return true;
 }
 
-/**
- * .
+/* Whether the view, or the zoom it is animating towards, can still show
+ * more of the scene.
  */
 bool
 View::allowZoomOut()
 {
-    QPointF origin = mapToScene(0,0);
-    QPointF corner = mapToScene(width(), height());
-    EmbReal maxWidth = corner.x() - origin.x();
-    EmbReal maxHeight = corner.y() - origin.y();
-
-    EmbReal zoomOutLimit = 10000000000000.0;
-    if (std::max(maxWidth, maxHeight) > zoomOutLimit) {
-        debug_message("ZoomOut limit reached. (limit=%d)", zoomOutLimit);
+    if (navigator.scale() <= navigator.minScale()) {
+        debug_message("ZoomOut limit reached. (limit=%g)", ZOOM_OUT_LIMIT);
         return false;
     }
-
     return true;
 }
 
@@ -1694,6 +2851,8 @@ View::allowZoomOut()
 void
 View::wheelEvent(QWheelEvent* event)
 {
+    session_log.mouse("wheel", event->position(), event->angleDelta().y(),
+        event->buttons(), event->modifiers());
     QPointF delta = event->angleDelta();
     int zoomDir = delta.y() > 0;
     QPointF mousePoint = event->position();
@@ -1729,18 +2888,20 @@ View::zoomToPoint(const QPoint& mousePoint, int zoomDir)
         s = settings[ST_ZOOMSCALE_OUT].r;
     }
 
-    scale(s, s);
-    alignScenePointWithViewPoint(pointBeforeScale, mousePoint);
-    recalculateLimits();
-    alignScenePointWithViewPoint(pointBeforeScale, mousePoint);
+    navigator.zoomAbout(pointBeforeScale, mousePoint, s);
+}
 
-    updateMouseCoords(mousePoint.x(), mousePoint.y());
+/* Called by the navigator after each zoom step has been applied. */
+void
+View::zoomStepped(const QPoint& viewPoint)
+{
+    updateMouseCoords(viewPoint.x(), viewPoint.y());
     if (pastingActive) {
         pasteObjectItemGroup->setPos(sceneMousePoint - pasteDelta);
     }
     if (selectingActive)
     {
-        selectBox->setGeometry(QRect(mapFromScene(scenePressPoint), mousePoint).normalized());
+        selectBox->setGeometry(QRect(mapFromScene(scenePressPoint), viewPoint).normalized());
     }
     gscene->update();
 }
@@ -1861,8 +3022,8 @@ View::startGripping(Geometry* obj)
     grippingActive = true;
     gripBaseObj = obj;
     sceneGripPoint = gripBaseObj->mouseSnapPoint(sceneMousePoint);
-    gripBaseObj->objRubberPoints.insert("GRIP_POINT", sceneGripPoint);
-    gripBaseObj->objRubberMode = "OBJ_RUBBER_GRIP";
+    gripBaseObj->setRubberPoint(RUBBER_POINT_GRIP, sceneGripPoint);
+    gripBaseObj->objRubberMode = RUBBER_GRIP;
 }
 
 /* . */
@@ -1873,7 +3034,7 @@ View::stopGripping(bool accept)
     if (gripBaseObj) {
         gripBaseObj->vulcanize();
         if (accept) {
-            UndoableCommand* cmd = new UndoableCommand(sceneGripPoint, sceneMousePoint, translate_str("Grip Edit ") + gripBaseObj->data(OBJ_NAME).toString(), gripBaseObj, this, 0);
+            UndoableCommand* cmd = new UndoableCommand(sceneGripPoint, sceneMousePoint, translate_str("Grip Edit ") + gripBaseObj->typeName(), gripBaseObj, this, 0);
             if (cmd) undoStack->push(cmd);
             selectionChanged(); //Update the Property Editor
         }
@@ -1903,7 +3064,7 @@ View::deleteSelected()
         if (itemList.at(i)->data(OBJ_TYPE) != OBJ_TYPE_NULL) {
             Geometry* base = static_cast<Geometry*>(itemList.at(i));
             if (base) {
-                UndoableCommand* cmd = new UndoableCommand("delete", translate_str("Delete 1 ") + base->data(OBJ_NAME).toString(), base, this, 0);
+                UndoableCommand* cmd = new UndoableCommand("delete", translate_str("Delete 1 ") + base->typeName(), base, this, 0);
                 if (cmd)
                     undoStack->push(cmd);
             }
@@ -2034,7 +3195,7 @@ View::moveSelected(EmbVector delta)
         if (!base) {
             continue;
         }
-        QString a =  translate_str("Move 1 ") + base->data(OBJ_NAME).toString();
+        QString a =  translate_str("Move 1 ") + base->typeName();
         UndoableCommand* cmd = new UndoableCommand(delta, a, base, this, 0);
         if (cmd) {
             undoStack->push(cmd);
@@ -2071,7 +3232,7 @@ View::rotateSelected(EmbVector pivot, EmbReal rot)
         if (!base) {
             continue;
         }
-        QString a = translate_str("Rotate 1 ") + base->data(OBJ_NAME).toString();
+        QString a = translate_str("Rotate 1 ") + base->typeName();
         UndoableCommand* cmd = new UndoableCommand("rotate", pivot, rot, a, base, this, 0);
         if (cmd) {
             undoStack->push(cmd);
@@ -2099,7 +3260,7 @@ View::mirrorSelected(EmbReal x1, EmbReal y1, EmbReal x2, EmbReal y2)
         if (!base) {
             continue;
         }
-        QString a = translate_str("Mirror 1 ") + base->data(OBJ_NAME).toString();
+        QString a = translate_str("Mirror 1 ") + base->typeName();
         UndoableCommand* cmd = new UndoableCommand(x1, y1, x2, y2, a, base, this, 0);
         if (cmd) {
             undoStack->push(cmd);
@@ -2136,7 +3297,7 @@ View::scaleSelected(EmbVector point, EmbReal factor)
         if (!base) {
             continue;
         }
-        UndoableCommand* cmd = new UndoableCommand("scale", point, factor, translate_str("Scale 1 ") + base->data(OBJ_NAME).toString(), base, this, 0);
+        UndoableCommand* cmd = new UndoableCommand("scale", point, factor, translate_str("Scale 1 ") + base->typeName(), base, this, 0);
         if (cmd) {
             undoStack->push(cmd);
         }
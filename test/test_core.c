@@ -1,44 +1,905 @@
-/*
- *  Embroidermodder 2.
- *  Testing for C core.
- *
- *  ------------------------------------------------------------
- *
- *  Copyright 2013-2023 The Embroidermodder Team
- *  Embroidermodder 2 is Open Source Software.
- *  See LICENSE for licensing terms.
- *
- *  ------------------------------------------------------------
- *
- *  Use Python's PEP7 style guide.
- *      https://peps.python.org/pep-0007/
- */
-
-#include "core.h"
-
-int
-main(void)
-{
-    root = create_node(CNODE_TYPE_DICTIONARY);
-	strcpy(root->key, "root");
-	strcpy(root->data, "{}");
-    CNode *leaf1 = create_and_add_leaf(root, "key1", "value1");
-    CNode *leaf2 = create_and_add_leaf(root, "key2", "value2");
-    CNode *leaf3 = create_and_add_leaf(root, "settings", "{}");
-    CNode *leaf4 = create_and_add_leaf(leaf3, "key4", "value4");
-    print_tree(root, 0);
-	CNode *found = find_node(root, "key1");
-	if (found != NULL) {
-        print_tree(found, 0);
-	}
-	found = find_node(root, "settings.key4");
-	if (found != NULL) {
-        print_tree(found, 0);
-	}
-	found = find_node(root, "not-a-key");
-	if (found != NULL) {
-        print_tree(found, 0);
-	}
-    free_node(root);
-    return 0;
-}
+/*
+ *  Embroidermodder 2.
+ *  Testing for C core.
+ *
+ *  ------------------------------------------------------------
+ *
+ *  Copyright 2013-2023 The Embroidermodder Team
+ *  Embroidermodder 2 is Open Source Software.
+ *  See LICENSE for licensing terms.
+ *
+ *  ------------------------------------------------------------
+ *
+ *  Use Python's PEP7 style guide.
+ *      https://peps.python.org/pep-0007/
+ *
+ *  Each test_* function checks one part of the core and the program
+ *  exits with the number of failed checks, so ctest and test.sh see
+ *  any failure.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "core.h"
+
+static int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+/* Report a failed check without stopping, so one run lists them all. */
+static void
+check(int ok, const char *what, const char *file, int line)
+{
+    if (!ok) {
+        printf("%s:%d: check failed: %s\n", file, line, what);
+        failures++;
+    }
+}
+
+/* Whether a and b are within tolerance of each other. */
+static int
+near(EmbReal a, EmbReal b, EmbReal tolerance)
+{
+    return fabs(a - b) <= tolerance;
+}
+
+/* The core calls back into the interface for these; the tests have no
+ * interface, so they do nothing.
+ */
+const char *
+actuator(char string[MAX_STRING_LENGTH])
+{
+    (void)string;
+    return "";
+}
+
+int
+string_equal(const char *a, const char *b)
+{
+    return !strcmp(a, b);
+}
+
+const char *
+translate(char *str)
+{
+    return str;
+}
+
+void
+clear_selection(void)
+{
+}
+
+void
+prompt_output(char *s)
+{
+    (void)s;
+}
+
+/* The batched Fourier sum agrees with summing each sample on its own,
+ * including across the points where the recurrence is reseeded.
+ */
+static void
+test_fourier_batch(void)
+{
+    const EmbReal terms[] = {
+        1.0, 0.0, 1.0,
+        0.5, 0.3, -2.0,
+        0.25, 1.7, 7.0
+    };
+    int n = 3*FOURIER_BLOCK + 5;
+    EmbReal h = 2.0*embConstantPi / (n - 1);
+    EmbReal *batch = malloc(n*sizeof(EmbReal));
+    fourier_series_batch(terms, 9, 0.0, h, n, batch);
+    EmbReal worst = 0.0;
+    for (int i=0; i<n; i++) {
+        EmbReal d = fabs(batch[i] - fourier_series(h*i, terms, 9));
+        if (d > worst) {
+            worst = d;
+        }
+    }
+    CHECK(worst < 1.0e-9);
+    free(batch);
+}
+
+/* Evenly sampled designs land on known points and close up. */
+static void
+test_curve_samples(void)
+{
+    EmbVector scale = {1.0, 1.0};
+    EmbVector out[5];
+
+    /* The heart at t = 0, pi/2, pi, 3pi/2 and 2pi. */
+    CHECK(curve_points(DESIGN_HEART5, 4, scale, 0.0, out, 5) == 5);
+    CHECK(near(out[0].x, 0.0, 1.0e-9) && near(out[0].y, 5.0, 1.0e-9));
+    CHECK(near(out[1].x, 16.0, 1.0e-9) && near(out[1].y, 4.0, 1.0e-9));
+    CHECK(near(out[2].x, 0.0, 1.0e-9) && near(out[2].y, -17.0, 1.0e-9));
+    CHECK(near(out[3].x, -16.0, 1.0e-9) && near(out[3].y, 4.0, 1.0e-9));
+    CHECK(near(out[4].x, out[0].x, 1.0e-9) && near(out[4].y, out[0].y, 1.0e-9));
+
+    EmbVector dolphin[65];
+    CHECK(curve_points(DESIGN_DOLPHIN, 64, scale, 0.0, dolphin, 65) == 65);
+    CHECK(near(dolphin[64].x, dolphin[0].x, 1.0e-6));
+    CHECK(near(dolphin[64].y, dolphin[0].y, 1.0e-6));
+
+    CHECK(curve_points(DESIGN_HEART5, 2, scale, 0.0, out, 5) == 0);
+}
+
+/* The dolphin written out term by term as in assets/commands/dolphin.toml,
+ * to check the coefficient tables against.
+ */
+static EmbReal
+dolphin_x_formula(EmbReal t)
+{
+    return 4.0/23*sin(62.0/33 - 58*t)
+        + 8.0/11*sin(10.0/9 - 56*t)
+        + 17.0/24*sin(38.0/35 - 55*t)
+        + 30.0/89*sin(81.0/23 - 54*t)
+        + 3.0/17*sin(53.0/18 - 53*t)
+        + 21.0/38*sin(29.0/19 - 52*t)
+        + 11.0/35*sin(103.0/40 - 51*t)
+        + 7.0/16*sin(79.0/18 - 50*t)
+        + 4.0/15*sin(270.0/77 - 49*t)
+        + 19.0/35*sin(59.0/27 - 48*t)
+        + 37.0/43*sin(71.0/17 - 47*t)
+        + sin(18.0/43 - 45*t)
+        + 21.0/26*sin(37.0/26 - 44*t)
+        + 27.0/19*sin(111.0/32 - 42*t)
+        + 8.0/39*sin(13.0/25 - 41*t)
+        + 23.0/30*sin(27.0/8 - 40*t)
+        + 23.0/21*sin(32.0/35 - 37*t)
+        + 18.0/37*sin(91.0/31 - 36*t)
+        + 45.0/22*sin(29.0/37 - 35*t)
+        + 56.0/45*sin(11.0/8 - 33*t)
+        + 4.0/7*sin(32.0/19 - 32*t)
+        + 54.0/23*sin(74.0/29 - 31*t)
+        + 28.0/19*sin(125.0/33 - 30*t)
+        + 19.0/9*sin(73.0/27 - 29*t)
+        + 16.0/17*sin(737.0/736 - 28*t)
+        + 52.0/33*sin(130.0/29 - 27*t)
+        + 41.0/23*sin(43.0/30 - 25*t)
+        + 29.0/20*sin(67.0/26 - 24*t)
+        + 64.0/25*sin(136.0/29 - 23*t)
+        + 162.0/37*sin(59.0/34 - 21*t)
+        + 871.0/435*sin(199.0/51 - 20*t)
+        + 61.0/42*sin(58.0/17 - 19*t)
+        + 159.0/25*sin(77.0/31 - 17*t)
+        + 241.0/15*sin(94.0/31 - 13*t)
+        + 259.0/18*sin(114.0/91 - 12*t)
+        + 356.0/57*sin(23.0/25 - 11*t)
+        + 2283.0/137*sin(23.0/25 - 10*t)
+        + 1267.0/45*sin(139.0/42 - 9*t)
+        + 613.0/26*sin(41.0/23 - 8*t)
+        + 189.0/16*sin(122.0/47 - 6*t)
+        + 385.0/6*sin(151.0/41 - 5*t)
+        + 2551.0/38*sin(106.0/35 - 4*t)
+        + 1997.0/18*sin(6.0/5 - 2*t)
+        - 43357.0/47*sin(81.0/26 - t)
+        - 4699.0/35*sin(3*t + 25.0/31)
+        - 1029.0/34*sin(7*t + 20.0/21)
+        - 250.0/17*sin(14*t + 7.0/40)
+        - 140.0/17*sin(15*t + 14.0/25)
+        - 194.0/29*sin(16*t + 29.0/44)
+        - 277.0/52*sin(18*t + 37.0/53)
+        - 94.0/41*sin(22*t + 33.0/31)
+        - 57.0/28*sin(26*t + 44.0/45)
+        - 128.0/61*sin(34*t + 11.0/14)
+        - 111.0/95*sin(38*t + 55.0/37)
+        - 85.0/71*sin(39*t + 4.0/45)
+        - 25.0/29*sin(43*t + 129.0/103)
+        - 7.0/37*sin(46*t + 9.0/20)
+        - 17.0/32*sin(57*t + 11.0/28)
+        - 5.0/16*sin(59*t + 32.0/39);
+}
+
+static EmbReal
+dolphin_y_formula(EmbReal t)
+{
+    return 5.0/11*sin(163.0/37 - 59*t)
+        + 7.0/22*sin(19.0/41 - 58*t)
+        + 30.0/41*sin(1.0 - 57*t)
+        + 37.0/29*sin(137.0/57 - 56*t)
+        + 5.0/7*sin(17.0/6 - 55*t)
+        + 11.0/39*sin(46.0/45 - 52*t)
+        + 25.0/28*sin(116.0/83 - 51*t)
+        + 25.0/34*sin(11.0/20 - 47*t)
+        + 8.0/27*sin(81.0/41 - 46*t)
+        + 44.0/39*sin(78.0/37 - 45*t)
+        + 11.0/25*sin(107.0/37 - 44*t)
+        + 7.0/20*sin(7.0/16 - 41*t)
+        + 30.0/31*sin(19.0/5 - 40*t)
+        + 37.0/27*sin(148.0/59 - 39*t)
+        + 44.0/39*sin(17.0/27 - 38*t)
+        + 13.0/11*sin(7.0/11 - 37*t)
+        + 28.0/33*sin(119.0/39 - 36*t)
+        + 27.0/13*sin(244.0/81 - 35*t)
+        + 13.0/23*sin(113.0/27 - 34*t)
+        + 47.0/38*sin(127.0/32 - 33*t)
+        + 155.0/59*sin(173.0/45 - 29*t)
+        + 105.0/37*sin(22.0/43 - 27*t)
+        + 106.0/27*sin(23.0/37 - 26*t)
+        + 97.0/41*sin(53.0/29 - 25*t)
+        + 83.0/45*sin(109.0/31 - 24*t)
+        + 81.0/31*sin(96.0/29 - 23*t)
+        + 56.0/37*sin(29.0/10 - 22*t)
+        + 44.0/13*sin(29.0/19 - 19*t)
+        + 18.0/5*sin(34.0/31 - 18*t)
+        + 163.0/51*sin(75.0/17 - 17*t)
+        + 152.0/31*sin(61.0/18 - 16*t)
+        + 146.0/19*sin(47.0/20 - 15*t)
+        + 353.0/35*sin(55.0/48 - 14*t)
+        + 355.0/28*sin(102.0/25 - 12*t)
+        + 1259.0/63*sin(71.0/18 - 11*t)
+        + 17.0/35*sin(125.0/52 - 10*t)
+        + 786.0/23*sin(23.0/26 - 6*t)
+        + 2470.0/41*sin(77.0/30 - 5*t)
+        + 2329.0/47*sin(47.0/21 - 4*t)
+        + 2527.0/33*sin(23.0/14 - 3*t)
+        - 9931.0/33*sin(51.0/35 - 2*t)
+        - 11506.0/19*sin(t + 56.0/67)
+        - 2081.0/42*sin(7*t + 9.0/28)
+        - 537.0/14*sin(8*t + 3.0/25)
+        - 278.0/29*sin(9*t + 23.0/33)
+        - 107.0/15*sin(13*t + 35.0/26)
+        - 56.0/19*sin(20*t + 5.0/9)
+        - 5.0/9*sin(21*t + 1.0/34)
+        - 17.0/24*sin(28*t + 36.0/23)
+        - 21.0/11*sin(30*t + 27.0/37)
+        - 138.0/83*sin(31*t + 1.0/7)
+        - 10.0/17*sin(32*t + 29.0/48)
+        - 31.0/63*sin(42*t + 27.0/28)
+        - 4.0/27*sin(43*t + 29.0/43)
+        - 13.0/24*sin(48*t + 5.0/21)
+        - 4.0/7*sin(49*t + 29.0/23)
+        - 26.0/77*sin(50*t + 29.0/27)
+        + 19.0/14*sin(53*t + 61.0/48)
+        + 34.0/25*sin(54*t + 37.0/26);
+}
+
+/* The dolphin's tables give the same curve as its formula. */
+static void
+test_dolphin_formula(void)
+{
+    EmbVector scale = {1.0, 1.0};
+    EmbVector out[33];
+    CHECK(curve_points(DESIGN_DOLPHIN, 32, scale, 0.0, out, 33) == 33);
+    EmbReal h = 2.0*embConstantPi / 32;
+    for (int i=0; i<=32; i++) {
+        CHECK(near(out[i].x, dolphin_x_formula(h*i), 1.0e-6));
+        CHECK(near(out[i].y, dolphin_y_formula(h*i), 1.0e-6));
+    }
+}
+
+/* Refinement only adds points, and a buffer that is too small is
+ * reported rather than silently cut short.
+ */
+static void
+test_curve_overflow(void)
+{
+    EmbVector scale = {0.04, 0.04};
+    EmbVector small[10];
+    int n = curve_points(DESIGN_SNOWFLAKE, 256, scale, 0.001, small, 10);
+    CHECK(n > 257);
+
+    EmbVector *all = malloc(n*sizeof(EmbVector));
+    CHECK(curve_points(DESIGN_SNOWFLAKE, 256, scale, 0.001, all, n) == n);
+    int same = 1;
+    for (int i=0; i<10; i++) {
+        if (!near(all[i].x, small[i].x, 0.0) || !near(all[i].y, small[i].y, 0.0)) {
+            same = 0;
+        }
+    }
+    CHECK(same);
+    CHECK(near(all[n-1].x, all[0].x, 1.0e-6) && near(all[n-1].y, all[0].y, 1.0e-6));
+    free(all);
+}
+
+/* Star corners alternate between the outer and inner radius. */
+static void
+test_star_points(void)
+{
+    EmbVector out[10];
+    EmbVector center = {1.0, 2.0};
+    EmbVector outer = {1.0, 4.0};
+    CHECK(star_points(center, outer, 1.0, 5, out) == 10);
+    CHECK(near(out[0].x, 1.0, 1.0e-9) && near(out[0].y, 4.0, 1.0e-9));
+    for (int i=0; i<10; i++) {
+        EmbReal r = sqrt(pow(out[i].x - 1.0, 2) + pow(out[i].y - 2.0, 2));
+        CHECK(near(r, (i%2 == 0) ? 2.0 : 1.0, 1.0e-9));
+    }
+    EmbReal angle = atan2(out[1].y - 2.0, out[1].x - 1.0);
+    CHECK(near(angle, embConstantPi/2 + embConstantPi/5, 1.0e-9));
+}
+
+/* A deadline that has always passed, and a counter of how often it was
+ * asked.
+ */
+static int
+always_expired(void *data)
+{
+    (*(int*)data)++;
+    return 1;
+}
+
+/* Whether steps lists each of the n runs exactly once. */
+static int
+is_permutation(const StitchStep *steps, int n)
+{
+    int *seen = calloc(n, sizeof(int));
+    int ok = 1;
+    for (int i=0; i<n; i++) {
+        if (steps[i].run < 0 || steps[i].run >= n || seen[steps[i].run]) {
+            ok = 0;
+            break;
+        }
+        seen[steps[i].run] = 1;
+    }
+    free(seen);
+    return ok;
+}
+
+/* Short runs along a line, listed out of order, come back in order from
+ * the nearest neighbour seed; a deadline that has passed still leaves
+ * every run in the order and stops the refinement passes at once.
+ */
+static void
+test_sequence_deadline(void)
+{
+    enum { RUNS = 40 };
+    EmbVector points[2*RUNS];
+    StitchRun runs[RUNS];
+    int members[RUNS];
+    for (int i=0; i<RUNS; i++) {
+        /* Run i sits at position (i*17) % RUNS along the line. */
+        EmbReal x = 10.0 * ((i*17) % RUNS);
+        points[2*i].x = x;
+        points[2*i].y = 0.0;
+        points[2*i+1].x = x + 1.0;
+        points[2*i+1].y = 0.0;
+        runs[i].points = points + 2*i;
+        runs[i].count = 2;
+        runs[i].color = 0;
+        runs[i].closed = 0;
+        members[i] = i;
+    }
+
+    StitchStep steps[RUNS];
+    sequence_nearest(runs, members, RUNS, 0, steps, NULL);
+    CHECK(is_permutation(steps, RUNS));
+    int ordered = 1;
+    for (int i=1; i<RUNS; i++) {
+        if (step_entry(runs, steps[i]).x < step_entry(runs, steps[i-1]).x) {
+            ordered = 0;
+        }
+    }
+    CHECK(ordered);
+    CHECK(near(sequence_travel(runs, steps, RUNS, step_entry(runs, steps[0])),
+        9.0*(RUNS-1), 1.0e-9));
+
+    int asked = 0;
+    SequenceDeadline passed = {always_expired, &asked};
+    sequence_nearest(runs, members, RUNS, 5, steps, &passed);
+    CHECK(asked == 1);
+    CHECK(steps[0].run == 5);
+    CHECK(is_permutation(steps, RUNS));
+
+    asked = 0;
+    CHECK(sequence_2opt_pass(runs, steps, RUNS, &passed) == 0);
+    CHECK(sequence_oropt_pass(runs, steps, RUNS, &passed) == 0);
+    CHECK(asked == 2);
+    CHECK(is_permutation(steps, RUNS));
+
+    /* With time to spare the passes only ever shorten the travel. */
+    EmbReal before = sequence_travel(runs, steps, RUNS,
+        step_entry(runs, steps[0]));
+    while (sequence_2opt_pass(runs, steps, RUNS, NULL)
+        + sequence_oropt_pass(runs, steps, RUNS, NULL)) {
+    }
+    CHECK(is_permutation(steps, RUNS));
+    CHECK(sequence_travel(runs, steps, RUNS, step_entry(runs, steps[0]))
+        <= before + 1.0e-9);
+}
+
+/* Two lines side by side are rails, whichever way round they were
+ * drawn; lines too far apart, or that cross, are not.
+ */
+static void
+test_column_rails(void)
+{
+    EmbVector left[3] = {{0.0, 0.0}, {10.0, 0.0}, {20.0, 1.0}};
+    EmbVector right[2] = {{0.0, 3.0}, {20.0, 4.0}};
+    EmbVector backwards[2] = {{20.0, 4.0}, {0.0, 3.0}};
+    EmbVector far[2] = {{0.0, 30.0}, {20.0, 30.0}};
+    EmbVector crossing[2] = {{0.0, 3.0}, {20.0, -3.0}};
+    int reversed;
+
+    CHECK(column_rails(left, 3, right, 2, &reversed) && !reversed);
+    CHECK(column_rails(left, 3, backwards, 2, &reversed) && reversed);
+    CHECK(!column_rails(left, 3, far, 2, &reversed));
+    CHECK(!column_rails(left, 3, crossing, 2, &reversed));
+    CHECK(!column_rails(left, 1, right, 2, &reversed));
+}
+
+/* What a StitchFilter wrote, for the tests to look over. */
+typedef struct Written_ {
+    EmbVector at[64];
+    int flags[64];
+    int count;
+} Written;
+
+static void
+write_down(void *data, EmbReal x, EmbReal y, int flags)
+{
+    Written *w = data;
+    if (w->count < 64) {
+        w->at[w->count].x = x;
+        w->at[w->count].y = y;
+        w->flags[w->count] = flags;
+        w->count++;
+    }
+}
+
+/* The needle points a column hands out. */
+typedef struct Needle_ {
+    EmbVector points[128];
+    int count;
+} Needle;
+
+static void
+needle_down(void *data, EmbVector v)
+{
+    Needle *needle = (Needle *)data;
+    if (needle->count < 128) {
+        needle->points[needle->count] = v;
+    }
+    needle->count++;
+}
+
+/* A line typed satin is sewn as a column rather than along the line:
+ * the needle crosses from side to side every half spacing, pulled out
+ * past the width. Fishbone adds a stitch just across the middle, a
+ * couple of rows on, after each of those.
+ */
+static void
+test_satin_columns(void)
+{
+    EmbVector line[2] = {{0.0, 0.0}, {10.0, 0.0}};
+    Needle satin;
+    memset(&satin, 0, sizeof(Needle));
+    column_stitches(line, 2, NULL, 0, 2.0, 0.5, 0.2, OBJ_LTYPE_SATIN,
+        needle_down, &satin);
+    CHECK(satin.count == 41);
+    int sides = 1;
+    for (int i=0; i<satin.count; i++) {
+        EmbVector p = satin.points[i];
+        sides = sides && near(p.x, 0.25*i, 1.0e-9)
+            && near(fabs(p.y), 1.2, 1.0e-9);
+        if (i > 0) {
+            sides = sides && (p.y * satin.points[i-1].y < 0.0);
+        }
+    }
+    CHECK(sides);
+
+    Needle fishbone;
+    memset(&fishbone, 0, sizeof(Needle));
+    column_stitches(line, 2, NULL, 0, 2.0, 0.5, 0.2, OBJ_LTYPE_FISHBONE,
+        needle_down, &fishbone);
+    CHECK(fishbone.count == 81);
+    int bones = 1;
+    for (int i=1; i<fishbone.count; i+=2) {
+        EmbVector side = fishbone.points[i-1];
+        EmbVector bone = fishbone.points[i];
+        EmbReal x = 0.25*(i/2 + FISHBONE_SLANT);
+        bones = bones && near(side.x, 0.25*(i/2), 1.0e-9)
+            && near(bone.x, (x < 10.0) ? x : 10.0, 1.0e-9)
+            && near(bone.y, -FISHBONE_OVERLAP*side.y, 1.0e-9);
+    }
+    CHECK(bones);
+}
+
+/* Long moves are split, short stitches merged, and every trim the
+ * filter writes is a jump too: once per run of jumps, either where the
+ * run first goes past the trim length or at its trim_jumps-th jump.
+ */
+static void
+test_stitch_filter(void)
+{
+    StitchFilter f;
+    Written w;
+
+    memset(&w, 0, sizeof(Written));
+    filter_init(&f, 5.0, 1.0, 0, 0.0, write_down, &w);
+    filter_stitch(&f, 0.0, 0.0, JUMP);
+    filter_stitch(&f, 12.0, 0.0, NORMAL);
+    filter_stitch(&f, 12.3, 0.0, NORMAL);
+    filter_stitch(&f, 14.0, 0.0, NORMAL);
+    filter_stitch(&f, 14.0, 0.0, END);
+    CHECK(w.count == 6);
+    CHECK(near(w.at[1].x, 4.0, 1.0e-9) && (w.flags[1] == NORMAL));
+    CHECK(near(w.at[3].x, 12.0, 1.0e-9));
+    CHECK(near(w.at[4].x, 14.0, 1.0e-9));
+    CHECK((f.split == 2) && (f.dropped == 1) && (f.trims == 0));
+
+    /* One long jump: split, with the trim on its first piece. */
+    memset(&w, 0, sizeof(Written));
+    filter_init(&f, 5.0, 0.0, 0, 3.0, write_down, &w);
+    filter_stitch(&f, 0.0, 0.0, NORMAL);
+    filter_stitch(&f, 20.0, 0.0, JUMP);
+    CHECK(w.count == 5);
+    CHECK(w.flags[1] == (JUMP | TRIM));
+    for (int i=2; i<5; i++) {
+        CHECK(w.flags[i] == JUMP);
+    }
+    CHECK(f.trims == 1);
+
+    /* Short jumps trim on the third, and a bare TRIM is made a jump. */
+    memset(&w, 0, sizeof(Written));
+    filter_init(&f, 5.0, 0.0, 3, 10.0, write_down, &w);
+    filter_stitch(&f, 0.0, 0.0, NORMAL);
+    filter_stitch(&f, 1.0, 0.0, JUMP);
+    filter_stitch(&f, 2.0, 0.0, JUMP);
+    filter_stitch(&f, 3.0, 0.0, JUMP);
+    filter_stitch(&f, 4.0, 0.0, JUMP);
+    filter_stitch(&f, 5.0, 0.0, NORMAL);
+    filter_stitch(&f, 6.0, 0.0, TRIM);
+    CHECK(w.count == 7);
+    CHECK((w.flags[1] == JUMP) && (w.flags[2] == JUMP));
+    CHECK(w.flags[3] == (JUMP | TRIM));
+    CHECK(w.flags[4] == JUMP);
+    CHECK(w.flags[6] == (JUMP | TRIM));
+    CHECK(f.trims == 2);
+}
+
+/* Known CIELAB values, and the k-d tree agreeing with a plain search
+ * over the whole catalog, ties going to the earlier entry.
+ */
+static void
+test_nearest_thread(void)
+{
+    LabColor white = rgb_to_lab(255, 255, 255);
+    LabColor red = rgb_to_lab(255, 0, 0);
+    CHECK(near(white.l, 100.0, 1.0e-2) && near(white.a, 0.0, 1.0e-2)
+        && near(white.b, 0.0, 1.0e-2));
+    CHECK(near(rgb_to_lab(0, 0, 0).l, 0.0, 1.0e-9));
+    CHECK(near(red.l, 53.24, 0.05) && near(red.a, 80.09, 0.05)
+        && near(red.b, 67.20, 0.05));
+
+    enum { CATALOG = 300 };
+    unsigned char rgb[3*CATALOG];
+    unsigned int seed = 12345;
+    for (int i=0; i<3*CATALOG; i++) {
+        seed = seed*1103515245 + 12345;
+        rgb[i] = (seed >> 16) & 0xFF;
+    }
+    /* Entry 200 is the same colour as entry 7. */
+    memcpy(rgb + 3*200, rgb + 3*7, 3);
+
+    ColorIndex index;
+    CHECK(color_index_build(&index, rgb, CATALOG));
+    EmbReal d;
+    CHECK(color_index_nearest(&index, rgb_to_lab(rgb[21], rgb[22], rgb[23]),
+        &d) == 7);
+    CHECK(near(d, 0.0, 1.0e-9));
+
+    int agree = 1;
+    for (int q=0; q<500; q++) {
+        seed = seed*1103515245 + 12345;
+        LabColor c = rgb_to_lab((seed >> 8) & 0xFF, (seed >> 16) & 0xFF,
+            (seed >> 24) & 0xFF);
+        int best = 0;
+        for (int i=1; i<CATALOG; i++) {
+            LabColor x = rgb_to_lab(rgb[3*i], rgb[3*i+1], rgb[3*i+2]);
+            LabColor y = rgb_to_lab(rgb[3*best], rgb[3*best+1],
+                rgb[3*best+2]);
+            if (delta_e(c, x) < delta_e(c, y)) {
+                best = i;
+            }
+        }
+        if (color_index_nearest(&index, c, NULL) != best) {
+            agree = 0;
+        }
+    }
+    CHECK(agree);
+    color_index_free(&index);
+
+    CHECK(color_index_build(&index, rgb, 0));
+    CHECK(color_index_nearest(&index, white, &d) == -1);
+    color_index_free(&index);
+}
+
+/* A grid of columns by rows cells of 1 mm, cleared, from the origin. */
+static void
+density_grid(DensityGrid *g, float *cells, int columns, int rows)
+{
+    memset(cells, 0, columns*rows*sizeof(float));
+    g->cells = cells;
+    g->columns = columns;
+    g->rows = rows;
+    g->origin.x = 0.0;
+    g->origin.y = 0.0;
+    g->cell = 1.0;
+}
+
+/* The sum of the cells of g. */
+static EmbReal
+density_total(const DensityGrid *g)
+{
+    EmbReal total = 0.0;
+    for (int i=0; i<g->columns*g->rows; i++) {
+        total += g->cells[i];
+    }
+    return total;
+}
+
+/* Each stitch counts one, shared between the cells its thread crosses
+ * by the length in each; a stitch with no length counts one where it
+ * is; and a tile takes only the share of a stitch that lies on it.
+ */
+static void
+test_density_cells(void)
+{
+    float cells[16];
+    DensityGrid g;
+
+    density_grid(&g, cells, 4, 4);
+    EmbVector inside[2] = {{0.2, 0.2}, {0.7, 0.6}};
+    density_add_run(&g, inside, 2);
+    CHECK(near(cells[0], 1.0, 1.0e-6));
+    CHECK(near(density_total(&g), 1.0, 1.0e-6));
+
+    /* Crosses x = 1 a quarter of the way along, x = 2 at three quarters
+     * and y = 1 at four fifths.
+     */
+    density_grid(&g, cells, 4, 4);
+    EmbVector diagonal[2] = {{0.5, 0.2}, {2.5, 1.2}};
+    density_add_run(&g, diagonal, 2);
+    CHECK(near(cells[0], 0.25, 1.0e-6));
+    CHECK(near(cells[1], 0.5, 1.0e-6));
+    CHECK(near(cells[2], 0.05, 1.0e-6));
+    CHECK(near(cells[4 + 2], 0.2, 1.0e-6));
+    CHECK(near(density_total(&g), 1.0, 1.0e-6));
+
+    density_grid(&g, cells, 4, 4);
+    EmbVector hole[2] = {{1.5, 2.5}, {1.5, 2.5}};
+    density_add_run(&g, hole, 1);
+    CHECK(near(cells[2*4 + 1], 1.0, 1.0e-6));
+    density_add_run(&g, hole, 2);
+    CHECK(near(cells[2*4 + 1], 2.0, 1.0e-6));
+    CHECK(near(density_total(&g), 2.0, 1.0e-6));
+
+    density_grid(&g, cells, 2, 2);
+    EmbVector across[2] = {{-1.0, 0.5}, {1.0, 0.5}};
+    density_add_run(&g, across, 2);
+    CHECK(near(cells[0], 0.5, 1.0e-6));
+    CHECK(near(density_total(&g), 0.5, 1.0e-6));
+}
+
+/* Separate groups of cells over the limit are told apart, with their
+ * area added up and the densest cell found; and a pattern's jumps,
+ * trims and stops aren't counted as sewn.
+ */
+static void
+test_density_report(void)
+{
+    float cells[36];
+    DensityGrid g;
+    DensityReport report;
+
+    density_grid(&g, cells, 6, 6);
+    cells[0] = 5.0;
+    cells[1] = 5.0;
+    cells[6] = 5.0;
+    cells[4*6 + 4] = 3.0;
+    cells[4*6 + 5] = 8.0;
+    cells[2*6 + 2] = 1.5;
+    density_report(&g, 2.0, &report);
+    CHECK(report.regions == 2);
+    CHECK(near(report.area, 5.0, 1.0e-9));
+    CHECK(near(report.peak, 8.0, 1.0e-9));
+    CHECK(near(report.peak_at.x, 5.5, 1.0e-9));
+    CHECK(near(report.peak_at.y, 4.5, 1.0e-9));
+
+    EmbPattern *p = embPattern_create();
+    embPattern_addStitchAbs(p, 0.0, 0.0, JUMP, 1);
+    embPattern_addStitchAbs(p, 0.2, 0.2, NORMAL, 1);
+    embPattern_addStitchAbs(p, 0.8, 0.8, NORMAL, 1);
+    embPattern_addStitchAbs(p, 3.2, 0.2, JUMP, 1);
+    embPattern_addStitchAbs(p, 3.5, 0.5, TRIM, 1);
+    embPattern_addStitchAbs(p, 3.8, 0.8, STOP, 1);
+    embPattern_addStitchAbs(p, 3.8, 0.8, END, 1);
+    CHECK(density_pattern(p, 1.0, 1.0, &report));
+    CHECK(report.regions == 1);
+    CHECK(near(report.area, 1.0, 1.0e-9));
+    CHECK(near(report.peak, 2.0, 1.0e-6));
+    CHECK(near(report.peak_at.x, 0.5, 1.0e-9));
+    CHECK(near(report.peak_at.y, 0.5, 1.0e-9));
+    embPattern_free(p);
+}
+
+/* Zig-zag rows over a 250 by 130 mm design. */
+static EmbPattern *
+hoop_design(void)
+{
+    EmbPattern *p = embPattern_create();
+    EmbThread thread;
+    memset(&thread, 0, sizeof(EmbThread));
+    thread.color.r = 255;
+    embPattern_addThread(p, thread);
+    embPattern_addStitchAbs(p, 0.0, 0.0, JUMP, 1);
+    for (int row=0; row<=65; row++) {
+        for (int k=0; k<=50; k++) {
+            EmbReal x = 5.0 * ((row % 2) ? 50 - k : k);
+            embPattern_addStitchAbs(p, x, 2.0*row, NORMAL, 1);
+        }
+    }
+    embPattern_addStitchAbs(p, 0.0, 130.0, END, 1);
+    return p;
+}
+
+/* Each hoop sews the stitches hoop_plan() counted for it, all inside its
+ * field; hoops the design only touches are left out; and a design that
+ * can't be split says why.
+ */
+static void
+test_hoop_split(void)
+{
+    EmbPattern *design = hoop_design();
+    HoopPlan plan;
+    CHECK(hoop_plan(&plan, design, 100.0, 160.0, 10.0) == HOOP_OK);
+    CHECK((plan.count == 3) && (plan.columns == 3) && (plan.rows == 1));
+    for (int i=0; i<plan.count; i++) {
+        EmbPattern *hoop = embPattern_create();
+        CHECK(hoop_pattern(&plan, i, design, hoop) == plan.tiles[i].stitches);
+        /* The registration marks reach past the cut, but not the hoop. */
+        EmbRect field = plan.tiles[i].field;
+        int inside = 1;
+        for (int k=0; k<hoop->stitch_list->count; k++) {
+            EmbStitch st = hoop->stitch_list->stitch[k];
+            if ((st.flags == NORMAL) && ((st.x < field.left - 1.0e-9)
+                || (st.x > field.right + 1.0e-9)
+                || (st.y < field.top - 1.0e-9)
+                || (st.y > field.bottom + 1.0e-9))) {
+                inside = 0;
+            }
+        }
+        CHECK(inside);
+        embPattern_free(hoop);
+    }
+    hoop_free(&plan);
+
+    CHECK(hoop_plan(&plan, design, 100.0, 160.0, 120.0) == HOOP_NO_OVERLAP);
+    hoop_free(&plan);
+    CHECK(hoop_plan(&plan, design, 5.0, 5.0, 1.0) == HOOP_TOO_MANY);
+    hoop_free(&plan);
+    embPattern_free(design);
+
+    /* A diagonal's box covers all four hoops, but it only passes through
+     * two of them, meeting the others at their shared corner.
+     */
+    EmbPattern *diagonal = embPattern_create();
+    embPattern_addStitchAbs(diagonal, 0.0, 0.0, JUMP, 1);
+    embPattern_addStitchAbs(diagonal, 200.0, 200.0, NORMAL, 1);
+    embPattern_addStitchAbs(diagonal, 200.0, 200.0, END, 1);
+    CHECK(hoop_plan(&plan, diagonal, 110.0, 110.0, 10.0) == HOOP_OK);
+    CHECK((plan.columns == 2) && (plan.rows == 2) && (plan.count == 2));
+    CHECK((plan.tiles[0].column == 0) && (plan.tiles[0].row == 0));
+    CHECK((plan.tiles[1].column == 1) && (plan.tiles[1].row == 1));
+    hoop_free(&plan);
+    embPattern_free(diagonal);
+}
+
+/* Add the rectangle from (x0, y0) to (x1, y1) to set as a ring. */
+static void
+add_box(PolygonSet *set, EmbReal x0, EmbReal y0, EmbReal x1, EmbReal y1)
+{
+    EmbVector corners[4] = {{x0, y0}, {x1, y0}, {x1, y1}, {x0, y1}};
+    for (int i=0; i<4; i++) {
+        polygon_add_point(set, corners[i]);
+    }
+    polygon_close_ring(set);
+}
+
+/* The area set covers: its rings have the inside on their left, so the
+ * holes count against it.
+ */
+static EmbReal
+set_area(const PolygonSet *set)
+{
+    EmbReal area = 0.0;
+    int start = 0;
+    for (int r=0; r<set->rings; r++) {
+        int end = set->ring_ends[r];
+        for (int i=start; i<end; i++) {
+            EmbVector a = set->points[i];
+            EmbVector b = set->points[(i+1 < end) ? i+1 : start];
+            area += 0.5 * (a.x*b.y - b.x*a.y);
+        }
+        start = end;
+    }
+    return area;
+}
+
+/* Two overlapping squares combined each way, a square with a hole cut
+ * in it, and a square grown and shrunk.
+ */
+static void
+test_clip(void)
+{
+    PolygonSet a, b, hole, result;
+    memset(&a, 0, sizeof(PolygonSet));
+    memset(&b, 0, sizeof(PolygonSet));
+    memset(&hole, 0, sizeof(PolygonSet));
+    add_box(&a, 0.0, 0.0, 10.0, 10.0);
+    add_box(&b, 5.0, 5.0, 15.0, 15.0);
+    add_box(&hole, 3.0, 3.0, 6.0, 6.0);
+
+    const int ops[3] = {CLIP_UNION, CLIP_INTERSECTION, CLIP_DIFFERENCE};
+    const EmbReal areas[3] = {175.0, 25.0, 75.0};
+    for (int i=0; i<3; i++) {
+        memset(&result, 0, sizeof(PolygonSet));
+        CHECK(polygon_boolean(&a, CLIP_NONZERO, &b, CLIP_NONZERO, ops[i],
+            &result));
+        CHECK(result.rings == 1);
+        CHECK(near(set_area(&result), areas[i], 1.0e-6));
+        polygon_free(&result);
+    }
+
+    memset(&result, 0, sizeof(PolygonSet));
+    CHECK(polygon_boolean(&a, CLIP_NONZERO, &hole, CLIP_NONZERO,
+        CLIP_DIFFERENCE, &result));
+    CHECK(result.rings == 2);
+    CHECK(near(set_area(&result), 91.0, 1.0e-6));
+    polygon_free(&result);
+
+    /* Growing rounds the corners off, shrinking keeps them square. */
+    memset(&result, 0, sizeof(PolygonSet));
+    CHECK(polygon_offset(&a, CLIP_NONZERO, 1.0, &result));
+    CHECK(result.rings == 1);
+    CHECK(near(set_area(&result), 140.0 + embConstantPi, 0.05));
+    polygon_free(&result);
+
+    memset(&result, 0, sizeof(PolygonSet));
+    CHECK(polygon_offset(&a, CLIP_NONZERO, -1.0, &result));
+    CHECK(result.rings == 1);
+    CHECK(near(set_area(&result), 64.0, 1.0e-6));
+    polygon_free(&result);
+
+    memset(&result, 0, sizeof(PolygonSet));
+    CHECK(polygon_offset(&a, CLIP_NONZERO, -6.0, &result));
+    CHECK(result.rings == 0);
+    polygon_free(&result);
+
+    polygon_free(&a);
+    polygon_free(&b);
+    polygon_free(&hole);
+}
+
+int
+main(void)
+{
+    test_fourier_batch();
+    test_curve_samples();
+    test_dolphin_formula();
+    test_curve_overflow();
+    test_star_points();
+    test_sequence_deadline();
+    test_column_rails();
+    test_satin_columns();
+    test_stitch_filter();
+    test_nearest_thread();
+    test_density_cells();
+    test_density_report();
+    test_hoop_split();
+    test_clip();
+
+    if (failures) {
+        printf("%d checks failed.\n", failures);
+    }
+    else {
+        printf("All checks passed.\n");
+    }
+    return failures;
+}